@@ -361,12 +361,22 @@ static inline int snd_open_device(const char *filename, int fmode)
 	snd1_dlobj_cache_put
 #define snd_dlobj_cache_cleanup \
 	snd1_dlobj_cache_cleanup
+#define snd_pcm_rate_cache_cleanup \
+	snd1_pcm_rate_cache_cleanup
 #define snd_config_set_hop \
 	snd1_config_set_hop
 #define snd_config_check_hop \
 	snd1_config_check_hop
 #define snd_config_search_alias_hooks \
 	snd1_config_search_alias_hooks
+#define snd_pcm_simd_init \
+	snd1_pcm_simd_init
+#define snd_pcm_simd_features \
+	snd1_pcm_simd_features
+#define snd_pcm_simd_interleave \
+	snd1_pcm_simd_interleave
+#define snd_pcm_simd_deinterleave \
+	snd1_pcm_simd_deinterleave
 
 /* dlobj cache */
 void *snd_dlobj_cache_get(const char *lib, const char *name, const char *version, int verbose);
@@ -374,6 +384,9 @@ void *snd_dlobj_cache_get2(const char *lib, const char *name, const char *versio
 int snd_dlobj_cache_put(void *open_func);
 void snd_dlobj_cache_cleanup(void);
 
+/* converters kept by the rate plugin, they hold dlobj references */
+void snd_pcm_rate_cache_cleanup(void);
+
 /* for recursive checks */
 void snd_config_set_hop(snd_config_t *conf, int hop);
 int snd_config_check_hop(snd_config_t *conf);
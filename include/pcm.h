@@ -1296,6 +1296,13 @@ int snd_pcm_scope_s16_open(snd_pcm_t *pcm, const char *name,
 			   snd_pcm_scope_t **scopep);
 int16_t *snd_pcm_scope_s16_get_channel_buffer(snd_pcm_scope_t *scope,
 					      unsigned int channel);
+int snd_pcm_scope_level_open(snd_pcm_t *pcm, const char *name,
+			     snd_pcm_scope_t **scopep);
+int snd_pcm_scope_level_get_channel(snd_pcm_scope_t *scope,
+				    unsigned int channel,
+				    double *peak, double *rms);
+int snd_pcm_scope_level_get_loudness(snd_pcm_scope_t *scope,
+				     double *momentary, double *short_term);
 
 /** \} */
 
@@ -112,6 +112,10 @@ int snd_pcm_mulaw_open(snd_pcm_t **pcmp, const char *name,
 int _snd_pcm_mulaw_open(snd_pcm_t **pcmp, const char *name,
 			snd_config_t *root, snd_config_t *conf,
                         snd_pcm_stream_t stream, int mode);
+void snd_pcm_mulaw_to_s16(int16_t *dst, const unsigned char *src,
+			  unsigned int samples);
+void snd_pcm_s16_to_mulaw(unsigned char *dst, const int16_t *src,
+			  unsigned int samples);
 
 /*
  *  Linear<->a-Law conversion plugin
@@ -122,6 +126,10 @@ int snd_pcm_alaw_open(snd_pcm_t **pcmp, const char *name,
 int _snd_pcm_alaw_open(snd_pcm_t **pcmp, const char *name,
 		       snd_config_t *root, snd_config_t *conf,
 		       snd_pcm_stream_t stream, int mode);
+void snd_pcm_alaw_to_s16(int16_t *dst, const unsigned char *src,
+			 unsigned int samples);
+void snd_pcm_s16_to_alaw(unsigned char *dst, const int16_t *src,
+			 unsigned int samples);
 
 /*
  *  Linear<->Ima-ADPCM conversion plugin
@@ -132,6 +140,13 @@ int snd_pcm_adpcm_open(snd_pcm_t **pcmp, const char *name,
 int _snd_pcm_adpcm_open(snd_pcm_t **pcmp, const char *name,
 			snd_config_t *root, snd_config_t *conf,
 			snd_pcm_stream_t stream, int mode);
+size_t snd_pcm_adpcm_block_bytes(unsigned int channels, unsigned int frames);
+unsigned int snd_pcm_adpcm_block_frames(unsigned int channels, size_t bytes);
+ssize_t snd_pcm_adpcm_block_encode(void *dst, const int16_t *src,
+				   unsigned int channels, unsigned int frames,
+				   unsigned char *step_idx);
+snd_pcm_sframes_t snd_pcm_adpcm_block_decode(int16_t *dst, const void *src,
+					     unsigned int channels, size_t bytes);
 
 /*
  *  Route plugin for linear formats
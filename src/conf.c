@@ -4788,6 +4788,9 @@ int snd_config_update_free_global(void)
 	snd_config_global_update = NULL;
 	snd_config_unlock();
 	/* FIXME: better to place this in another place... */
+#if defined(BUILD_PCM) && defined(BUILD_PCM_PLUGIN_RATE)
+	snd_pcm_rate_cache_cleanup();
+#endif
 	snd_dlobj_cache_cleanup();
 
 	return 0;
@@ -668,6 +668,7 @@ playback devices.
 */
 
 #include "pcm_local.h"
+#include "pcm_simd.h"
 #include <stdio.h>
 #include <string.h>
 #if HAVE_MALLOC_H
@@ -3086,6 +3087,63 @@ int snd_pcm_avail_delay(snd_pcm_t *pcm,
 	return err;
 }
 
+/* length of the silence fill pattern, whole samples of any format fit in */
+#define SILENCE_PATTERN_BYTES	64
+
+/*
+ * Build the silence fill pattern for the format, returns the pattern
+ * length in bytes (the 3-byte formats use 48 bytes to keep whole samples)
+ */
+static unsigned int silence_pattern(uint8_t *pattern, uint64_t silence,
+				    int width)
+{
+	unsigned int i;
+
+	if (width == 24) {
+		uint8_t s[3];
+#ifdef SNDRV_LITTLE_ENDIAN
+		s[0] = silence >> 0;
+		s[1] = silence >> 8;
+		s[2] = silence >> 16;
+#else
+		s[2] = silence >> 0;
+		s[1] = silence >> 8;
+		s[0] = silence >> 16;
+#endif
+		for (i = 0; i < 48; i += 3)
+			memcpy(pattern + i, s, 3);
+		return 48;
+	}
+	for (i = 0; i < SILENCE_PATTERN_BYTES; i += 8)
+		memcpy(pattern + i, &silence, 8);
+	return SILENCE_PATTERN_BYTES;
+}
+
+/*
+ * Fill contiguous bytes with the pattern; the fixed size copies are
+ * expanded to wide vector stores by the compiler.
+ */
+static void silence_fill(char *dst, size_t bytes, uint64_t silence,
+			 const uint8_t *pattern, unsigned int len)
+{
+	if (silence == 0) {
+		memset(dst, 0, bytes);
+		return;
+	}
+	if (len == SILENCE_PATTERN_BYTES) {
+		for (; bytes >= SILENCE_PATTERN_BYTES; bytes -= SILENCE_PATTERN_BYTES) {
+			memcpy(dst, pattern, SILENCE_PATTERN_BYTES);
+			dst += SILENCE_PATTERN_BYTES;
+		}
+	} else {
+		for (; bytes >= 48; bytes -= 48) {
+			memcpy(dst, pattern, 48);
+			dst += 48;
+		}
+	}
+	memcpy(dst, pattern, bytes);
+}
+
 /**
  * \brief Silence an area
  * \param dst_area area specification
@@ -3107,21 +3165,20 @@ int snd_pcm_area_silence(const snd_pcm_channel_area_t *dst_area, snd_pcm_uframes
 	dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
 	width = snd_pcm_format_physical_width(format);
 	silence = snd_pcm_format_silence_64(format);
-        /*
-         * Iterate copying silent sample for sample data aligned to 64 bit.
-         * This is a fast path.
-         */
-        if (dst_area->step == (unsigned int) width &&
-            width != 24 &&
-            ((intptr_t)dst & 7) == 0) {
-		unsigned int dwords = samples * width / 64;
-		uint64_t *dstp = (uint64_t *)dst;
-		samples -= dwords * 64 / width;
-		while (dwords-- > 0)
-			*dstp++ = silence;
+	/*
+	 * Contiguous samples are filled with a repeated pattern of whole
+	 * samples.  This is a fast path.
+	 */
+	if (dst_area->step == (unsigned int) width &&
+	    dst_area->first % 8 == 0 && width > 0) {
+		uint8_t pattern[SILENCE_PATTERN_BYTES];
+		unsigned int len = silence_pattern(pattern, silence, width);
+		size_t bytes = (size_t)samples * width / 8;
+		silence_fill(dst, bytes, silence, pattern, len);
+		samples -= bytes * 8 / width;
 		if (samples == 0)
 			return 0;
-		dst = (char *)dstp;
+		dst += bytes;
 	}
 	dst_step = dst_area->step / 8;
 	switch (width) {
@@ -3200,6 +3257,34 @@ int snd_pcm_area_silence(const snd_pcm_channel_area_t *dst_area, snd_pcm_uframes
 	return 0;
 }
 
+/*
+ * Silence a run of adjacent channels inside wider interleaved frames;
+ * the pattern is stored over all channels of the run at once.
+ */
+static int snd_pcm_area_silence_run(const snd_pcm_channel_area_t *area,
+				    snd_pcm_uframes_t offset, unsigned int chns,
+				    snd_pcm_uframes_t frames, snd_pcm_format_t format,
+				    int width)
+{
+	uint8_t pattern[SILENCE_PATTERN_BYTES];
+	unsigned int len, bytes, step;
+	char *dst;
+
+	if (width <= 0 || width % 8 || area->step % 8 || area->first % 8)
+		return -EINVAL;
+	len = silence_pattern(pattern, snd_pcm_format_silence_64(format), width);
+	bytes = chns * width / 8;
+	if (bytes > len)
+		return -EINVAL;
+	dst = snd_pcm_channel_area_addr(area, offset);
+	step = area->step / 8;
+	while (frames-- > 0) {
+		memcpy(dst, pattern, bytes);
+		dst += step;
+	}
+	return 0;
+}
+
 /**
  * \brief Silence one or more areas
  * \param dst_areas areas specification (one for each channel)
@@ -3238,6 +3323,11 @@ int snd_pcm_areas_silence(const snd_pcm_channel_area_t *dst_areas, snd_pcm_ufram
 			d.step = width;
 			err = snd_pcm_area_silence(&d, dst_offset * chns, frames * chns, format);
 			channels -= chns;
+		} else if (chns > 1 &&
+			   snd_pcm_area_silence_run(begin, dst_offset, chns,
+						    frames, format, width) == 0) {
+			err = 0;
+			channels -= chns;
 		} else {
 			err = snd_pcm_area_silence(begin, dst_offset, frames, format);
 			dst_areas = begin + 1;
@@ -3370,6 +3460,55 @@ int snd_pcm_area_copy(const snd_pcm_channel_area_t *dst_area, snd_pcm_uframes_t
 	return 0;
 }
 
+#define TRANSPOSE_CHANNELS	32
+
+/*
+ * Interleaved <-> non-interleaved copy; all channels are handled in one
+ * pass over the frames instead of one pass per channel.
+ */
+static int snd_pcm_areas_copy_transpose(const snd_pcm_channel_area_t *dst_areas,
+					snd_pcm_uframes_t dst_offset,
+					const snd_pcm_channel_area_t *src_areas,
+					snd_pcm_uframes_t src_offset,
+					unsigned int channels, snd_pcm_uframes_t frames,
+					unsigned int width)
+{
+	void *ptrs[TRANSPOSE_CHANNELS];
+	unsigned int c, i, chunk;
+	char *base;
+
+	if (width % 8 || channels < 2)
+		return -EINVAL;
+	base = snd_pcm_areas_interleaved_addr(dst_areas, dst_offset, channels, width);
+	if (base && snd_pcm_areas_noninterleaved(src_areas, channels, width)) {
+		for (c = 0; c < channels; c += chunk) {
+			chunk = channels - c;
+			if (chunk > TRANSPOSE_CHANNELS)
+				chunk = TRANSPOSE_CHANNELS;
+			for (i = 0; i < chunk; i++)
+				ptrs[i] = snd_pcm_channel_area_addr(&src_areas[c + i], src_offset);
+			snd_pcm_simd_interleave(base + c * width / 8, channels,
+						(const void *const *)ptrs, chunk,
+						frames, width);
+		}
+		return 0;
+	}
+	base = snd_pcm_areas_interleaved_addr(src_areas, src_offset, channels, width);
+	if (base && snd_pcm_areas_noninterleaved(dst_areas, channels, width)) {
+		for (c = 0; c < channels; c += chunk) {
+			chunk = channels - c;
+			if (chunk > TRANSPOSE_CHANNELS)
+				chunk = TRANSPOSE_CHANNELS;
+			for (i = 0; i < chunk; i++)
+				ptrs[i] = snd_pcm_channel_area_addr(&dst_areas[c + i], dst_offset);
+			snd_pcm_simd_deinterleave(ptrs, base + c * width / 8,
+						  channels, chunk, frames, width);
+		}
+		return 0;
+	}
+	return -EINVAL;
+}
+
 /**
  * \brief Copy one or more areas
  * \param dst_areas destination areas specification (one for each channel)
@@ -3396,6 +3535,10 @@ int snd_pcm_areas_copy(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_
 		SNDMSG("invalid frames %ld", frames);
 		return -EINVAL;
 	}
+	if (snd_pcm_areas_copy_transpose(dst_areas, dst_offset,
+					 src_areas, src_offset,
+					 channels, frames, width) == 0)
+		return 0;
 	while (channels > 0) {
 		unsigned int step = src_areas->step;
 		void *src_addr = src_areas->addr;
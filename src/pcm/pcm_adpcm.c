@@ -60,6 +60,8 @@ IMA compatibility project proceedings, Vol 2, Issue 2, May 1992.
 #include "pcm_plugin.h"
 #include "plugin_ops.h"
 #include "bswap.h"
+#include "pcm_simd.h"
+#include <limits.h>
 
 #ifndef PIC
 /* entry for static linking */
@@ -210,6 +212,85 @@ static int adpcm_decoder(unsigned char code, snd_pcm_adpcm_state_t * state)
 	return (state->pred_val);
 }
 
+#include "pcm_adpcm_block.c"
+
+/**
+ * \brief Get the size of an Ima-ADPCM block
+ * \param channels count of channels
+ * \param frames frames in the block, 1 + a multiple of 8
+ * \return the size of the block in bytes, 0 when frames is invalid
+ *
+ * The blocks have the layout of the Ima-ADPCM WAV files: a 4 byte header
+ * for each channel (the first sample as 16-bit little endian value, the
+ * step index and a zero byte), then words of 8 samples for each channel
+ * in turn, the first sample in the low nibble of the first byte.
+ */
+size_t snd_pcm_adpcm_block_bytes(unsigned int channels, unsigned int frames)
+{
+	if (!channels || !frames || (frames - 1) % 8)
+		return 0;
+	return (size_t)channels * 4 * (1 + (frames - 1) / 8);
+}
+
+/**
+ * \brief Get the frames in an Ima-ADPCM block
+ * \param channels count of channels
+ * \param bytes size of the block in bytes (the block alignment of WAV files)
+ * \return the frames of the block, 0 when bytes is invalid
+ */
+unsigned int snd_pcm_adpcm_block_frames(unsigned int channels, size_t bytes)
+{
+	size_t words;
+
+	if (!channels || bytes % (channels * 4))
+		return 0;
+	words = bytes / (channels * 4);
+	if (!words || words > (UINT_MAX - 1) / 8)
+		return 0;
+	return 1 + (words - 1) * 8;
+}
+
+/**
+ * \brief Encode an Ima-ADPCM block
+ * \param dst destination buffer, snd_pcm_adpcm_block_bytes() in size
+ * \param src interleaved native endian S16 samples
+ * \param channels count of channels
+ * \param frames frames to encode, 1 + a multiple of 8
+ * \param step_idx the step index of each channel, updated for the next
+ *        block; NULL to start all channels with 0
+ * \return the size of the block in bytes otherwise a negative error code
+ *
+ * The channels are coded in parallel, each in a lane of a vector when
+ * the CPU has vector instructions.
+ */
+ssize_t snd_pcm_adpcm_block_encode(void *dst, const int16_t *src,
+				   unsigned int channels, unsigned int frames,
+				   unsigned char *step_idx)
+{
+	return adpcm_block_encode(adpcm_select_kernels(), dst, src,
+				  channels, frames, step_idx);
+}
+
+/**
+ * \brief Decode an Ima-ADPCM block
+ * \param dst destination buffer for the interleaved native endian S16
+ *        samples, snd_pcm_adpcm_block_frames() frames in size
+ * \param src the block
+ * \param channels count of channels
+ * \param bytes size of the block in bytes
+ * \return the decoded frames otherwise a negative error code
+ *
+ * -EINVAL is returned for an invalid size or a broken header; the
+ * decoding can continue with the next block, every block starts with
+ * the complete coder state.
+ */
+snd_pcm_sframes_t snd_pcm_adpcm_block_decode(int16_t *dst, const void *src,
+					     unsigned int channels, size_t bytes)
+{
+	return adpcm_block_decode(adpcm_select_kernels(), dst, src,
+				  channels, bytes);
+}
+
 #ifndef DOC_HIDDEN
 
 void snd_pcm_adpcm_decode(const snd_pcm_channel_area_t *dst_areas,
@@ -608,11 +689,20 @@ pcm.name {
 }
 \endcode
 
+The PCM format carries a plain stream of 4-bit codes.  The block framing
+of the Ima-ADPCM WAV files, where every block starts with the coder state
+of each channel, is available through snd_pcm_adpcm_block_encode() and
+snd_pcm_adpcm_block_decode().
+
 \subsection pcm_plugins_adpcm_funcref Function reference
 
 <UL>
   <LI>snd_pcm_adpcm_open()
   <LI>_snd_pcm_adpcm_open()
+  <LI>snd_pcm_adpcm_block_bytes()
+  <LI>snd_pcm_adpcm_block_frames()
+  <LI>snd_pcm_adpcm_block_encode()
+  <LI>snd_pcm_adpcm_block_decode()
 </UL>
 
 */
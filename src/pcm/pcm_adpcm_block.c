@@ -0,0 +1,232 @@
+/**
+ * \file pcm/pcm_adpcm_block.c
+ * \ingroup PCM_Plugins
+ * \brief PCM Ima-ADPCM Conversion Plugin Interface - block codec
+ */
+/*
+ *  PCM - Ima-ADPCM conversion
+ *
+ *  This file is included from pcm_adpcm.c.
+ *
+ *  The Ima-ADPCM blocks of WAV files, coded by the kernels of
+ *  pcm_adpcm_simd.h with the channels in the lanes of a vector.
+ *  StepSize[] and IndexAdjust[] are defined by the includer.
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * The same coder for the blocks, with the differences computed in int
+ * like the IMA reference; the first sample of a block is stored in its
+ * header.
+ */
+static inline unsigned int adpcm_block_encoder(int sl, snd_pcm_adpcm_state_t *state)
+{
+	int diff = sl - state->pred_val;
+	int step = StepSize[state->step_idx];
+	int pred_diff = step >> 3;
+	unsigned int sign = 0, code = 0, i;
+
+	if (diff < 0) {
+		sign = 0x8;
+		diff = -diff;
+	}
+	for (i = 0x4; i; i >>= 1, step >>= 1) {
+		if (diff >= step) {
+			code |= i;
+			diff -= step;
+			pred_diff += step;
+		}
+	}
+	state->pred_val += sign ? -pred_diff : pred_diff;
+	if (state->pred_val > 32767)
+		state->pred_val = 32767;
+	else if (state->pred_val < -32768)
+		state->pred_val = -32768;
+	state->step_idx += IndexAdjust[code];
+	if (state->step_idx < 0)
+		state->step_idx = 0;
+	else if (state->step_idx > 88)
+		state->step_idx = 88;
+	return sign | code;
+}
+
+static inline int adpcm_block_decoder(unsigned int code, snd_pcm_adpcm_state_t *state)
+{
+	int step = StepSize[state->step_idx];
+	int pred_diff = step >> 3;
+
+	if (code & 4)
+		pred_diff += step;
+	if (code & 2)
+		pred_diff += step >> 1;
+	if (code & 1)
+		pred_diff += step >> 2;
+	state->pred_val += (code & 8) ? -pred_diff : pred_diff;
+	if (state->pred_val > 32767)
+		state->pred_val = 32767;
+	else if (state->pred_val < -32768)
+		state->pred_val = -32768;
+	state->step_idx += IndexAdjust[code & 7];
+	if (state->step_idx < 0)
+		state->step_idx = 0;
+	else if (state->step_idx > 88)
+		state->step_idx = 88;
+	return state->pred_val;
+}
+
+static inline void adpcm_put_le32(unsigned char *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static inline uint32_t adpcm_get_le32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+#ifndef DOC_HIDDEN
+struct adpcm_kernels {
+	unsigned int lanes;
+	void (*enc)(unsigned char *dst, const int16_t *src,
+		    unsigned int channels, unsigned int lanes,
+		    unsigned int groups, snd_pcm_adpcm_state_t *states);
+	void (*dec)(int16_t *dst, const unsigned char *src,
+		    unsigned int channels, unsigned int lanes,
+		    unsigned int groups, snd_pcm_adpcm_state_t *states);
+};
+#endif
+
+#ifdef PCM_SIMD
+#define SIMD_BYTES	16
+#define SIMD_ATTR
+#define SIMD_NAME(x)	simd_##x##_v128
+#include "pcm_adpcm_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+
+#ifdef PCM_SIMD_AVX2
+#define SIMD_BYTES	32
+#define SIMD_ATTR	PCM_SIMD_AVX2_ATTR
+#define SIMD_NAME(x)	simd_##x##_avx2
+#include "pcm_adpcm_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif
+#else
+#define SIMD_BYTES	0
+#define SIMD_ATTR
+#define SIMD_NAME(x)	generic_##x
+#include "pcm_adpcm_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif /* PCM_SIMD */
+
+static const struct adpcm_kernels *adpcm_select_kernels(void)
+{
+#ifdef PCM_SIMD
+#ifdef PCM_SIMD_AVX2
+	if (snd_pcm_simd_features() & SND_PCM_SIMD_AVX2)
+		return &simd_adpcm_kernels_avx2;
+#endif
+	return &simd_adpcm_kernels_v128;
+#else
+	return &generic_adpcm_kernels;
+#endif
+}
+
+/* the block codec of snd_pcm_adpcm_block_encode() with the given kernels */
+static ssize_t adpcm_block_encode(const struct adpcm_kernels *kern,
+				  void *dst, const int16_t *src,
+				  unsigned int channels, unsigned int frames,
+				  unsigned char *step_idx)
+{
+	snd_pcm_adpcm_state_t states[16];
+	size_t bytes = snd_pcm_adpcm_block_bytes(channels, frames);
+	unsigned char *d = dst;
+	unsigned int c, l, lanes;
+
+	if (!bytes)
+		return -EINVAL;
+	for (c = 0; c < channels; c++) {
+		int idx = step_idx ? step_idx[c] : 0;
+
+		if (idx > 88)
+			idx = 88;
+		d[c * 4] = src[c];
+		d[c * 4 + 1] = (uint16_t)src[c] >> 8;
+		d[c * 4 + 2] = idx;
+		d[c * 4 + 3] = 0;
+	}
+	for (c = 0; c < channels; c += lanes) {
+		lanes = channels - c;
+		if (lanes > kern->lanes)
+			lanes = kern->lanes;
+		if (lanes > ARRAY_SIZE(states))
+			lanes = ARRAY_SIZE(states);
+		for (l = 0; l < lanes; l++) {
+			states[l].pred_val = src[c + l];
+			states[l].step_idx = d[(c + l) * 4 + 2];
+		}
+		kern->enc(d + (channels + c) * 4, src + channels + c, channels,
+			  lanes, (frames - 1) / 8, states);
+		if (step_idx) {
+			for (l = 0; l < lanes; l++)
+				step_idx[c + l] = states[l].step_idx;
+		}
+	}
+	return bytes;
+}
+
+/* the block codec of snd_pcm_adpcm_block_decode() with the given kernels */
+static snd_pcm_sframes_t adpcm_block_decode(const struct adpcm_kernels *kern,
+					    int16_t *dst, const void *src,
+					    unsigned int channels, size_t bytes)
+{
+	snd_pcm_adpcm_state_t states[16];
+	unsigned int frames = snd_pcm_adpcm_block_frames(channels, bytes);
+	const unsigned char *s = src;
+	unsigned int c, l, lanes;
+
+	if (!frames)
+		return -EINVAL;
+	for (c = 0; c < channels; c++) {
+		if (s[c * 4 + 2] > 88 || s[c * 4 + 3])
+			return -EINVAL;
+		dst[c] = (int16_t)(s[c * 4] | (s[c * 4 + 1] << 8));
+	}
+	for (c = 0; c < channels; c += lanes) {
+		lanes = channels - c;
+		if (lanes > kern->lanes)
+			lanes = kern->lanes;
+		if (lanes > ARRAY_SIZE(states))
+			lanes = ARRAY_SIZE(states);
+		for (l = 0; l < lanes; l++) {
+			states[l].pred_val = dst[c + l];
+			states[l].step_idx = s[(c + l) * 4 + 2];
+		}
+		kern->dec(dst + channels + c, s + (channels + c) * 4, channels,
+			  lanes, (frames - 1) / 8, states);
+	}
+	return frames;
+}
@@ -0,0 +1,256 @@
+/**
+ * \file pcm/pcm_adpcm_simd.h
+ * \ingroup PCM_Plugins
+ * \brief PCM Ima-ADPCM Conversion Plugin Interface - block kernels
+ */
+/*
+ *  PCM - Ima-ADPCM conversion
+ *
+ *  This file is included from pcm_adpcm_block.c several times, with
+ *  SIMD_BYTES (vector size, 0 for plain C), SIMD_ATTR (function
+ *  attributes) and SIMD_NAME() (symbol suffix) defined.
+ *
+ *  The kernels code the sample groups of a block for a run of adjacent
+ *  channels, one channel per 32-bit lane.  A group holds 8 samples of a
+ *  channel in a little endian 32-bit word, the first sample in the low
+ *  nibble; the words of the channels follow each other.  The results are
+ *  identical to adpcm_block_encoder() and adpcm_block_decoder().
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#if SIMD_BYTES
+typedef int32_t SIMD_NAME(vs32) __attribute__((vector_size(SIMD_BYTES)));
+
+/* 32-bit lanes in one vector */
+#define LANES		(SIMD_BYTES / 4)
+
+/* StepSize[] of every lane */
+static inline __attribute__((always_inline)) SIMD_ATTR
+SIMD_NAME(vs32) SIMD_NAME(step)(SIMD_NAME(vs32) idx)
+{
+	SIMD_NAME(vs32) step;
+	unsigned int l;
+
+	for (l = 0; l < LANES; l++)
+		step[l] = StepSize[idx[l]];
+	return step;
+}
+
+/* IndexAdjust[] and the clamp of the step index */
+static inline __attribute__((always_inline)) SIMD_ATTR
+SIMD_NAME(vs32) SIMD_NAME(adjust)(SIMD_NAME(vs32) idx, SIMD_NAME(vs32) code)
+{
+	SIMD_NAME(vs32) big = (code & 4) != 0;
+
+	idx += (((code & 3) * 2 + 2) & big) | ~big;
+	idx &= idx >= 0;
+	return (idx & (idx <= 88)) | (88 & (idx > 88));
+}
+
+static inline __attribute__((always_inline)) SIMD_ATTR
+SIMD_NAME(vs32) SIMD_NAME(clamp16)(SIMD_NAME(vs32) v)
+{
+	SIMD_NAME(vs32) hi = v > 32767, lo = v < -32768;
+
+	return (v & ~(hi | lo)) | (32767 & hi) | (-32768 & lo);
+}
+
+/* the words of the lanes, little endian */
+static inline __attribute__((always_inline)) SIMD_ATTR
+void SIMD_NAME(store_words)(unsigned char *dst, SIMD_NAME(vs32) w,
+			    unsigned int lanes)
+{
+#ifdef SND_LITTLE_ENDIAN
+	if (lanes == LANES)
+		simd_store(dst, w);
+	else
+		__builtin_memcpy(dst, &w, lanes * 4);
+#else
+	unsigned int l;
+
+	for (l = 0; l < lanes; l++)
+		adpcm_put_le32(dst + l * 4, w[l]);
+#endif
+}
+
+static inline __attribute__((always_inline)) SIMD_ATTR
+SIMD_NAME(vs32) SIMD_NAME(load_words)(const unsigned char *src,
+				      unsigned int lanes)
+{
+	SIMD_NAME(vs32) w = { 0 };
+#ifdef SND_LITTLE_ENDIAN
+	if (lanes == LANES)
+		simd_load(w, src);
+	else
+		__builtin_memcpy(&w, src, lanes * 4);
+#else
+	unsigned int l;
+
+	for (l = 0; l < lanes; l++)
+		w[l] = adpcm_get_le32(src + l * 4);
+#endif
+	return w;
+}
+#endif
+
+/*
+ * Encode groups of 8 frames for lanes channels; src is the interleaved
+ * first sample of the first channel, dst the word of the first channel
+ * in the first group.
+ */
+static SIMD_ATTR
+void SIMD_NAME(adpcm_enc_lanes)(unsigned char *dst, const int16_t *src,
+				unsigned int channels, unsigned int lanes,
+				unsigned int groups,
+				snd_pcm_adpcm_state_t *states)
+{
+	unsigned int g, k;
+#if SIMD_BYTES
+	SIMD_NAME(vs32) pred, idx, s, diff, sign, step, pred_diff, code, m, w;
+	unsigned int l;
+
+	for (l = 0; l < LANES; l++) {
+		pred[l] = l < lanes ? states[l].pred_val : 0;
+		idx[l] = l < lanes ? states[l].step_idx : 0;
+	}
+	for (g = 0; g < groups; g++) {
+		w = (SIMD_NAME(vs32)) { 0 };
+		for (k = 0; k < 8; k++) {
+			for (l = 0; l < LANES; l++)
+				s[l] = l < lanes ? src[l] : 0;
+			diff = s - pred;
+			sign = diff < 0;
+			diff = (diff ^ sign) - sign;
+			step = SIMD_NAME(step)(idx);
+			pred_diff = step >> 3;
+			m = diff >= step;
+			code = 4 & m;
+			diff -= step & m;
+			pred_diff += step & m;
+			step >>= 1;
+			m = diff >= step;
+			code |= 2 & m;
+			diff -= step & m;
+			pred_diff += step & m;
+			step >>= 1;
+			m = diff >= step;
+			code |= 1 & m;
+			pred_diff += step & m;
+			pred = SIMD_NAME(clamp16)(pred + ((pred_diff ^ sign) - sign));
+			idx = SIMD_NAME(adjust)(idx, code);
+			w |= (code | (8 & sign)) << (k * 4);
+			src += channels;
+		}
+		SIMD_NAME(store_words)(dst, w, lanes);
+		dst += channels * 4;
+	}
+	for (l = 0; l < lanes; l++) {
+		states[l].pred_val = pred[l];
+		states[l].step_idx = idx[l];
+	}
+#else
+	unsigned int l;
+
+	for (l = 0; l < lanes; l++) {
+		const int16_t *s = src + l;
+		unsigned char *d = dst + l * 4;
+
+		for (g = 0; g < groups; g++) {
+			uint32_t w = 0;
+
+			for (k = 0; k < 8; k++) {
+				w |= (uint32_t)adpcm_block_encoder(*s, &states[l]) << (k * 4);
+				s += channels;
+			}
+			adpcm_put_le32(d, w);
+			d += channels * 4;
+		}
+	}
+#endif
+}
+
+static SIMD_ATTR
+void SIMD_NAME(adpcm_dec_lanes)(int16_t *dst, const unsigned char *src,
+				unsigned int channels, unsigned int lanes,
+				unsigned int groups,
+				snd_pcm_adpcm_state_t *states)
+{
+	unsigned int g, k;
+#if SIMD_BYTES
+	SIMD_NAME(vs32) pred, idx, step, pred_diff, code, sign, w;
+	unsigned int l;
+
+	for (l = 0; l < LANES; l++) {
+		pred[l] = l < lanes ? states[l].pred_val : 0;
+		idx[l] = l < lanes ? states[l].step_idx : 0;
+	}
+	for (g = 0; g < groups; g++) {
+		w = SIMD_NAME(load_words)(src, lanes);
+		for (k = 0; k < 8; k++) {
+			code = (w >> (k * 4)) & 7;
+			sign = ((w >> (k * 4)) & 8) != 0;
+			step = SIMD_NAME(step)(idx);
+			pred_diff = (step >> 3) + (step & -(code >> 2)) +
+				((step >> 1) & -((code >> 1) & 1)) +
+				((step >> 2) & -(code & 1));
+			pred = SIMD_NAME(clamp16)(pred + ((pred_diff ^ sign) - sign));
+			idx = SIMD_NAME(adjust)(idx, code);
+			for (l = 0; l < lanes; l++)
+				dst[l] = pred[l];
+			dst += channels;
+		}
+		src += channels * 4;
+	}
+	for (l = 0; l < lanes; l++) {
+		states[l].pred_val = pred[l];
+		states[l].step_idx = idx[l];
+	}
+#else
+	unsigned int l;
+
+	for (l = 0; l < lanes; l++) {
+		const unsigned char *s = src + l * 4;
+		int16_t *d = dst + l;
+
+		for (g = 0; g < groups; g++) {
+			uint32_t w = adpcm_get_le32(s);
+
+			for (k = 0; k < 8; k++) {
+				*d = adpcm_block_decoder((w >> (k * 4)) & 0xf,
+							 &states[l]);
+				d += channels;
+			}
+			s += channels * 4;
+		}
+	}
+#endif
+}
+
+static const struct adpcm_kernels SIMD_NAME(adpcm_kernels) = {
+#if SIMD_BYTES
+	.lanes = LANES,
+#else
+	.lanes = UINT_MAX,	/* any count of channels */
+#endif
+	.enc = SIMD_NAME(adpcm_enc_lanes),
+	.dec = SIMD_NAME(adpcm_dec_lanes),
+};
+
+#if SIMD_BYTES
+#undef LANES
+#endif
@@ -31,6 +31,9 @@
 #include "pcm_plugin.h"
 
 #include "plugin_ops.h"
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #ifndef PIC
 /* entry for static linking */
@@ -139,6 +142,48 @@ static int alaw_to_s16(unsigned char a_val)
 	return ((a_val & 0x80) ? t : -t);
 }
 
+/*
+ * The conversions above go through tables built once: the linear value
+ * of every code, and the code of the magnitude >> 4 before the sign mask
+ * is applied.  The four low bits of the magnitude never change the code,
+ * so the results are identical.
+ */
+static int16_t alaw_dec_table[256];
+static unsigned char alaw_enc_table[(0x8000 >> 4) + 1];
+
+static void alaw_init_tables(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < 256; i++)
+		alaw_dec_table[i] = alaw_to_s16(i);
+	for (i = 0; i < (0x8000 >> 4); i++)
+		alaw_enc_table[i] = s16_to_alaw(i << 4) ^ 0xD5;
+	/* -32768 saturates */
+	alaw_enc_table[i] = s16_to_alaw(-0x8000) ^ 0x55;
+}
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_once_t alaw_tables_once = PTHREAD_ONCE_INIT;
+#endif
+
+static void alaw_tables(void)
+{
+#ifdef HAVE_LIBPTHREAD
+	pthread_once(&alaw_tables_once, alaw_init_tables);
+#else
+	if (!alaw_dec_table[0])
+		alaw_init_tables();
+#endif
+}
+
+static inline unsigned char alaw_encode(int16_t sample)
+{
+	if (sample < 0)
+		return alaw_enc_table[-(int)sample >> 4] ^ 0x55;
+	return alaw_enc_table[sample >> 4] ^ 0xD5;
+}
+
 #ifndef DOC_HIDDEN
 
 void snd_pcm_alaw_decode(const snd_pcm_channel_area_t *dst_areas,
@@ -153,6 +198,7 @@ void snd_pcm_alaw_decode(const snd_pcm_channel_area_t *dst_areas,
 #undef PUT16_LABELS
 	void *put = put16_labels[putidx];
 	unsigned int channel;
+	alaw_tables();
 	for (channel = 0; channel < channels; ++channel) {
 		const unsigned char *src;
 		char *dst;
@@ -166,7 +212,7 @@ void snd_pcm_alaw_decode(const snd_pcm_channel_area_t *dst_areas,
 		dst_step = snd_pcm_channel_area_step(dst_area);
 		frames1 = frames;
 		while (frames1-- > 0) {
-			int16_t sample = alaw_to_s16(*src);
+			int16_t sample = alaw_dec_table[*src];
 			goto *put;
 #define PUT16_END after
 #include "plugin_ops.h"
@@ -191,6 +237,7 @@ void snd_pcm_alaw_encode(const snd_pcm_channel_area_t *dst_areas,
 	void *get = get16_labels[getidx];
 	unsigned int channel;
 	int16_t sample = 0;
+	alaw_tables();
 	for (channel = 0; channel < channels; ++channel) {
 		const char *src;
 		char *dst;
@@ -209,15 +256,116 @@ void snd_pcm_alaw_encode(const snd_pcm_channel_area_t *dst_areas,
 #include "plugin_ops.h"
 #undef GET16_END
 		after:
-			*dst = s16_to_alaw(sample);
+			*dst = alaw_encode(sample);
 			src += src_step;
 			dst += dst_step;
 		}
 	}
 }
 
+/* native S16 on the linear side, without the get/put labels */
+static void snd_pcm_alaw_decode_s16(const snd_pcm_channel_area_t *dst_areas,
+				    snd_pcm_uframes_t dst_offset,
+				    const snd_pcm_channel_area_t *src_areas,
+				    snd_pcm_uframes_t src_offset,
+				    unsigned int channels, snd_pcm_uframes_t frames,
+				    unsigned int putidx ATTRIBUTE_UNUSED)
+{
+	unsigned int channel;
+	alaw_tables();
+	for (channel = 0; channel < channels; ++channel) {
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		const unsigned char *src = snd_pcm_channel_area_addr(src_area, src_offset);
+		int16_t *dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		int src_step = snd_pcm_channel_area_step(src_area);
+		int dst_step = snd_pcm_channel_area_step(dst_area) / sizeof(int16_t);
+		snd_pcm_uframes_t i;
+
+		if (src_step == 1 && dst_step == 1) {
+			snd_pcm_alaw_to_s16(dst, src, frames);
+			continue;
+		}
+		for (i = 0; i < frames; i++)
+			dst[i * dst_step] = alaw_dec_table[src[i * src_step]];
+	}
+}
+
+static void snd_pcm_alaw_encode_s16(const snd_pcm_channel_area_t *dst_areas,
+				    snd_pcm_uframes_t dst_offset,
+				    const snd_pcm_channel_area_t *src_areas,
+				    snd_pcm_uframes_t src_offset,
+				    unsigned int channels, snd_pcm_uframes_t frames,
+				    unsigned int getidx ATTRIBUTE_UNUSED)
+{
+	unsigned int channel;
+	alaw_tables();
+	for (channel = 0; channel < channels; ++channel) {
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		const int16_t *src = snd_pcm_channel_area_addr(src_area, src_offset);
+		unsigned char *dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		int src_step = snd_pcm_channel_area_step(src_area) / sizeof(int16_t);
+		int dst_step = snd_pcm_channel_area_step(dst_area);
+		snd_pcm_uframes_t i;
+
+		if (src_step == 1 && dst_step == 1) {
+			snd_pcm_s16_to_alaw(dst, src, frames);
+			continue;
+		}
+		for (i = 0; i < frames; i++)
+			dst[i * dst_step] = alaw_encode(src[i * src_step]);
+	}
+}
+
 #endif /* DOC_HIDDEN */
 
+/**
+ * \brief Convert A-Law samples to 16-bit linear
+ * \param dst destination buffer (native endian S16 samples)
+ * \param src source buffer (one A-Law code per byte)
+ * \param samples count of samples
+ */
+void snd_pcm_alaw_to_s16(int16_t *dst, const unsigned char *src,
+			 unsigned int samples)
+{
+	unsigned int i = 0;
+
+	alaw_tables();
+	for (; i + 4 <= samples; i += 4) {
+		dst[i] = alaw_dec_table[src[i]];
+		dst[i + 1] = alaw_dec_table[src[i + 1]];
+		dst[i + 2] = alaw_dec_table[src[i + 2]];
+		dst[i + 3] = alaw_dec_table[src[i + 3]];
+	}
+	for (; i < samples; i++)
+		dst[i] = alaw_dec_table[src[i]];
+}
+
+/**
+ * \brief Convert 16-bit linear samples to A-Law
+ * \param dst destination buffer (one A-Law code per byte)
+ * \param src source buffer (native endian S16 samples)
+ * \param samples count of samples
+ *
+ * The codes are identical to the ones of the A-Law plugin.
+ */
+void snd_pcm_s16_to_alaw(unsigned char *dst, const int16_t *src,
+			 unsigned int samples)
+{
+	unsigned int i = 0;
+
+	alaw_tables();
+	for (; i + 4 <= samples; i += 4) {
+		dst[i] = alaw_encode(src[i]);
+		dst[i + 1] = alaw_encode(src[i + 1]);
+		dst[i + 2] = alaw_encode(src[i + 2]);
+		dst[i + 3] = alaw_encode(src[i + 3]);
+	}
+	for (; i < samples; i++)
+		dst[i] = alaw_encode(src[i]);
+}
+
 static int snd_pcm_alaw_hw_refine_cprepare(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 {
 	snd_pcm_alaw_t *alaw = pcm->private_data;
@@ -335,6 +483,12 @@ static int snd_pcm_alaw_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 			alaw->func = snd_pcm_alaw_encode;
 		}
 	}
+	if (format == SND_PCM_FORMAT_S16 || alaw->sformat == SND_PCM_FORMAT_S16) {
+		if (alaw->func == snd_pcm_alaw_encode)
+			alaw->func = snd_pcm_alaw_encode_s16;
+		else
+			alaw->func = snd_pcm_alaw_decode_s16;
+	}
 	return 0;
 }
 
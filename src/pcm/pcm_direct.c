@@ -44,17 +44,6 @@
  *
  */
  
-#if !defined(__OpenBSD__) && !defined(__DragonFly__) && !defined(__ANDROID__)
-union semun {
-	int              val;    /* Value for SETVAL */
-	struct semid_ds *buf;    /* Buffer for IPC_STAT, IPC_SET */
-	unsigned short  *array;  /* Array for GETALL, SETALL */
-#if defined(__linux__)
-	struct seminfo  *__buf;  /* Buffer for IPC_INFO (Linux specific) */
-#endif
-};
-#endif
- 
 /*
  * FIXME:
  *  add possibility to use futexes here
@@ -1917,6 +1906,20 @@ static int snd_pcm_direct_get_slave_ipc_offset(snd_config_t *root,
 	return _snd_pcm_direct_get_slave_ipc_offset(root, sconf, direction, 0);
 }
 
+/* the option is implemented only by the plugin of the given type */
+static int snd_pcm_direct_check_option(snd_config_t *conf, const char *id,
+				       const char *type)
+{
+	snd_config_t *n;
+	const char *str;
+
+	if (snd_config_search(conf, "type", &n) >= 0 &&
+	    snd_config_get_string(n, &str) >= 0 && strcmp(str, type) == 0)
+		return 0;
+	SNDERR("%s is supported by the %s plugin only", id, type);
+	return -EINVAL;
+}
+
 int snd_pcm_direct_parse_open_conf(snd_config_t *root, snd_config_t *conf,
 				   int stream, struct snd_pcm_direct_open_conf *rec)
 {
@@ -1938,6 +1941,10 @@ int snd_pcm_direct_parse_open_conf(snd_config_t *root, snd_config_t *conf,
 #else
 	rec->direct_memory_access = 0;
 #endif
+	rec->lockless_mix = 0;
+	rec->float_sum = 0;
+	rec->soft_limit = 1.0;
+	rec->zero_copy = 0;
 	rec->hw_ptr_alignment = SND_PCM_HW_PTR_ALIGNMENT_AUTO;
 	rec->tstamp_type = -1;
 
@@ -2103,6 +2110,51 @@ int snd_pcm_direct_parse_open_conf(snd_config_t *root, snd_config_t *conf,
 			rec->direct_memory_access = err;
 			continue;
 		}
+		if (strcmp(id, "lockless_mix") == 0) {
+			err = snd_pcm_direct_check_option(conf, id, "dmix");
+			if (err < 0)
+				return err;
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			rec->lockless_mix = err;
+			continue;
+		}
+		if (strcmp(id, "float_sum") == 0) {
+			err = snd_pcm_direct_check_option(conf, id, "dmix");
+			if (err < 0)
+				return err;
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			rec->float_sum = err;
+			continue;
+		}
+		if (strcmp(id, "zero_copy") == 0) {
+			err = snd_pcm_direct_check_option(conf, id, "dsnoop");
+			if (err < 0)
+				return err;
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			rec->zero_copy = err;
+			continue;
+		}
+		if (strcmp(id, "soft_limit") == 0) {
+			double val;
+			err = snd_pcm_direct_check_option(conf, id, "dmix");
+			if (err < 0)
+				return err;
+			err = snd_config_get_ireal(n, &val);
+			if (err < 0)
+				return err;
+			if (val <= 0.0 || val > 1.0) {
+				SNDERR("soft_limit must be in range (0, 1]");
+				return -EINVAL;
+			}
+			rec->soft_limit = val;
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -22,6 +22,17 @@
 #include "pcm_local.h"  
 #include "../timer/timer_local.h"
 
+#if !defined(__OpenBSD__) && !defined(__DragonFly__) && !defined(__ANDROID__)
+union semun {
+	int              val;    /* Value for SETVAL */
+	struct semid_ds *buf;    /* Buffer for IPC_STAT, IPC_SET */
+	unsigned short  *array;  /* Array for GETALL, SETALL */
+#if defined(__linux__)
+	struct seminfo  *__buf;  /* Buffer for IPC_INFO (Linux specific) */
+#endif
+};
+#endif
+
 #define DIRECT_IPC_SEMS         1
 #define DIRECT_IPC_SEM_CLIENT   0
 /* Seconds representing in Milli seconds */
@@ -55,6 +66,20 @@ typedef void (mix_areas_u8_t)(unsigned int size,
 			      volatile signed int *sum, size_t dst_step,
 			      size_t src_step, size_t sum_step);
 
+typedef void (mix_areas_float_t)(unsigned int size,
+				 volatile void *dst, void *src,
+				 volatile float *sum, size_t dst_step,
+				 size_t src_step, size_t sum_step,
+				 float knee);
+
+/* lockless_mix: add staged samples to the accumulator, store the result */
+typedef void (mix_sum_t)(unsigned int size, signed int *acc,
+			 const void *src, size_t src_step);
+
+typedef void (mix_put_t)(unsigned int size, void *dst,
+			 const signed int *acc, size_t dst_step,
+			 size_t acc_step);
+
 typedef enum snd_pcm_direct_hw_ptr_alignment {
 	SND_PCM_HW_PTR_ALIGNMENT_NO = 0,	/* use the hw_ptr as is and do no rounding */
 	SND_PCM_HW_PTR_ALIGNMENT_ROUNDUP = 1,	/* round the slave_appl_ptr up to slave_period */
@@ -121,12 +146,20 @@ typedef struct {
 		unsigned int frame_bits;
 	} s;
 	union {
+		struct {
+			unsigned int lockless_mix;
+			unsigned int float_sum;
+			float soft_limit;
+		} dmix;
 		struct {
 			unsigned long long chn_mask;
 		} dshare;
 	} u;
 } snd_pcm_direct_share_t;
 
+typedef struct snd_pcm_dmix_lockless snd_pcm_dmix_lockless_t;
+typedef struct snd_pcm_dmix_lockless_slot snd_pcm_dmix_lockless_slot_t;
+
 typedef struct snd_pcm_direct snd_pcm_direct_t;
 
 struct snd_pcm_direct {
@@ -187,10 +220,28 @@ struct snd_pcm_direct {
 			mix_areas_24_t *remix_areas_24;
 			mix_areas_u8_t *remix_areas_u8;
 			unsigned int use_sem;
+			unsigned int lockless_mix;	/* mix via per-client staging rings */
+			int shmid_mix;			/* IPC staging rings memory identification */
+			int semid_mix;			/* IPC staging ring ownership semaphores */
+			snd_pcm_dmix_lockless_t *lockless;	/* shared staging rings */
+			snd_pcm_dmix_lockless_slot_t *slot;	/* our own staging ring */
+			unsigned int mixer_seen;	/* mixer and its pass count when */
+			unsigned int rendered_seen;	/* we lost the role the last time */
+			snd_pcm_channel_area_t *ring_areas;	/* areas of our own staging ring */
+			signed int *mix_buffer;		/* private accumulator of the mixer */
+			mix_sum_t *mix_sum;
+			mix_put_t *mix_put;
+			unsigned int float_sum;		/* sum buffer holds floats */
+			float soft_limit;		/* soft limiter knee for float_sum */
+			mix_areas_float_t *mix_areas_float;
+			mix_areas_float_t *remix_areas_float;
 		} dmix;
 		struct {
 			unsigned long long chn_mask;
 		} dshare;
+		struct {
+			int zero_copy;			/* clients read the slave ring in place */
+		} dsnoop;
 	} u;
 	void (*server_free)(snd_pcm_direct_t *direct);
 };
@@ -364,6 +415,10 @@ struct snd_pcm_direct_open_conf {
 	int max_periods;
 	int var_periodsize;
 	int direct_memory_access;
+	int lockless_mix;
+	int float_sum;
+	double soft_limit;
+	int zero_copy;
 	snd_pcm_direct_hw_ptr_alignment_t hw_ptr_alignment;
 	int tstamp_type;
 	snd_config_t *slave;
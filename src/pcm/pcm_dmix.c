@@ -128,11 +128,19 @@ static int shm_sum_discard(snd_pcm_direct_t *dmix)
 	return ret;
 }
 
+static int shm_mix_create_or_connect(snd_pcm_direct_t *dmix);
+static int shm_mix_discard(snd_pcm_direct_t *dmix);
+
 static void dmix_server_free(snd_pcm_direct_t *dmix)
 {
 	/* remove the memory region */
-	shm_sum_create_or_connect(dmix);
-	shm_sum_discard(dmix);
+	if (dmix->u.dmix.lockless_mix) {
+		shm_mix_create_or_connect(dmix);
+		shm_mix_discard(dmix);
+	} else {
+		shm_sum_create_or_connect(dmix);
+		shm_sum_discard(dmix);
+	}
 }
 
 /*
@@ -152,6 +160,51 @@ static void dmix_server_free(snd_pcm_direct_t *dmix)
 #endif
 #endif
 
+#include "pcm_dmix_lockless.c"
+
+/* float_sum variant of the loops below, sum_buffer holds floats */
+static void mix_areas_float(snd_pcm_direct_t *dmix,
+			    mix_areas_float_t *do_mix_areas,
+			    const snd_pcm_channel_area_t *src_areas,
+			    const snd_pcm_channel_area_t *dst_areas,
+			    snd_pcm_uframes_t src_ofs,
+			    snd_pcm_uframes_t dst_ofs,
+			    snd_pcm_uframes_t size,
+			    unsigned int sample_size)
+{
+	float *sum = (float *)dmix->u.dmix.sum_buffer;
+	unsigned int src_step, dst_step;
+	unsigned int chn, dchn, channels;
+
+	channels = dmix->channels;
+	if (dmix->interleaved) {
+		do_mix_areas(size * channels,
+			     (unsigned char *)dst_areas[0].addr + sample_size * dst_ofs * channels,
+			     (unsigned char *)src_areas[0].addr + sample_size * src_ofs * channels,
+			     sum + dst_ofs * channels,
+			     sample_size,
+			     sample_size,
+			     sizeof(float),
+			     dmix->u.dmix.soft_limit);
+		return;
+	}
+	for (chn = 0; chn < channels; chn++) {
+		dchn = dmix->bindings ? dmix->bindings[chn] : chn;
+		if (dchn >= dmix->shmptr->s.channels)
+			continue;
+		src_step = src_areas[chn].step / 8;
+		dst_step = dst_areas[dchn].step / 8;
+		do_mix_areas(size,
+			     ((unsigned char *)dst_areas[dchn].addr + dst_areas[dchn].first / 8) + dst_ofs * dst_step,
+			     ((unsigned char *)src_areas[chn].addr + src_areas[chn].first / 8) + src_ofs * src_step,
+			     sum + dmix->shmptr->s.channels * dst_ofs + dchn,
+			     dst_step,
+			     src_step,
+			     dmix->shmptr->s.channels * sizeof(float),
+			     dmix->u.dmix.soft_limit);
+	}
+}
+
 static void mix_areas(snd_pcm_direct_t *dmix,
 		      const snd_pcm_channel_area_t *src_areas,
 		      const snd_pcm_channel_area_t *dst_areas,
@@ -190,6 +243,11 @@ static void mix_areas(snd_pcm_direct_t *dmix,
 	default:
 		return;
 	}
+	if (dmix->u.dmix.float_sum) {
+		mix_areas_float(dmix, dmix->u.dmix.mix_areas_float, src_areas,
+				dst_areas, src_ofs, dst_ofs, size, sample_size);
+		return;
+	}
 	if (dmix->interleaved) {
 		/*
 		 * process all areas in one loop
@@ -258,6 +316,11 @@ static void remix_areas(snd_pcm_direct_t *dmix,
 	default:
 		return;
 	}
+	if (dmix->u.dmix.float_sum) {
+		mix_areas_float(dmix, dmix->u.dmix.remix_areas_float, src_areas,
+				dst_areas, src_ofs, dst_ofs, size, sample_size);
+		return;
+	}
 	if (dmix->interleaved) {
 		/*
 		 * process all areas in one loop
@@ -313,7 +376,7 @@ static void snd_pcm_dmix_sync_area(snd_pcm_t *pcm)
 {
 	snd_pcm_direct_t *dmix = pcm->private_data;
 	snd_pcm_uframes_t slave_hw_ptr, slave_appl_ptr, slave_size;
-	snd_pcm_uframes_t appl_ptr, size, transfer;
+	snd_pcm_uframes_t appl_ptr, size, transfer, slave_start;
 	const snd_pcm_channel_area_t *src_areas, *dst_areas;
 	
 	/* calculate the size to transfer */
@@ -361,6 +424,7 @@ static void snd_pcm_dmix_sync_area(snd_pcm_t *pcm)
 	appl_ptr = dmix->last_appl_ptr % pcm->buffer_size;
 	dmix->last_appl_ptr += size;
 	dmix->last_appl_ptr %= pcm->boundary;
+	slave_start = dmix->slave_appl_ptr;
 	slave_appl_ptr = dmix->slave_appl_ptr % dmix->slave_buffer_size;
 	dmix->slave_appl_ptr += size;
 	dmix->slave_appl_ptr %= dmix->slave_boundary;
@@ -371,7 +435,10 @@ static void snd_pcm_dmix_sync_area(snd_pcm_t *pcm)
 			transfer = pcm->buffer_size - appl_ptr;
 		if (slave_appl_ptr + transfer > dmix->slave_buffer_size)
 			transfer = dmix->slave_buffer_size - slave_appl_ptr;
-		mix_areas(dmix, src_areas, dst_areas, appl_ptr, slave_appl_ptr, transfer);
+		if (dmix->u.dmix.lockless_mix)
+			lockless_write_areas(dmix, src_areas, appl_ptr, slave_appl_ptr, transfer);
+		else
+			mix_areas(dmix, src_areas, dst_areas, appl_ptr, slave_appl_ptr, transfer);
 		size -= transfer;
 		if (! size)
 			break;
@@ -381,6 +448,8 @@ static void snd_pcm_dmix_sync_area(snd_pcm_t *pcm)
 		appl_ptr %= pcm->buffer_size;
 	}
 	dmix_up_sem(dmix);
+	if (dmix->u.dmix.lockless_mix)
+		lockless_publish(dmix, slave_start, dmix->slave_appl_ptr);
 }
 
 /*
@@ -723,8 +792,13 @@ static snd_pcm_sframes_t snd_pcm_dmix_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t f
 	dmix->slave_appl_ptr -= size;
 	dmix->slave_appl_ptr %= dmix->slave_boundary;
 	slave_appl_ptr = dmix->slave_appl_ptr % dmix->slave_buffer_size;
+	if (dmix->u.dmix.lockless_mix) {
+		/* the rings keep the samples, just unpublish them */
+		lockless_rewind(dmix, dmix->slave_appl_ptr);
+		size = 0;
+	}
 	dmix_down_sem(dmix);
-	for (;;) {
+	for (; size;) {
 		transfer = size;
 		if (appl_ptr + transfer > pcm->buffer_size)
 			transfer = pcm->buffer_size - appl_ptr;
@@ -783,6 +857,8 @@ static int snd_pcm_dmix_close(snd_pcm_t *pcm)
 	if (dmix->timer)
 		snd_timer_close(dmix->timer);
 	snd_pcm_direct_semaphore_down(dmix, DIRECT_IPC_SEM_CLIENT);
+	if (dmix->u.dmix.lockless_mix)
+		lockless_done(dmix);
 	snd_pcm_close(dmix->spcm);
  	if (dmix->server)
  		snd_pcm_direct_server_discard(dmix);
@@ -974,6 +1050,11 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 		return -EINVAL;
 	}
 
+	if (opts->lockless_mix && opts->float_sum) {
+		SNDERR("float_sum cannot be used with lockless_mix");
+		return -EINVAL;
+	}
+
 	ret = _snd_pcm_direct_new(&pcm, &dmix, SND_PCM_TYPE_DMIX, name, opts, params, stream, mode);
 	if (ret < 0)
 		return ret;
@@ -989,6 +1070,13 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 	dmix->hw_ptr_alignment = opts->hw_ptr_alignment;
 	dmix->sync_ptr = snd_pcm_dmix_sync_ptr;
 	dmix->direct_memory_access = opts->direct_memory_access;
+	dmix->u.dmix.lockless_mix = opts->lockless_mix;
+	dmix->u.dmix.float_sum = opts->float_sum;
+	dmix->u.dmix.shmid_sum = -1;
+	dmix->u.dmix.sum_buffer = (void *) -1;
+	dmix->u.dmix.shmid_mix = -1;
+	dmix->u.dmix.semid_mix = -1;
+	dmix->u.dmix.lockless = (void *) -1;
 
  retry:
 	if (first_instance) {
@@ -1073,11 +1161,33 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 		dmix->spcm = spcm;
 	}
 
-	ret = shm_sum_create_or_connect(dmix);
-	if (ret < 0) {
-		SNDERR("unable to initialize sum ring buffer");
+	if (first_instance) {
+		dmix->shmptr->u.dmix.lockless_mix = opts->lockless_mix;
+		dmix->shmptr->u.dmix.float_sum = opts->float_sum;
+		dmix->shmptr->u.dmix.soft_limit = opts->soft_limit;
+	} else if (dmix->shmptr->u.dmix.lockless_mix != (unsigned int)opts->lockless_mix ||
+		   dmix->shmptr->u.dmix.float_sum != (unsigned int)opts->float_sum) {
+		SNDERR("lockless_mix or float_sum differs from the running dmix instance");
+		ret = -EINVAL;
 		goto _err;
 	}
+	/* the limiter knee is shared, too */
+	dmix->u.dmix.soft_limit = dmix->shmptr->u.dmix.soft_limit;
+
+	/* the staging rings replace the sum ring buffer */
+	if (dmix->u.dmix.lockless_mix) {
+		ret = lockless_init(dmix);
+		if (ret < 0) {
+			SNDERR("unable to initialize lockless_mix staging rings");
+			goto _err;
+		}
+	} else {
+		ret = shm_sum_create_or_connect(dmix);
+		if (ret < 0) {
+			SNDERR("unable to initialize sum ring buffer");
+			goto _err;
+		}
+	}
 
 	ret = snd_pcm_direct_initialize_poll_fd(dmix);
 	if (ret < 0) {
@@ -1086,6 +1196,10 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 	}
 
 	mix_select_callbacks(dmix);
+	if (dmix->u.dmix.float_sum)
+		float_mix_select_callbacks(dmix);
+	if (dmix->u.dmix.lockless_mix)
+		dmix->u.dmix.use_sem = 0;
 		
 	pcm->poll_fd = dmix->poll_fd;
 	pcm->poll_events = POLLIN;	/* it's different than other plugins */
@@ -1111,6 +1225,8 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 		snd_pcm_direct_client_discard(dmix);
 	if (spcm)
 		snd_pcm_close(spcm);
+	if (dmix->u.dmix.lockless_mix)
+		lockless_done(dmix);
 	if (dmix->u.dmix.shmid_sum >= 0)
 		shm_sum_discard(dmix);
 	if ((dmix->shmid >= 0) && (snd_pcm_direct_shm_discard(dmix))) {
@@ -1169,6 +1285,9 @@ pcm.name {
 		N INT		# maps slave channel to client channel N
 	}
 	slowptr BOOL		# slow but more precise pointer updates
+	lockless_mix BOOL	# mix via per-client staging rings
+	float_sum BOOL		# use a float sum buffer with a soft limiter
+	soft_limit REAL		# soft limiter knee for float_sum (default 1.0)
 }
 \endcode
 
@@ -1180,6 +1299,24 @@ added to the value set in <code>ipc_key</code>.  This will
 avoid the confliction of the same IPC key with different users
 concurrently.
 
+<code>lockless_mix</code> switches to the staging ring mode.  Each client
+writes its samples to a private ring in shared memory and the client
+which updates the slave buffer sums all rings at once, so no semaphore
+is taken while streaming.  All clients of the same dmix instance must
+use the same setting; up to 16 clients can be connected.  The ring
+slots are guarded by a second semaphore set (the key
+<code>ipc_key</code> + 2), the slot of a killed client is freed by
+the kernel.
+
+<code>float_sum</code> keeps the running sum as floats normalized to the
+full scale of the slave format.  By default the result is clipped as
+in the integer mode, so a single stream passes unchanged.  With a
+<code>soft_limit</code> knee below 1.0 (a fraction of the full scale),
+peaks above the knee are compressed smoothly instead of being clipped,
+so a mix of several loud streams does not break up; the samples above
+the knee are then altered even for a single stream.  It cannot be
+combined with <code>lockless_mix</code>.
+
 <code>hw_ptr_alignment</code> specifies slave application and hw
 pointer alignment type. By default hw_ptr_alignment is auto. Below are
 the possible configurations:
@@ -0,0 +1,112 @@
+/*
+ * float sum buffer with a soft limiter (float_sum mode),
+ * included from pcm_dmix_generic.c
+ *
+ * The sum buffer holds the mix normalized to [-1.0, 1.0).  On write-out
+ * the samples above the knee are compressed smoothly towards full scale
+ * instead of being clipped:
+ *
+ *	y = knee + (1 - knee) * e / (e + 1 - knee),  e = |x| - knee
+ *
+ * The curve has the slope 1 at the knee and never reaches full scale,
+ * knee = 1.0 gives the plain saturation.
+ */
+
+#include <float.h>
+
+static inline float dmix_soft_limit(float x, float knee)
+{
+	float a = x < 0 ? -x : x;
+	float r = 1.0f - knee;
+	float e = a > knee ? a - knee : 0.0f;
+
+	/* FLT_MIN keeps 0/0 away for knee = 1.0, the vector code does the same */
+	a = (a < knee ? a : knee) + r * e / (e + r + FLT_MIN);
+	return x < 0 ? -a : a;
+}
+
+#define MIX_AREAS_FLOAT		generic_mix_areas_float_16_native
+#define REMIX_AREAS_FLOAT	generic_remix_areas_float_16_native
+#define SAMPLE_GET(p)		(*(volatile signed short *)(p))
+#define SAMPLE_PUT(p, v)	(*(volatile signed short *)(p) = (v))
+#define SAMPLE_FULL		32768.0f
+#define SAMPLE_MAXF		32767.0f
+#include "pcm_dmix_float.h"
+#undef MIX_AREAS_FLOAT
+#undef REMIX_AREAS_FLOAT
+#undef SAMPLE_GET
+#undef SAMPLE_PUT
+#undef SAMPLE_FULL
+#undef SAMPLE_MAXF
+
+#define MIX_AREAS_FLOAT		generic_mix_areas_float_16_swap
+#define REMIX_AREAS_FLOAT	generic_remix_areas_float_16_swap
+#define SAMPLE_GET(p)		((signed short) bswap_16(*(volatile unsigned short *)(p)))
+#define SAMPLE_PUT(p, v)	(*(volatile unsigned short *)(p) = bswap_16((unsigned short)(v)))
+#define SAMPLE_FULL		32768.0f
+#define SAMPLE_MAXF		32767.0f
+#include "pcm_dmix_float.h"
+#undef MIX_AREAS_FLOAT
+#undef REMIX_AREAS_FLOAT
+#undef SAMPLE_GET
+#undef SAMPLE_PUT
+#undef SAMPLE_FULL
+#undef SAMPLE_MAXF
+
+/* 2147483520 is the largest float below 2^31 */
+#define MIX_AREAS_FLOAT		generic_mix_areas_float_32_native
+#define REMIX_AREAS_FLOAT	generic_remix_areas_float_32_native
+#define SAMPLE_GET(p)		(*(volatile signed int *)(p))
+#define SAMPLE_PUT(p, v)	(*(volatile signed int *)(p) = (v))
+#define SAMPLE_FULL		2147483648.0f
+#define SAMPLE_MAXF		2147483520.0f
+#include "pcm_dmix_float.h"
+#undef MIX_AREAS_FLOAT
+#undef REMIX_AREAS_FLOAT
+#undef SAMPLE_GET
+#undef SAMPLE_PUT
+#undef SAMPLE_FULL
+#undef SAMPLE_MAXF
+
+#define MIX_AREAS_FLOAT		generic_mix_areas_float_32_swap
+#define REMIX_AREAS_FLOAT	generic_remix_areas_float_32_swap
+#define SAMPLE_GET(p)		((signed int) bswap_32(*(volatile unsigned int *)(p)))
+#define SAMPLE_PUT(p, v)	(*(volatile unsigned int *)(p) = bswap_32((unsigned int)(v)))
+#define SAMPLE_FULL		2147483648.0f
+#define SAMPLE_MAXF		2147483520.0f
+#include "pcm_dmix_float.h"
+#undef MIX_AREAS_FLOAT
+#undef REMIX_AREAS_FLOAT
+#undef SAMPLE_GET
+#undef SAMPLE_PUT
+#undef SAMPLE_FULL
+#undef SAMPLE_MAXF
+
+/* always little endian, the fourth byte of S24_LE is kept as is */
+#define MIX_AREAS_FLOAT		generic_mix_areas_float_24
+#define REMIX_AREAS_FLOAT	generic_remix_areas_float_24
+#define SAMPLE_GET(p)		((p)[0] | ((p)[1] << 8) | (((volatile signed char *)(p))[2] << 16))
+#define SAMPLE_PUT(p, v)	((p)[0] = (v), (p)[1] = (v) >> 8, (p)[2] = (v) >> 16)
+#define SAMPLE_FULL		8388608.0f
+#define SAMPLE_MAXF		8388607.0f
+#include "pcm_dmix_float.h"
+#undef MIX_AREAS_FLOAT
+#undef REMIX_AREAS_FLOAT
+#undef SAMPLE_GET
+#undef SAMPLE_PUT
+#undef SAMPLE_FULL
+#undef SAMPLE_MAXF
+
+#define MIX_AREAS_FLOAT		generic_mix_areas_float_u8
+#define REMIX_AREAS_FLOAT	generic_remix_areas_float_u8
+#define SAMPLE_GET(p)		(*(p) - 0x80)
+#define SAMPLE_PUT(p, v)	(*(p) = (v) + 0x80)
+#define SAMPLE_FULL		128.0f
+#define SAMPLE_MAXF		127.0f
+#include "pcm_dmix_float.h"
+#undef MIX_AREAS_FLOAT
+#undef REMIX_AREAS_FLOAT
+#undef SAMPLE_GET
+#undef SAMPLE_PUT
+#undef SAMPLE_FULL
+#undef SAMPLE_MAXF
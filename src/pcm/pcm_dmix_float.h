@@ -0,0 +1,83 @@
+/**
+ * \file pcm/pcm_dmix_float.h
+ * \ingroup PCM_Plugins
+ * \brief PCM Direct Stream Mixing (dmix) Plugin Interface - float sum code
+ */
+/*
+ *  PCM - Direct Stream Mixing
+ *
+ *  This file is included from pcm_dmix_float.c once per sample format,
+ *  with MIX_AREAS_FLOAT, REMIX_AREAS_FLOAT (function names),
+ *  SAMPLE_GET(p), SAMPLE_PUT(p, v) (sample access), SAMPLE_FULL and
+ *  SAMPLE_MAXF (full scale and the largest float result) defined.
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+static void MIX_AREAS_FLOAT(unsigned int size,
+			    volatile void *dst, void *src,
+			    volatile float *sum,
+			    size_t dst_step, size_t src_step,
+			    size_t sum_step, float knee)
+{
+	volatile unsigned char *d = dst;
+	unsigned char *s = src;
+	register float sample;
+
+	for (;;) {
+		sample = SAMPLE_GET(s) * (1.0f / SAMPLE_FULL);
+		if (SAMPLE_GET(d))
+			sample += *sum;
+		*sum = sample;
+		sample = dmix_soft_limit(sample, knee) * SAMPLE_FULL;
+		if (sample > SAMPLE_MAXF)
+			sample = SAMPLE_MAXF;
+		SAMPLE_PUT(d, (signed int)sample);
+		if (!--size)
+			return;
+		d += dst_step;
+		s += src_step;
+		sum = (volatile float *) ((volatile char *)sum + sum_step);
+	}
+}
+
+static void REMIX_AREAS_FLOAT(unsigned int size,
+			      volatile void *dst, void *src,
+			      volatile float *sum,
+			      size_t dst_step, size_t src_step,
+			      size_t sum_step, float knee)
+{
+	volatile unsigned char *d = dst;
+	unsigned char *s = src;
+	register float sample;
+
+	for (;;) {
+		sample = SAMPLE_GET(s) * (-1.0f / SAMPLE_FULL);
+		if (SAMPLE_GET(d))
+			sample += *sum;
+		*sum = sample;
+		sample = dmix_soft_limit(sample, knee) * SAMPLE_FULL;
+		if (sample > SAMPLE_MAXF)
+			sample = SAMPLE_MAXF;
+		SAMPLE_PUT(d, (signed int)sample);
+		if (!--size)
+			return;
+		d += dst_step;
+		s += src_step;
+		sum = (volatile float *) ((volatile char *)sum + sum_step);
+	}
+}
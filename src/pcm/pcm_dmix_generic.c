@@ -511,6 +511,195 @@ static void generic_remix_areas_u8(unsigned int size,
 	}
 }
 
+/*
+ *  lockless_mix: accumulate the staging rings and store the result
+ */
+
+static void generic_sum_16_native(unsigned int size, signed int *acc,
+				  const void *src, size_t src_step)
+{
+	const signed short *s = src;
+
+	(void)src_step;
+	while (size--)
+		*acc++ += *s++;
+}
+
+static void generic_sum_16_swap(unsigned int size, signed int *acc,
+				const void *src, size_t src_step)
+{
+	const signed short *s = src;
+
+	(void)src_step;
+	while (size--)
+		*acc++ += (signed short) bswap_16(*s++);
+}
+
+static void generic_sum_32_native(unsigned int size, signed int *acc,
+				  const void *src, size_t src_step)
+{
+	const signed int *s = src;
+
+	(void)src_step;
+	while (size--)
+		*acc++ += *s++ >> 8;
+}
+
+static void generic_sum_32_swap(unsigned int size, signed int *acc,
+				const void *src, size_t src_step)
+{
+	const signed int *s = src;
+
+	(void)src_step;
+	while (size--)
+		*acc++ += (signed int) bswap_32(*s++) >> 8;
+}
+
+/* always little endian, 3 or 4 bytes per sample */
+static void generic_sum_24(unsigned int size, signed int *acc,
+			   const void *src, size_t src_step)
+{
+	const unsigned char *s = src;
+
+	while (size--) {
+		*acc++ += s[0] | (s[1] << 8) | (((signed char *)s)[2] << 16);
+		s += src_step;
+	}
+}
+
+static void generic_sum_u8(unsigned int size, signed int *acc,
+			   const void *src, size_t src_step)
+{
+	const unsigned char *s = src;
+
+	(void)src_step;
+	while (size--)
+		*acc++ += *s++ - 0x80;
+}
+
+static void generic_put_16_native(unsigned int size, void *dst,
+				  const signed int *acc, size_t dst_step,
+				  size_t acc_step)
+{
+	register signed int sample;
+	signed short *d = dst;
+
+	while (size--) {
+		sample = *acc;
+		if (sample > 0x7fff)
+			sample = 0x7fff;
+		else if (sample < -0x8000)
+			sample = -0x8000;
+		*d = sample;
+		d = (signed short *) ((char *)d + dst_step);
+		acc = (const signed int *) ((const char *)acc + acc_step);
+	}
+}
+
+static void generic_put_16_swap(unsigned int size, void *dst,
+				const signed int *acc, size_t dst_step,
+				size_t acc_step)
+{
+	register signed int sample;
+	signed short *d = dst;
+
+	while (size--) {
+		sample = *acc;
+		if (sample > 0x7fff)
+			sample = 0x7fff;
+		else if (sample < -0x8000)
+			sample = -0x8000;
+		*d = (signed short) bswap_16((signed short) sample);
+		d = (signed short *) ((char *)d + dst_step);
+		acc = (const signed int *) ((const char *)acc + acc_step);
+	}
+}
+
+static void generic_put_32_native(unsigned int size, void *dst,
+				  const signed int *acc, size_t dst_step,
+				  size_t acc_step)
+{
+	register signed int sample;
+	signed int *d = dst;
+
+	while (size--) {
+		sample = *acc;
+		if (sample > 0x7fffff)
+			sample = 0x7fffffff;
+		else if (sample < -0x800000)
+			sample = -0x80000000;
+		else
+			sample *= 256;
+		*d = sample;
+		d = (signed int *) ((char *)d + dst_step);
+		acc = (const signed int *) ((const char *)acc + acc_step);
+	}
+}
+
+static void generic_put_32_swap(unsigned int size, void *dst,
+				const signed int *acc, size_t dst_step,
+				size_t acc_step)
+{
+	register signed int sample;
+	signed int *d = dst;
+
+	while (size--) {
+		sample = *acc;
+		if (sample > 0x7fffff)
+			sample = 0x7fffffff;
+		else if (sample < -0x800000)
+			sample = -0x80000000;
+		else
+			sample *= 256;
+		*d = bswap_32(sample);
+		d = (signed int *) ((char *)d + dst_step);
+		acc = (const signed int *) ((const char *)acc + acc_step);
+	}
+}
+
+/* always little endian, the fourth byte of S24_LE is kept as is */
+static void generic_put_24(unsigned int size, void *dst,
+			   const signed int *acc, size_t dst_step,
+			   size_t acc_step)
+{
+	register signed int sample;
+	unsigned char *d = dst;
+
+	while (size--) {
+		sample = *acc;
+		if (sample > 0x7fffff)
+			sample = 0x7fffff;
+		else if (sample < -0x800000)
+			sample = -0x800000;
+		d[0] = sample;
+		d[1] = sample >> 8;
+		d[2] = sample >> 16;
+		d += dst_step;
+		acc = (const signed int *) ((const char *)acc + acc_step);
+	}
+}
+
+static void generic_put_u8(unsigned int size, void *dst,
+			   const signed int *acc, size_t dst_step,
+			   size_t acc_step)
+{
+	register signed int sample;
+	unsigned char *d = dst;
+
+	while (size--) {
+		sample = *acc;
+		if (sample > 0x7f)
+			sample = 0x7f;
+		else if (sample < -0x80)
+			sample = -0x80;
+		*d = sample + 0x80;
+		d += dst_step;
+		acc = (const signed int *) ((const char *)acc + acc_step);
+	}
+}
+
+#include "pcm_dmix_float.c"
+#include "pcm_dmix_simd.c"
 
 static void generic_mix_select_callbacks(snd_pcm_direct_t *dmix)
 {
@@ -529,6 +718,91 @@ static void generic_mix_select_callbacks(snd_pcm_direct_t *dmix)
 	dmix->u.dmix.mix_areas_u8 = generic_mix_areas_u8;
 	dmix->u.dmix.remix_areas_24 = generic_remix_areas_24;
 	dmix->u.dmix.remix_areas_u8 = generic_remix_areas_u8;
+#ifdef PCM_SIMD
+	simd_mix_select_callbacks(dmix);
+#endif
+	dmix->u.dmix.use_sem = 1;
+}
+
+static void generic_lockless_select_callbacks(snd_pcm_direct_t *dmix)
+{
+	switch (dmix->shmptr->s.format) {
+	case SND_PCM_FORMAT_S16_LE:
+	case SND_PCM_FORMAT_S16_BE:
+		if (snd_pcm_format_cpu_endian(dmix->shmptr->s.format)) {
+			dmix->u.dmix.mix_sum = generic_sum_16_native;
+			dmix->u.dmix.mix_put = generic_put_16_native;
+		} else {
+			dmix->u.dmix.mix_sum = generic_sum_16_swap;
+			dmix->u.dmix.mix_put = generic_put_16_swap;
+		}
+		break;
+	case SND_PCM_FORMAT_S32_LE:
+	case SND_PCM_FORMAT_S32_BE:
+		if (snd_pcm_format_cpu_endian(dmix->shmptr->s.format)) {
+			dmix->u.dmix.mix_sum = generic_sum_32_native;
+			dmix->u.dmix.mix_put = generic_put_32_native;
+		} else {
+			dmix->u.dmix.mix_sum = generic_sum_32_swap;
+			dmix->u.dmix.mix_put = generic_put_32_swap;
+		}
+		break;
+	case SND_PCM_FORMAT_S24_LE:
+	case SND_PCM_FORMAT_S24_3LE:
+		dmix->u.dmix.mix_sum = generic_sum_24;
+		dmix->u.dmix.mix_put = generic_put_24;
+		break;
+	case SND_PCM_FORMAT_U8:
+		dmix->u.dmix.mix_sum = generic_sum_u8;
+		dmix->u.dmix.mix_put = generic_put_u8;
+		break;
+	default:
+		break;
+	}
+#ifdef PCM_SIMD
+	simd_lockless_select_callbacks(dmix);
+#endif
+}
+
+static void float_mix_select_callbacks(snd_pcm_direct_t *dmix)
+{
+	switch (dmix->shmptr->s.format) {
+	case SND_PCM_FORMAT_S16_LE:
+	case SND_PCM_FORMAT_S16_BE:
+		if (snd_pcm_format_cpu_endian(dmix->shmptr->s.format)) {
+			dmix->u.dmix.mix_areas_float = generic_mix_areas_float_16_native;
+			dmix->u.dmix.remix_areas_float = generic_remix_areas_float_16_native;
+		} else {
+			dmix->u.dmix.mix_areas_float = generic_mix_areas_float_16_swap;
+			dmix->u.dmix.remix_areas_float = generic_remix_areas_float_16_swap;
+		}
+		break;
+	case SND_PCM_FORMAT_S32_LE:
+	case SND_PCM_FORMAT_S32_BE:
+		if (snd_pcm_format_cpu_endian(dmix->shmptr->s.format)) {
+			dmix->u.dmix.mix_areas_float = generic_mix_areas_float_32_native;
+			dmix->u.dmix.remix_areas_float = generic_remix_areas_float_32_native;
+		} else {
+			dmix->u.dmix.mix_areas_float = generic_mix_areas_float_32_swap;
+			dmix->u.dmix.remix_areas_float = generic_remix_areas_float_32_swap;
+		}
+		break;
+	case SND_PCM_FORMAT_S24_LE:
+	case SND_PCM_FORMAT_S24_3LE:
+		dmix->u.dmix.mix_areas_float = generic_mix_areas_float_24;
+		dmix->u.dmix.remix_areas_float = generic_remix_areas_float_24;
+		break;
+	case SND_PCM_FORMAT_U8:
+		dmix->u.dmix.mix_areas_float = generic_mix_areas_float_u8;
+		dmix->u.dmix.remix_areas_float = generic_remix_areas_float_u8;
+		break;
+	default:
+		break;
+	}
+#ifdef PCM_SIMD
+	simd_float_mix_select_callbacks(dmix);
+#endif
+	/* the float sum cannot be updated atomically */
 	dmix->u.dmix.use_sem = 1;
 }
 
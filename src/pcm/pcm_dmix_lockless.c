@@ -0,0 +1,537 @@
+/**
+ * \file pcm/pcm_dmix_lockless.c
+ * \ingroup PCM_Plugins
+ * \brief PCM Direct Stream Mixing (dmix) Plugin Interface - lockless_mix mode
+ */
+/*
+ *  PCM - Direct Stream Mixing
+ *
+ *  This file is included from pcm_dmix.c.
+ *
+ *  In the lockless_mix mode the clients don't touch the slave buffer
+ *  directly.  Each client owns a slot with a private staging ring (same
+ *  size and layout as the slave buffer) in a separate shared memory
+ *  segment and only publishes the range of slave positions it has
+ *  written.  Whichever client manages to take the mixer role renders
+ *  the changed range of the slave buffer from all rings in one pass.
+ *  The mixer role is taken with an atomic exchange, so no semop() call
+ *  is issued in the transfer path and the shared cache lines are only
+ *  written by their owners.
+ *
+ *  A slot is owned by holding its semaphore in a separate set with
+ *  SEM_UNDO, the kernel drops it when the owner dies, so the slots of
+ *  crashed clients are recovered without looking at (reused) pids.
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#define LOCKLESS_SLOTS		16
+#define LOCKLESS_NONE		(~0ULL)		/* no pending change */
+#define LOCKLESS_CHUNK		4096		/* samples rendered at once */
+
+/* shared among dmix clients - be careful to be 32/64bit compatible! */
+struct snd_pcm_dmix_lockless_slot {
+	unsigned int pid;		/* owner, zero = unused slot */
+	unsigned int pad;
+	unsigned long long begin;	/* first valid slave position */
+	unsigned long long end;		/* end of valid data (slave appl_ptr) */
+	unsigned long long dirty;	/* first position changed since the last mix */
+} __attribute__((aligned(64)));
+
+struct snd_pcm_dmix_lockless {
+	unsigned int mixer;		/* slot index + 1 of the current mixer, zero = none */
+	unsigned int request;		/* bumped on each publish */
+	unsigned int rendered;		/* bumped on each pass of the mixer */
+	unsigned int pad;
+	unsigned long long mixed_end;	/* end of the rendered data */
+	struct snd_pcm_dmix_lockless_slot slots[LOCKLESS_SLOTS];
+	/* staging rings follow */
+} __attribute__((aligned(64)));
+
+/*
+ *  staging rings shared memory area
+ */
+
+static size_t lockless_frame_bytes(snd_pcm_direct_t *dmix)
+{
+	return dmix->shmptr->s.channels *
+	       snd_pcm_format_physical_width(dmix->shmptr->s.format) / 8;
+}
+
+static size_t lockless_ring_bytes(snd_pcm_direct_t *dmix)
+{
+	return dmix->shmptr->s.buffer_size * lockless_frame_bytes(dmix);
+}
+
+static unsigned char *lockless_ring(snd_pcm_direct_t *dmix,
+				    const snd_pcm_dmix_lockless_slot_t *slot)
+{
+	return (unsigned char *)(dmix->u.dmix.lockless + 1) +
+	       (slot - dmix->u.dmix.lockless->slots) * lockless_ring_bytes(dmix);
+}
+
+static int shm_mix_discard(snd_pcm_direct_t *dmix)
+{
+	struct shmid_ds buf;
+	int ret = 0;
+
+	if (dmix->u.dmix.shmid_mix < 0)
+		return -EINVAL;
+	if (dmix->u.dmix.lockless != (void *) -1 && shmdt(dmix->u.dmix.lockless) < 0)
+		return -errno;
+	dmix->u.dmix.lockless = (void *) -1;
+	if (shmctl(dmix->u.dmix.shmid_mix, IPC_STAT, &buf) < 0)
+		return -errno;
+	if (buf.shm_nattch == 0) {	/* we're the last user, destroy the segment */
+		if (shmctl(dmix->u.dmix.shmid_mix, IPC_RMID, NULL) < 0)
+			return -errno;
+		/* and the slot semaphores with it */
+		if (dmix->u.dmix.semid_mix >= 0)
+			semctl(dmix->u.dmix.semid_mix, 0, IPC_RMID);
+		ret = 1;
+	}
+	dmix->u.dmix.shmid_mix = -1;
+	dmix->u.dmix.semid_mix = -1;
+	return ret;
+}
+
+static int sem_mix_create_or_connect(snd_pcm_direct_t *dmix)
+{
+	union semun s;
+	struct semid_ds buf;
+
+	dmix->u.dmix.semid_mix = semget(dmix->ipc_key + 2, LOCKLESS_SLOTS,
+					IPC_CREAT | dmix->ipc_perm);
+	if (dmix->u.dmix.semid_mix < 0)
+		return -errno;
+	if (dmix->ipc_gid < 0)
+		return 0;
+	s.buf = &buf;
+	if (semctl(dmix->u.dmix.semid_mix, 0, IPC_STAT, s) < 0)
+		return -errno;
+	buf.sem_perm.gid = dmix->ipc_gid;
+	s.buf = &buf;
+	semctl(dmix->u.dmix.semid_mix, 0, IPC_SET, s);
+	return 0;
+}
+
+static int shm_mix_create_or_connect(snd_pcm_direct_t *dmix)
+{
+	struct shmid_ds buf;
+	int tmpid, err;
+	size_t size;
+
+	size = sizeof(snd_pcm_dmix_lockless_t) +
+	       LOCKLESS_SLOTS * lockless_ring_bytes(dmix);
+retryshm:
+	dmix->u.dmix.shmid_mix = shmget(dmix->ipc_key + 2, size,
+					IPC_CREAT | dmix->ipc_perm);
+	err = -errno;
+	if (dmix->u.dmix.shmid_mix < 0) {
+		if (errno == EINVAL)
+		if ((tmpid = shmget(dmix->ipc_key + 2, 0, dmix->ipc_perm)) != -1)
+		if (!shmctl(tmpid, IPC_STAT, &buf))
+		if (!buf.shm_nattch)
+		/* no users so destroy the segment */
+		if (!shmctl(tmpid, IPC_RMID, NULL))
+		    goto retryshm;
+		return err;
+	}
+	if (shmctl(dmix->u.dmix.shmid_mix, IPC_STAT, &buf) < 0) {
+		err = -errno;
+		shm_mix_discard(dmix);
+		return err;
+	}
+	if (dmix->ipc_gid >= 0) {
+		buf.shm_perm.gid = dmix->ipc_gid;
+		shmctl(dmix->u.dmix.shmid_mix, IPC_SET, &buf);
+	}
+	dmix->u.dmix.lockless = shmat(dmix->u.dmix.shmid_mix, 0, 0);
+	if (dmix->u.dmix.lockless == (void *) -1) {
+		err = -errno;
+		shm_mix_discard(dmix);
+		return err;
+	}
+	mlock(dmix->u.dmix.lockless, size);
+	err = sem_mix_create_or_connect(dmix);
+	if (err < 0) {
+		shm_mix_discard(dmix);
+		return err;
+	}
+	return 0;
+}
+
+/*
+ *  slave positions are compared relative to a base position, the result
+ *  is negative for positions behind the base
+ */
+static snd_pcm_sframes_t lockless_offset(snd_pcm_direct_t *dmix,
+					 unsigned long long pos,
+					 snd_pcm_uframes_t base)
+{
+	snd_pcm_uframes_t diff;
+
+	diff = pcm_frame_diff(pos, base, dmix->slave_boundary);
+	if (diff > dmix->slave_boundary / 2)
+		return (snd_pcm_sframes_t)diff - (snd_pcm_sframes_t)dmix->slave_boundary;
+	return diff;
+}
+
+/* check whether the owner of the slot index + 1 (mixer role) still exists */
+static int lockless_owner_alive(snd_pcm_direct_t *dmix, unsigned int owner)
+{
+	return owner && semctl(dmix->u.dmix.semid_mix, owner - 1, GETVAL) != 0;
+}
+
+static int lockless_claim_slot(snd_pcm_direct_t *dmix)
+{
+	snd_pcm_dmix_lockless_t *lm = dmix->u.dmix.lockless;
+	snd_pcm_dmix_lockless_slot_t *slot;
+	struct sembuf op[2];
+	unsigned int i, owner;
+
+	for (i = 0; i < LOCKLESS_SLOTS; i++) {
+		/* take the semaphore only when nobody holds it */
+		op[0].sem_num = i;
+		op[0].sem_op = 0;
+		op[0].sem_flg = IPC_NOWAIT;
+		op[1].sem_num = i;
+		op[1].sem_op = 1;
+		op[1].sem_flg = SEM_UNDO | IPC_NOWAIT;
+		if (semop(dmix->u.dmix.semid_mix, op, 2) < 0) {
+			if (errno == EAGAIN)
+				continue;
+			return -errno;
+		}
+		slot = &lm->slots[i];
+		/* a crashed previous owner may have died as the mixer */
+		owner = i + 1;
+		__atomic_compare_exchange_n(&lm->mixer, &owner, 0, 0,
+					    __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->begin, slot->end, __ATOMIC_RELEASE);
+		__atomic_store_n(&slot->dirty, LOCKLESS_NONE, __ATOMIC_RELEASE);
+		memset(lockless_ring(dmix, slot), 0, lockless_ring_bytes(dmix));
+		__atomic_store_n(&slot->pid, getpid(), __ATOMIC_RELEASE);
+		dmix->u.dmix.slot = slot;
+		return 0;
+	}
+	return -EBUSY;
+}
+
+static int lockless_slave_interleaved(const snd_pcm_channel_area_t *areas,
+				      unsigned int channels,
+				      unsigned int sample_size)
+{
+	unsigned int chn;
+
+	for (chn = 0; chn < channels; chn++) {
+		if (areas[chn].addr != areas[0].addr ||
+		    areas[chn].first != areas[0].first + chn * sample_size * 8 ||
+		    areas[chn].step != channels * sample_size * 8)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ *  render the changed part of the slave buffer from all staging rings;
+ *  called with the mixer role held
+ */
+static void lockless_render(snd_pcm_direct_t *dmix)
+{
+	snd_pcm_dmix_lockless_t *lm = dmix->u.dmix.lockless;
+	snd_pcm_dmix_lockless_slot_t *slot;
+	const snd_pcm_channel_area_t *dst_areas;
+	snd_pcm_uframes_t hw_ptr, ofs, frames, chunk;
+	snd_pcm_sframes_t limit, start, end, pos, lo, hi, o;
+	unsigned long long dirty;
+	unsigned int channels = dmix->shmptr->s.channels;
+	unsigned int sample_size, chn, i;
+	size_t frame_bytes = lockless_frame_bytes(dmix);
+	signed int *acc = dmix->u.dmix.mix_buffer;
+
+	hw_ptr = *dmix->spcm->hw.ptr;
+	/* don't write on the last active period, see snd_pcm_dmix_sync_area() */
+	limit = dmix->slave_buffer_size - hw_ptr % dmix->slave_period_size;
+	start = limit;
+	end = lockless_offset(dmix, lm->mixed_end, hw_ptr);
+	for (i = 0; i < LOCKLESS_SLOTS; i++) {
+		slot = &lm->slots[i];
+		if (!__atomic_load_n(&slot->pid, __ATOMIC_ACQUIRE))
+			continue;
+		dirty = __atomic_exchange_n(&slot->dirty, LOCKLESS_NONE,
+					    __ATOMIC_ACQ_REL);
+		if (dirty != LOCKLESS_NONE) {
+			o = lockless_offset(dmix, dirty, hw_ptr);
+			if (o < 0)
+				o = 0;
+			if (o < start)
+				start = o;
+		}
+		o = lockless_offset(dmix, __atomic_load_n(&slot->end, __ATOMIC_ACQUIRE),
+				    hw_ptr);
+		if (o > end)
+			end = o;
+	}
+	if (end > limit)
+		end = limit;
+	if (start >= end)
+		return;
+
+	dst_areas = snd_pcm_mmap_areas(dmix->spcm);
+	sample_size = frame_bytes / channels;
+	chunk = LOCKLESS_CHUNK / channels;
+	if (!chunk)
+		chunk = 1;
+	for (pos = start; pos < end; pos += frames) {
+		ofs = (hw_ptr + pos) % dmix->slave_buffer_size;
+		frames = end - pos;
+		if (ofs + frames > dmix->slave_buffer_size)
+			frames = dmix->slave_buffer_size - ofs;
+		if (frames > chunk)
+			frames = chunk;
+		memset(acc, 0, frames * channels * sizeof(*acc));
+		for (i = 0; i < LOCKLESS_SLOTS; i++) {
+			slot = &lm->slots[i];
+			if (!__atomic_load_n(&slot->pid, __ATOMIC_ACQUIRE))
+				continue;
+			lo = lockless_offset(dmix, __atomic_load_n(&slot->begin, __ATOMIC_ACQUIRE),
+					     hw_ptr);
+			hi = lockless_offset(dmix, __atomic_load_n(&slot->end, __ATOMIC_ACQUIRE),
+					     hw_ptr);
+			if (lo < pos)
+				lo = pos;
+			if (hi > pos + (snd_pcm_sframes_t)frames)
+				hi = pos + frames;
+			if (lo >= hi)
+				continue;
+			dmix->u.dmix.mix_sum((hi - lo) * channels,
+					     acc + (lo - pos) * channels,
+					     lockless_ring(dmix, slot) +
+					     (ofs + lo - pos) * frame_bytes,
+					     sample_size);
+		}
+		if (lockless_slave_interleaved(dst_areas, channels, sample_size)) {
+			dmix->u.dmix.mix_put(frames * channels,
+					     (unsigned char *)dst_areas[0].addr +
+					     dst_areas[0].first / 8 + ofs * frame_bytes,
+					     acc, sample_size, sizeof(*acc));
+			continue;
+		}
+		for (chn = 0; chn < channels; chn++)
+			dmix->u.dmix.mix_put(frames,
+					     (unsigned char *)dst_areas[chn].addr +
+					     dst_areas[chn].first / 8 +
+					     ofs * (dst_areas[chn].step / 8),
+					     acc + chn, dst_areas[chn].step / 8,
+					     channels * sizeof(*acc));
+	}
+	o = 0;
+	for (i = 0; i < LOCKLESS_SLOTS; i++) {
+		slot = &lm->slots[i];
+		if (!__atomic_load_n(&slot->pid, __ATOMIC_ACQUIRE))
+			continue;
+		hi = lockless_offset(dmix, __atomic_load_n(&slot->end, __ATOMIC_ACQUIRE),
+				     hw_ptr);
+		if (hi > o)
+			o = hi;
+	}
+	if (o > end)
+		o = end;
+	lm->mixed_end = (hw_ptr + o) % dmix->slave_boundary;
+}
+
+/*
+ *  take the mixer role and render until no more requests are pending;
+ *  when another client holds the role, it picks up our request
+ */
+static void lockless_mix(snd_pcm_direct_t *dmix)
+{
+	snd_pcm_dmix_lockless_t *lm = dmix->u.dmix.lockless;
+	unsigned int req, owner, rendered;
+	unsigned int mine = dmix->u.dmix.slot - lm->slots + 1;
+
+	for (;;) {
+		owner = 0;
+		if (!__atomic_compare_exchange_n(&lm->mixer, &owner, mine, 0,
+						 __ATOMIC_ACQUIRE,
+						 __ATOMIC_RELAXED)) {
+			if (owner == mine)
+				return;
+			/*
+			 * a mixer which has rendered since we lost the last
+			 * time is alive, the (syscall) check of its semaphore
+			 * is only done when it seems stuck
+			 */
+			rendered = __atomic_load_n(&lm->rendered, __ATOMIC_ACQUIRE);
+			if (owner != dmix->u.dmix.mixer_seen ||
+			    rendered != dmix->u.dmix.rendered_seen) {
+				dmix->u.dmix.mixer_seen = owner;
+				dmix->u.dmix.rendered_seen = rendered;
+				return;
+			}
+			/* take over the role from a crashed process */
+			if (lockless_owner_alive(dmix, owner))
+				return;
+			if (!__atomic_compare_exchange_n(&lm->mixer, &owner, mine, 0,
+							 __ATOMIC_ACQUIRE,
+							 __ATOMIC_RELAXED))
+				return;
+		}
+		do {
+			req = __atomic_load_n(&lm->request, __ATOMIC_ACQUIRE);
+			lockless_render(dmix);
+			__atomic_add_fetch(&lm->rendered, 1, __ATOMIC_RELEASE);
+		} while (req != __atomic_load_n(&lm->request, __ATOMIC_ACQUIRE));
+		__atomic_store_n(&lm->mixer, 0, __ATOMIC_RELEASE);
+		/* a request may have come after the last check */
+		if (req == __atomic_load_n(&lm->request, __ATOMIC_ACQUIRE))
+			return;
+	}
+}
+
+/* lower the dirty position of our slot to pos */
+static void lockless_mark_dirty(snd_pcm_direct_t *dmix, snd_pcm_uframes_t pos)
+{
+	snd_pcm_dmix_lockless_slot_t *slot = dmix->u.dmix.slot;
+	unsigned long long old;
+
+	old = __atomic_load_n(&slot->dirty, __ATOMIC_RELAXED);
+	do {
+		if (old != LOCKLESS_NONE && lockless_offset(dmix, old, pos) <= 0)
+			break;
+	} while (!__atomic_compare_exchange_n(&slot->dirty, &old, pos, 0,
+					      __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+	__atomic_add_fetch(&dmix->u.dmix.lockless->request, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ *  copy size frames to our staging ring at slave_appl_ptr, publish them
+ *  and mix
+ */
+static void lockless_write_areas(snd_pcm_direct_t *dmix,
+				 const snd_pcm_channel_area_t *src_areas,
+				 snd_pcm_uframes_t src_ofs,
+				 snd_pcm_uframes_t dst_ofs,
+				 snd_pcm_uframes_t size)
+{
+	unsigned int chn, dchn;
+
+	if (dmix->interleaved) {
+		snd_pcm_areas_copy(dmix->u.dmix.ring_areas, dst_ofs,
+				   src_areas, src_ofs, dmix->channels, size,
+				   dmix->shmptr->s.format);
+		return;
+	}
+	for (chn = 0; chn < dmix->channels; chn++) {
+		dchn = dmix->bindings ? dmix->bindings[chn] : chn;
+		if (dchn >= dmix->shmptr->s.channels)
+			continue;
+		snd_pcm_area_copy(&dmix->u.dmix.ring_areas[dchn], dst_ofs,
+				  &src_areas[chn], src_ofs, size,
+				  dmix->shmptr->s.format);
+	}
+}
+
+static void lockless_publish(snd_pcm_direct_t *dmix,
+			     snd_pcm_uframes_t from, snd_pcm_uframes_t to)
+{
+	snd_pcm_dmix_lockless_slot_t *slot = dmix->u.dmix.slot;
+
+	/* the stream was restarted or skipped ahead */
+	if (__atomic_load_n(&slot->end, __ATOMIC_RELAXED) != from)
+		__atomic_store_n(&slot->begin, from, __ATOMIC_RELEASE);
+	__atomic_store_n(&slot->end, to, __ATOMIC_RELEASE);
+	lockless_mark_dirty(dmix, from);
+	lockless_mix(dmix);
+}
+
+/* drop the published frames from pos */
+static void lockless_rewind(snd_pcm_direct_t *dmix, snd_pcm_uframes_t pos)
+{
+	snd_pcm_dmix_lockless_slot_t *slot = dmix->u.dmix.slot;
+
+	if (lockless_offset(dmix, __atomic_load_n(&slot->begin, __ATOMIC_RELAXED),
+			    pos) > 0)
+		__atomic_store_n(&slot->begin, pos, __ATOMIC_RELEASE);
+	__atomic_store_n(&slot->end, pos, __ATOMIC_RELEASE);
+	lockless_mark_dirty(dmix, pos);
+	lockless_mix(dmix);
+}
+
+static int lockless_init(snd_pcm_direct_t *dmix)
+{
+	snd_pcm_channel_area_t *areas;
+	unsigned int chn, channels = dmix->shmptr->s.channels;
+	unsigned int width = snd_pcm_format_physical_width(dmix->shmptr->s.format);
+	size_t chunk;
+	int err;
+
+	generic_lockless_select_callbacks(dmix);
+	if (!dmix->u.dmix.mix_sum) {
+		SNDERR("lockless_mix does not support format %s",
+		       snd_pcm_format_name(dmix->shmptr->s.format));
+		return -EINVAL;
+	}
+	err = shm_mix_create_or_connect(dmix);
+	if (err < 0)
+		return err;
+	err = lockless_claim_slot(dmix);
+	if (err < 0) {
+		SNDERR("no free lockless_mix slot (max %d clients)", LOCKLESS_SLOTS);
+		return err;
+	}
+	areas = calloc(channels, sizeof(*areas));
+	if (!areas)
+		return -ENOMEM;
+	for (chn = 0; chn < channels; chn++) {
+		areas[chn].addr = lockless_ring(dmix, dmix->u.dmix.slot);
+		areas[chn].first = chn * width;
+		areas[chn].step = channels * width;
+	}
+	dmix->u.dmix.ring_areas = areas;
+	chunk = LOCKLESS_CHUNK / channels;
+	if (!chunk)
+		chunk = 1;
+	dmix->u.dmix.mix_buffer = malloc(chunk * channels * sizeof(signed int));
+	if (!dmix->u.dmix.mix_buffer)
+		return -ENOMEM;
+	return 0;
+}
+
+static void lockless_done(snd_pcm_direct_t *dmix)
+{
+	snd_pcm_dmix_lockless_slot_t *slot = dmix->u.dmix.slot;
+	struct sembuf op;
+
+	if (slot) {
+		__atomic_store_n(&slot->begin, slot->end, __ATOMIC_RELEASE);
+		__atomic_store_n(&slot->pid, 0, __ATOMIC_RELEASE);
+		op.sem_num = slot - dmix->u.dmix.lockless->slots;
+		op.sem_op = -1;
+		op.sem_flg = SEM_UNDO | IPC_NOWAIT;
+		semop(dmix->u.dmix.semid_mix, &op, 1);
+		dmix->u.dmix.slot = NULL;
+	}
+	if (dmix->u.dmix.shmid_mix >= 0)
+		shm_mix_discard(dmix);
+	free(dmix->u.dmix.ring_areas);
+	dmix->u.dmix.ring_areas = NULL;
+	free(dmix->u.dmix.mix_buffer);
+	dmix->u.dmix.mix_buffer = NULL;
+}
@@ -0,0 +1,125 @@
+/*
+ * vectorized mixing code for the non-concurrent (semaphore) mode,
+ * included from pcm_dmix_generic.c
+ */
+
+#include "pcm_simd.h"
+
+#ifdef PCM_SIMD
+
+#define SIMD_BYTES	16
+#define SIMD_ATTR
+#define SIMD_NAME(x)	simd_##x##_v128
+#include "pcm_dmix_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+
+#ifdef PCM_SIMD_AVX2
+#define SIMD_BYTES	32
+#define SIMD_ATTR	PCM_SIMD_AVX2_ATTR
+#define SIMD_NAME(x)	simd_##x##_avx2
+#include "pcm_dmix_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif
+
+static void simd_mix_select_callbacks(snd_pcm_direct_t *dmix)
+{
+#ifdef PCM_SIMD_AVX2
+	if (snd_pcm_simd_features() & SND_PCM_SIMD_AVX2) {
+		if (snd_pcm_format_cpu_endian(dmix->shmptr->s.format)) {
+			dmix->u.dmix.mix_areas_16 = simd_mix_areas_16_avx2;
+			dmix->u.dmix.mix_areas_32 = simd_mix_areas_32_avx2;
+			dmix->u.dmix.remix_areas_16 = simd_remix_areas_16_avx2;
+			dmix->u.dmix.remix_areas_32 = simd_remix_areas_32_avx2;
+		}
+#ifdef SNDRV_LITTLE_ENDIAN
+		dmix->u.dmix.mix_areas_24 = simd_mix_areas_24_avx2;
+		dmix->u.dmix.remix_areas_24 = simd_remix_areas_24_avx2;
+#endif
+		return;
+	}
+#endif
+	if (snd_pcm_format_cpu_endian(dmix->shmptr->s.format)) {
+		dmix->u.dmix.mix_areas_16 = simd_mix_areas_16_v128;
+		dmix->u.dmix.mix_areas_32 = simd_mix_areas_32_v128;
+		dmix->u.dmix.remix_areas_16 = simd_remix_areas_16_v128;
+		dmix->u.dmix.remix_areas_32 = simd_remix_areas_32_v128;
+	}
+#ifdef SNDRV_LITTLE_ENDIAN
+	dmix->u.dmix.mix_areas_24 = simd_mix_areas_24_v128;
+	dmix->u.dmix.remix_areas_24 = simd_remix_areas_24_v128;
+#endif
+}
+
+static void simd_lockless_select_callbacks(snd_pcm_direct_t *dmix)
+{
+	if (!snd_pcm_format_cpu_endian(dmix->shmptr->s.format))
+		return;
+	switch (dmix->shmptr->s.format) {
+	case SND_PCM_FORMAT_S16_LE:
+	case SND_PCM_FORMAT_S16_BE:
+#ifdef PCM_SIMD_AVX2
+		if (snd_pcm_simd_features() & SND_PCM_SIMD_AVX2) {
+			dmix->u.dmix.mix_sum = simd_sum_16_avx2;
+			dmix->u.dmix.mix_put = simd_put_16_avx2;
+			break;
+		}
+#endif
+		dmix->u.dmix.mix_sum = simd_sum_16_v128;
+		dmix->u.dmix.mix_put = simd_put_16_v128;
+		break;
+	case SND_PCM_FORMAT_S32_LE:
+	case SND_PCM_FORMAT_S32_BE:
+#ifdef PCM_SIMD_AVX2
+		if (snd_pcm_simd_features() & SND_PCM_SIMD_AVX2) {
+			dmix->u.dmix.mix_sum = simd_sum_32_avx2;
+			dmix->u.dmix.mix_put = simd_put_32_avx2;
+			break;
+		}
+#endif
+		dmix->u.dmix.mix_sum = simd_sum_32_v128;
+		dmix->u.dmix.mix_put = simd_put_32_v128;
+		break;
+	default:
+		break;
+	}
+}
+
+static void simd_float_mix_select_callbacks(snd_pcm_direct_t *dmix)
+{
+	if (!snd_pcm_format_cpu_endian(dmix->shmptr->s.format))
+		return;
+	switch (dmix->shmptr->s.format) {
+	case SND_PCM_FORMAT_S16_LE:
+	case SND_PCM_FORMAT_S16_BE:
+#ifdef PCM_SIMD_AVX2
+		if (snd_pcm_simd_features() & SND_PCM_SIMD_AVX2) {
+			dmix->u.dmix.mix_areas_float = simd_mix_areas_float_16_avx2;
+			dmix->u.dmix.remix_areas_float = simd_remix_areas_float_16_avx2;
+			break;
+		}
+#endif
+		dmix->u.dmix.mix_areas_float = simd_mix_areas_float_16_v128;
+		dmix->u.dmix.remix_areas_float = simd_remix_areas_float_16_v128;
+		break;
+	case SND_PCM_FORMAT_S32_LE:
+	case SND_PCM_FORMAT_S32_BE:
+#ifdef PCM_SIMD_AVX2
+		if (snd_pcm_simd_features() & SND_PCM_SIMD_AVX2) {
+			dmix->u.dmix.mix_areas_float = simd_mix_areas_float_32_avx2;
+			dmix->u.dmix.remix_areas_float = simd_remix_areas_float_32_avx2;
+			break;
+		}
+#endif
+		dmix->u.dmix.mix_areas_float = simd_mix_areas_float_32_v128;
+		dmix->u.dmix.remix_areas_float = simd_remix_areas_float_32_v128;
+		break;
+	default:
+		break;
+	}
+}
+
+#endif /* PCM_SIMD */
@@ -0,0 +1,602 @@
+/**
+ * \file pcm/pcm_dmix_simd.h
+ * \ingroup PCM_Plugins
+ * \brief PCM Direct Stream Mixing (dmix) Plugin Interface - vector code
+ */
+/*
+ *  PCM - Direct Stream Mixing
+ *
+ *  This file is included from pcm_dmix_simd.c several times, with
+ *  SIMD_BYTES (vector size), SIMD_ATTR (function attributes) and
+ *  SIMD_NAME() (symbol suffix) defined.
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+typedef int16_t SIMD_NAME(hs16) __attribute__((vector_size(SIMD_BYTES / 2)));
+typedef int32_t SIMD_NAME(vs32) __attribute__((vector_size(SIMD_BYTES)));
+typedef uint32_t SIMD_NAME(vu32) __attribute__((vector_size(SIMD_BYTES)));
+typedef uint8_t SIMD_NAME(vu8) __attribute__((vector_size(SIMD_BYTES)));
+typedef float SIMD_NAME(vf32) __attribute__((vector_size(SIMD_BYTES)));
+
+/* 32-bit lanes in one vector */
+#define LANES		(SIMD_BYTES / 4)
+
+#if SIMD_BYTES == 16
+#define GATHER24	0, 1, 2, 16, 3, 4, 5, 16, 6, 7, 8, 16, 9, 10, 11, 16
+#define SCATTER24	0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0, 0, 0, 0
+#elif SIMD_BYTES == 32
+#define GATHER24	0, 1, 2, 32, 3, 4, 5, 32, 6, 7, 8, 32, 9, 10, 11, 32, \
+			12, 13, 14, 32, 15, 16, 17, 32, 18, 19, 20, 32, 21, 22, 23, 32
+#define SCATTER24	0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, \
+			16, 17, 18, 20, 21, 22, 24, 25, 26, 28, 29, 30, \
+			0, 0, 0, 0, 0, 0, 0, 0
+#else
+#error "unsupported SIMD_BYTES"
+#endif
+
+/*
+ * The sum is reset where the destination sample is still zero (no other
+ * stream has been mixed to it yet), then the source is added (mix) or
+ * subtracted (remix) and the result is saturated to the slave format,
+ * exactly as the generic code does it sample by sample.
+ */
+
+static inline __attribute__((always_inline)) SIMD_ATTR
+void SIMD_NAME(mix_16_core)(unsigned int size, int16_t *dst,
+			    const int16_t *src, int32_t *sum,
+			    const int remix)
+{
+	SIMD_NAME(hs16) s16, d16;
+	SIMD_NAME(vs32) s, d, m, acc, hi, lo;
+
+	for (; size >= LANES; size -= LANES) {
+		simd_load(s16, src);
+		simd_load(d16, dst);
+		simd_load(acc, sum);
+		s = simd_convert(s16, SIMD_NAME(vs32));
+		d = simd_convert(d16, SIMD_NAME(vs32));
+		m = d == 0;
+		acc &= ~m;
+		if (remix)
+			acc -= s;
+		else
+			acc += s;
+		simd_store(sum, acc);
+		hi = acc > 0x7fff;
+		lo = acc < -0x8000;
+		d = (acc & ~(hi | lo)) | (0x7fff & hi) | (-0x8000 & lo);
+		if (remix)
+			d = (acc & m) | (d & ~m);
+		d16 = simd_convert(d, SIMD_NAME(hs16));
+		simd_store(dst, d16);
+		src += LANES;
+		dst += LANES;
+		sum += LANES;
+	}
+	if (size) {
+		if (remix)
+			generic_remix_areas_16_native(size, dst, (signed short *)src,
+						      sum, 2, 2, 4);
+		else
+			generic_mix_areas_16_native(size, dst, (signed short *)src,
+						    sum, 2, 2, 4);
+	}
+}
+
+static inline __attribute__((always_inline)) SIMD_ATTR
+void SIMD_NAME(mix_32_core)(unsigned int size, int32_t *dst,
+			    const int32_t *src, int32_t *sum,
+			    const int remix)
+{
+	SIMD_NAME(vs32) sv, s, d, m, acc, hi, lo;
+
+	for (; size >= LANES; size -= LANES) {
+		simd_load(sv, src);
+		simd_load(d, dst);
+		simd_load(acc, sum);
+		s = sv >> 8;
+		m = d == 0;
+		acc &= ~m;
+		if (remix)
+			acc -= s;
+		else
+			acc += s;
+		simd_store(sum, acc);
+		hi = acc > 0x7fffff;
+		lo = acc < -0x800000;
+		d = ((acc * 256) & ~(hi | lo)) | (0x7fffffff & hi) | (INT32_MIN & lo);
+		if (remix)
+			sv = -sv;
+		d = (sv & m) | (d & ~m);
+		simd_store(dst, d);
+		src += LANES;
+		dst += LANES;
+		sum += LANES;
+	}
+	if (size) {
+		if (remix)
+			generic_remix_areas_32_native(size, dst, (signed int *)src,
+						      sum, 4, 4, 4);
+		else
+			generic_mix_areas_32_native(size, dst, (signed int *)src,
+						    sum, 4, 4, 4);
+	}
+}
+
+#ifdef SNDRV_LITTLE_ENDIAN
+/* S24_3LE, samples are expanded to 32-bit lanes */
+static inline __attribute__((always_inline)) SIMD_ATTR
+void SIMD_NAME(mix_24_3_core)(unsigned int size, uint8_t *dst,
+			      const uint8_t *src, int32_t *sum,
+			      const int remix)
+{
+	const SIMD_NAME(vu8) zero = { 0 };
+	SIMD_NAME(vu8) sb, db;
+	SIMD_NAME(vs32) s, d, m, acc, hi, lo;
+
+	for (; size >= LANES; size -= LANES) {
+		sb = zero;
+		db = zero;
+		memcpy(&sb, src, LANES * 3);
+		memcpy(&db, dst, LANES * 3);
+		simd_load(acc, sum);
+		s = (SIMD_NAME(vs32))simd_shuffle(sb, zero, GATHER24);
+		d = (SIMD_NAME(vs32))simd_shuffle(db, zero, GATHER24);
+		s = (SIMD_NAME(vs32))((SIMD_NAME(vu32))s << 8) >> 8;
+		m = d == 0;
+		acc &= ~m;
+		if (remix)
+			acc -= s;
+		else
+			acc += s;
+		simd_store(sum, acc);
+		hi = acc > 0x7fffff;
+		lo = acc < -0x800000;
+		d = (acc & ~(hi | lo)) | (0x7fffff & hi) | (-0x800000 & lo);
+		if (remix)
+			d = (acc & m) | (d & ~m);
+		db = (SIMD_NAME(vu8))d;
+		db = simd_shuffle(db, db, SCATTER24);
+		memcpy(dst, &db, LANES * 3);
+		src += LANES * 3;
+		dst += LANES * 3;
+		sum += LANES;
+	}
+	if (size) {
+		if (remix)
+			generic_remix_areas_24(size, dst, (unsigned char *)src,
+					       sum, 3, 3, 4);
+		else
+			generic_mix_areas_24(size, dst, (unsigned char *)src,
+					     sum, 3, 3, 4);
+	}
+}
+
+/* S24_LE, the upper byte of the destination is kept as is */
+static inline __attribute__((always_inline)) SIMD_ATTR
+void SIMD_NAME(mix_24_4_core)(unsigned int size, uint32_t *dst,
+			      const uint32_t *src, int32_t *sum,
+			      const int remix)
+{
+	SIMD_NAME(vu32) sv, dv;
+	SIMD_NAME(vs32) s, d, m, acc, hi, lo;
+
+	for (; size >= LANES; size -= LANES) {
+		simd_load(sv, src);
+		simd_load(dv, dst);
+		simd_load(acc, sum);
+		s = (SIMD_NAME(vs32))(sv << 8) >> 8;
+		m = (SIMD_NAME(vs32))(dv & 0xffffff) == 0;
+		acc &= ~m;
+		if (remix)
+			acc -= s;
+		else
+			acc += s;
+		simd_store(sum, acc);
+		hi = acc > 0x7fffff;
+		lo = acc < -0x800000;
+		d = (acc & ~(hi | lo)) | (0x7fffff & hi) | (-0x800000 & lo);
+		if (remix)
+			d = (acc & m) | (d & ~m);
+		dv = (dv & 0xff000000) | ((SIMD_NAME(vu32))d & 0xffffff);
+		simd_store(dst, dv);
+		src += LANES;
+		dst += LANES;
+		sum += LANES;
+	}
+	if (size) {
+		if (remix)
+			generic_remix_areas_24(size, (unsigned char *)dst,
+					       (unsigned char *)src, sum, 4, 4, 4);
+		else
+			generic_mix_areas_24(size, (unsigned char *)dst,
+					     (unsigned char *)src, sum, 4, 4, 4);
+	}
+}
+#endif /* SNDRV_LITTLE_ENDIAN */
+
+/*
+ * mix_areas_t entries; the vector code is used for the interleaved case
+ * only, where the samples and the sum buffer are contiguous
+ */
+
+static SIMD_ATTR void SIMD_NAME(mix_areas_16)(unsigned int size,
+					      volatile signed short *dst,
+					      signed short *src,
+					      volatile signed int *sum,
+					      size_t dst_step,
+					      size_t src_step,
+					      size_t sum_step)
+{
+	if (dst_step != 2 || src_step != 2 || sum_step != 4)
+		generic_mix_areas_16_native(size, dst, src, sum,
+					    dst_step, src_step, sum_step);
+	else
+		SIMD_NAME(mix_16_core)(size, (int16_t *)dst, src,
+				       (int32_t *)sum, 0);
+}
+
+static SIMD_ATTR void SIMD_NAME(remix_areas_16)(unsigned int size,
+						volatile signed short *dst,
+						signed short *src,
+						volatile signed int *sum,
+						size_t dst_step,
+						size_t src_step,
+						size_t sum_step)
+{
+	if (dst_step != 2 || src_step != 2 || sum_step != 4)
+		generic_remix_areas_16_native(size, dst, src, sum,
+					      dst_step, src_step, sum_step);
+	else
+		SIMD_NAME(mix_16_core)(size, (int16_t *)dst, src,
+				       (int32_t *)sum, 1);
+}
+
+static SIMD_ATTR void SIMD_NAME(mix_areas_32)(unsigned int size,
+					      volatile signed int *dst,
+					      signed int *src,
+					      volatile signed int *sum,
+					      size_t dst_step,
+					      size_t src_step,
+					      size_t sum_step)
+{
+	if (dst_step != 4 || src_step != 4 || sum_step != 4)
+		generic_mix_areas_32_native(size, dst, src, sum,
+					    dst_step, src_step, sum_step);
+	else
+		SIMD_NAME(mix_32_core)(size, (int32_t *)dst, src,
+				       (int32_t *)sum, 0);
+}
+
+static SIMD_ATTR void SIMD_NAME(remix_areas_32)(unsigned int size,
+						volatile signed int *dst,
+						signed int *src,
+						volatile signed int *sum,
+						size_t dst_step,
+						size_t src_step,
+						size_t sum_step)
+{
+	if (dst_step != 4 || src_step != 4 || sum_step != 4)
+		generic_remix_areas_32_native(size, dst, src, sum,
+					      dst_step, src_step, sum_step);
+	else
+		SIMD_NAME(mix_32_core)(size, (int32_t *)dst, src,
+				       (int32_t *)sum, 1);
+}
+
+#ifdef SNDRV_LITTLE_ENDIAN
+static SIMD_ATTR void SIMD_NAME(mix_areas_24)(unsigned int size,
+					      volatile unsigned char *dst,
+					      unsigned char *src,
+					      volatile signed int *sum,
+					      size_t dst_step,
+					      size_t src_step,
+					      size_t sum_step)
+{
+	if (dst_step == 3 && src_step == 3 && sum_step == 4)
+		SIMD_NAME(mix_24_3_core)(size, (uint8_t *)dst, src,
+					 (int32_t *)sum, 0);
+	else if (dst_step == 4 && src_step == 4 && sum_step == 4)
+		SIMD_NAME(mix_24_4_core)(size, (uint32_t *)dst,
+					 (const uint32_t *)src,
+					 (int32_t *)sum, 0);
+	else
+		generic_mix_areas_24(size, dst, src, sum,
+				     dst_step, src_step, sum_step);
+}
+
+static SIMD_ATTR void SIMD_NAME(remix_areas_24)(unsigned int size,
+						volatile unsigned char *dst,
+						unsigned char *src,
+						volatile signed int *sum,
+						size_t dst_step,
+						size_t src_step,
+						size_t sum_step)
+{
+	if (dst_step == 3 && src_step == 3 && sum_step == 4)
+		SIMD_NAME(mix_24_3_core)(size, (uint8_t *)dst, src,
+					 (int32_t *)sum, 1);
+	else if (dst_step == 4 && src_step == 4 && sum_step == 4)
+		SIMD_NAME(mix_24_4_core)(size, (uint32_t *)dst,
+					 (const uint32_t *)src,
+					 (int32_t *)sum, 1);
+	else
+		generic_remix_areas_24(size, dst, src, sum,
+				       dst_step, src_step, sum_step);
+}
+#endif /* SNDRV_LITTLE_ENDIAN */
+
+/*
+ * lockless_mix: the staging rings are added to the accumulator and the
+ * saturated result is stored to the slave buffer
+ */
+
+static SIMD_ATTR void SIMD_NAME(sum_16)(unsigned int size, signed int *acc,
+					const void *src, size_t src_step)
+{
+	const int16_t *s = src;
+	SIMD_NAME(hs16) s16;
+	SIMD_NAME(vs32) a;
+
+	for (; size >= LANES; size -= LANES) {
+		simd_load(s16, s);
+		simd_load(a, acc);
+		a += simd_convert(s16, SIMD_NAME(vs32));
+		simd_store(acc, a);
+		s += LANES;
+		acc += LANES;
+	}
+	if (size)
+		generic_sum_16_native(size, acc, s, src_step);
+}
+
+static SIMD_ATTR void SIMD_NAME(sum_32)(unsigned int size, signed int *acc,
+					const void *src, size_t src_step)
+{
+	const int32_t *s = src;
+	SIMD_NAME(vs32) sv, a;
+
+	for (; size >= LANES; size -= LANES) {
+		simd_load(sv, s);
+		simd_load(a, acc);
+		a += sv >> 8;
+		simd_store(acc, a);
+		s += LANES;
+		acc += LANES;
+	}
+	if (size)
+		generic_sum_32_native(size, acc, s, src_step);
+}
+
+static SIMD_ATTR void SIMD_NAME(put_16)(unsigned int size, void *dst,
+					const signed int *acc, size_t dst_step,
+					size_t acc_step)
+{
+	int16_t *d = dst;
+	SIMD_NAME(hs16) d16;
+	SIMD_NAME(vs32) a, hi, lo;
+
+	if (dst_step != 2 || acc_step != 4) {
+		generic_put_16_native(size, dst, acc, dst_step, acc_step);
+		return;
+	}
+	for (; size >= LANES; size -= LANES) {
+		simd_load(a, acc);
+		hi = a > 0x7fff;
+		lo = a < -0x8000;
+		a = (a & ~(hi | lo)) | (0x7fff & hi) | (-0x8000 & lo);
+		d16 = simd_convert(a, SIMD_NAME(hs16));
+		simd_store(d, d16);
+		d += LANES;
+		acc += LANES;
+	}
+	if (size)
+		generic_put_16_native(size, d, acc, 2, 4);
+}
+
+static SIMD_ATTR void SIMD_NAME(put_32)(unsigned int size, void *dst,
+					const signed int *acc, size_t dst_step,
+					size_t acc_step)
+{
+	int32_t *d = dst;
+	SIMD_NAME(vs32) a, hi, lo;
+
+	if (dst_step != 4 || acc_step != 4) {
+		generic_put_32_native(size, dst, acc, dst_step, acc_step);
+		return;
+	}
+	for (; size >= LANES; size -= LANES) {
+		simd_load(a, acc);
+		hi = a > 0x7fffff;
+		lo = a < -0x800000;
+		a = ((a * 256) & ~(hi | lo)) | (0x7fffffff & hi) | (INT32_MIN & lo);
+		simd_store(d, a);
+		d += LANES;
+		acc += LANES;
+	}
+	if (size)
+		generic_put_32_native(size, d, acc, 4, 4);
+}
+
+/*
+ * float_sum: see pcm_dmix_float.c for the soft limiter curve, the lane
+ * operations below are the same as in dmix_soft_limit()
+ */
+
+/* per-lane m ? a : b for float vectors */
+#define FSELECT(m, a, b) \
+	((SIMD_NAME(vf32))(((SIMD_NAME(vs32))(a) & (m)) | \
+			   ((SIMD_NAME(vs32))(b) & ~(m))))
+
+static inline __attribute__((always_inline)) SIMD_ATTR
+SIMD_NAME(vf32) SIMD_NAME(soft_limit)(SIMD_NAME(vf32) x, float knee)
+{
+	const SIMD_NAME(vf32) zero = { 0 };
+	const SIMD_NAME(vf32) k = zero + knee;
+	const float r = 1.0f - knee;
+	SIMD_NAME(vf32) a, e;
+	SIMD_NAME(vs32) sign;
+
+	sign = (SIMD_NAME(vs32))x & INT32_MIN;
+	a = (SIMD_NAME(vf32))((SIMD_NAME(vs32))x & INT32_MAX);
+	e = FSELECT(a > k, a - k, zero);
+	a = FSELECT(a < k, a, k) + r * e / (e + r + FLT_MIN);
+	return (SIMD_NAME(vf32))((SIMD_NAME(vs32))a | sign);
+}
+
+static inline __attribute__((always_inline)) SIMD_ATTR
+void SIMD_NAME(mix_float_16_core)(unsigned int size, int16_t *dst,
+				  const int16_t *src, float *sum,
+				  float knee, const int remix)
+{
+	const float scale = (remix ? -1.0f : 1.0f) / 32768.0f;
+	const SIMD_NAME(vf32) maxf = (SIMD_NAME(vf32)){ 0 } + 32767.0f;
+	SIMD_NAME(hs16) s16, d16;
+	SIMD_NAME(vs32) m;
+	SIMD_NAME(vf32) s, acc;
+
+	for (; size >= LANES; size -= LANES) {
+		simd_load(s16, src);
+		simd_load(d16, dst);
+		simd_load(acc, sum);
+		s = simd_convert(simd_convert(s16, SIMD_NAME(vs32)),
+				 SIMD_NAME(vf32)) * scale;
+		m = simd_convert(d16, SIMD_NAME(vs32)) == 0;
+		acc = (SIMD_NAME(vf32))((SIMD_NAME(vs32))acc & ~m);
+		acc += s;
+		simd_store(sum, acc);
+		acc = SIMD_NAME(soft_limit)(acc, knee) * 32768.0f;
+		acc = FSELECT(acc > maxf, maxf, acc);
+		d16 = simd_convert(simd_convert(acc, SIMD_NAME(vs32)),
+				   SIMD_NAME(hs16));
+		simd_store(dst, d16);
+		src += LANES;
+		dst += LANES;
+		sum += LANES;
+	}
+	if (size) {
+		if (remix)
+			generic_remix_areas_float_16_native(size, dst, (void *)src,
+							    sum, 2, 2, 4, knee);
+		else
+			generic_mix_areas_float_16_native(size, dst, (void *)src,
+							  sum, 2, 2, 4, knee);
+	}
+}
+
+static inline __attribute__((always_inline)) SIMD_ATTR
+void SIMD_NAME(mix_float_32_core)(unsigned int size, int32_t *dst,
+				  const int32_t *src, float *sum,
+				  float knee, const int remix)
+{
+	const float scale = (remix ? -1.0f : 1.0f) / 2147483648.0f;
+	const SIMD_NAME(vf32) maxf = (SIMD_NAME(vf32)){ 0 } + 2147483520.0f;
+	SIMD_NAME(vs32) sv, d, m;
+	SIMD_NAME(vf32) s, acc;
+
+	for (; size >= LANES; size -= LANES) {
+		simd_load(sv, src);
+		simd_load(d, dst);
+		simd_load(acc, sum);
+		s = simd_convert(sv, SIMD_NAME(vf32)) * scale;
+		m = d == 0;
+		acc = (SIMD_NAME(vf32))((SIMD_NAME(vs32))acc & ~m);
+		acc += s;
+		simd_store(sum, acc);
+		acc = SIMD_NAME(soft_limit)(acc, knee) * 2147483648.0f;
+		acc = FSELECT(acc > maxf, maxf, acc);
+		d = simd_convert(acc, SIMD_NAME(vs32));
+		simd_store(dst, d);
+		src += LANES;
+		dst += LANES;
+		sum += LANES;
+	}
+	if (size) {
+		if (remix)
+			generic_remix_areas_float_32_native(size, dst, (void *)src,
+							    sum, 4, 4, 4, knee);
+		else
+			generic_mix_areas_float_32_native(size, dst, (void *)src,
+							  sum, 4, 4, 4, knee);
+	}
+}
+
+static SIMD_ATTR void SIMD_NAME(mix_areas_float_16)(unsigned int size,
+						    volatile void *dst, void *src,
+						    volatile float *sum,
+						    size_t dst_step,
+						    size_t src_step,
+						    size_t sum_step, float knee)
+{
+	if (dst_step != 2 || src_step != 2 || sum_step != 4)
+		generic_mix_areas_float_16_native(size, dst, src, sum, dst_step,
+						  src_step, sum_step, knee);
+	else
+		SIMD_NAME(mix_float_16_core)(size, (int16_t *)dst, src,
+					     (float *)sum, knee, 0);
+}
+
+static SIMD_ATTR void SIMD_NAME(remix_areas_float_16)(unsigned int size,
+						      volatile void *dst, void *src,
+						      volatile float *sum,
+						      size_t dst_step,
+						      size_t src_step,
+						      size_t sum_step, float knee)
+{
+	if (dst_step != 2 || src_step != 2 || sum_step != 4)
+		generic_remix_areas_float_16_native(size, dst, src, sum, dst_step,
+						    src_step, sum_step, knee);
+	else
+		SIMD_NAME(mix_float_16_core)(size, (int16_t *)dst, src,
+					     (float *)sum, knee, 1);
+}
+
+static SIMD_ATTR void SIMD_NAME(mix_areas_float_32)(unsigned int size,
+						    volatile void *dst, void *src,
+						    volatile float *sum,
+						    size_t dst_step,
+						    size_t src_step,
+						    size_t sum_step, float knee)
+{
+	if (dst_step != 4 || src_step != 4 || sum_step != 4)
+		generic_mix_areas_float_32_native(size, dst, src, sum, dst_step,
+						  src_step, sum_step, knee);
+	else
+		SIMD_NAME(mix_float_32_core)(size, (int32_t *)dst, src,
+					     (float *)sum, knee, 0);
+}
+
+static SIMD_ATTR void SIMD_NAME(remix_areas_float_32)(unsigned int size,
+						      volatile void *dst, void *src,
+						      volatile float *sum,
+						      size_t dst_step,
+						      size_t src_step,
+						      size_t sum_step, float knee)
+{
+	if (dst_step != 4 || src_step != 4 || sum_step != 4)
+		generic_remix_areas_float_32_native(size, dst, src, sum, dst_step,
+						    src_step, sum_step, knee);
+	else
+		SIMD_NAME(mix_float_32_core)(size, (int32_t *)dst, src,
+					     (float *)sum, knee, 1);
+}
+
+#undef FSELECT
+#undef LANES
+#undef GATHER24
+#undef SCATTER24
@@ -96,6 +96,8 @@ static void snoop_areas(snd_pcm_direct_t *dsnoop,
 	}
 }
 
+#include "pcm_dsnoop_zero_copy.c"
+
 /*
  *  synchronize shm ring buffer with hardware
  */
@@ -106,6 +108,9 @@ static void snd_pcm_dsnoop_sync_area(snd_pcm_t *pcm, snd_pcm_uframes_t slave_hw_
 	snd_pcm_uframes_t transfer;
 	const snd_pcm_channel_area_t *src_areas, *dst_areas;
 	
+	/* the client reads the slave ring directly */
+	if (dsnoop->u.dsnoop.zero_copy)
+		return;
 	/* add sample areas here */
 	dst_areas = snd_pcm_mmap_areas(pcm);
 	src_areas = snd_pcm_mmap_areas(dsnoop->spcm);
@@ -131,6 +136,7 @@ static int snd_pcm_dsnoop_sync_ptr(snd_pcm_t *pcm)
 {
 	snd_pcm_direct_t *dsnoop = pcm->private_data;
 	snd_pcm_uframes_t slave_hw_ptr, old_slave_hw_ptr, avail;
+	snd_pcm_uframes_t stop_threshold = pcm->stop_threshold;
 	snd_pcm_sframes_t diff;
 	int err;
 
@@ -149,9 +155,11 @@ static int snd_pcm_dsnoop_sync_ptr(snd_pcm_t *pcm)
 	dsnoop->hw_ptr += diff;
 	dsnoop->hw_ptr %= pcm->boundary;
 	// printf("sync ptr diff = %li\n", diff);
-	if (pcm->stop_threshold >= pcm->boundary)	/* don't care */
+	if (stop_threshold >= pcm->boundary)	/* don't care */
 		return 0;
-	if ((avail = snd_pcm_mmap_capture_avail(pcm)) >= pcm->stop_threshold) {
+	if (dsnoop->u.dsnoop.zero_copy)
+		stop_threshold = snoop_zero_copy_stop_threshold(pcm, stop_threshold);
+	if ((avail = snd_pcm_mmap_capture_avail(pcm)) >= stop_threshold) {
 		gettimestamp(&dsnoop->trigger_tstamp, pcm->tstamp_type);
 		dsnoop->state = SND_PCM_STATE_XRUN;
 		dsnoop->avail_max = avail;
@@ -252,6 +260,8 @@ static int snd_pcm_dsnoop_reset(snd_pcm_t *pcm)
 	dsnoop->hw_ptr %= pcm->period_size;
 	dsnoop->appl_ptr = dsnoop->hw_ptr;
 	snd_pcm_direct_reset_slave_ptr(pcm, dsnoop, dsnoop->slave_hw_ptr);
+	if (dsnoop->u.dsnoop.zero_copy)
+		snoop_zero_copy_align(pcm);
 	return 0;
 }
 
@@ -265,6 +275,8 @@ static int snd_pcm_dsnoop_start(snd_pcm_t *pcm)
 	snd_pcm_hwsync(dsnoop->spcm);
 	snoop_timestamp(pcm);
 	snd_pcm_direct_reset_slave_ptr(pcm, dsnoop, dsnoop->slave_hw_ptr);
+	if (dsnoop->u.dsnoop.zero_copy)
+		snoop_zero_copy_align(pcm);
 	err = snd_timer_start(dsnoop->timer);
 	if (err < 0)
 		return err;
@@ -447,11 +459,85 @@ static int snd_pcm_dsnoop_htimestamp(snd_pcm_t *pcm,
 	return 0;
 }
 
+static int snd_pcm_dsnoop_hw_refine(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
+{
+	snd_pcm_direct_t *dsnoop = pcm->private_data;
+	snd_pcm_access_mask_t access_mask;
+	int err;
+
+	if (dsnoop->u.dsnoop.zero_copy) {
+		/* the client buffer is the slave ring itself */
+		snoop_zero_copy_access(dsnoop, &access_mask);
+		err = _snd_pcm_hw_param_set_mask(params, SND_PCM_HW_PARAM_ACCESS,
+						 &access_mask);
+		if (err < 0)
+			return err;
+		err = _snd_pcm_hw_param_set(params, SND_PCM_HW_PARAM_BUFFER_SIZE,
+					    dsnoop->slave_buffer_size, 0);
+		if (err < 0)
+			return err;
+	}
+	return snd_pcm_direct_hw_refine(pcm, params);
+}
+
+static int snd_pcm_dsnoop_munmap(snd_pcm_t *pcm)
+{
+	snd_pcm_direct_t *dsnoop = pcm->private_data;
+
+	if (!dsnoop->u.dsnoop.zero_copy)
+		return 0;
+	if (pcm->running_areas)
+		snoop_zero_copy_protect(dsnoop, PROT_READ | PROT_WRITE);
+	free(pcm->mmap_channels);
+	free(pcm->running_areas);
+	pcm->mmap_channels = NULL;
+	pcm->running_areas = NULL;
+	return 0;
+}
+
+/* zero copy: map the client channels onto the slave ring, read-only */
+static int snd_pcm_dsnoop_mmap(snd_pcm_t *pcm)
+{
+	snd_pcm_direct_t *dsnoop = pcm->private_data;
+	snd_pcm_t *spcm = dsnoop->spcm;
+	unsigned int chn, schn;
+
+	if (!dsnoop->u.dsnoop.zero_copy)
+		return 0;
+	pcm->mmap_channels = calloc(pcm->channels, sizeof(pcm->mmap_channels[0]));
+	pcm->running_areas = calloc(pcm->channels, sizeof(pcm->running_areas[0]));
+	if (!pcm->mmap_channels || !pcm->running_areas) {
+		snd_pcm_dsnoop_munmap(pcm);
+		return -ENOMEM;
+	}
+	for (chn = 0; chn < pcm->channels; chn++) {
+		schn = dsnoop->bindings ? dsnoop->bindings[chn] : chn;
+		pcm->mmap_channels[chn] = spcm->mmap_channels[schn];
+		pcm->mmap_channels[chn].channel = chn;
+		pcm->running_areas[chn] = spcm->running_areas[schn];
+	}
+	snoop_zero_copy_protect(dsnoop, PROT_READ);
+	return 0;
+}
+
+static int snd_pcm_dsnoop_channel_info(snd_pcm_t *pcm, snd_pcm_channel_info_t *info)
+{
+	snd_pcm_direct_t *dsnoop = pcm->private_data;
+
+	if (dsnoop->u.dsnoop.zero_copy && pcm->mmap_channels) {
+		*info = pcm->mmap_channels[info->channel];
+		return 0;
+	}
+	return snd_pcm_direct_channel_info(pcm, info);
+}
+
 static void snd_pcm_dsnoop_dump(snd_pcm_t *pcm, snd_output_t *out)
 {
 	snd_pcm_direct_t *dsnoop = pcm->private_data;
 
 	snd_output_printf(out, "Direct Snoop PCM\n");
+	if (dsnoop->u.dsnoop.zero_copy)
+		snd_output_printf(out, "Zero copy: reading the slave ring in place\n");
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -463,16 +549,16 @@ static void snd_pcm_dsnoop_dump(snd_pcm_t *pcm, snd_output_t *out)
 static const snd_pcm_ops_t snd_pcm_dsnoop_ops = {
 	.close = snd_pcm_dsnoop_close,
 	.info = snd_pcm_direct_info,
-	.hw_refine = snd_pcm_direct_hw_refine,
+	.hw_refine = snd_pcm_dsnoop_hw_refine,
 	.hw_params = snd_pcm_direct_hw_params,
 	.hw_free = snd_pcm_direct_hw_free,
 	.sw_params = snd_pcm_direct_sw_params,
-	.channel_info = snd_pcm_direct_channel_info,
+	.channel_info = snd_pcm_dsnoop_channel_info,
 	.dump = snd_pcm_dsnoop_dump,
 	.nonblock = snd_pcm_direct_nonblock,
 	.async = snd_pcm_direct_async,
-	.mmap = snd_pcm_direct_mmap,
-	.munmap = snd_pcm_direct_munmap,
+	.mmap = snd_pcm_dsnoop_mmap,
+	.munmap = snd_pcm_dsnoop_munmap,
 	.query_chmaps = snd_pcm_direct_query_chmaps,
 	.get_chmap = snd_pcm_direct_get_chmap,
 	.set_chmap = snd_pcm_direct_set_chmap,
@@ -652,6 +738,20 @@ int snd_pcm_dsnoop_open(snd_pcm_t **pcmp, const char *name,
 	
 	if (dsnoop->channels == UINT_MAX)
 		dsnoop->channels = dsnoop->shmptr->s.channels;
+
+	if (opts->zero_copy) {
+		unsigned int chn;
+
+		dsnoop->u.dsnoop.zero_copy = 1;
+		for (chn = 0; dsnoop->bindings && chn < dsnoop->channels; chn++) {
+			if (dsnoop->bindings[chn] >= spcm->channels) {
+				SNDERR("zero_copy needs all channels bound, copying");
+				dsnoop->u.dsnoop.zero_copy = 0;
+				break;
+			}
+		}
+		pcm->mmap_shadow = dsnoop->u.dsnoop.zero_copy;
+	}
 	
 	snd_pcm_direct_semaphore_up(dsnoop, DIRECT_IPC_SEM_CLIENT);
 
@@ -726,9 +826,20 @@ pcm.name {
 		N INT		# maps slave channel to client channel N
 	}
 	slowptr BOOL		# slow but more precise pointer updates
+	zero_copy BOOL		# read the slave ring in place (see below)
 }
 \endcode
 
+With <code>zero_copy</code>, the client areas point into a read-only
+mapping of the shared capture ring instead of a private buffer, so no
+frames are copied per client.  The client buffer size is then the slave
+buffer size and the client keeps only its own appl_ptr.  The mmap access
+is offered only where it matches the layout of the slave ring (all
+channels in their slave order for the interleaved access); otherwise use
+the read calls, which still copy only once.  The hardware overwrites the
+ring in place, so a client lagging more than the buffer minus one slave
+period behind gets an xrun.
+
 <code>hw_ptr_alignment</code> specifies slave application and hw
 pointer alignment type. By default hw_ptr_alignment is auto. Below are
 the possible configurations:
@@ -0,0 +1,127 @@
+/**
+ * \file pcm/pcm_dsnoop_zero_copy.c
+ * \ingroup PCM_Plugins
+ * \brief PCM Capture Stream Snooping (dsnoop) Plugin Interface - zero copy mode
+ */
+/*
+ *  PCM - Capture Stream Snooping
+ *
+ *  This file is included from pcm_dsnoop.c.
+ *
+ *  In the zero copy mode the client does not get a buffer of its own,
+ *  its areas point into the mapping of the slave ring, made read-only.
+ *  The client buffer has the size of the slave buffer and its hw_ptr is
+ *  kept congruent to the slave one, so the same frame sits at the same
+ *  offset in both.
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ *  zero copy: the client areas point into the slave ring, so the client
+ *  hw_ptr is kept congruent to the slave hw_ptr modulo the buffer size
+ */
+static void snoop_zero_copy_align(snd_pcm_t *pcm)
+{
+	snd_pcm_direct_t *dsnoop = pcm->private_data;
+
+	dsnoop->hw_ptr = dsnoop->slave_hw_ptr % pcm->buffer_size;
+	dsnoop->appl_ptr = dsnoop->hw_ptr;
+}
+
+/* the client mmap access matching the layout of the slave ring */
+static void snoop_zero_copy_access(snd_pcm_direct_t *dsnoop,
+				   snd_pcm_access_mask_t *mask)
+{
+	const snd_pcm_channel_area_t *areas = snd_pcm_mmap_areas(dsnoop->spcm);
+	unsigned int bits = dsnoop->spcm->sample_bits;
+	unsigned int chn, schn, channels = dsnoop->channels;
+	int interleaved = channels == dsnoop->spcm->channels;
+	int noninterleaved = 1;
+
+	for (chn = 0; chn < channels; chn++) {
+		schn = dsnoop->bindings ? dsnoop->bindings[chn] : chn;
+		if (schn != chn || areas[schn].addr != areas[0].addr ||
+		    areas[schn].first != chn * bits ||
+		    areas[schn].step != channels * bits)
+			interleaved = 0;
+		if (areas[schn].first != 0 || areas[schn].step != bits)
+			noninterleaved = 0;
+	}
+	snd_pcm_access_mask_none(mask);
+	snd_pcm_access_mask_set(mask, SND_PCM_ACCESS_RW_INTERLEAVED);
+	snd_pcm_access_mask_set(mask, SND_PCM_ACCESS_RW_NONINTERLEAVED);
+	if (interleaved)
+		snd_pcm_access_mask_set(mask, SND_PCM_ACCESS_MMAP_INTERLEAVED);
+	if (noninterleaved)
+		snd_pcm_access_mask_set(mask, SND_PCM_ACCESS_MMAP_NONINTERLEAVED);
+}
+
+/* the end of the last sample of the channel in bits */
+static size_t snoop_zero_copy_channel_end(snd_pcm_t *spcm,
+					  const snd_pcm_channel_info_t *i)
+{
+	return i->first + (size_t)i->step * (spcm->buffer_size - 1) +
+	       spcm->sample_bits;
+}
+
+/*
+ * change the protection of our mapping of the slave ring, each mapping
+ * spans the samples of all channels sharing its addr
+ */
+static void snoop_zero_copy_protect(snd_pcm_direct_t *dsnoop, int prot)
+{
+	snd_pcm_t *spcm = dsnoop->spcm;
+	long page = sysconf(_SC_PAGESIZE);
+	unsigned int c, c1;
+
+	for (c = 0; c < spcm->channels; c++) {
+		snd_pcm_channel_info_t *i = &spcm->mmap_channels[c];
+		size_t size, end;
+
+		if (i->type != SND_PCM_AREA_MMAP || !i->addr)
+			continue;
+		for (c1 = 0; c1 < c; c1++) {
+			if (spcm->mmap_channels[c1].addr == i->addr)
+				break;
+		}
+		if (c1 < c)
+			continue;
+		size = snoop_zero_copy_channel_end(spcm, i);
+		for (c1 = c + 1; c1 < spcm->channels; c1++) {
+			if (spcm->mmap_channels[c1].addr != i->addr)
+				continue;
+			end = snoop_zero_copy_channel_end(spcm, &spcm->mmap_channels[c1]);
+			if (end > size)
+				size = end;
+		}
+		size = (size / 8 + page - 1) / page * page;
+		if (mprotect(i->addr, size, prot) < 0)
+			SYSMSG("mprotect failed");
+	}
+}
+
+/* the hardware overwrites the last slave period in place */
+static snd_pcm_uframes_t snoop_zero_copy_stop_threshold(snd_pcm_t *pcm,
+							snd_pcm_uframes_t stop_threshold)
+{
+	snd_pcm_direct_t *dsnoop = pcm->private_data;
+
+	if (stop_threshold > pcm->buffer_size - dsnoop->slave_period_size)
+		stop_threshold = pcm->buffer_size - dsnoop->slave_period_size;
+	return stop_threshold;
+}
@@ -31,6 +31,11 @@
 #include "bswap.h"
 #include <ctype.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #ifndef PIC
 /* entry for static linking */
@@ -54,6 +59,38 @@ typedef enum _snd_pcm_file_format {
 	SND_PCM_FILE_FORMAT_WAV
 } snd_pcm_file_format_t;
 
+/* the writer thread writes whole chunks of its ring, except when flushing */
+#define ASYNC_CHUNK	(64 * 1024)
+/* partial chunks are written after this many seconds without a whole one */
+#define ASYNC_TIMEOUT	1
+#define ASYNC_MAX_MB	1024
+#define MMAP_MAX_MB	1024
+
+#ifdef HAVE_LIBPTHREAD
+/*
+ * single producer, single consumer byte ring between the stream and the
+ * writer thread; head and tail count all bytes ever queued and written
+ */
+struct snd_pcm_file_async {
+	char *buf;
+	size_t size;
+	size_t head;		/* owned by the stream */
+	size_t tail;		/* owned by the writer */
+	size_t flush_pos;	/* write partial chunks up to here */
+	size_t max_fill;
+	size_t dropped;		/* bytes not queued because the ring was full */
+	int overrun;		/* the last bytes were dropped */
+	int err;		/* of the first failed write() */
+	int waiting;		/* the writer sleeps on cond */
+	int quit;
+	int running;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;	/* wakes the writer */
+	pthread_cond_t done;	/* the writer reached flush_pos */
+};
+#endif
+
 /* WAV format chunk */
 struct wav_fmt {
 	short fmt;
@@ -90,6 +127,19 @@ typedef struct {
 	struct wav_fmt wav_header;
 	size_t filelen;
 	char ifmmap_overwritten;
+	unsigned int async_mb;	/* ring size of the writer thread, 0 = none */
+	unsigned int mmap_mb;	/* mapped output window, 0 = write() */
+	unsigned int checkpoint;	/* seconds between WAV header updates */
+	int out_ready;		/* out_pos and the mapping are set up */
+	off_t out_pos;		/* file offset of the next output byte */
+	size_t checkpoint_bytes;
+	off_t checkpoint_pos;
+	size_t map_size;	/* of the window, 0 = write() */
+	char *map;
+	off_t map_off;
+#ifdef HAVE_LIBPTHREAD
+	struct snd_pcm_file_async async;
+#endif
 } snd_pcm_file_t;
 
 #if __BYTE_ORDER == __LITTLE_ENDIAN
@@ -115,6 +165,350 @@ static ssize_t safe_write(int fd, const void *buf, size_t len)
 	}
 }
 
+/* fix up the length fields in WAV header */
+static void fixup_wav_header(snd_pcm_file_t *file, size_t filelen)
+{
+	int len;
+
+	/* RIFF length */
+	len = (filelen + 0x24) > 0x7fffffff ?
+		0x7fffffff : (int)(filelen + 0x24);
+	len = TO_LE32(len);
+	if (pwrite(file->fd, &len, 4, 4) != 4)
+		return;
+	/* data length */
+	len = filelen > 0x7fffffff ?
+		0x7fffffff : (int)filelen;
+	len = TO_LE32(len);
+	pwrite(file->fd, &len, 4, 0x28);
+}
+
+/* reserve the disk blocks of the window at off, -EOPNOTSUPP when not possible */
+static int snd_pcm_file_preallocate(snd_pcm_file_t *file, off_t off)
+{
+#ifdef HAVE_FALLOCATE
+	if (fallocate(file->fd, 0, off, file->map_size) < 0)
+		return errno == ENOSYS ? -EOPNOTSUPP : -errno;
+	return 0;
+#else
+	(void)file;
+	(void)off;
+	return -EOPNOTSUPP;
+#endif
+}
+
+/* preallocate and map the window of the output file starting at pos */
+static int snd_pcm_file_map_window(snd_pcm_file_t *file, off_t pos)
+{
+	off_t off = pos - pos % page_size();
+	void *map;
+	int err;
+
+	if (file->map) {
+		munmap(file->map, file->map_size);
+		file->map = NULL;
+	}
+	err = snd_pcm_file_preallocate(file, off);
+	if (err < 0) {
+		if (err != -EOPNOTSUPP) {
+			SYSERR("%s preallocation failed", file->fname);
+			return err;
+		}
+		/*
+		 * a sparse mapping raises SIGBUS when the disk is full,
+		 * so go on with write() from pos
+		 */
+		SNDERR("%s cannot be preallocated, not mapping it",
+		       file->fname);
+		file->map_size = 0;
+		if (ftruncate(file->fd, pos) < 0 ||
+		    lseek(file->fd, pos, SEEK_SET) < 0) {
+			SYSERR("%s cannot be truncated", file->fname);
+			return -errno;
+		}
+		return 0;
+	}
+	map = mmap(NULL, file->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   file->fd, off);
+	if (map == MAP_FAILED) {
+		SYSERR("%s mmap failed", file->fname);
+		return -errno;
+	}
+	file->map = map;
+	file->map_off = off;
+	return 0;
+}
+
+static ssize_t snd_pcm_file_map_write(snd_pcm_file_t *file,
+				      const void *buf, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len) {
+		off_t pos = file->out_pos + done;
+		size_t n = len - done;
+		size_t ofs;
+
+		if (!file->map || pos < file->map_off ||
+		    pos >= file->map_off + (off_t)file->map_size) {
+			int err = snd_pcm_file_map_window(file, pos);
+			if (err < 0)
+				return done ? (ssize_t)done : err;
+			if (!file->map_size) {
+				ssize_t r = safe_write(file->fd,
+						       (const char *)buf + done,
+						       len - done);
+				if (r < 0)
+					return done ? (ssize_t)done : r;
+				return done + r;
+			}
+		}
+		ofs = pos - file->map_off;
+		if (n > file->map_size - ofs)
+			n = file->map_size - ofs;
+		memcpy(file->map + ofs, (const char *)buf + done, n);
+		done += n;
+	}
+	return done;
+}
+
+/* write to the output file, the mapped window or with write() */
+static ssize_t snd_pcm_file_sink(snd_pcm_file_t *file, const void *buf,
+				 size_t len)
+{
+	ssize_t r;
+
+	if (file->map_size)
+		r = snd_pcm_file_map_write(file, buf, len);
+	else
+		r = safe_write(file->fd, buf, len);
+	if (r <= 0)
+		return r;
+	file->out_pos += r;
+	if (file->checkpoint_bytes && file->wav_header.fmt &&
+	    file->out_pos >= file->checkpoint_pos) {
+		fixup_wav_header(file, file->out_pos - 0x2c);
+		file->checkpoint_pos = file->out_pos + file->checkpoint_bytes;
+	}
+	return r;
+}
+
+/* find the output position and set up the mapped window mode */
+static void snd_pcm_file_setup_output(snd_pcm_file_t *file)
+{
+	struct stat st;
+
+	file->out_pos = lseek(file->fd, 0, SEEK_CUR);
+	if (file->out_pos < 0)
+		file->out_pos = 0;
+	file->map_size = 0;
+	if (file->mmap_mb) {
+		if (fstat(file->fd, &st) < 0 || !S_ISREG(st.st_mode))
+			SNDERR("%s is not a regular file, not mapping it",
+			       file->fname);
+		else if ((fcntl(file->fd, F_GETFL) & O_ACCMODE) != O_RDWR)
+			SNDERR("%s is not open for reading, not mapping it",
+			       file->fname);
+		else
+			file->map_size = (size_t)file->mmap_mb << 20;
+	}
+	file->out_ready = 1;
+}
+
+/* cut the preallocated space behind the data */
+static void snd_pcm_file_unmap(snd_pcm_file_t *file)
+{
+	if (file->map) {
+		munmap(file->map, file->map_size);
+		file->map = NULL;
+	}
+	if (file->map_size && ftruncate(file->fd, file->out_pos) < 0)
+		SYSERR("%s truncate failed", file->fname);
+	file->map_size = 0;
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void *snd_pcm_file_writer(void *arg)
+{
+	snd_pcm_file_t *file = arg;
+	struct snd_pcm_file_async *a = &file->async;
+	int partial = 0;
+
+	pthread_mutex_lock(&a->mutex);
+	for (;;) {
+		size_t head = __atomic_load_n(&a->head, __ATOMIC_ACQUIRE);
+		size_t off = a->tail % a->size;
+		size_t n = head - a->tail;
+		ssize_t r;
+
+		if ((ssize_t)(a->flush_pos - a->tail) <= 0 && !partial) {
+			pthread_cond_broadcast(&a->done);
+			if (a->quit && n == 0)
+				break;
+		}
+		if (n > a->size - off)
+			n = a->size - off;
+		if (!partial && !a->quit &&
+		    (ssize_t)(a->flush_pos - a->tail) <= 0) {
+			/* only up to the last chunk boundary */
+			size_t end = (off + n) & ~(size_t)(ASYNC_CHUNK - 1);
+			n = end > off ? end - off : 0;
+		}
+		if (n == 0) {
+			struct timespec ts;
+
+			partial = 0;
+			__atomic_store_n(&a->waiting, 1, __ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&a->head, __ATOMIC_SEQ_CST) == head &&
+			    !a->quit && (ssize_t)(a->flush_pos - a->tail) <= 0) {
+				clock_gettime(CLOCK_REALTIME, &ts);
+				ts.tv_sec += ASYNC_TIMEOUT;
+				if (pthread_cond_timedwait(&a->cond, &a->mutex,
+							   &ts) == ETIMEDOUT)
+					partial = head != a->tail;
+			}
+			__atomic_store_n(&a->waiting, 0, __ATOMIC_RELAXED);
+			continue;
+		}
+		pthread_mutex_unlock(&a->mutex);
+		r = snd_pcm_file_sink(file, a->buf + off, n);
+		pthread_mutex_lock(&a->mutex);
+		if (r <= 0) {
+			SYSERR("%s write failed, file data may be corrupt",
+			       file->fname);
+			if (r == 0)
+				r = -EIO;
+			__atomic_store_n(&a->err, (int)r, __ATOMIC_RELAXED);
+			/* discard everything, the stream fails from now on */
+			r = head - a->tail;
+		}
+		__atomic_store_n(&a->tail, a->tail + r, __ATOMIC_RELEASE);
+		if ((ssize_t)(head - a->tail) <= 0)
+			partial = 0;
+	}
+	pthread_mutex_unlock(&a->mutex);
+	return NULL;
+}
+
+static int snd_pcm_file_async_start(snd_pcm_file_t *file)
+{
+	struct snd_pcm_file_async *a = &file->async;
+	int err;
+
+	a->size = (size_t)file->async_mb << 20;
+	err = posix_memalign((void **)&a->buf, ASYNC_CHUNK, a->size);
+	if (err) {
+		a->buf = NULL;
+		return -err;
+	}
+	a->head = a->tail = a->flush_pos = 0;
+	a->max_fill = a->dropped = 0;
+	a->overrun = a->err = a->waiting = a->quit = 0;
+	pthread_mutex_init(&a->mutex, NULL);
+	pthread_cond_init(&a->cond, NULL);
+	pthread_cond_init(&a->done, NULL);
+	err = pthread_create(&a->thread, NULL, snd_pcm_file_writer, file);
+	if (err) {
+		pthread_cond_destroy(&a->cond);
+		pthread_cond_destroy(&a->done);
+		pthread_mutex_destroy(&a->mutex);
+		free(a->buf);
+		a->buf = NULL;
+		return -err;
+	}
+	a->running = 1;
+	return 0;
+}
+
+/* write everything queued and stop the writer */
+static void snd_pcm_file_async_stop(snd_pcm_file_t *file)
+{
+	struct snd_pcm_file_async *a = &file->async;
+
+	if (!a->running)
+		return;
+	pthread_mutex_lock(&a->mutex);
+	a->quit = 1;
+	pthread_cond_signal(&a->cond);
+	pthread_mutex_unlock(&a->mutex);
+	pthread_join(a->thread, NULL);
+	pthread_cond_destroy(&a->cond);
+	pthread_cond_destroy(&a->done);
+	pthread_mutex_destroy(&a->mutex);
+	free(a->buf);
+	a->buf = NULL;
+	a->running = 0;
+}
+
+/* have the writer write the partial chunk too, optionally wait for it */
+static void snd_pcm_file_async_flush(snd_pcm_file_t *file, int wait)
+{
+	struct snd_pcm_file_async *a = &file->async;
+
+	if (!a->running)
+		return;
+	pthread_mutex_lock(&a->mutex);
+	a->flush_pos = a->head;
+	pthread_cond_signal(&a->cond);
+	while (wait && (ssize_t)(a->flush_pos - a->tail) > 0)
+		pthread_cond_wait(&a->done, &a->mutex);
+	pthread_mutex_unlock(&a->mutex);
+}
+
+/*
+ * queue the bytes for the writer, never blocks; when the ring is full
+ * they are dropped and counted
+ */
+static ssize_t snd_pcm_file_async_push(snd_pcm_file_t *file,
+				       const void *buf, size_t len)
+{
+	struct snd_pcm_file_async *a = &file->async;
+	size_t head = a->head;
+	size_t fill = head - __atomic_load_n(&a->tail, __ATOMIC_ACQUIRE);
+	size_t off = head % a->size;
+	size_t n = a->size - off;
+	int err = __atomic_load_n(&a->err, __ATOMIC_RELAXED);
+
+	if (err < 0)
+		return err;
+	if (fill + len > a->size) {
+		if (!a->overrun)
+			SNDERR("%s writer ring overrun, file data dropped",
+			       file->fname);
+		a->overrun = 1;
+		a->dropped += len;
+		return len;
+	}
+	a->overrun = 0;
+	if (n > len)
+		n = len;
+	memcpy(a->buf + off, buf, n);
+	memcpy(a->buf, (const char *)buf + n, len - n);
+	__atomic_store_n(&a->head, head + len, __ATOMIC_SEQ_CST);
+	if (fill + len > a->max_fill)
+		a->max_fill = fill + len;
+	/* wake the writer when a chunk is complete */
+	if (head / ASYNC_CHUNK != (head + len) / ASYNC_CHUNK &&
+	    __atomic_load_n(&a->waiting, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&a->mutex);
+		pthread_cond_signal(&a->cond);
+		pthread_mutex_unlock(&a->mutex);
+	}
+	return len;
+}
+#endif /* HAVE_LIBPTHREAD */
+
+/* write to the output file, or queue for the writer thread */
+static ssize_t snd_pcm_file_out(snd_pcm_file_t *file, const void *buf,
+				size_t len)
+{
+#ifdef HAVE_LIBPTHREAD
+	if (file->async.running)
+		return snd_pcm_file_async_push(file, buf, len);
+#endif
+	return snd_pcm_file_sink(file, buf, len);
+}
+
 static int snd_pcm_file_append_value(char **string_p, char **index_ch_p,
 		int *len_p, const char *value)
 {
@@ -224,6 +618,8 @@ static int snd_pcm_file_replace_fname(snd_pcm_file_t *file, char **new_fname_p)
 
 static int snd_pcm_file_open_output_file(snd_pcm_file_t *file)
 {
+	/* the mapping needs read access too */
+	int mode = file->mmap_mb ? O_RDWR : O_WRONLY;
 	int err, fd;
 
 	/* fname can contain keys, generating final_fname */
@@ -248,10 +644,10 @@ static int snd_pcm_file_open_output_file(snd_pcm_file_t *file)
 	} else {
 		file->pipe = NULL;
 		if (file->trunc)
-			fd = open(file->final_fname, O_WRONLY|O_CREAT|O_TRUNC,
+			fd = open(file->final_fname, mode|O_CREAT|O_TRUNC,
 					file->perm);
 		else {
-			fd = open(file->final_fname, O_WRONLY|O_CREAT|O_EXCL,
+			fd = open(file->final_fname, mode|O_CREAT|O_EXCL,
 					file->perm);
 			if (fd < 0) {
 				char *tmpfname = NULL;
@@ -265,7 +661,7 @@ static int snd_pcm_file_open_output_file(snd_pcm_file_t *file)
 						"%s.%04d", file->final_fname,
 						idx);
 					fd = open(tmpfname,
-							O_WRONLY|O_CREAT|O_EXCL,
+							mode|O_CREAT|O_EXCL,
 							file->perm);
 					if (fd >= 0) {
 						free(file->final_fname);
@@ -354,15 +750,15 @@ static int write_wav_header(snd_pcm_t *pcm)
 	
 	setup_wav_header(pcm, &file->wav_header);
 
-	res = safe_write(file->fd, header, sizeof(header));
+	res = snd_pcm_file_out(file, header, sizeof(header));
 	if (res != sizeof(header))
 		goto write_error;
 
-	res = safe_write(file->fd, &file->wav_header, sizeof(file->wav_header));
+	res = snd_pcm_file_out(file, &file->wav_header, sizeof(file->wav_header));
 	if (res != sizeof(file->wav_header))
 		goto write_error;
 
-	res = safe_write(file->fd, header2, sizeof(header2));
+	res = snd_pcm_file_out(file, header2, sizeof(header2));
 	if (res != sizeof(header2))
 		goto write_error;
 
@@ -385,31 +781,6 @@ write_error:
 	return -EIO;
 }
 
-/* fix up the length fields in WAV header */
-static void fixup_wav_header(snd_pcm_t *pcm)
-{
-	snd_pcm_file_t *file = pcm->private_data;
-	int len, ret;
-
-	/* RIFF length */
-	if (lseek(file->fd, 4, SEEK_SET) == 4) {
-		len = (file->filelen + 0x24) > 0x7fffffff ?
-			0x7fffffff : (int)(file->filelen + 0x24);
-		len = TO_LE32(len);
-		ret = safe_write(file->fd, &len, 4);
-		if (ret < 0)
-			return;
-	}
-	/* data length */
-	if (lseek(file->fd, 0x28, SEEK_SET) == 0x28) {
-		len = file->filelen > 0x7fffffff ?
-			0x7fffffff : (int)file->filelen;
-		len = TO_LE32(len);
-		ret = safe_write(file->fd, &len, 4);
-		if (ret < 0)
-			return;
-	}
-}
 #endif /* DOC_HIDDEN */
 
 
@@ -436,7 +807,7 @@ static int snd_pcm_file_write_bytes(snd_pcm_t *pcm, size_t bytes)
 		size_t cont = file->wbuf_size_bytes - file->file_ptr_bytes;
 		if (n > cont)
 			n = cont;
-		err = safe_write(file->fd, file->wbuf + file->file_ptr_bytes, n);
+		err = snd_pcm_file_out(file, file->wbuf + file->file_ptr_bytes, n);
 		if (err < 0) {
 			file->wbuf_used_bytes = 0;
 			file->file_ptr_bytes = 0;
@@ -492,9 +863,17 @@ static int snd_pcm_file_add_frames(snd_pcm_t *pcm,
 static int snd_pcm_file_close(snd_pcm_t *pcm)
 {
 	snd_pcm_file_t *file = pcm->private_data;
+#ifdef HAVE_LIBPTHREAD
+	snd_pcm_file_async_stop(file);
+#endif
+	snd_pcm_file_unmap(file);
 	if (file->fname) {
+		size_t filelen = file->filelen;
+#ifdef HAVE_LIBPTHREAD
+		filelen -= file->async.dropped;
+#endif
 		if (file->wav_header.fmt)
-			fixup_wav_header(pcm);
+			fixup_wav_header(file, filelen);
 		free((void *)file->fname);
 		if (file->pipe) {
 			pclose(file->pipe);
@@ -517,6 +896,9 @@ static int snd_pcm_file_reset(snd_pcm_t *pcm)
 		/* FIXME: Questionable here */
 		snd_pcm_file_write_bytes(pcm, file->wbuf_used_bytes);
 		assert(file->wbuf_used_bytes == 0);
+#ifdef HAVE_LIBPTHREAD
+		snd_pcm_file_async_flush(file, 0);
+#endif
 	}
 	return err;
 }
@@ -529,6 +911,9 @@ static int snd_pcm_file_drop(snd_pcm_t *pcm)
 		/* FIXME: Questionable here */
 		snd_pcm_file_write_bytes(pcm, file->wbuf_used_bytes);
 		assert(file->wbuf_used_bytes == 0);
+#ifdef HAVE_LIBPTHREAD
+		snd_pcm_file_async_flush(file, 0);
+#endif
 	}
 	return err;
 }
@@ -543,6 +928,9 @@ static int snd_pcm_file_drain(snd_pcm_t *pcm)
 		snd_pcm_file_write_bytes(pcm, file->wbuf_used_bytes);
 		assert(file->wbuf_used_bytes == 0);
 		__snd_pcm_unlock(pcm);
+#ifdef HAVE_LIBPTHREAD
+		snd_pcm_file_async_flush(file, 1);
+#endif
 	}
 	return err;
 }
@@ -795,6 +1183,26 @@ static int snd_pcm_file_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 			return err;
 		}
 	}
+	/*
+	 * set up once for the file, the writer thread uses the output
+	 * state from now on also when the parameters are set again
+	 */
+	if (!file->out_ready) {
+		snd_pcm_file_setup_output(file);
+		file->checkpoint_bytes = (size_t)file->checkpoint * slave->rate *
+			snd_pcm_frames_to_bytes(slave, 1);
+		file->checkpoint_pos = file->out_pos + file->checkpoint_bytes;
+	}
+#ifdef HAVE_LIBPTHREAD
+	if (file->async_mb && !file->async.running) {
+		err = snd_pcm_file_async_start(file);
+		if (err < 0) {
+			SNDERR("cannot start the writer thread for %s",
+			       file->fname);
+			return err;
+		}
+	}
+#endif
 
 	/* pointer may have changed - e.g if plug is used. */
 	snd_pcm_unlink_hw_ptr(pcm, file->gen.slave);
@@ -816,6 +1224,19 @@ static void snd_pcm_file_dump(snd_pcm_t *pcm, snd_output_t *out)
 	if (file->final_fname)
 		snd_output_printf(out, "Final file PCM (file=%s)\n",
 				file->final_fname);
+	if (file->map_size)
+		snd_output_printf(out, "Mapped window: %zu bytes at offset %lld\n",
+				  file->map_size, (long long)file->map_off);
+	if (file->checkpoint)
+		snd_output_printf(out, "WAV header checkpoint: %u s\n",
+				  file->checkpoint);
+#ifdef HAVE_LIBPTHREAD
+	if (file->async.running)
+		snd_output_printf(out, "Writer thread: ring %zu bytes, max fill %zu, %zu written, %zu dropped\n",
+				  file->async.size, file->async.max_fill,
+				  __atomic_load_n(&file->async.tail, __ATOMIC_ACQUIRE),
+				  file->async.dropped);
+#endif
 
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
@@ -875,31 +1296,12 @@ static const snd_pcm_fast_ops_t snd_pcm_file_fast_ops = {
 	.mmap_begin = snd_pcm_file_mmap_begin,
 };
 
-/**
- * \brief Creates a new File PCM
- * \param pcmp Returns created PCM handle
- * \param name Name of PCM
- * \param fname Output filename (or NULL if file descriptor fd is available)
- * \param fd Output file descriptor
- * \param ifname Input filename (or NULL if file descriptor ifd is available)
- * \param ifd Input file descriptor (if (ifd < 0) && (ifname == NULL), no input
- *            redirection will be performed)
- * \param trunc Truncate the file if it already exists
- * \param fmt File format ("raw" or "wav" are available)
- * \param perm File permission
- * \param slave Slave PCM handle
- * \param close_slave When set, the slave PCM handle is closed with copy PCM
- * \param stream the direction of PCM stream
- * \retval zero on success otherwise a negative error code
- * \warning Using of this function might be dangerous in the sense
- *          of compatibility reasons. The prototype might be freely
- *          changed in future.
- */
-int snd_pcm_file_open(snd_pcm_t **pcmp, const char *name,
-		      const char *fname, int fd, const char *ifname, int ifd,
-		      int trunc,
-		      const char *fmt, int perm, snd_pcm_t *slave, int close_slave,
-		      snd_pcm_stream_t stream)
+static int file_open(snd_pcm_t **pcmp, const char *name,
+		     const char *fname, int fd, const char *ifname, int ifd,
+		     int trunc, const char *fmt, int perm,
+		     unsigned int async_mb, unsigned int mmap_mb,
+		     unsigned int checkpoint,
+		     snd_pcm_t *slave, int close_slave, snd_pcm_stream_t stream)
 {
 	snd_pcm_t *pcm;
 	snd_pcm_file_t *file;
@@ -942,6 +1344,9 @@ int snd_pcm_file_open(snd_pcm_t **pcmp, const char *name,
 	file->fd = fd;
 	file->ifd = ifd;
 	file->format = format;
+	file->async_mb = async_mb;
+	file->mmap_mb = mmap_mb;
+	file->checkpoint = checkpoint;
 	file->gen.slave = slave;
 	file->gen.close_slave = close_slave;
 
@@ -970,6 +1375,36 @@ int snd_pcm_file_open(snd_pcm_t **pcmp, const char *name,
 	return 0;
 }
 
+/**
+ * \brief Creates a new File PCM
+ * \param pcmp Returns created PCM handle
+ * \param name Name of PCM
+ * \param fname Output filename (or NULL if file descriptor fd is available)
+ * \param fd Output file descriptor
+ * \param ifname Input filename (or NULL if file descriptor ifd is available)
+ * \param ifd Input file descriptor (if (ifd < 0) && (ifname == NULL), no input
+ *            redirection will be performed)
+ * \param trunc Truncate the file if it already exists
+ * \param fmt File format ("raw" or "wav" are available)
+ * \param perm File permission
+ * \param slave Slave PCM handle
+ * \param close_slave When set, the slave PCM handle is closed with copy PCM
+ * \param stream the direction of PCM stream
+ * \retval zero on success otherwise a negative error code
+ * \warning Using of this function might be dangerous in the sense
+ *          of compatibility reasons. The prototype might be freely
+ *          changed in future.
+ */
+int snd_pcm_file_open(snd_pcm_t **pcmp, const char *name,
+		      const char *fname, int fd, const char *ifname, int ifd,
+		      int trunc,
+		      const char *fmt, int perm, snd_pcm_t *slave, int close_slave,
+		      snd_pcm_stream_t stream)
+{
+	return file_open(pcmp, name, fname, fd, ifname, ifd, trunc, fmt, perm,
+			 0, 0, 0, slave, close_slave, stream);
+}
+
 /*! \page pcm_plugins
 
 \section pcm_plugins_file Plugin: File
@@ -1006,9 +1441,32 @@ pcm.name {
 	infile INT		# Input file descriptor number
 	[format STR]		# File format ("raw" or "wav")
 	[perm INT]		# Output file permission (octal, def. 0600)
+	[async_buffer INT]	# Writer thread ring size in MB (def. 0, none)
+	[mmap_window INT]	# Mapped output window size in MB (def. 0, none)
+	[checkpoint INT]	# Update the WAV header every INT seconds
+				# (def. 0, only when closing)
 }
 \endcode
 
+With async_buffer, the stream does not write the file itself.  The data
+is queued in a ring of the given size and a writer thread writes it in
+large chunks, so a slow disk or pipe does not stall the stream.  When
+the writer falls behind by more than the ring, the data that does not fit
+is dropped and reported, the stream goes on.  Drain waits for the writer,
+drop and reset only have it write the partial chunk.
+
+With mmap_window, a regular output file is written through a mapped
+window of the given size instead of write() calls.  The space of each
+window is preallocated before it is mapped, the window moves forward
+with the data and the file is cut to the data length when closing.
+Other outputs, and files on filesystems or systems which cannot
+preallocate (without fallocate()), are written with write().
+
+The length fields of the WAV header are set when closing the file.  With
+checkpoint, they are also updated after every INT seconds of data, so a
+recording interrupted by a crash stays readable up to the last
+checkpoint.
+
 \subsection pcm_plugins_file_funcref Function reference
 
 <UL>
@@ -1043,6 +1501,8 @@ int _snd_pcm_file_open(snd_pcm_t **pcmp, const char *name,
 	const char *format = NULL;
 	long fd = -1, ifd = -1, trunc = 1;
 	long perm = 0600;
+	long async_mb = 0;
+	long mmap_mb = 0, checkpoint = 0;
 	snd_config_for_each(i, next, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
 		const char *id;
@@ -1096,6 +1556,44 @@ int _snd_pcm_file_open(snd_pcm_t **pcmp, const char *name,
 			}
 			continue;
 		}
+		if (strcmp(id, "async_buffer") == 0) {
+			err = snd_config_get_integer(n, &async_mb);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return err;
+			}
+			if (async_mb < 0 || async_mb > ASYNC_MAX_MB) {
+				SNDERR("The field async_buffer must be 0-%d MB",
+				       ASYNC_MAX_MB);
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "mmap_window") == 0) {
+			err = snd_config_get_integer(n, &mmap_mb);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return err;
+			}
+			if (mmap_mb < 0 || mmap_mb > MMAP_MAX_MB) {
+				SNDERR("The field mmap_window must be 0-%d MB",
+				       MMAP_MAX_MB);
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "checkpoint") == 0) {
+			err = snd_config_get_integer(n, &checkpoint);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return err;
+			}
+			if (checkpoint < 0 || checkpoint > INT_MAX) {
+				SNDERR("The field checkpoint must not be negative");
+				return -EINVAL;
+			}
+			continue;
+		}
 		if (strcmp(id, "truncate") == 0) {
 			err = snd_config_get_bool(n);
 			if (err < 0)
@@ -1133,8 +1631,14 @@ int _snd_pcm_file_open(snd_pcm_t **pcmp, const char *name,
 	snd_config_delete(sconf);
 	if (err < 0)
 		return err;
-	err = snd_pcm_file_open(pcmp, name, fname, fd, ifname, ifd,
-				trunc, format, perm, spcm, 1, stream);
+#ifndef HAVE_LIBPTHREAD
+	if (async_mb) {
+		SNDERR("async_buffer needs thread support, writing synchronously");
+		async_mb = 0;
+	}
+#endif
+	err = file_open(pcmp, name, fname, fd, ifname, ifd, trunc, format,
+			perm, async_mb, mmap_mb, checkpoint, spcm, 1, stream);
 	if (err < 0)
 		snd_pcm_close(spcm);
 	return err;
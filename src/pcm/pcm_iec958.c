@@ -30,6 +30,7 @@
 #include "pcm_plugin.h"
 #include "plugin_ops.h"
 #include "bswap.h"
+#include "pcm_simd.h"
 
 #ifndef PIC
 /* entry for static linking */
@@ -50,6 +51,13 @@ typedef void (*iec958_f)(snd_pcm_iec958_t *iec,
 			 snd_pcm_uframes_t src_offset,
 			 unsigned int channels, snd_pcm_uframes_t frames);
 
+struct iec958_kernels {
+	void (*enc)(uint32_t *dst, const int32_t *src, const uint32_t *bits,
+		    unsigned int n, int swap);
+	void (*dec)(int32_t *dst, const uint32_t *src, unsigned int n,
+		    int swap);
+};
+
 struct snd_pcm_iec958 {
 	/* This field need to be the first */
 	snd_pcm_plugin_t plug;
@@ -59,34 +67,43 @@ struct snd_pcm_iec958 {
 	snd_pcm_format_t format;
 	unsigned int counter;
 	unsigned char status[24];
+	snd_pcm_format_t lformat;	/* format of the linear side */
 	unsigned int byteswap;
 	unsigned char preamble[3];	/* B/M/W or Z/X/Y */
 	snd_pcm_fast_ops_t fops;
 	int hdmi_mode;
+	/* channel status bit and preamble for each frame of a block,
+	 * [0] for the first channel (Z/X), [1] for the others (Y) */
+	uint32_t cs_bits[2][192];
+	const struct iec958_kernels *kernels;
 };
 
 enum { PREAMBLE_Z, PREAMBLE_X, PREAMBLE_Y };
 
 #endif /* DOC_HIDDEN */
 
+/* parity of a byte */
+#define P2(n)	n, n ^ 1, n ^ 1, n
+#define P4(n)	P2(n), P2(n ^ 1), P2(n ^ 1), P2(n)
+#define P6(n)	P4(n), P4(n ^ 1), P4(n ^ 1), P4(n)
+static const unsigned char iec958_parity_table[256] = {
+	P6(0), P6(1), P6(1), P6(0)
+};
+#undef P2
+#undef P4
+#undef P6
+
 /*
  * Determine parity for time slots 4 upto 30
  * to be sure that bit 4 upt 31 will carry
  * an even number of ones and zeros.
  */
-static unsigned int iec958_parity(unsigned int data)
+static inline unsigned int iec958_parity(uint32_t data)
 {
-	unsigned int parity;
-	int bit;
-
-	data >>= 4;     /* start from bit 4 */
-	parity = 0;
-	for (bit = 4; bit <= 30; bit++) {
-		if (data & 1)
-			parity++;
-		data >>= 1;
-	}
-	return (parity & 1);
+	data &= 0x7ffffff0;
+	data ^= data >> 16;
+	data ^= data >> 8;
+	return iec958_parity_table[data & 0xff];
 }
 
 /*
@@ -100,47 +117,106 @@ static unsigned int iec958_parity(unsigned int data)
  *     29   = user data (0)
  *     30   = channel status (24 bytes for 192 frames)
  *     31   = parity
+ *
+ * bits holds the channel status bit and the preamble, see
+ * iec958_setup_bits().
  */
-
-static inline uint32_t iec958_subframe(snd_pcm_iec958_t *iec, uint32_t data, int channel)
+static inline uint32_t iec958_subframe_bits(uint32_t data, uint32_t bits,
+					    int swap)
 {
-	unsigned int byte = iec->counter >> 3;
-	unsigned int mask = 1 << (iec->counter - (byte << 3));
-
 	/* bit 4-27 */
 	data >>= 4;
 	data &= ~0xf;
-
-	/* set IEC status bits (up to 192 bits) */
-	if (iec->status[byte] & mask)
-		data |= 0x40000000;
+	data |= bits;
 
 	if (iec958_parity(data))	/* parity bit 4-30 */
 		data |= 0x80000000;
 
-	/* Preamble */
-	if (channel)
-		data |= iec->preamble[PREAMBLE_Y];	/* odd sub frame, 'Y' */
-	else if (! iec->counter)
-		data |= iec->preamble[PREAMBLE_Z];	/* Block start, 'Z' */
-	else
-		data |= iec->preamble[PREAMBLE_X];	/* even sub frame, 'X' */
-
-	if (iec->byteswap)
+	if (swap)
 		data = bswap_32(data);
 
 	return data;
 }
 
-static inline int32_t iec958_to_s32(snd_pcm_iec958_t *iec, uint32_t data)
+static inline uint32_t iec958_subframe(snd_pcm_iec958_t *iec, uint32_t data, int channel)
+{
+	return iec958_subframe_bits(data, iec->cs_bits[channel != 0][iec->counter],
+				    iec->byteswap);
+}
+
+static inline int32_t iec958_sample(uint32_t data, int swap)
 {
-	if (iec->byteswap)
+	if (swap)
 		data = bswap_32(data);
 	data &= ~0xf;
 	data <<= 4;
 	return (int32_t)data;
 }
 
+static inline int32_t iec958_to_s32(snd_pcm_iec958_t *iec, uint32_t data)
+{
+	return iec958_sample(data, iec->byteswap);
+}
+
+/* the status bits (up to 192 bits) and the preambles of a block */
+static void iec958_setup_bits(snd_pcm_iec958_t *iec)
+{
+	unsigned int i;
+
+	for (i = 0; i < 192; i++) {
+		uint32_t cs = 0;
+
+		if (iec->status[i >> 3] & (1 << (i & 7)))
+			cs = 0x40000000;
+		if (i)
+			iec->cs_bits[0][i] = cs | iec->preamble[PREAMBLE_X];	/* even sub frame, 'X' */
+		else
+			iec->cs_bits[0][i] = cs | iec->preamble[PREAMBLE_Z];	/* Block start, 'Z' */
+		iec->cs_bits[1][i] = cs | iec->preamble[PREAMBLE_Y];	/* odd sub frame, 'Y' */
+	}
+}
+
+#ifdef PCM_SIMD
+#define SIMD_BYTES	16
+#define SIMD_ATTR
+#define SIMD_NAME(x)	simd_##x##_v128
+#include "pcm_iec958_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+
+#ifdef PCM_SIMD_AVX2
+#define SIMD_BYTES	32
+#define SIMD_ATTR	PCM_SIMD_AVX2_ATTR
+#define SIMD_NAME(x)	simd_##x##_avx2
+#include "pcm_iec958_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif
+#else
+#define SIMD_BYTES	0
+#define SIMD_ATTR
+#define SIMD_NAME(x)	generic_##x
+#include "pcm_iec958_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif /* PCM_SIMD */
+
+static const struct iec958_kernels *iec958_select_kernels(void)
+{
+#ifdef PCM_SIMD
+#ifdef PCM_SIMD_AVX2
+	if (snd_pcm_simd_features() & SND_PCM_SIMD_AVX2)
+		return &simd_iec958_kernels_avx2;
+#endif
+	return &simd_iec958_kernels_v128;
+#else
+	return &generic_iec958_kernels;
+#endif
+}
+
 #ifndef DOC_HIDDEN
 static void snd_pcm_iec958_decode(snd_pcm_iec958_t *iec,
 				  const snd_pcm_channel_area_t *dst_areas,
@@ -233,6 +309,118 @@ static void snd_pcm_iec958_encode(snd_pcm_iec958_t *iec,
 			iec->counter = (counter + frames * counter_step) % 192;
 	}
 }
+
+/*
+ * The S16 and S32 cases go through the kernels in runs of one channel up
+ * to the end of the status block; strided samples are gathered first.
+ */
+static void snd_pcm_iec958_decode_fast(snd_pcm_iec958_t *iec,
+				       const snd_pcm_channel_area_t *dst_areas,
+				       snd_pcm_uframes_t dst_offset,
+				       const snd_pcm_channel_area_t *src_areas,
+				       snd_pcm_uframes_t src_offset,
+				       unsigned int channels, snd_pcm_uframes_t frames)
+{
+	int32_t sbuf[192], dbuf[192];
+	unsigned int channel, i;
+
+	for (channel = 0; channel < channels; ++channel) {
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		const uint32_t *src = snd_pcm_channel_area_addr(src_area, src_offset);
+		char *dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		int src_step = snd_pcm_channel_area_step(src_area) / sizeof(uint32_t);
+		int dst_step = snd_pcm_channel_area_step(dst_area);
+		snd_pcm_uframes_t frames1 = frames;
+
+		while (frames1 > 0) {
+			unsigned int n = frames1 > 192 ? 192 : frames1;
+			const uint32_t *s = src;
+			int32_t *d = dbuf;
+
+			if (src_step != 1) {
+				for (i = 0; i < n; i++)
+					sbuf[i] = src[i * src_step];
+				s = (const uint32_t *)sbuf;
+			}
+			if (iec->lformat == SND_PCM_FORMAT_S32 &&
+			    dst_step == sizeof(int32_t))
+				d = (int32_t *)dst;
+			iec->kernels->dec(d, s, n, iec->byteswap);
+			if (iec->lformat == SND_PCM_FORMAT_S16) {
+				for (i = 0; i < n; i++)
+					*(int16_t *)(dst + i * dst_step) = dbuf[i] >> 16;
+			} else if (d == dbuf) {
+				for (i = 0; i < n; i++)
+					*(int32_t *)(dst + i * dst_step) = dbuf[i];
+			}
+			src += n * src_step;
+			dst += n * dst_step;
+			frames1 -= n;
+		}
+	}
+}
+
+static void snd_pcm_iec958_encode_fast(snd_pcm_iec958_t *iec,
+				       const snd_pcm_channel_area_t *dst_areas,
+				       snd_pcm_uframes_t dst_offset,
+				       const snd_pcm_channel_area_t *src_areas,
+				       snd_pcm_uframes_t src_offset,
+				       unsigned int channels, snd_pcm_uframes_t frames)
+{
+	int32_t sbuf[192];
+	uint32_t dbuf[192];
+	unsigned int channel, i;
+
+	/* the HDMI single stream layout steps the counter per frame pair */
+	if (iec->hdmi_mode && (iec->status[0] & IEC958_AES0_NONAUDIO) &&
+	    channels == 8) {
+		snd_pcm_iec958_encode(iec, dst_areas, dst_offset,
+				      src_areas, src_offset, channels, frames);
+		return;
+	}
+	for (channel = 0; channel < channels; ++channel) {
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		const char *src = snd_pcm_channel_area_addr(src_area, src_offset);
+		uint32_t *dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		int src_step = snd_pcm_channel_area_step(src_area);
+		int dst_step = snd_pcm_channel_area_step(dst_area) / sizeof(uint32_t);
+		const uint32_t *bits = iec->cs_bits[channel != 0];
+		unsigned int pos = iec->counter;
+		snd_pcm_uframes_t frames1 = frames;
+
+		while (frames1 > 0) {
+			unsigned int n = 192 - pos;
+			const int32_t *s = sbuf;
+			uint32_t *d = dbuf;
+
+			if (n > frames1)
+				n = frames1;
+			if (iec->lformat == SND_PCM_FORMAT_S16) {
+				for (i = 0; i < n; i++)
+					sbuf[i] = (uint32_t)(uint16_t)*(const int16_t *)(src + i * src_step) << 16;
+			} else if (src_step == sizeof(int32_t)) {
+				s = (const int32_t *)src;
+			} else {
+				for (i = 0; i < n; i++)
+					sbuf[i] = *(const int32_t *)(src + i * src_step);
+			}
+			if (dst_step == 1)
+				d = dst;
+			iec->kernels->enc(d, s, bits + pos, n, iec->byteswap);
+			if (d == dbuf) {
+				for (i = 0; i < n; i++)
+					dst[i * dst_step] = dbuf[i];
+			}
+			src += n * src_step;
+			dst += n * dst_step;
+			frames1 -= n;
+			pos = (pos + n) % 192;
+		}
+	}
+	iec->counter = (iec->counter + frames) % 192;
+}
 #endif /* DOC_HIDDEN */
 
 static int snd_pcm_iec958_hw_refine_cprepare(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
@@ -346,10 +534,12 @@ static int snd_pcm_iec958_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params
 		    iec->sformat == SND_PCM_FORMAT_IEC958_SUBFRAME_BE) {
 			iec->getput_idx = snd_pcm_linear_get_index(format, SND_PCM_FORMAT_S32);
 			iec->func = snd_pcm_iec958_encode;
+			iec->lformat = format;
 			iec->byteswap = iec->sformat != SND_PCM_FORMAT_IEC958_SUBFRAME;
 		} else {
 			iec->getput_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, iec->sformat);
 			iec->func = snd_pcm_iec958_decode;
+			iec->lformat = iec->sformat;
 			iec->byteswap = format != SND_PCM_FORMAT_IEC958_SUBFRAME;
 		}
 	} else {
@@ -357,13 +547,22 @@ static int snd_pcm_iec958_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params
 		    iec->sformat == SND_PCM_FORMAT_IEC958_SUBFRAME_BE) {
 			iec->getput_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, format);
 			iec->func = snd_pcm_iec958_decode;
+			iec->lformat = format;
 			iec->byteswap = iec->sformat != SND_PCM_FORMAT_IEC958_SUBFRAME;
 		} else {
 			iec->getput_idx = snd_pcm_linear_get_index(iec->sformat, SND_PCM_FORMAT_S32);
 			iec->func = snd_pcm_iec958_encode;
+			iec->lformat = iec->sformat;
 			iec->byteswap = format != SND_PCM_FORMAT_IEC958_SUBFRAME;
 		}
 	}
+	if (iec->lformat == SND_PCM_FORMAT_S16 ||
+	    iec->lformat == SND_PCM_FORMAT_S32) {
+		if (iec->func == snd_pcm_iec958_encode)
+			iec->func = snd_pcm_iec958_encode_fast;
+		else
+			iec->func = snd_pcm_iec958_decode_fast;
+	}
 
 	if ((iec->status[0] & IEC958_AES0_PROFESSIONAL) == 0) {
 		if ((iec->status[3] & IEC958_AES3_CON_FS) == IEC958_AES3_CON_FS_NOTID) {
@@ -438,6 +637,7 @@ static int snd_pcm_iec958_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params
 			iec->status[4] |= ws;
 		}
 	}
+	iec958_setup_bits(iec);
 	return 0;
 }
 
@@ -605,6 +805,8 @@ int snd_pcm_iec958_open(snd_pcm_t **pcmp, const char *name, snd_pcm_format_t sfo
 	memcpy(iec->preamble, preamble_vals, 3);
 
 	iec->hdmi_mode = hdmi_mode;
+	iec958_setup_bits(iec);
+	iec->kernels = iec958_select_kernels();
 
 	err = snd_pcm_new(&pcm, SND_PCM_TYPE_IEC958, name, slave->stream, slave->mode);
 	if (err < 0) {
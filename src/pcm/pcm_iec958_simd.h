@@ -0,0 +1,104 @@
+/**
+ * \file pcm/pcm_iec958_simd.h
+ * \ingroup PCM_Plugins
+ * \brief PCM IEC958 Subframe Conversion Plugin Interface - subframe kernels
+ */
+/*
+ *  PCM - IEC958 Subframe Conversion Plugin
+ *
+ *  This file is included from pcm_iec958.c several times, with
+ *  SIMD_BYTES (vector size, 0 for plain C), SIMD_ATTR (function
+ *  attributes) and SIMD_NAME() (symbol suffix) defined.
+ *
+ *  The kernels work on a run of contiguous S32 samples of one channel.
+ *  The encoder takes the channel status bit and the preamble of each
+ *  subframe from bits[], the parity is folded in the lanes.  The results
+ *  are identical to iec958_subframe() and iec958_to_s32().
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#if SIMD_BYTES
+typedef uint32_t SIMD_NAME(vu32) __attribute__((vector_size(SIMD_BYTES)));
+
+/* 32-bit lanes in one vector */
+#define LANES		(SIMD_BYTES / 4)
+
+static inline __attribute__((always_inline)) SIMD_ATTR
+SIMD_NAME(vu32) SIMD_NAME(bswap)(SIMD_NAME(vu32) x)
+{
+	return (x << 24) | ((x & 0xff00) << 8) | ((x >> 8) & 0xff00) | (x >> 24);
+}
+#endif
+
+static SIMD_ATTR
+void SIMD_NAME(iec958_enc)(uint32_t *dst, const int32_t *src,
+			   const uint32_t *bits, unsigned int n, int swap)
+{
+	unsigned int i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(vu32) d, b, p;
+
+	for (; i + LANES <= n; i += LANES) {
+		simd_load(d, src + i);
+		simd_load(b, bits + i);
+		d = ((d >> 4) & ~0xfU) | b;
+		/* parity of the time slots 4 to 30 into bit 0 */
+		p = d & 0x7ffffff0;
+		p ^= p >> 16;
+		p ^= p >> 8;
+		p ^= p >> 4;
+		p ^= p >> 2;
+		p ^= p >> 1;
+		d |= p << 31;
+		if (swap)
+			d = SIMD_NAME(bswap)(d);
+		simd_store(dst + i, d);
+	}
+#endif
+	for (; i < n; i++)
+		dst[i] = iec958_subframe_bits((uint32_t)src[i], bits[i], swap);
+}
+
+static SIMD_ATTR
+void SIMD_NAME(iec958_dec)(int32_t *dst, const uint32_t *src,
+			   unsigned int n, int swap)
+{
+	unsigned int i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(vu32) d;
+
+	for (; i + LANES <= n; i += LANES) {
+		simd_load(d, src + i);
+		if (swap)
+			d = SIMD_NAME(bswap)(d);
+		d = (d & ~0xfU) << 4;
+		simd_store(dst + i, d);
+	}
+#endif
+	for (; i < n; i++)
+		dst[i] = iec958_sample(src[i], swap);
+}
+
+static const struct iec958_kernels SIMD_NAME(iec958_kernels) = {
+	.enc = SIMD_NAME(iec958_enc),
+	.dec = SIMD_NAME(iec958_dec),
+};
+
+#if SIMD_BYTES
+#undef LANES
+#endif
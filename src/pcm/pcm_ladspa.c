@@ -34,9 +34,11 @@
   
 #include "pcm_local.h"
 #include "pcm_plugin.h"
+#include "pcm_workers.h"
 #include <dirent.h>
 #include <locale.h>
 #include <math.h>
+#include <sys/stat.h>
 
 #include "ladspa.h"
 
@@ -49,12 +51,44 @@ const char *_snd_module_pcm_ladspa = "";
 
 #define NO_ASSIGN	0xffffffff
 
+#define SND_PCM_LADSPA_MAX_THREADS	64
+#define SND_PCM_LADSPA_MAX_BLOCK	65536
+
 typedef enum _snd_pcm_ladspa_policy {
 	SND_PCM_LADSPA_POLICY_NONE,		/* use bindings only */
 	SND_PCM_LADSPA_POLICY_DUPLICATE		/* duplicate bindings for all channels */
 } snd_pcm_ladspa_policy_t;
 
+/*
+ * The execution graph: the stages run one after the other, the chains of
+ * a stage are independent and may run in parallel, the instances of a
+ * chain run in order.  Consecutive plugins with the duplicate policy form
+ * one stage with a chain per channel, any other plugin is a stage with
+ * a single chain.
+ */
+typedef struct {
+	unsigned int count;
+	struct snd_pcm_ladspa_instance **instances;
+} snd_pcm_ladspa_chain_t;
+
+typedef struct {
+	int parallel;				/* chains are per channel */
+	unsigned int chains_count;
+	snd_pcm_ladspa_chain_t *chains;
+} snd_pcm_ladspa_stage_t;
+
+/* one run of the graph */
 typedef struct {
+	const snd_pcm_channel_area_t *in_areas;
+	snd_pcm_uframes_t in_offset;
+	const snd_pcm_channel_area_t *out_areas;
+	snd_pcm_uframes_t out_offset;
+	unsigned long size;
+} snd_pcm_ladspa_job_t;
+
+typedef struct snd_pcm_ladspa snd_pcm_ladspa_t;
+
+struct snd_pcm_ladspa {
 	/* This field need to be the first */
 	snd_pcm_plugin_t plug;
 	/* Plugin custom fields */
@@ -63,7 +97,18 @@ typedef struct {
 	unsigned int channels;			/* forced input channels, 0 = auto */
 	unsigned int allocated;			/* count of allocated samples */
 	LADSPA_Data *zero[2];			/* zero input or dummy output */
-} snd_pcm_ladspa_t;
+	unsigned int stages_count;
+	snd_pcm_ladspa_stage_t *stages;
+	unsigned int block;			/* frames per run, 0 = any */
+	unsigned int threads;			/* count of worker threads */
+#ifdef HAVE_LIBPTHREAD
+	/* worker threads running the chains of parallel stages */
+	snd_pcm_workers_t *workers;
+	snd_pcm_ladspa_stage_t *stage;
+	const snd_pcm_ladspa_job_t *job;
+	unsigned int next_chain;		/* next chain to take, atomic */
+#endif
+};
  
 typedef struct {
         unsigned int size;
@@ -192,10 +237,30 @@ static void snd_pcm_ladspa_free_plugins(struct list_head *plugins)
 	}
 }
 
+static void snd_pcm_ladspa_free_graph(snd_pcm_ladspa_t *ladspa)
+{
+	unsigned int idx, chain;
+
+	for (idx = 0; idx < ladspa->stages_count; idx++) {
+		snd_pcm_ladspa_stage_t *stage = &ladspa->stages[idx];
+		for (chain = 0; chain < stage->chains_count; chain++)
+			free(stage->chains[chain].instances);
+		free(stage->chains);
+	}
+	free(ladspa->stages);
+	ladspa->stages = NULL;
+	ladspa->stages_count = 0;
+}
+
 static void snd_pcm_ladspa_free(snd_pcm_ladspa_t *ladspa)
 {
         unsigned int idx;
 
+#ifdef HAVE_LIBPTHREAD
+	snd_pcm_workers_stop(ladspa->workers);
+	ladspa->workers = NULL;
+#endif
+	snd_pcm_ladspa_free_graph(ladspa);
 	snd_pcm_ladspa_free_plugins(&ladspa->pplugins);
 	snd_pcm_ladspa_free_plugins(&ladspa->cplugins);
 	for (idx = 0; idx < 2; idx++) {
@@ -205,6 +270,113 @@ static void snd_pcm_ladspa_free(snd_pcm_ladspa_t *ladspa)
         ladspa->allocated = 0;
 }
 
+/* connect the audio ports of the instance and run it */
+static void snd_pcm_ladspa_run_instance(snd_pcm_ladspa_instance_t *instance,
+					const snd_pcm_ladspa_job_t *job)
+{
+	LADSPA_Data *data;
+	unsigned int idx, chn;
+
+	for (idx = 0; idx < instance->input.channels.size; idx++) {
+		chn = instance->input.channels.array[idx];
+		data = instance->input.data[idx];
+		if (data == NULL)
+			data = snd_pcm_channel_area_addr(&job->in_areas[chn],
+							 job->in_offset);
+		instance->desc->connect_port(instance->handle, instance->input.ports.array[idx], data);
+	}
+	for (idx = 0; idx < instance->output.channels.size; idx++) {
+		chn = instance->output.channels.array[idx];
+		data = instance->output.data[idx];
+		if (data == NULL)
+			data = snd_pcm_channel_area_addr(&job->out_areas[chn],
+							 job->out_offset);
+		instance->desc->connect_port(instance->handle, instance->output.ports.array[idx], data);
+	}
+	instance->desc->run(instance->handle, job->size);
+}
+
+static void snd_pcm_ladspa_run_chain(snd_pcm_ladspa_chain_t *chain,
+				     const snd_pcm_ladspa_job_t *job)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < chain->count; idx++)
+		snd_pcm_ladspa_run_instance(chain->instances[idx], job);
+}
+
+#ifdef HAVE_LIBPTHREAD
+/* take the chains of the current stage until none is left */
+static void snd_pcm_ladspa_take_chains(void *private_data,
+				       unsigned int idx ATTRIBUTE_UNUSED)
+{
+	snd_pcm_ladspa_t *ladspa = private_data;
+	snd_pcm_ladspa_stage_t *stage = ladspa->stage;
+	unsigned int chain;
+
+	for (;;) {
+		chain = __atomic_fetch_add(&ladspa->next_chain, 1, __ATOMIC_RELAXED);
+		if (chain >= stage->chains_count)
+			break;
+		snd_pcm_ladspa_run_chain(&stage->chains[chain], ladspa->job);
+	}
+}
+#endif /* HAVE_LIBPTHREAD */
+
+/* run the chains of a stage, in parallel with the worker threads */
+static void snd_pcm_ladspa_run_stage(snd_pcm_ladspa_t *ladspa,
+				     snd_pcm_ladspa_stage_t *stage,
+				     const snd_pcm_ladspa_job_t *job)
+{
+	unsigned int chain;
+
+#ifdef HAVE_LIBPTHREAD
+	if (ladspa->workers && stage->chains_count > 1) {
+		ladspa->stage = stage;
+		ladspa->job = job;
+		ladspa->next_chain = 0;
+		snd_pcm_workers_run(ladspa->workers, snd_pcm_ladspa_take_chains,
+				    ladspa);
+		return;
+	}
+#endif
+	for (chain = 0; chain < stage->chains_count; chain++)
+		snd_pcm_ladspa_run_chain(&stage->chains[chain], job);
+}
+
+static void snd_pcm_ladspa_run_graph(snd_pcm_ladspa_t *ladspa,
+				     const snd_pcm_ladspa_job_t *job)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < ladspa->stages_count; idx++)
+		snd_pcm_ladspa_run_stage(ladspa, &ladspa->stages[idx], job);
+}
+
+static void snd_pcm_ladspa_process(snd_pcm_ladspa_t *ladspa,
+				   const snd_pcm_channel_area_t *in_areas,
+				   snd_pcm_uframes_t in_offset,
+				   const snd_pcm_channel_area_t *out_areas,
+				   snd_pcm_uframes_t out_offset,
+				   snd_pcm_uframes_t size)
+{
+	snd_pcm_ladspa_job_t job;
+	snd_pcm_uframes_t block;
+
+	block = ladspa->block ? ladspa->block : ladspa->allocated;
+	job.in_areas = in_areas;
+	job.out_areas = out_areas;
+	while (size > 0) {
+		job.size = size < block ? size : block;
+		job.in_offset = in_offset;
+		job.out_offset = out_offset;
+		snd_pcm_ladspa_run_graph(ladspa, &job);
+		in_offset += job.size;
+		out_offset += job.size;
+		size -= job.size;
+	}
+}
+
 static int snd_pcm_ladspa_close(snd_pcm_t *pcm)
 {
 	snd_pcm_ladspa_t *ladspa = pcm->private_data;
@@ -695,6 +867,8 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
         ladspa->allocated = 2048;
         if (pcm->buffer_size > ladspa->allocated)
                 ladspa->allocated = pcm->buffer_size;
+        if (ladspa->block > ladspa->allocated)
+                ladspa->allocated = ladspa->block;
         if (pcm->stream == SND_PCM_STREAM_PLAYBACK) {
                 ichannels = pcm->channels;
                 ochannels = ladspa->plug.gen.slave->channels;
@@ -732,6 +906,7 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
                                 for (idx = channels; idx < nchannels; idx++)
                                         npchannels[idx] = NULL;
                                 pchannels = npchannels;
+                                channels = nchannels;
                         }
                         assert(instance->input.data == NULL);
                         assert(instance->input.m_data == NULL);
@@ -787,6 +962,9 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
                         for (idx = 0; idx < instance->output.channels.size; idx++) {
         			chn = instance->output.channels.array[idx];
                                 if (instance->output.data[idx] == pchannels[chn]) {
+					/* parallel chains cannot share the dummy area */
+					if (chn >= ochannels && ladspa->threads)
+						continue;
 					free(instance->output.m_data[idx]);
 					instance->output.m_data[idx] = NULL;
                                         if (chn < ochannels) {
@@ -820,11 +998,72 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
 	return 0;
 }
 
+static int snd_pcm_ladspa_add_to_chain(snd_pcm_ladspa_chain_t *chain,
+				       snd_pcm_ladspa_instance_t *instance)
+{
+	snd_pcm_ladspa_instance_t **instances;
+
+	instances = realloc(chain->instances, (chain->count + 1) * sizeof(*instances));
+	if (instances == NULL)
+		return -ENOMEM;
+	instances[chain->count++] = instance;
+	chain->instances = instances;
+	return 0;
+}
+
+/* group the instances to the stages and chains of the execution graph */
+static int snd_pcm_ladspa_build_graph(snd_pcm_t *pcm, snd_pcm_ladspa_t *ladspa)
+{
+	struct list_head *list, *pos, *pos1;
+	snd_pcm_ladspa_stage_t *stage = NULL, *nstages;
+	snd_pcm_ladspa_instance_t *instance;
+	unsigned int idx;
+	int parallel, err;
+
+	list = pcm->stream == SND_PCM_STREAM_PLAYBACK ? &ladspa->pplugins : &ladspa->cplugins;
+	list_for_each(pos, list) {
+		snd_pcm_ladspa_plugin_t *plugin = list_entry(pos, snd_pcm_ladspa_plugin_t, list);
+		parallel = plugin->policy == SND_PCM_LADSPA_POLICY_DUPLICATE;
+		if (stage == NULL || !parallel || !stage->parallel) {
+			nstages = realloc(ladspa->stages, (ladspa->stages_count + 1) * sizeof(*nstages));
+			if (nstages == NULL)
+				return -ENOMEM;
+			ladspa->stages = nstages;
+			stage = &ladspa->stages[ladspa->stages_count++];
+			stage->parallel = parallel;
+			stage->chains_count = 0;
+			stage->chains = NULL;
+		}
+		idx = 0;
+		list_for_each(pos1, &plugin->instances) {
+			instance = list_entry(pos1, snd_pcm_ladspa_instance_t, list);
+			if (!parallel)
+				idx = 0;
+			if (idx >= stage->chains_count) {
+				snd_pcm_ladspa_chain_t *nchains;
+				nchains = realloc(stage->chains, (idx + 1) * sizeof(*nchains));
+				if (nchains == NULL)
+					return -ENOMEM;
+				stage->chains = nchains;
+				stage->chains[idx].count = 0;
+				stage->chains[idx].instances = NULL;
+				stage->chains_count = idx + 1;
+			}
+			err = snd_pcm_ladspa_add_to_chain(&stage->chains[idx], instance);
+			if (err < 0)
+				return err;
+			idx++;
+		}
+	}
+	return 0;
+}
+
 static int snd_pcm_ladspa_init(snd_pcm_t *pcm)
 {
 	snd_pcm_ladspa_t *ladspa = pcm->private_data;
 	int err;
 	
+	snd_pcm_ladspa_free_graph(ladspa);
 	snd_pcm_ladspa_free_instances(pcm, ladspa, 1);
 	err = snd_pcm_ladspa_allocate_instances(pcm, ladspa);
 	if (err < 0) {
@@ -836,6 +1075,12 @@ static int snd_pcm_ladspa_init(snd_pcm_t *pcm)
 		snd_pcm_ladspa_free_instances(pcm, ladspa, 1);
 		return err;
 	}
+	err = snd_pcm_ladspa_build_graph(pcm, ladspa);
+	if (err < 0) {
+		snd_pcm_ladspa_free_graph(ladspa);
+		snd_pcm_ladspa_free_instances(pcm, ladspa, 1);
+		return err;
+	}
 	return 0;
 }
 
@@ -843,6 +1088,7 @@ static int snd_pcm_ladspa_hw_free(snd_pcm_t *pcm)
 {
 	snd_pcm_ladspa_t *ladspa = pcm->private_data;
 
+	snd_pcm_ladspa_free_graph(ladspa);
 	snd_pcm_ladspa_free_instances(pcm, ladspa, 1);
 	return snd_pcm_generic_hw_free(pcm);
 }
@@ -857,10 +1103,7 @@ snd_pcm_ladspa_write_areas(snd_pcm_t *pcm,
 			   snd_pcm_uframes_t *slave_sizep)
 {
 	snd_pcm_ladspa_t *ladspa = pcm->private_data;
-	snd_pcm_ladspa_instance_t *instance;
-	struct list_head *pos, *pos1;
-	LADSPA_Data *data;
-	unsigned int idx, chn, size1, size2;
+	snd_pcm_uframes_t size2;
 	
 	if (size > *slave_sizep)
 		size = *slave_sizep;
@@ -870,39 +1113,8 @@ snd_pcm_ladspa_write_areas(snd_pcm_t *pcm,
 			   areas, offset,
 			   pcm->channels, size, pcm->format);
 #else
-        while (size > 0) {
-                size1 = size;
-                if (size1 > ladspa->allocated)
-                        size1 = ladspa->allocated;
-        	list_for_each(pos, &ladspa->pplugins) {
-        		snd_pcm_ladspa_plugin_t *plugin = list_entry(pos, snd_pcm_ladspa_plugin_t, list);
-        		list_for_each(pos1, &plugin->instances) {
-        			instance = list_entry(pos1, snd_pcm_ladspa_instance_t, list);
-        			for (idx = 0; idx < instance->input.channels.size; idx++) {
-                                        chn = instance->input.channels.array[idx];
-                                        data = instance->input.data[idx];
-                                        if (data == NULL) {
-                                		data = (LADSPA_Data *)((char *)areas[chn].addr + (areas[chn].first / 8));
-                                       		data += offset;
-                                        }
-                                        instance->desc->connect_port(instance->handle, instance->input.ports.array[idx], data);
-        			}
-        			for (idx = 0; idx < instance->output.channels.size; idx++) {
-                                        chn = instance->output.channels.array[idx];
-                                        data = instance->output.data[idx];
-                                        if (data == NULL) {
-                                		data = (LADSPA_Data *)((char *)slave_areas[chn].addr + (areas[chn].first / 8));
-                                		data += slave_offset;
-                                        }
-					instance->desc->connect_port(instance->handle, instance->output.ports.array[idx], data);
-        			}
-        			instance->desc->run(instance->handle, size1);
-        		}
-        	}
-        	offset += size1;
-        	slave_offset += size1;
-        	size -= size1;
-	}
+	snd_pcm_ladspa_process(ladspa, areas, offset,
+			       slave_areas, slave_offset, size);
 #endif
 	*slave_sizep = size2;
 	return size2;
@@ -918,10 +1130,7 @@ snd_pcm_ladspa_read_areas(snd_pcm_t *pcm,
 			  snd_pcm_uframes_t *slave_sizep)
 {
 	snd_pcm_ladspa_t *ladspa = pcm->private_data;
-	snd_pcm_ladspa_instance_t *instance;
-	struct list_head *pos, *pos1;
-	LADSPA_Data *data;
-	unsigned int idx, chn, size1, size2;;
+	snd_pcm_uframes_t size2;
 
 	if (size > *slave_sizep)
 		size = *slave_sizep;
@@ -931,39 +1140,8 @@ snd_pcm_ladspa_read_areas(snd_pcm_t *pcm,
 			   slave_areas, slave_offset,
 			   pcm->channels, size, pcm->format);
 #else
-        while (size > 0) {
-                size1 = size;
-                if (size1 > ladspa->allocated)
-                        size1 = ladspa->allocated;
-        	list_for_each(pos, &ladspa->cplugins) {
-        		snd_pcm_ladspa_plugin_t *plugin = list_entry(pos, snd_pcm_ladspa_plugin_t, list);
-        		list_for_each(pos1, &plugin->instances) {
-        			instance = list_entry(pos1, snd_pcm_ladspa_instance_t, list);
-        			for (idx = 0; idx < instance->input.channels.size; idx++) {
-                                        chn = instance->input.channels.array[idx];
-                                        data = instance->input.data[idx];
-                                        if (data == NULL) {
-                                		data = (LADSPA_Data *)((char *)slave_areas[chn].addr + (areas[chn].first / 8));
-                                		data += slave_offset;
-                                        }	
-                			instance->desc->connect_port(instance->handle, instance->input.ports.array[idx], data);
-        			}
-        			for (idx = 0; idx < instance->output.channels.size; idx++) {
-                                        chn = instance->output.channels.array[idx];
-                                        data = instance->output.data[idx];
-                                        if (data == NULL) {
-                                		data = (LADSPA_Data *)((char *)areas[chn].addr + (areas[chn].first / 8));
-                                       		data += offset;
-                                        }
-        		        	instance->desc->connect_port(instance->handle, instance->output.ports.array[idx], data);
-        			}
-        			instance->desc->run(instance->handle, size1);
-        		}
-        	}
-        	offset += size1;
-        	slave_offset += size1;
-        	size -= size1;
-	}
+	snd_pcm_ladspa_process(ladspa, slave_areas, slave_offset,
+			       areas, offset, size);
 #endif
 	*slave_sizep = size2;
 	return size2;
@@ -1057,6 +1235,12 @@ static void snd_pcm_ladspa_dump(snd_pcm_t *pcm, snd_output_t *out)
 	snd_pcm_ladspa_plugins_dump(&ladspa->pplugins, out);
 	snd_output_printf(out, "  Capture:\n");
 	snd_pcm_ladspa_plugins_dump(&ladspa->cplugins, out);
+	if (ladspa->block)
+		snd_output_printf(out, "  Block: %u frames\n", ladspa->block);
+	if (ladspa->threads)
+		snd_output_printf(out, "  Threads: %u\n", ladspa->threads);
+	if (ladspa->stages_count)
+		snd_output_printf(out, "  Stages: %u\n", ladspa->stages_count);
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -1083,12 +1267,48 @@ static const snd_pcm_ops_t snd_pcm_ladspa_ops = {
 	.set_chmap = snd_pcm_generic_set_chmap,
 };
 
+/* 1 when the plugin label and ID match, 0 when not, or a negative error */
+static int snd_pcm_ladspa_match(const char *label,
+				const unsigned long ladspa_id,
+				const char *dlabel,
+				const unsigned long did)
+{
+/*
+ * avoid locale problems - see ALSA bug#1553
+ */
+#if 0
+	if (label != NULL && strcmp(label, dlabel))
+		return 0;
+#else
+        char *labellocale;
+        struct lconv *lc;
+        if (label != NULL) {
+                lc = localeconv ();
+                labellocale = malloc (strlen (label) + 1);
+                if (labellocale == NULL)
+                        return -ENOMEM;
+                strcpy (labellocale, label);
+                if (strrchr(labellocale, '.'))
+                        *strrchr (labellocale, '.') = *lc->decimal_point;
+                if (strcmp(label, dlabel) && strcmp(labellocale, dlabel)) {
+                        free(labellocale);
+                        return 0;
+                }
+                free (labellocale);
+        }
+#endif
+	if (ladspa_id > 0 && did != ladspa_id)
+		return 0;
+	return 1;
+}
+
 static int snd_pcm_ladspa_check_file(snd_pcm_ladspa_plugin_t * const plugin,
 				     const char *filename,
 				     const char *label,
 				     const unsigned long ladspa_id)
 {
 	void *handle;
+	int err;
 
 	assert(filename);
 	handle = dlopen(filename, RTLD_LAZY);
@@ -1098,33 +1318,12 @@ static int snd_pcm_ladspa_check_file(snd_pcm_ladspa_plugin_t * const plugin,
 			long idx;
 			const LADSPA_Descriptor *d;
 			for (idx = 0; (d = fcn(idx)) != NULL; idx++) {
-/*
- * avoid locale problems - see ALSA bug#1553
- */
-#if 0
-				if (strcmp(label, d->Label))
-					continue;
-#else
-                                char *labellocale;
-                                struct lconv *lc;
-                                if (label != NULL) {
-                                        lc = localeconv ();
-                                        labellocale = malloc (strlen (label) + 1);
-                                        if (labellocale == NULL) {
-                                        	dlclose(handle);
-                                                return -ENOMEM;
-					}
-                                        strcpy (labellocale, label);
-                                        if (strrchr(labellocale, '.'))
-                                                *strrchr (labellocale, '.') = *lc->decimal_point;
-                                        if (strcmp(label, d->Label) && strcmp(labellocale, d->Label)) {
-                                                free(labellocale);
-                                                continue;
-                                        }
-                                        free (labellocale);
-                                }
-#endif
-				if (ladspa_id > 0 && d->UniqueID != ladspa_id)
+				err = snd_pcm_ladspa_match(label, ladspa_id, d->Label, d->UniqueID);
+				if (err < 0) {
+					dlclose(handle);
+					return err;
+				}
+				if (err == 0)
 					continue;
 				plugin->filename = strdup(filename);
 				if (plugin->filename == NULL) {
@@ -1156,9 +1355,10 @@ static int snd_pcm_ladspa_check_dir(snd_pcm_ladspa_plugin_t * const plugin,
 		return 0;
 	need_slash = path[len - 1] != '/';
 	
+	/* a missing directory in the path is skipped, as with the index */
 	dir = opendir(path);
 	if (!dir)
-		return -ENOENT;
+		return 0;
 		
 	while (1) {
 		dirent = readdir64(dir);
@@ -1191,7 +1391,611 @@ static int snd_pcm_ladspa_check_dir(snd_pcm_ladspa_plugin_t * const plugin,
 	return 0;
 }
 
+/*
+ * The plugin index caches the LADSPA descriptors of the files in the
+ * plugin directories, so the files need not be opened one by one to find
+ * a plugin.  A directory is scanned again when its modification time has
+ * changed or when a plugin is not found in it, a file is probed again
+ * when its modification time or size has changed.  The times have
+ * nanoseconds, a file added right after a scan changes the directory
+ * time even within the same second.  The text format is:
+ *
+ *   D <mtime> <directory>
+ *   F <mtime> <size> <file name in the directory>
+ *   P <index> <id> <label>
+ *
+ * with the F lines following their D line and the P lines following
+ * their F line, the times are written as <seconds>.<nanoseconds>.
+ */
+
+#ifndef DOC_HIDDEN
+
+#define SND_PCM_LADSPA_INDEX_MAGIC	"# ALSA LADSPA plugin index 3\n"
+
+typedef struct {
+	unsigned long idx;			/* for ladspa_descriptor() */
+	unsigned long id;
+	char *label;
+} snd_pcm_ladspa_index_desc_t;
+
+typedef struct {
+	char *name;
+	struct timespec mtime;
+	off_t size;
+	unsigned int descs_count;
+	snd_pcm_ladspa_index_desc_t *descs;
+} snd_pcm_ladspa_index_file_t;
+
+typedef struct {
+	char *path;
+	struct timespec mtime;
+	int scanned;				/* by this open */
+	unsigned int files_count;
+	snd_pcm_ladspa_index_file_t *files;
+} snd_pcm_ladspa_index_dir_t;
+
+typedef struct {
+	unsigned int dirs_count;
+	snd_pcm_ladspa_index_dir_t *dirs;
+	int dirty;				/* save the index */
+} snd_pcm_ladspa_index_t;
+
+#endif /* DOC_HIDDEN */
+
+/* append a zeroed element to the array */
+static void *snd_pcm_ladspa_index_grow(void *parray, unsigned int *count, size_t size)
+{
+	char *array = *(char **)parray;
+
+	array = realloc(array, (*count + 1) * size);
+	if (array == NULL)
+		return NULL;
+	*(char **)parray = array;
+	array += (*count)++ * size;
+	memset(array, 0, size);
+	return array;
+}
+
+static void snd_pcm_ladspa_index_free_file(snd_pcm_ladspa_index_file_t *file)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < file->descs_count; idx++)
+		free(file->descs[idx].label);
+	free(file->descs);
+	free(file->name);
+}
+
+static void snd_pcm_ladspa_index_free_dir(snd_pcm_ladspa_index_dir_t *dir)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < dir->files_count; idx++)
+		snd_pcm_ladspa_index_free_file(&dir->files[idx]);
+	free(dir->files);
+	free(dir->path);
+}
+
+static void snd_pcm_ladspa_index_free(snd_pcm_ladspa_index_t *index)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < index->dirs_count; idx++)
+		snd_pcm_ladspa_index_free_dir(&index->dirs[idx]);
+	free(index->dirs);
+	index->dirs = NULL;
+	index->dirs_count = 0;
+}
+
+/* the rest of the line without the newline */
+static char *snd_pcm_ladspa_index_string(const char *str)
+{
+	size_t len = strcspn(str, "\n");
+	char *res = malloc(len + 1);
+
+	if (res) {
+		memcpy(res, str, len);
+		res[len] = '\0';
+	}
+	return res;
+}
+
+static int snd_pcm_ladspa_index_mtime_eq(const struct timespec *mtime,
+					 const struct stat *st)
+{
+	return mtime->tv_sec == st->st_mtim.tv_sec &&
+	       mtime->tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/* read the index, an invalid index file is ignored */
+static int snd_pcm_ladspa_index_load(snd_pcm_ladspa_index_t *index,
+				     const char *filename)
+{
+	snd_pcm_ladspa_index_dir_t *dir = NULL;
+	snd_pcm_ladspa_index_file_t *file = NULL;
+	snd_pcm_ladspa_index_desc_t *desc;
+	char line[PATH_MAX + 128];
+	long long mtime, size;
+	long nsec;
+	FILE *fp;
+	int pos, err = 0;
+
+	fp = fopen(filename, "r");
+	if (fp == NULL)
+		return 0;
+	if (fgets(line, sizeof(line), fp) == NULL ||
+	    strcmp(line, SND_PCM_LADSPA_INDEX_MAGIC))
+		goto _invalid;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (line[0] == '\0' || line[strlen(line) - 1] != '\n')
+			goto _invalid;
+		pos = 0;
+		switch (line[0]) {
+		case 'D':
+			if (sscanf(line, "D %lld.%ld %n", &mtime, &nsec, &pos) < 2 || !pos)
+				goto _invalid;
+			dir = snd_pcm_ladspa_index_grow(&index->dirs, &index->dirs_count, sizeof(*dir));
+			if (dir == NULL)
+				goto _nomem;
+			dir->mtime.tv_sec = mtime;
+			dir->mtime.tv_nsec = nsec;
+			dir->path = snd_pcm_ladspa_index_string(line + pos);
+			if (dir->path == NULL)
+				goto _nomem;
+			file = NULL;
+			break;
+		case 'F':
+			if (dir == NULL ||
+			    sscanf(line, "F %lld.%ld %lld %n", &mtime, &nsec, &size, &pos) < 3 || !pos)
+				goto _invalid;
+			file = snd_pcm_ladspa_index_grow(&dir->files, &dir->files_count, sizeof(*file));
+			if (file == NULL)
+				goto _nomem;
+			file->mtime.tv_sec = mtime;
+			file->mtime.tv_nsec = nsec;
+			file->size = size;
+			file->name = snd_pcm_ladspa_index_string(line + pos);
+			if (file->name == NULL)
+				goto _nomem;
+			break;
+		case 'P':
+			if (file == NULL)
+				goto _invalid;
+			desc = snd_pcm_ladspa_index_grow(&file->descs, &file->descs_count, sizeof(*desc));
+			if (desc == NULL)
+				goto _nomem;
+			if (sscanf(line, "P %lu %lu %n", &desc->idx, &desc->id, &pos) < 2 || !pos)
+				goto _invalid;
+			desc->label = snd_pcm_ladspa_index_string(line + pos);
+			if (desc->label == NULL)
+				goto _nomem;
+			break;
+		default:
+			goto _invalid;
+		}
+	}
+	fclose(fp);
+	return 0;
+
+ _nomem:
+	err = -ENOMEM;
+ _invalid:
+	fclose(fp);
+	snd_pcm_ladspa_index_free(index);
+	index->dirty = 1;
+	return err;
+}
+
+static int snd_pcm_ladspa_index_savable(const snd_pcm_ladspa_index_dir_t *dir)
+{
+	unsigned int idx, idx1;
+
+	if (strchr(dir->path, '\n'))
+		return 0;
+	for (idx = 0; idx < dir->files_count; idx++) {
+		if (strchr(dir->files[idx].name, '\n'))
+			return 0;
+		for (idx1 = 0; idx1 < dir->files[idx].descs_count; idx1++)
+			if (strchr(dir->files[idx].descs[idx1].label, '\n'))
+				return 0;
+	}
+	return 1;
+}
+
+/* create the directory of the index file, not its parents */
+static void snd_pcm_ladspa_index_mkdir(const char *filename)
+{
+	char *dirname, *slash;
+
+	dirname = strdup(filename);
+	if (dirname == NULL)
+		return;
+	slash = strrchr(dirname, '/');
+	if (slash && slash != dirname) {
+		*slash = '\0';
+		mkdir(dirname, 0700);
+	}
+	free(dirname);
+}
+
+/* write the index to a temporary file and move it to place */
+static int snd_pcm_ladspa_index_save(snd_pcm_ladspa_index_t *index,
+				     const char *filename)
+{
+	unsigned int idx, idx1, idx2;
+	char *tmpname;
+	FILE *fp;
+	int fd, err = 0;
+
+	tmpname = malloc(strlen(filename) + 8);
+	if (tmpname == NULL)
+		return -ENOMEM;
+	sprintf(tmpname, "%s.XXXXXX", filename);
+	fd = mkstemp(tmpname);
+	if (fd < 0 && errno == ENOENT) {
+		snd_pcm_ladspa_index_mkdir(filename);
+		sprintf(tmpname, "%s.XXXXXX", filename);
+		fd = mkstemp(tmpname);
+	}
+	if (fd < 0) {
+		err = -errno;
+		free(tmpname);
+		return err;
+	}
+	/* mkstemp() creates the file private */
+	fchmod(fd, 0644);
+	fp = fdopen(fd, "w");
+	if (fp == NULL) {
+		err = -errno;
+		close(fd);
+		unlink(tmpname);
+		free(tmpname);
+		return err;
+	}
+	fputs(SND_PCM_LADSPA_INDEX_MAGIC, fp);
+	for (idx = 0; idx < index->dirs_count; idx++) {
+		snd_pcm_ladspa_index_dir_t *dir = &index->dirs[idx];
+		if (!snd_pcm_ladspa_index_savable(dir))
+			continue;
+		fprintf(fp, "D %lld.%09ld %s\n", (long long)dir->mtime.tv_sec,
+			(long)dir->mtime.tv_nsec, dir->path);
+		for (idx1 = 0; idx1 < dir->files_count; idx1++) {
+			snd_pcm_ladspa_index_file_t *file = &dir->files[idx1];
+			fprintf(fp, "F %lld.%09ld %lld %s\n",
+				(long long)file->mtime.tv_sec,
+				(long)file->mtime.tv_nsec,
+				(long long)file->size, file->name);
+			for (idx2 = 0; idx2 < file->descs_count; idx2++) {
+				snd_pcm_ladspa_index_desc_t *desc = &file->descs[idx2];
+				fprintf(fp, "P %lu %lu %s\n", desc->idx, desc->id, desc->label);
+			}
+		}
+	}
+	if (ferror(fp))
+		err = -EIO;
+	if (fclose(fp) && !err)
+		err = -errno;
+	if (!err && rename(tmpname, filename) < 0)
+		err = -errno;
+	if (err < 0)
+		unlink(tmpname);
+	else
+		index->dirty = 0;
+	free(tmpname);
+	return err;
+}
+
+/* list the descriptors of the file */
+static int snd_pcm_ladspa_index_probe(snd_pcm_ladspa_index_file_t *file,
+				      const char *filename)
+{
+	snd_pcm_ladspa_index_desc_t *desc;
+	LADSPA_Descriptor_Function fcn;
+	const LADSPA_Descriptor *d;
+	void *handle;
+	unsigned long idx;
+	int err = 0;
+
+	handle = dlopen(filename, RTLD_LAZY);
+	if (handle == NULL)
+		return 0;
+	fcn = (LADSPA_Descriptor_Function)dlsym(handle, "ladspa_descriptor");
+	if (fcn == NULL)
+		goto _close;
+	for (idx = 0; (d = fcn(idx)) != NULL; idx++) {
+		if (d->Label == NULL)
+			continue;
+		desc = snd_pcm_ladspa_index_grow(&file->descs, &file->descs_count, sizeof(*desc));
+		if (desc == NULL) {
+			err = -ENOMEM;
+			break;
+		}
+		desc->idx = idx;
+		desc->id = d->UniqueID;
+		desc->label = strdup(d->Label);
+		if (desc->label == NULL) {
+			err = -ENOMEM;
+			break;
+		}
+	}
+ _close:
+	dlclose(handle);
+	return err;
+}
+
+static snd_pcm_ladspa_index_file_t *
+snd_pcm_ladspa_index_find_file(snd_pcm_ladspa_index_dir_t *dir,
+			       const char *name, unsigned int hint)
+{
+	unsigned int idx;
+
+	/* the order of the directory entries rarely changes */
+	if (hint < dir->files_count && strcmp(dir->files[hint].name, name) == 0)
+		return &dir->files[hint];
+	for (idx = 0; idx < dir->files_count; idx++)
+		if (strcmp(dir->files[idx].name, name) == 0)
+			return &dir->files[idx];
+	return NULL;
+}
+
+static char *snd_pcm_ladspa_index_filename(const char *path, const char *name)
+{
+	size_t len = strlen(path);
+	char *filename;
+
+	filename = malloc(len + strlen(name) + 2);
+	if (filename == NULL)
+		return NULL;
+	strcpy(filename, path);
+	if (len > 0 && path[len - 1] != '/')
+		strcat(filename, "/");
+	strcat(filename, name);
+	return filename;
+}
+
+/*
+ * Scan the directory to ndir, the unchanged files are taken over from
+ * the old index of the directory, the others are probed.
+ */
+static int snd_pcm_ladspa_index_scan(snd_pcm_ladspa_index_dir_t *ndir,
+				     snd_pcm_ladspa_index_dir_t *dir,
+				     const char *path,
+				     const struct timespec *mtime)
+{
+	snd_pcm_ladspa_index_file_t *file, *ofile;
+	struct dirent64 *dirent;
+	struct stat st;
+	char *filename;
+	DIR *d;
+	int err = 0;
+
+	d = opendir(path);
+	if (d == NULL)
+		return -ENOENT;
+	ndir->path = strdup(path);
+	ndir->mtime = *mtime;
+	ndir->scanned = 1;
+	if (ndir->path == NULL) {
+		closedir(d);
+		return -ENOMEM;
+	}
+	while ((dirent = readdir64(d)) != NULL) {
+		filename = snd_pcm_ladspa_index_filename(path, dirent->d_name);
+		if (filename == NULL) {
+			err = -ENOMEM;
+			break;
+		}
+		if (stat(filename, &st) < 0 || !S_ISREG(st.st_mode)) {
+			free(filename);
+			continue;
+		}
+		file = snd_pcm_ladspa_index_grow(&ndir->files, &ndir->files_count, sizeof(*file));
+		if (file == NULL) {
+			free(filename);
+			err = -ENOMEM;
+			break;
+		}
+		ofile = NULL;
+		if (dir)
+			ofile = snd_pcm_ladspa_index_find_file(dir, dirent->d_name,
+							       ndir->files_count - 1);
+		file->mtime = st.st_mtim;
+		file->size = st.st_size;
+		file->name = strdup(dirent->d_name);
+		if (file->name == NULL) {
+			free(filename);
+			err = -ENOMEM;
+			break;
+		}
+		if (ofile && snd_pcm_ladspa_index_mtime_eq(&ofile->mtime, &st) &&
+		    ofile->size == st.st_size) {
+			file->descs_count = ofile->descs_count;
+			file->descs = ofile->descs;
+			ofile->descs_count = 0;
+			ofile->descs = NULL;
+		} else {
+			err = snd_pcm_ladspa_index_probe(file, filename);
+		}
+		free(filename);
+		if (err < 0)
+			break;
+	}
+	closedir(d);
+	return err;
+}
+
+/* the valid index of the directory, scanned again when changed or forced */
+static snd_pcm_ladspa_index_dir_t *
+snd_pcm_ladspa_index_update(snd_pcm_ladspa_index_t *index, const char *path,
+			    int force, int *errp)
+{
+	snd_pcm_ladspa_index_dir_t *dir = NULL, ndir;
+	snd_pcm_ladspa_index_file_t *file;
+	unsigned int idx;
+	struct stat st;
+	char *filename;
+	int err;
+
+	*errp = 0;
+	if (stat(path, &st) < 0 || !S_ISDIR(st.st_mode))
+		return NULL;
+	for (idx = 0; idx < index->dirs_count; idx++) {
+		if (strcmp(index->dirs[idx].path, path) == 0) {
+			dir = &index->dirs[idx];
+			break;
+		}
+	}
+	if (dir && !force && snd_pcm_ladspa_index_mtime_eq(&dir->mtime, &st)) {
+		for (idx = 0; idx < dir->files_count; idx++) {
+			file = &dir->files[idx];
+			filename = snd_pcm_ladspa_index_filename(path, file->name);
+			if (filename == NULL) {
+				*errp = -ENOMEM;
+				return NULL;
+			}
+			err = stat(filename, &st);
+			free(filename);
+			if (err < 0 || !snd_pcm_ladspa_index_mtime_eq(&file->mtime, &st) ||
+			    file->size != st.st_size)
+				break;
+		}
+		if (idx == dir->files_count)
+			return dir;
+		/* a file has changed in place */
+		if (stat(path, &st) < 0)
+			return NULL;
+	}
+	memset(&ndir, 0, sizeof(ndir));
+	err = snd_pcm_ladspa_index_scan(&ndir, dir, path, &st.st_mtim);
+	if (err < 0) {
+		snd_pcm_ladspa_index_free_dir(&ndir);
+		if (err != -ENOENT)
+			*errp = err;
+		return NULL;
+	}
+	if (dir == NULL) {
+		dir = snd_pcm_ladspa_index_grow(&index->dirs, &index->dirs_count, sizeof(*dir));
+		if (dir == NULL) {
+			snd_pcm_ladspa_index_free_dir(&ndir);
+			*errp = -ENOMEM;
+			return NULL;
+		}
+	} else {
+		snd_pcm_ladspa_index_free_dir(dir);
+	}
+	*dir = ndir;
+	index->dirty = 1;
+	return dir;
+}
+
+/*
+ * open the descriptor listed in the index, -ENOENT when the file does
+ * not provide it any more
+ */
+static int snd_pcm_ladspa_index_open(snd_pcm_ladspa_plugin_t * const plugin,
+				     const char *filename,
+				     const snd_pcm_ladspa_index_desc_t *desc,
+				     const char *label,
+				     const unsigned long ladspa_id)
+{
+	LADSPA_Descriptor_Function fcn;
+	const LADSPA_Descriptor *d;
+	void *handle;
+	int err = -ENOENT;
+
+	handle = dlopen(filename, RTLD_LAZY);
+	if (handle == NULL)
+		return -ENOENT;
+	fcn = (LADSPA_Descriptor_Function)dlsym(handle, "ladspa_descriptor");
+	if (fcn == NULL)
+		goto _close;
+	d = fcn(desc->idx);
+	if (d == NULL || d->Label == NULL)
+		goto _close;
+	err = snd_pcm_ladspa_match(label, ladspa_id, d->Label, d->UniqueID);
+	if (err <= 0) {
+		if (err == 0)
+			err = -ENOENT;
+		goto _close;
+	}
+	plugin->filename = strdup(filename);
+	if (plugin->filename == NULL) {
+		err = -ENOMEM;
+		goto _close;
+	}
+	plugin->dl_handle = handle;
+	plugin->desc = d;
+	return 1;
+
+ _close:
+	dlclose(handle);
+	return err;
+}
+
+/* open the plugin from the files listing it in the index of the directory */
+static int snd_pcm_ladspa_index_find(snd_pcm_ladspa_plugin_t * const plugin,
+				     snd_pcm_ladspa_index_dir_t *dir,
+				     const char *path,
+				     const char *label,
+				     const unsigned long ladspa_id)
+{
+	snd_pcm_ladspa_index_file_t *file;
+	unsigned int idx, idx1;
+	char *filename;
+	int err = 0;
+
+	for (idx = 0; idx < dir->files_count; idx++) {
+		file = &dir->files[idx];
+		for (idx1 = 0; idx1 < file->descs_count; idx1++) {
+			err = snd_pcm_ladspa_match(label, ladspa_id,
+						   file->descs[idx1].label,
+						   file->descs[idx1].id);
+			if (err != 0)
+				break;
+		}
+		if (err < 0)
+			return err;
+		if (idx1 == file->descs_count)
+			continue;
+		filename = snd_pcm_ladspa_index_filename(path, file->name);
+		if (filename == NULL)
+			return -ENOMEM;
+		err = snd_pcm_ladspa_index_open(plugin, filename, &file->descs[idx1],
+						label, ladspa_id);
+		free(filename);
+		if (err != -ENOENT)
+			return err;
+	}
+	return 0;
+}
+
+/*
+ * look for the plugin in the directory with help of the index, the
+ * directory is scanned again when the plugin is not in its index
+ */
+static int snd_pcm_ladspa_index_check_dir(snd_pcm_ladspa_plugin_t * const plugin,
+					  snd_pcm_ladspa_index_t *index,
+					  const char *path,
+					  const char *label,
+					  const unsigned long ladspa_id)
+{
+	snd_pcm_ladspa_index_dir_t *dir;
+	int err;
+
+	dir = snd_pcm_ladspa_index_update(index, path, 0, &err);
+	if (dir == NULL)
+		return err;
+	err = snd_pcm_ladspa_index_find(plugin, dir, path, label, ladspa_id);
+	if (err != 0 || dir->scanned)
+		return err;
+	dir = snd_pcm_ladspa_index_update(index, path, 1, &err);
+	if (dir == NULL)
+		return err;
+	return snd_pcm_ladspa_index_find(plugin, dir, path, label, ladspa_id);
+}
+
 static int snd_pcm_ladspa_look_for_plugin(snd_pcm_ladspa_plugin_t * const plugin,
+					  snd_pcm_ladspa_index_t *index,
 					  const char *path,
 					  const char *label,
 					  const long ladspa_id)
@@ -1208,7 +2012,10 @@ static int snd_pcm_ladspa_look_for_plugin(snd_pcm_ladspa_plugin_t * const plugin
 		err = snd_user_file(name, &fullpath);
 		if (err < 0)
 			return err;
-		err = snd_pcm_ladspa_check_dir(plugin, fullpath, label, ladspa_id);
+		if (index)
+			err = snd_pcm_ladspa_index_check_dir(plugin, index, fullpath, label, ladspa_id);
+		else
+			err = snd_pcm_ladspa_check_dir(plugin, fullpath, label, ladspa_id);
 		free(fullpath);
 		if (err < 0)
 			return err;
@@ -1424,6 +2231,7 @@ static int snd_pcm_ladspa_parse_ioconfig(snd_pcm_ladspa_plugin_t *lplug,
 }
 
 static int snd_pcm_ladspa_add_plugin(struct list_head *list,
+				     snd_pcm_ladspa_index_t *index,
 				     const char *path,
 				     snd_config_t *plugin,
 				     int reverse)
@@ -1504,7 +2312,7 @@ static int snd_pcm_ladspa_add_plugin(struct list_head *list,
 			return err;
 		}
 	} else {
-		err = snd_pcm_ladspa_look_for_plugin(lplug, path, label, ladspa_id);
+		err = snd_pcm_ladspa_look_for_plugin(lplug, index, path, label, ladspa_id);
 		if (err < 0) {
 			SNDERR("Unable to find or load plugin '%s' ID %li, path '%s'", label, ladspa_id, path);
 			free(lplug);
@@ -1526,6 +2334,7 @@ static int snd_pcm_ladspa_add_plugin(struct list_head *list,
 }
 
 static int snd_pcm_ladspa_build_plugins(struct list_head *list,
+					snd_pcm_ladspa_index_t *index,
 					const char *path,
 					snd_config_t *plugins,
 					int reverse)
@@ -1554,7 +2363,7 @@ static int snd_pcm_ladspa_build_plugins(struct list_head *list,
 			}
 			if (i == idx) {
 				idx++;
-				err = snd_pcm_ladspa_add_plugin(list, path, n, reverse);
+				err = snd_pcm_ladspa_add_plugin(list, index, path, n, reverse);
 				if (err < 0)
 					return err;
 				hit = 1;
@@ -1568,31 +2377,21 @@ static int snd_pcm_ladspa_build_plugins(struct list_head *list,
 	return 0;
 }
 
-/**
- * \brief Creates a new LADSPA<->ALSA Plugin
- * \param pcmp Returns created PCM handle
- * \param name Name of PCM
- * \param ladspa_path The path for LADSPA plugins
- * \param channels Force input channel count to LADSPA plugin chain, 0 = no force (auto)
- * \param ladspa_pplugins The playback configuration
- * \param ladspa_cplugins The capture configuration
- * \param slave Slave PCM handle
- * \param close_slave When set, the slave PCM handle is closed with copy PCM
- * \retval zero on success otherwise a negative error code
- * \warning Using of this function might be dangerous in the sense
- *          of compatibility reasons. The prototype might be freely
- *          changed in future.
- */
-int snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
-			const char *ladspa_path,
-			unsigned int channels,
-			snd_config_t *ladspa_pplugins,
-			snd_config_t *ladspa_cplugins,
-			snd_pcm_t *slave, int close_slave)
+static int snd_pcm_ladspa_open1(snd_pcm_t **pcmp, const char *name,
+				const char *ladspa_path,
+				const char *index_file,
+				unsigned int channels,
+				unsigned int block,
+				unsigned int threads, const int *cpus,
+				snd_config_t *ladspa_pplugins,
+				snd_config_t *ladspa_cplugins,
+				snd_pcm_t *slave, int close_slave)
 {
 	snd_pcm_t *pcm;
 	snd_pcm_ladspa_t *ladspa;
-	int err, reverse = 0;
+	snd_pcm_ladspa_index_t index, *pindex = NULL;
+	char *index_path = NULL;
+	int err = 0, reverse = 0;
 
 	assert(pcmp && (ladspa_pplugins || ladspa_cplugins) && slave);
 
@@ -1613,23 +2412,47 @@ int snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
 	INIT_LIST_HEAD(&ladspa->pplugins);
 	INIT_LIST_HEAD(&ladspa->cplugins);
 	ladspa->channels = channels;
-
-	if (slave->stream == SND_PCM_STREAM_PLAYBACK) {
-		err = snd_pcm_ladspa_build_plugins(&ladspa->pplugins, ladspa_path, ladspa_pplugins, reverse);
-		if (err < 0) {
-			snd_pcm_ladspa_free(ladspa);
-			return err;
-		}
+	ladspa->block = block;
+
+	memset(&index, 0, sizeof(index));
+	/* the index is only a cache, the plugins are looked up without it */
+	if (index_file && *index_file &&
+	    snd_user_file(index_file, &index_path) >= 0) {
+		err = snd_pcm_ladspa_index_load(&index, index_path);
+		pindex = &index;
 	}
-	if (slave->stream == SND_PCM_STREAM_CAPTURE) {
+	if (err >= 0 && slave->stream == SND_PCM_STREAM_PLAYBACK)
+		err = snd_pcm_ladspa_build_plugins(&ladspa->pplugins, pindex, ladspa_path, ladspa_pplugins, reverse);
+	if (err >= 0 && slave->stream == SND_PCM_STREAM_CAPTURE) {
 		if (ladspa_cplugins == ladspa_pplugins)
 			reverse = 1;
-		err = snd_pcm_ladspa_build_plugins(&ladspa->cplugins, ladspa_path, ladspa_cplugins, reverse);
+		err = snd_pcm_ladspa_build_plugins(&ladspa->cplugins, pindex, ladspa_path, ladspa_cplugins, reverse);
+	}
+	if (pindex) {
+		/* it may be left unwritten as well */
+		if (index.dirty)
+			snd_pcm_ladspa_index_save(&index, index_path);
+		snd_pcm_ladspa_index_free(&index);
+		free(index_path);
+	}
+	if (err < 0) {
+		snd_pcm_ladspa_free(ladspa);
+		return err;
+	}
+#ifdef HAVE_LIBPTHREAD
+	if (threads) {
+		err = snd_pcm_workers_start(&ladspa->workers, "LADSPA", threads, cpus);
 		if (err < 0) {
+			SNDERR("Cannot start the LADSPA worker threads");
 			snd_pcm_ladspa_free(ladspa);
 			return err;
 		}
+		ladspa->threads = threads;
 	}
+#else
+	(void)threads;
+	(void)cpus;
+#endif
 
 	err = snd_pcm_new(&pcm, SND_PCM_TYPE_LADSPA, name, slave->stream, slave->mode);
 	if (err < 0) {
@@ -1649,6 +2472,33 @@ int snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
 	return 0;
 }
 
+/**
+ * \brief Creates a new LADSPA<->ALSA Plugin
+ * \param pcmp Returns created PCM handle
+ * \param name Name of PCM
+ * \param ladspa_path The path for LADSPA plugins
+ * \param channels Force input channel count to LADSPA plugin chain, 0 = no force (auto)
+ * \param ladspa_pplugins The playback configuration
+ * \param ladspa_cplugins The capture configuration
+ * \param slave Slave PCM handle
+ * \param close_slave When set, the slave PCM handle is closed with copy PCM
+ * \retval zero on success otherwise a negative error code
+ * \warning Using of this function might be dangerous in the sense
+ *          of compatibility reasons. The prototype might be freely
+ *          changed in future.
+ */
+int snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
+			const char *ladspa_path,
+			unsigned int channels,
+			snd_config_t *ladspa_pplugins,
+			snd_config_t *ladspa_cplugins,
+			snd_pcm_t *slave, int close_slave)
+{
+	return snd_pcm_ladspa_open1(pcmp, name, ladspa_path, NULL, channels,
+				    0, 0, NULL, ladspa_pplugins, ladspa_cplugins,
+				    slave, close_slave);
+}
+
 /*! \page pcm_plugins
 
 \section pcm_plugins_ladpsa Plugin: LADSPA <-> ALSA
@@ -1672,6 +2522,23 @@ connected to a dummy sample area.
 
 Instances of LADSPA plugins are created dynamically.
 
+The plugins given by label or ID are looked up in the directories of the
+path.  With an index file, the labels, IDs and port layouts found there
+are kept in it, so later opens load only the file with the wanted plugin.
+A directory is scanned again when its modification time changes or when
+the plugin is not listed for it, a plugin file is probed again when its
+modification time or size changes.  The index is a cache only: when it
+cannot be read or written, the plugins are looked up without it.
+
+The instances are run as a graph of stages.  Consecutive plugins with
+the duplicate policy form one stage, where the instances of each channel
+make an independent chain; any other plugin is a stage of its own.  With
+threads, the chains of a stage are shared between the calling thread and
+the given count of worker threads, optionally pinned to the CPUs given
+in cpus (where the system supports the thread affinity), so long per
+channel chains on many channels finish in time.
+The block size limits the frames given to one run of the plugins.
+
 \code
 pcm.name {
         type ladspa             # ALSA<->LADSPA PCM
@@ -1684,6 +2551,13 @@ pcm.name {
         }
         [channels INT]		# count input channels (input to LADSPA plugin chain)
 	[path STR]		# Path (directory) with LADSPA plugins
+	[index STR]		# Plugin index file, default none
+				# (for example "~/.cache/alsa-ladspa.index")
+	[threads INT]		# Count of worker threads, default 0
+	[cpus {			# Pin the worker threads to CPUs
+		N INT		# CPU of the worker thread N
+	}]
+	[block INT]		# Frames per run of the plugins, default any
 	plugins |		# Definition for both directions
         playback_plugins |	# Definition for playback direction
 	capture_plugins {	# Definition for capture direction
@@ -1736,10 +2610,15 @@ int _snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
 {
 	snd_config_iterator_t i, next;
 	int err;
+	long idx;
 	snd_pcm_t *spcm;
 	snd_config_t *slave = NULL, *sconf;
 	const char *path = NULL;
+	const char *index = NULL;
 	long channels = 0;
+	long threads = 0, block = 0;
+	int *cpus = NULL;
+	snd_config_t *cpus_conf = NULL;
 	snd_config_t *plugins = NULL, *pplugins = NULL, *cplugins = NULL;
 	snd_config_for_each(i, next, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
@@ -1756,6 +2635,14 @@ int _snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
 			snd_config_get_string(n, &path);
 			continue;
 		}
+		if (strcmp(id, "index") == 0) {
+			err = snd_config_get_string(n, &index);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return -EINVAL;
+			}
+			continue;
+		}
 		if (strcmp(id, "channels") == 0) {
 			snd_config_get_integer(n, &channels);
 			if (channels > 1024)
@@ -1776,6 +2663,30 @@ int _snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
 			cplugins = n;
 			continue;
 		}
+		if (strcmp(id, "threads") == 0) {
+			err = snd_config_get_integer(n, &threads);
+			if (err < 0 || threads < 0 || threads > SND_PCM_LADSPA_MAX_THREADS) {
+				SNDERR("Invalid value for %s", id);
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "cpus") == 0) {
+			if (snd_config_get_type(n) != SND_CONFIG_TYPE_COMPOUND) {
+				SNDERR("Invalid type for %s", id);
+				return -EINVAL;
+			}
+			cpus_conf = n;
+			continue;
+		}
+		if (strcmp(id, "block") == 0) {
+			err = snd_config_get_integer(n, &block);
+			if (err < 0 || block < 0 || block > SND_PCM_LADSPA_MAX_BLOCK) {
+				SNDERR("Invalid value for %s", id);
+				return -EINVAL;
+			}
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -1783,24 +2694,58 @@ int _snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
 		SNDERR("slave is not defined");
 		return -EINVAL;
 	}
+	if (threads) {
+		cpus = malloc(threads * sizeof(*cpus));
+		if (cpus == NULL)
+			return -ENOMEM;
+		for (idx = 0; idx < threads; idx++)
+			cpus[idx] = -1;
+	}
+	if (cpus_conf) {
+		snd_config_for_each(i, next, cpus_conf) {
+			snd_config_t *n = snd_config_iterator_entry(i);
+			const char *id;
+			long worker, cpu;
+			if (snd_config_get_id(n, &id) < 0)
+				continue;
+			err = safe_strtol(id, &worker);
+			if (err < 0 || worker < 0 || worker >= threads) {
+				SNDERR("Unknown worker %s in cpus", id);
+				err = -EINVAL;
+				goto _free;
+			}
+			err = snd_config_get_integer(n, &cpu);
+			if (err < 0 || cpu < 0 || cpu >= SND_PCM_WORKERS_CPUS) {
+				SNDERR("Invalid CPU for worker %s", id);
+				err = -EINVAL;
+				goto _free;
+			}
+			cpus[worker] = cpu;
+		}
+	}
 	if (plugins) {
 		if (pplugins || cplugins) {
 			SNDERR("'plugins' definition cannot be combined with 'playback_plugins' or 'capture_plugins'");
-			return -EINVAL;
+			err = -EINVAL;
+			goto _free;
 		}
 		pplugins = plugins;
 		cplugins = plugins;
 	}
 	err = snd_pcm_slave_conf(root, slave, &sconf, 0);
 	if (err < 0)
-		return err;
+		goto _free;
 	err = snd_pcm_open_slave(&spcm, root, sconf, stream, mode, conf);
 	snd_config_delete(sconf);
 	if (err < 0)
-		return err;
-	err = snd_pcm_ladspa_open(pcmp, name, path, channels, pplugins, cplugins, spcm, 1);
+		goto _free;
+	err = snd_pcm_ladspa_open1(pcmp, name, path, index, channels,
+				   block, threads, cpus, pplugins, cplugins,
+				   spcm, 1);
 	if (err < 0)
 		snd_pcm_close(spcm);
+ _free:
+	free(cpus);
 	return err;
 }
 #ifndef DOC_HIDDEN
@@ -30,6 +30,7 @@
 #include "pcm_plugin.h"
 #include "plugin_ops.h"
 #include "bswap.h"
+#include "pcm_simd.h"
 
 #ifndef DOC_HIDDEN
 
@@ -45,6 +46,12 @@ typedef double double_t;
 const char *_snd_module_pcm_lfloat = "";
 #endif
 
+#define LFLOAT_DITHER_LANES	8	/* dither states, one per 32-bit lane */
+
+typedef void (*lfloat_kernel_func_t)(void *dst, const void *src,
+				     unsigned int samples, unsigned int flags,
+				     uint32_t *dither);
+
 typedef struct {
 	/* This field need to be the first */
 	snd_pcm_plugin_t plug;
@@ -55,6 +62,12 @@ typedef struct {
 		     const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
 		     unsigned int channels, snd_pcm_uframes_t frames,
 		     unsigned int get32idx, unsigned int put32floatidx);
+	lfloat_kernel_func_t kernel;	/* vector kernel, NULL if none */
+	unsigned int kernel_flags;
+	unsigned int src_width, dst_width;	/* physical widths in bits */
+	int dither;			/* TPDF dither on float -> integer */
+	unsigned int dither_width;	/* integer width if dithering, else 0 */
+	uint32_t dither_state[LFLOAT_DITHER_LANES];
 } snd_pcm_lfloat_t;
 
 int snd_pcm_lfloat_get_s32_index(snd_pcm_format_t format)
@@ -92,6 +105,228 @@ int snd_pcm_lfloat_put_s32_index(snd_pcm_format_t format)
 
 #ifndef DOC_HIDDEN
 
+/*
+ * Contiguous runs of 16, 24 (in 4 bytes) and 32 bit integers are converted
+ * by the kernels in pcm_lfloat_simd.h, anything else goes through the
+ * labels in plugin_ops.h.  The flags follow the bits of the
+ * snd_pcm_linear_*_index() and snd_pcm_lfloat_*_s32_index() values.
+ */
+#define LFLOAT_UNSIGNED		(1<<0)	/* unsigned integers */
+#define LFLOAT_INT_SWAP		(1<<1)	/* integers not in host byte order */
+#define LFLOAT_FLOAT_SWAP	(1<<2)	/* floats not in host byte order */
+
+#define LINEAR_GETPUT_IDX(width)	(((width) / 8 - 1) * 4)
+
+struct lfloat_kernel {
+	unsigned int int_idx;		/* native signed get32/put32 index */
+	unsigned int float_idx;		/* native float32 index */
+	lfloat_kernel_func_t to_float, to_int;
+};
+
+/*
+ * Add TPDF noise of one LSB of a width bit integer to an S32 sample,
+ * saturated; state is a xorshift32 generator
+ */
+static inline int32_t lfloat_dither(int32_t s, uint32_t *state,
+				    unsigned int width)
+{
+	uint32_t r = *state;
+	int32_t n, sum;
+
+	r ^= r << 13;
+	r ^= r >> 17;
+	r ^= r << 5;
+	*state = r;
+	n = (int32_t)(r & 0xffff) - (int32_t)(r >> 16);
+	if (width >= 16)
+		n >>= width - 16;
+	else
+		n *= 1 << (16 - width);
+	sum = (int32_t)((uint32_t)s + (uint32_t)n);
+	if (((s ^ sum) & (n ^ sum)) < 0)
+		sum = s < 0 ? INT32_MIN : INT32_MAX;
+	return sum;
+}
+
+static inline int32_t lfloat_get_int(const char *src, unsigned int width,
+				     unsigned int flags)
+{
+	uint32_t u;
+
+	if (width == 16) {
+		u = *(const uint16_t *)src;
+		if (flags & LFLOAT_INT_SWAP)
+			u = bswap_16(u);
+		u <<= 16;
+	} else {
+		u = *(const uint32_t *)src;
+		if (flags & LFLOAT_INT_SWAP)
+			u = bswap_32(u);
+		if (width == 24)
+			u <<= 8;
+	}
+	if (flags & LFLOAT_UNSIGNED)
+		u ^= 0x80000000;
+	return (int32_t)u;
+}
+
+static inline void lfloat_put_int(char *dst, int32_t s, unsigned int width,
+				  unsigned int flags)
+{
+	uint32_t u;
+
+	if (flags & LFLOAT_UNSIGNED)
+		s = (int32_t)((uint32_t)s ^ 0x80000000);
+	if (width == 16) {
+		u = (uint16_t)(s >> 16);
+		if (flags & LFLOAT_INT_SWAP)
+			u = bswap_16(u);
+		*(uint16_t *)dst = u;
+	} else {
+		u = width == 24 ? s >> 8 : s;
+		if (flags & LFLOAT_INT_SWAP)
+			u = bswap_32(u);
+		*(uint32_t *)dst = u;
+	}
+}
+
+/* plain C conversions, the kernels finish their runs with these */
+static inline void lfloat_to_float(char *dst, const char *src,
+				   unsigned int samples, unsigned int width,
+				   unsigned int fwidth, unsigned int flags)
+{
+	unsigned int bytes = width == 16 ? 2 : 4;
+	snd_tmp_float_t tmp_float;
+	snd_tmp_double_t tmp_double;
+	int32_t s;
+
+	for (; samples > 0; samples--, src += bytes) {
+		s = lfloat_get_int(src, width, flags);
+		if (fwidth == 32) {
+			tmp_float.f = (float_t)s / (float_t)0x80000000UL;
+			if (flags & LFLOAT_FLOAT_SWAP)
+				tmp_float.i = bswap_32(tmp_float.i);
+			*(uint32_t *)dst = tmp_float.i;
+			dst += 4;
+		} else {
+			tmp_double.d = (double_t)s / (double_t)0x80000000UL;
+			if (flags & LFLOAT_FLOAT_SWAP)
+				tmp_double.l = bswap_64(tmp_double.l);
+			*(uint64_t *)dst = tmp_double.l;
+			dst += 8;
+		}
+	}
+}
+
+static inline void lfloat_to_int(char *dst, const char *src,
+				 unsigned int samples, unsigned int width,
+				 unsigned int fwidth, unsigned int flags,
+				 uint32_t *dither)
+{
+	unsigned int bytes = width == 16 ? 2 : 4;
+	snd_tmp_float_t tmp_float;
+	snd_tmp_double_t tmp_double;
+	int32_t s;
+
+	for (; samples > 0; samples--, dst += bytes) {
+		if (fwidth == 32) {
+			tmp_float.i = *(const uint32_t *)src;
+			if (flags & LFLOAT_FLOAT_SWAP)
+				tmp_float.i = bswap_32(tmp_float.i);
+			if (tmp_float.f >= 1.0)
+				s = 0x7fffffff;
+			else if (tmp_float.f <= -1.0)
+				s = INT32_MIN;
+			else
+				s = (int32_t)(tmp_float.f * (float_t)0x80000000UL);
+			src += 4;
+		} else {
+			tmp_double.l = *(const uint64_t *)src;
+			if (flags & LFLOAT_FLOAT_SWAP)
+				tmp_double.l = bswap_64(tmp_double.l);
+			if (tmp_double.d >= 1.0)
+				s = 0x7fffffff;
+			else if (tmp_double.d <= -1.0)
+				s = INT32_MIN;
+			else
+				s = (int32_t)(tmp_double.d * (double_t)0x80000000UL);
+			src += 8;
+		}
+		if (dither && width < 32)
+			s = lfloat_dither(s, dither, width);
+		lfloat_put_int(dst, s, width, flags);
+	}
+}
+
+#ifdef PCM_SIMD
+#define SIMD_BYTES	16
+#define SIMD_ATTR
+#define SIMD_NAME(x)	simd_##x##_v128
+#include "pcm_lfloat_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+
+#ifdef PCM_SIMD_AVX2
+#define SIMD_BYTES	32
+#define SIMD_ATTR	PCM_SIMD_AVX2_ATTR
+#define SIMD_NAME(x)	simd_##x##_avx2
+#include "pcm_lfloat_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif
+#else
+#define SIMD_BYTES	0
+#define SIMD_ATTR
+#define SIMD_NAME(x)	generic_##x
+#include "pcm_lfloat_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif /* PCM_SIMD */
+
+static const struct lfloat_kernel *lfloat_kernels(void)
+{
+#ifdef PCM_SIMD
+#ifdef PCM_SIMD_AVX2
+	if (snd_pcm_simd_features() & SND_PCM_SIMD_AVX2)
+		return simd_kernels_avx2;
+#endif
+	return simd_kernels_v128;
+#else
+	return generic_kernels;
+#endif
+}
+
+/* return 0 if the areas layout does not fit the kernel */
+static int lfloat_run_kernel(snd_pcm_lfloat_t *lfloat,
+			     const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+			     const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
+			     unsigned int channels, snd_pcm_uframes_t frames)
+{
+	uint32_t *dither = lfloat->dither_width ? lfloat->dither_state : NULL;
+	unsigned int dst_width = lfloat->dst_width, src_width = lfloat->src_width;
+	char *dst, *src;
+	unsigned int c;
+
+	dst = snd_pcm_areas_interleaved_addr(dst_areas, dst_offset, channels, dst_width);
+	src = snd_pcm_areas_interleaved_addr(src_areas, src_offset, channels, src_width);
+	if (dst && src) {
+		lfloat->kernel(dst, src, frames * channels,
+			       lfloat->kernel_flags, dither);
+		return 1;
+	}
+	if (!snd_pcm_areas_noninterleaved(dst_areas, channels, dst_width) ||
+	    !snd_pcm_areas_noninterleaved(src_areas, channels, src_width))
+		return 0;
+	for (c = 0; c < channels; c++)
+		lfloat->kernel(snd_pcm_channel_area_addr(&dst_areas[c], dst_offset),
+			       snd_pcm_channel_area_addr(&src_areas[c], src_offset),
+			       frames, lfloat->kernel_flags, dither);
+	return 1;
+}
+
 void snd_pcm_lfloat_convert_integer_float(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
 					  const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
 					  unsigned int channels, snd_pcm_uframes_t frames,
@@ -137,10 +372,12 @@ void snd_pcm_lfloat_convert_integer_float(const snd_pcm_channel_area_t *dst_area
 	}
 }
 
-void snd_pcm_lfloat_convert_float_integer(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
-					  const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
-					  unsigned int channels, snd_pcm_uframes_t frames,
-					  unsigned int put32idx, unsigned int get32floatidx)
+/* dither is NULL or the state of a dither_width bit integer format */
+static void lfloat_convert_float_integer(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+					 const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
+					 unsigned int channels, snd_pcm_uframes_t frames,
+					 unsigned int put32idx, unsigned int get32floatidx,
+					 uint32_t *dither, unsigned int dither_width)
 {
 #define PUT32_LABELS
 #define GET32F_LABELS
@@ -171,6 +408,8 @@ void snd_pcm_lfloat_convert_float_integer(const snd_pcm_channel_area_t *dst_area
 #include "plugin_ops.h"
 #undef GET32F_END
 		sample_loaded:
+			if (dither)
+				sample = lfloat_dither(sample, dither, dither_width);
 			goto *put32;
 #define PUT32_END sample_put
 #include "plugin_ops.h"
@@ -182,6 +421,16 @@ void snd_pcm_lfloat_convert_float_integer(const snd_pcm_channel_area_t *dst_area
 	}
 }
 
+void snd_pcm_lfloat_convert_float_integer(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+					  const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
+					  unsigned int channels, snd_pcm_uframes_t frames,
+					  unsigned int put32idx, unsigned int get32floatidx)
+{
+	lfloat_convert_float_integer(dst_areas, dst_offset, src_areas, src_offset,
+				     channels, frames, put32idx, get32floatidx,
+				     NULL, 0);
+}
+
 #endif /* DOC_HIDDEN */
 
 static int snd_pcm_lfloat_hw_refine_cprepare(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
@@ -265,6 +514,24 @@ static int snd_pcm_lfloat_hw_refine(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 				       snd_pcm_generic_hw_refine);
 }
 
+/* pick the vector kernel for the int32_idx and float32_idx formats */
+static void lfloat_select_kernel(snd_pcm_lfloat_t *lfloat, int to_float)
+{
+	const struct lfloat_kernel *kernel;
+
+	lfloat->kernel = NULL;
+	for (kernel = lfloat_kernels(); kernel->to_float; kernel++) {
+		if (kernel->int_idx == (lfloat->int32_idx & ~3U) &&
+		    kernel->float_idx == (lfloat->float32_idx & ~1U)) {
+			lfloat->kernel = to_float ? kernel->to_float : kernel->to_int;
+			lfloat->kernel_flags = lfloat->int32_idx & 3;
+			if (lfloat->float32_idx & 1)
+				lfloat->kernel_flags |= LFLOAT_FLOAT_SWAP;
+			return;
+		}
+	}
+}
+
 static int snd_pcm_lfloat_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 {
 	snd_pcm_lfloat_t *lfloat = pcm->private_data;
@@ -288,14 +555,43 @@ static int snd_pcm_lfloat_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 		lfloat->int32_idx = snd_pcm_linear_get_index(src_format, SND_PCM_FORMAT_S32);
 		lfloat->float32_idx = snd_pcm_lfloat_put_s32_index(dst_format);
 		lfloat->func = snd_pcm_lfloat_convert_integer_float;
+		lfloat->dither_width = 0;
 	} else {
 		lfloat->int32_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, dst_format);
 		lfloat->float32_idx = snd_pcm_lfloat_get_s32_index(src_format);
 		lfloat->func = snd_pcm_lfloat_convert_float_integer;
+		lfloat->dither_width = 0;
+		if (lfloat->dither && snd_pcm_format_width(dst_format) < 32)
+			lfloat->dither_width = snd_pcm_format_width(dst_format);
 	}
+	lfloat->src_width = snd_pcm_format_physical_width(src_format);
+	lfloat->dst_width = snd_pcm_format_physical_width(dst_format);
+	lfloat_select_kernel(lfloat, snd_pcm_format_linear(src_format));
 	return 0;
 }
 
+static void lfloat_convert(snd_pcm_lfloat_t *lfloat,
+			   const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+			   const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
+			   unsigned int channels, snd_pcm_uframes_t frames)
+{
+	if (lfloat->kernel &&
+	    lfloat_run_kernel(lfloat, dst_areas, dst_offset,
+			      src_areas, src_offset, channels, frames))
+		return;
+	if (lfloat->dither_width)
+		lfloat_convert_float_integer(dst_areas, dst_offset,
+					     src_areas, src_offset,
+					     channels, frames,
+					     lfloat->int32_idx, lfloat->float32_idx,
+					     lfloat->dither_state, lfloat->dither_width);
+	else
+		lfloat->func(dst_areas, dst_offset,
+			     src_areas, src_offset,
+			     channels, frames,
+			     lfloat->int32_idx, lfloat->float32_idx);
+}
+
 static snd_pcm_uframes_t
 snd_pcm_lfloat_write_areas(snd_pcm_t *pcm,
 			   const snd_pcm_channel_area_t *areas,
@@ -308,10 +604,8 @@ snd_pcm_lfloat_write_areas(snd_pcm_t *pcm,
 	snd_pcm_lfloat_t *lfloat = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	lfloat->func(slave_areas, slave_offset,
-		     areas, offset, 
-		     pcm->channels, size,
-		     lfloat->int32_idx, lfloat->float32_idx);
+	lfloat_convert(lfloat, slave_areas, slave_offset,
+		       areas, offset, pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -328,10 +622,8 @@ snd_pcm_lfloat_read_areas(snd_pcm_t *pcm,
 	snd_pcm_lfloat_t *lfloat = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	lfloat->func(areas, offset, 
-		     slave_areas, slave_offset,
-		     pcm->channels, size,
-		     lfloat->int32_idx, lfloat->float32_idx);
+	lfloat_convert(lfloat, areas, offset,
+		       slave_areas, slave_offset, pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -341,6 +633,8 @@ static void snd_pcm_lfloat_dump(snd_pcm_t *pcm, snd_output_t *out)
 	snd_pcm_lfloat_t *lfloat = pcm->private_data;
 	snd_output_printf(out, "Linear Integer <-> Linear Float conversion PCM (%s)\n", 
 		snd_pcm_format_name(lfloat->sformat));
+	if (lfloat->dither)
+		snd_output_printf(out, "TPDF dither on float to integer\n");
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -367,22 +661,13 @@ static const snd_pcm_ops_t snd_pcm_lfloat_ops = {
 	.set_chmap = snd_pcm_generic_set_chmap,
 };
 
-/**
- * \brief Creates a new linear conversion PCM
- * \param pcmp Returns created PCM handle
- * \param name Name of PCM
- * \param sformat Slave (destination) format
- * \param slave Slave PCM handle
- * \param close_slave When set, the slave PCM handle is closed with copy PCM
- * \retval zero on success otherwise a negative error code
- * \warning Using of this function might be dangerous in the sense
- *          of compatibility reasons. The prototype might be freely
- *          changed in future.
- */
-int snd_pcm_lfloat_open(snd_pcm_t **pcmp, const char *name, snd_pcm_format_t sformat, snd_pcm_t *slave, int close_slave)
+static int lfloat_open(snd_pcm_t **pcmp, const char *name,
+		       snd_pcm_format_t sformat, int dither,
+		       snd_pcm_t *slave, int close_slave)
 {
 	snd_pcm_t *pcm;
 	snd_pcm_lfloat_t *lfloat;
+	unsigned int i;
 	int err;
 	assert(pcmp && slave);
 	if (snd_pcm_format_linear(sformat) != 1 &&
@@ -394,6 +679,9 @@ int snd_pcm_lfloat_open(snd_pcm_t **pcmp, const char *name, snd_pcm_format_t sfo
 	}
 	snd_pcm_plugin_init(&lfloat->plug);
 	lfloat->sformat = sformat;
+	lfloat->dither = dither;
+	for (i = 0; i < LFLOAT_DITHER_LANES; i++)
+		lfloat->dither_state[i] = 0x9e3779b9U * (i + 1);
 	lfloat->plug.read = snd_pcm_lfloat_read_areas;
 	lfloat->plug.write = snd_pcm_lfloat_write_areas;
 	lfloat->plug.undo_read = snd_pcm_plugin_undo_read_generic;
@@ -419,6 +707,23 @@ int snd_pcm_lfloat_open(snd_pcm_t **pcmp, const char *name, snd_pcm_format_t sfo
 	return 0;
 }
 
+/**
+ * \brief Creates a new linear conversion PCM
+ * \param pcmp Returns created PCM handle
+ * \param name Name of PCM
+ * \param sformat Slave (destination) format
+ * \param slave Slave PCM handle
+ * \param close_slave When set, the slave PCM handle is closed with copy PCM
+ * \retval zero on success otherwise a negative error code
+ * \warning Using of this function might be dangerous in the sense
+ *          of compatibility reasons. The prototype might be freely
+ *          changed in future.
+ */
+int snd_pcm_lfloat_open(snd_pcm_t **pcmp, const char *name, snd_pcm_format_t sformat, snd_pcm_t *slave, int close_slave)
+{
+	return lfloat_open(pcmp, name, sformat, 0, slave, close_slave);
+}
+
 /*! \page pcm_plugins
 
 \section pcm_plugins_lfloat Plugin: linear<->float
@@ -438,9 +743,17 @@ pcm.name {
                 pcm { }         # Slave PCM definition
                 format STR      # Slave format
         }
+        [dither BOOL]           # TPDF dither on float to integer
+                                # (default no)
 }
 \endcode
 
+Contiguous runs of 16, 24 and 32 bit samples are converted by vector
+kernels, other formats and layouts sample by sample.  Denormal floats are
+flushed to zero, the result is the same.  With dither set, triangular
+noise of one LSB of the integer format is added before the float samples
+are truncated to integers of less than 32 bits.
+
 \subsection pcm_plugins_lfloat_funcref Function reference
 
 <UL>
@@ -472,6 +785,7 @@ int _snd_pcm_lfloat_open(snd_pcm_t **pcmp, const char *name,
 	snd_pcm_t *spcm;
 	snd_config_t *slave = NULL, *sconf;
 	snd_pcm_format_t sformat;
+	int dither = 0;
 	snd_config_for_each(i, next, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
 		const char *id;
@@ -483,6 +797,13 @@ int _snd_pcm_lfloat_open(snd_pcm_t **pcmp, const char *name,
 			slave = n;
 			continue;
 		}
+		if (strcmp(id, "dither") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return -EINVAL;
+			dither = err;
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -504,7 +825,7 @@ int _snd_pcm_lfloat_open(snd_pcm_t **pcmp, const char *name,
 	snd_config_delete(sconf);
 	if (err < 0)
 		return err;
-	err = snd_pcm_lfloat_open(pcmp, name, sformat, spcm, 1);
+	err = lfloat_open(pcmp, name, sformat, dither, spcm, 1);
 	if (err < 0)
 		snd_pcm_close(spcm);
 	return err;
@@ -0,0 +1,301 @@
+/**
+ * \file pcm/pcm_lfloat_simd.h
+ * \ingroup PCM_Plugins
+ * \brief PCM Linear<->Float Conversion Plugin Interface - conversion kernels
+ */
+/*
+ *  PCM - Linear Integer <-> Linear Float conversion
+ *
+ *  This file is included from pcm_lfloat.c several times, with
+ *  SIMD_BYTES (vector size, 0 for plain C), SIMD_ATTR (function
+ *  attributes) and SIMD_NAME() (symbol suffix) defined.
+ *
+ *  The kernels convert a run of contiguous samples between 16, 24 (in 4
+ *  bytes) or 32 bit integers and float or double.  The flags give the
+ *  byte order of both sides and the sign of the integers.  The results
+ *  are identical to the get32/put32 and the float labels in plugin_ops.h;
+ *  denormal floats are flushed to zero before the conversion, which
+ *  truncates them to zero anyway.  A dither state, when given, adds TPDF
+ *  noise of one LSB of the integer width.
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#if SIMD_BYTES
+typedef uint16_t SIMD_NAME(hu16) __attribute__((vector_size(SIMD_BYTES / 2)));
+typedef int32_t SIMD_NAME(hs32) __attribute__((vector_size(SIMD_BYTES / 2)));
+typedef int32_t SIMD_NAME(vs32) __attribute__((vector_size(SIMD_BYTES)));
+typedef uint32_t SIMD_NAME(vu32) __attribute__((vector_size(SIMD_BYTES)));
+typedef int64_t SIMD_NAME(vs64) __attribute__((vector_size(SIMD_BYTES)));
+typedef uint64_t SIMD_NAME(vu64) __attribute__((vector_size(SIMD_BYTES)));
+typedef float SIMD_NAME(vf32) __attribute__((vector_size(SIMD_BYTES)));
+typedef double SIMD_NAME(vf64) __attribute__((vector_size(SIMD_BYTES)));
+
+/* 32-bit lanes in one vector */
+#define LANES		(SIMD_BYTES / 4)
+
+/* the lower and the upper half of the 32-bit lanes, and both together */
+#if SIMD_BYTES == 16
+#define HALF_LO		0, 1
+#define HALF_HI		2, 3
+#define HALF_CAT	0, 1, 2, 3
+#else
+#define HALF_LO		0, 1, 2, 3
+#define HALF_HI		4, 5, 6, 7
+#define HALF_CAT	0, 1, 2, 3, 4, 5, 6, 7
+#endif
+
+static inline __attribute__((always_inline)) SIMD_ATTR
+SIMD_NAME(vu32) SIMD_NAME(bswap32)(SIMD_NAME(vu32) x)
+{
+	return (x << 24) | ((x & 0xff00) << 8) | ((x >> 8) & 0xff00) | (x >> 24);
+}
+
+static inline __attribute__((always_inline)) SIMD_ATTR
+SIMD_NAME(vu64) SIMD_NAME(bswap64)(SIMD_NAME(vu64) x)
+{
+	x = (SIMD_NAME(vu64))SIMD_NAME(bswap32)((SIMD_NAME(vu32))x);
+	return (x << 32) | (x >> 32);
+}
+
+/* the integers as the upper bits of S32, like the get32 labels */
+static inline __attribute__((always_inline)) SIMD_ATTR
+SIMD_NAME(vs32) SIMD_NAME(load_int)(const char *src, unsigned int width,
+				    unsigned int flags)
+{
+	SIMD_NAME(vu32) u;
+
+	if (width == 16) {
+		SIMD_NAME(hu16) h;
+
+		simd_load(h, src);
+		if (flags & LFLOAT_INT_SWAP)
+			h = (h << 8) | (h >> 8);
+		u = simd_convert(h, SIMD_NAME(vu32)) << 16;
+	} else {
+		simd_load(u, src);
+		if (flags & LFLOAT_INT_SWAP)
+			u = SIMD_NAME(bswap32)(u);
+		if (width == 24)
+			u <<= 8;
+	}
+	if (flags & LFLOAT_UNSIGNED)
+		u ^= 0x80000000;
+	return (SIMD_NAME(vs32))u;
+}
+
+/* S32 to the integer format, like the put32 labels */
+static inline __attribute__((always_inline)) SIMD_ATTR
+void SIMD_NAME(store_int)(char *dst, SIMD_NAME(vs32) s, unsigned int width,
+			  unsigned int flags)
+{
+	SIMD_NAME(vu32) u;
+
+	if (flags & LFLOAT_UNSIGNED)
+		s = (SIMD_NAME(vs32))((SIMD_NAME(vu32))s ^ 0x80000000);
+	if (width == 16) {
+		SIMD_NAME(hu16) h = simd_convert(s >> 16, SIMD_NAME(hu16));
+
+		if (flags & LFLOAT_INT_SWAP)
+			h = (h << 8) | (h >> 8);
+		simd_store(dst, h);
+	} else {
+		u = (SIMD_NAME(vu32))(width == 24 ? s >> 8 : s);
+		if (flags & LFLOAT_INT_SWAP)
+			u = SIMD_NAME(bswap32)(u);
+		simd_store(dst, u);
+	}
+}
+
+/* get32f for half a vector of doubles, denormals flushed */
+static inline __attribute__((always_inline)) SIMD_ATTR
+SIMD_NAME(hs32) SIMD_NAME(load_double)(const char *src, unsigned int flags)
+{
+	SIMD_NAME(vu64) u;
+	SIMD_NAME(vs64) hi, lo;
+	SIMD_NAME(hs32) s, h, l;
+
+	simd_load(u, src);
+	if (flags & LFLOAT_FLOAT_SWAP)
+		u = SIMD_NAME(bswap64)(u);
+	u &= ~(SIMD_NAME(vu64))((u & 0x7ff0000000000000ULL) == 0);
+	hi = (SIMD_NAME(vf64))u >= 1.0;
+	lo = (SIMD_NAME(vf64))u <= -1.0;
+	u &= ~(SIMD_NAME(vu64))(hi | lo);
+	s = simd_convert((SIMD_NAME(vf64))u * 2147483648.0, SIMD_NAME(hs32));
+	h = simd_convert(hi, SIMD_NAME(hs32));
+	l = simd_convert(lo, SIMD_NAME(hs32));
+	return (s & ~(h | l)) | (0x7fffffff & h) | (INT32_MIN & l);
+}
+
+/* get32f for a vector of floats, denormals flushed */
+static inline __attribute__((always_inline)) SIMD_ATTR
+SIMD_NAME(vs32) SIMD_NAME(load_float)(const char *src, unsigned int flags)
+{
+	SIMD_NAME(vu32) u;
+	SIMD_NAME(vs32) s, hi, lo;
+
+	simd_load(u, src);
+	if (flags & LFLOAT_FLOAT_SWAP)
+		u = SIMD_NAME(bswap32)(u);
+	u &= ~(SIMD_NAME(vu32))((u & 0x7f800000) == 0);
+	hi = (SIMD_NAME(vf32))u >= 1.0f;
+	lo = (SIMD_NAME(vf32))u <= -1.0f;
+	u &= ~(SIMD_NAME(vu32))(hi | lo);
+	s = simd_convert((SIMD_NAME(vf32))u * 2147483648.0f, SIMD_NAME(vs32));
+	return (s & ~(hi | lo)) | (0x7fffffff & hi) | (INT32_MIN & lo);
+}
+
+/* lfloat_dither() for all lanes, width is 16 or 24 */
+static inline __attribute__((always_inline)) SIMD_ATTR
+SIMD_NAME(vs32) SIMD_NAME(dither)(SIMD_NAME(vs32) s, SIMD_NAME(vu32) *state,
+				  unsigned int width)
+{
+	SIMD_NAME(vu32) r = *state;
+	SIMD_NAME(vs32) n, sum, ovf;
+
+	r ^= r << 13;
+	r ^= r >> 17;
+	r ^= r << 5;
+	*state = r;
+	n = (SIMD_NAME(vs32))(r & 0xffff) - (SIMD_NAME(vs32))(r >> 16);
+	n >>= width - 16;
+	sum = (SIMD_NAME(vs32))((SIMD_NAME(vu32))s + (SIMD_NAME(vu32))n);
+	ovf = ((s ^ sum) & (n ^ sum)) < 0;
+	return (sum & ~ovf) | (((s >> 31) ^ 0x7fffffff) & ovf);
+}
+#endif
+
+static inline __attribute__((always_inline)) SIMD_ATTR
+void SIMD_NAME(to_float)(void *dst, const void *src, unsigned int samples,
+			 unsigned int width, unsigned int fwidth,
+			 unsigned int flags)
+{
+	const char *in = src;
+	char *out = dst;
+	unsigned int i = 0;
+#if SIMD_BYTES
+	unsigned int bytes = width == 16 ? 2 : 4;
+	SIMD_NAME(vs32) s;
+	SIMD_NAME(vu32) f;
+	SIMD_NAME(vu64) d;
+
+	for (; i + LANES <= samples; i += LANES) {
+		s = SIMD_NAME(load_int)(in + i * bytes, width, flags);
+		if (fwidth == 32) {
+			f = (SIMD_NAME(vu32))(simd_convert(s, SIMD_NAME(vf32)) *
+					      (1.0f / 2147483648.0f));
+			if (flags & LFLOAT_FLOAT_SWAP)
+				f = SIMD_NAME(bswap32)(f);
+			simd_store(out + i * 4, f);
+			continue;
+		}
+		d = (SIMD_NAME(vu64))(simd_convert(simd_shuffle(s, s, HALF_LO),
+						   SIMD_NAME(vf64)) *
+				      (1.0 / 2147483648.0));
+		if (flags & LFLOAT_FLOAT_SWAP)
+			d = SIMD_NAME(bswap64)(d);
+		simd_store(out + i * 8, d);
+		d = (SIMD_NAME(vu64))(simd_convert(simd_shuffle(s, s, HALF_HI),
+						   SIMD_NAME(vf64)) *
+				      (1.0 / 2147483648.0));
+		if (flags & LFLOAT_FLOAT_SWAP)
+			d = SIMD_NAME(bswap64)(d);
+		simd_store(out + i * 8 + SIMD_BYTES, d);
+	}
+#endif
+	lfloat_to_float(out + i * fwidth / 8, in + i * (width == 16 ? 2 : 4),
+			samples - i, width, fwidth, flags);
+}
+
+static inline __attribute__((always_inline)) SIMD_ATTR
+void SIMD_NAME(to_int)(void *dst, const void *src, unsigned int samples,
+		       unsigned int width, unsigned int fwidth,
+		       unsigned int flags, uint32_t *dither)
+{
+	const char *in = src;
+	char *out = dst;
+	unsigned int i = 0;
+#if SIMD_BYTES
+	unsigned int bytes = width == 16 ? 2 : 4;
+	SIMD_NAME(vs32) s;
+	SIMD_NAME(vu32) state = { 0 };
+
+	if (width == 32)
+		dither = NULL;
+	if (dither)
+		__builtin_memcpy(&state, dither, sizeof(state));
+	for (; i + LANES <= samples; i += LANES) {
+		if (fwidth == 32)
+			s = SIMD_NAME(load_float)(in + i * 4, flags);
+		else
+			s = simd_shuffle(SIMD_NAME(load_double)(in + i * 8, flags),
+					 SIMD_NAME(load_double)(in + i * 8 + SIMD_BYTES, flags),
+					 HALF_CAT);
+		if (dither)
+			s = SIMD_NAME(dither)(s, &state, width);
+		SIMD_NAME(store_int)(out + i * bytes, s, width, flags);
+	}
+	if (dither)
+		__builtin_memcpy(dither, &state, sizeof(state));
+#endif
+	lfloat_to_int(out + i * (width == 16 ? 2 : 4), in + i * fwidth / 8,
+		      samples - i, width, fwidth, flags, dither);
+}
+
+#define LFLOAT_KERNEL(width, fwidth) \
+static SIMD_ATTR \
+void SIMD_NAME(s##width##_to_f##fwidth)(void *dst, const void *src, \
+					unsigned int samples, \
+					unsigned int flags, \
+					uint32_t *dither ATTRIBUTE_UNUSED) \
+{ \
+	SIMD_NAME(to_float)(dst, src, samples, width, fwidth, flags); \
+} \
+static SIMD_ATTR \
+void SIMD_NAME(f##fwidth##_to_s##width)(void *dst, const void *src, \
+					unsigned int samples, \
+					unsigned int flags, uint32_t *dither) \
+{ \
+	SIMD_NAME(to_int)(dst, src, samples, width, fwidth, flags, dither); \
+}
+
+LFLOAT_KERNEL(16, 32)
+LFLOAT_KERNEL(24, 32)
+LFLOAT_KERNEL(32, 32)
+LFLOAT_KERNEL(16, 64)
+LFLOAT_KERNEL(24, 64)
+LFLOAT_KERNEL(32, 64)
+
+#undef LFLOAT_KERNEL
+
+static const struct lfloat_kernel SIMD_NAME(kernels)[] = {
+	{ LINEAR_GETPUT_IDX(16), 0, SIMD_NAME(s16_to_f32), SIMD_NAME(f32_to_s16) },
+	{ LINEAR_GETPUT_IDX(24), 0, SIMD_NAME(s24_to_f32), SIMD_NAME(f32_to_s24) },
+	{ LINEAR_GETPUT_IDX(32), 0, SIMD_NAME(s32_to_f32), SIMD_NAME(f32_to_s32) },
+	{ LINEAR_GETPUT_IDX(16), 2, SIMD_NAME(s16_to_f64), SIMD_NAME(f64_to_s16) },
+	{ LINEAR_GETPUT_IDX(24), 2, SIMD_NAME(s24_to_f64), SIMD_NAME(f64_to_s24) },
+	{ LINEAR_GETPUT_IDX(32), 2, SIMD_NAME(s32_to_f64), SIMD_NAME(f64_to_s32) },
+	{ 0, 0, NULL, NULL }
+};
+
+#if SIMD_BYTES
+#undef LANES
+#undef HALF_LO
+#undef HALF_HI
+#undef HALF_CAT
+#endif
@@ -30,6 +30,7 @@
 #include "pcm_plugin.h"
 #include "plugin_ops.h"
 #include "bswap.h"
+#include "pcm_simd.h"
 
 #ifndef PIC
 /* entry for static linking */
@@ -143,6 +144,96 @@ int snd_pcm_linear_put_index(snd_pcm_format_t src_format, snd_pcm_format_t dst_f
 	}
 }
 
+/*
+ * Conversion kernels for the common format pairs
+ *
+ * The kernels convert a run of contiguous samples and are used when both
+ * sides are interleaved or when every channel is contiguous, anything
+ * else goes through the conversion labels in plugin_ops.h.  Each table
+ * is terminated by an entry with a NULL func.
+ */
+typedef void (*linear_kernel_func_t)(void *dst, const void *src,
+				     snd_pcm_uframes_t samples);
+
+struct linear_kernel {
+	int conv_idx;			/* snd_pcm_linear_convert() index, -1 if none */
+	unsigned int get_idx, put_idx;	/* snd_pcm_linear_getput() indices */
+	unsigned int src_width, dst_width;	/* physical width in bits */
+	linear_kernel_func_t func;
+};
+
+/* indices of native endian signed formats, see snd_pcm_linear_*_index() */
+#define LINEAR_CONV_IDX(src_width, dst_width) \
+	(((src_width) / 8 - 1) * 32 + ((dst_width) / 8 - 1) * 2)
+#define LINEAR_GETPUT_IDX(width)	(((width) / 8 - 1) * 4)
+#define LINEAR_GETPUT_IDX_24_3		20
+
+#ifdef PCM_SIMD
+#define SIMD_BYTES	16
+#define SIMD_ATTR
+#define SIMD_NAME(x)	simd_##x##_v128
+#include "pcm_linear_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+
+#ifdef PCM_SIMD_AVX2
+#define SIMD_BYTES	32
+#define SIMD_ATTR	PCM_SIMD_AVX2_ATTR
+#define SIMD_NAME(x)	simd_##x##_avx2
+#include "pcm_linear_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif
+#else
+#define SIMD_BYTES	0
+#define SIMD_ATTR
+#define SIMD_NAME(x)	generic_##x
+#include "pcm_linear_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif /* PCM_SIMD */
+
+static const struct linear_kernel *linear_kernels(void)
+{
+#ifdef PCM_SIMD
+#ifdef PCM_SIMD_AVX2
+	if (snd_pcm_simd_features() & SND_PCM_SIMD_AVX2)
+		return simd_kernels_avx2;
+#endif
+	return simd_kernels_v128;
+#else
+	return generic_kernels;
+#endif
+}
+
+/* return 0 if the areas layout does not fit the kernel */
+static int linear_run_kernel(const struct linear_kernel *kernel,
+			     const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+			     const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
+			     unsigned int channels, snd_pcm_uframes_t frames)
+{
+	char *dst, *src;
+	unsigned int c;
+
+	dst = snd_pcm_areas_interleaved_addr(dst_areas, dst_offset, channels, kernel->dst_width);
+	src = snd_pcm_areas_interleaved_addr(src_areas, src_offset, channels, kernel->src_width);
+	if (dst && src) {
+		kernel->func(dst, src, frames * channels);
+		return 1;
+	}
+	if (!snd_pcm_areas_noninterleaved(dst_areas, channels, kernel->dst_width) ||
+	    !snd_pcm_areas_noninterleaved(src_areas, channels, kernel->src_width))
+		return 0;
+	for (c = 0; c < channels; c++)
+		kernel->func(snd_pcm_channel_area_addr(&dst_areas[c], dst_offset),
+			     snd_pcm_channel_area_addr(&src_areas[c], src_offset),
+			     frames);
+	return 1;
+}
+
 void snd_pcm_linear_convert(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
 			    const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
 			    unsigned int channels, snd_pcm_uframes_t frames,
@@ -152,7 +243,18 @@ void snd_pcm_linear_convert(const snd_pcm_channel_area_t *dst_areas, snd_pcm_ufr
 #include "plugin_ops.h"
 #undef CONV_LABELS
 	void *conv = conv_labels[convidx];
+	const struct linear_kernel *kernel;
 	unsigned int channel;
+
+	for (kernel = linear_kernels(); kernel->func; kernel++) {
+		if (kernel->conv_idx == (int)convidx) {
+			if (linear_run_kernel(kernel, dst_areas, dst_offset,
+					      src_areas, src_offset,
+					      channels, frames))
+				return;
+			break;
+		}
+	}
 	for (channel = 0; channel < channels; ++channel) {
 		const char *src;
 		char *dst;
@@ -187,8 +289,19 @@ void snd_pcm_linear_getput(const snd_pcm_channel_area_t *dst_areas, snd_pcm_ufra
 #undef CONV24_LABELS
 	void *get = get32_labels[get_idx];
 	void *put = put32_labels[put_idx];
+	const struct linear_kernel *kernel;
 	unsigned int channel;
 	uint32_t sample = 0;
+
+	for (kernel = linear_kernels(); kernel->func; kernel++) {
+		if (kernel->get_idx == get_idx && kernel->put_idx == put_idx) {
+			if (linear_run_kernel(kernel, dst_areas, dst_offset,
+					      src_areas, src_offset,
+					      channels, frames))
+				return;
+			break;
+		}
+	}
 	for (channel = 0; channel < channels; ++channel) {
 		const char *src;
 		char *dst;
@@ -0,0 +1,332 @@
+/**
+ * \file pcm/pcm_linear_simd.h
+ * \ingroup PCM_Plugins
+ * \brief PCM Linear Conversion Plugin Interface - sample run kernels
+ */
+/*
+ *  Linear conversion
+ *
+ *  This file is included from pcm_linear.c several times, with
+ *  SIMD_BYTES (vector size, 0 for plain C), SIMD_ATTR (function
+ *  attributes) and SIMD_NAME() (symbol suffix) defined.
+ *
+ *  Each kernel converts a run of contiguous native endian signed samples,
+ *  the results are identical to the conversion labels in plugin_ops.h.
+ *  The 3 byte formats are handled for little endian hosts only.  The
+ *  table at the end maps the conversion indices to the kernels.
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#if SIMD_BYTES
+typedef uint8_t SIMD_NAME(vu8) __attribute__((vector_size(SIMD_BYTES)));
+typedef int16_t SIMD_NAME(hs16) __attribute__((vector_size(SIMD_BYTES / 2)));
+typedef int32_t SIMD_NAME(vs32) __attribute__((vector_size(SIMD_BYTES)));
+typedef uint32_t SIMD_NAME(vu32) __attribute__((vector_size(SIMD_BYTES)));
+
+/* 32-bit lanes in one vector */
+#define LANES		(SIMD_BYTES / 4)
+
+/* byte shuffles between 3 byte samples and the upper bytes of 32-bit lanes */
+#define UNPACK3(i)	SIMD_BYTES, 3 * (i), 3 * (i) + 1, 3 * (i) + 2
+#define PACK3(i)	4 * (i) + 1, 4 * (i) + 2, 4 * (i) + 3
+#if SIMD_BYTES == 16
+#define UNPACK3_ALL	UNPACK3(0), UNPACK3(1), UNPACK3(2), UNPACK3(3)
+#define PACK3_ALL	PACK3(0), PACK3(1), PACK3(2), PACK3(3), 0, 0, 0, 0
+#else
+#define UNPACK3_ALL	UNPACK3(0), UNPACK3(1), UNPACK3(2), UNPACK3(3), \
+			UNPACK3(4), UNPACK3(5), UNPACK3(6), UNPACK3(7)
+#define PACK3_ALL	PACK3(0), PACK3(1), PACK3(2), PACK3(3), \
+			PACK3(4), PACK3(5), PACK3(6), PACK3(7), \
+			0, 0, 0, 0, 0, 0, 0, 0
+#endif
+
+/*
+ * LANES 3 byte samples to 32-bit lanes, the sample in the upper 24 bits;
+ * reads a whole vector, so the caller keeps SIMD_BYTES valid bytes at src
+ */
+static inline __attribute__((always_inline)) SIMD_ATTR
+SIMD_NAME(vu32) SIMD_NAME(load3)(const uint8_t *src)
+{
+	SIMD_NAME(vu8) v, zero = { 0 };
+
+	simd_load(v, src);
+	v = simd_shuffle(v, zero, UNPACK3_ALL);
+	return (SIMD_NAME(vu32))v;
+}
+
+/* the upper 24 bits of LANES 32-bit lanes to 3 byte samples */
+static inline __attribute__((always_inline)) SIMD_ATTR
+void SIMD_NAME(store3)(uint8_t *dst, SIMD_NAME(vu32) x)
+{
+	SIMD_NAME(vu8) v = (SIMD_NAME(vu8))x;
+
+	v = simd_shuffle(v, v, PACK3_ALL);
+	__builtin_memcpy(dst, &v, LANES * 3);
+}
+#endif
+
+static inline uint32_t SIMD_NAME(get3)(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24;
+}
+
+static inline void SIMD_NAME(put3)(uint8_t *p, uint32_t x)
+{
+	p[0] = x >> 8;
+	p[1] = x >> 16;
+	p[2] = x >> 24;
+}
+
+static SIMD_ATTR
+void SIMD_NAME(conv_16_32)(void *dst_addr, const void *src_addr,
+			   snd_pcm_uframes_t samples)
+{
+	const uint16_t *src = src_addr;
+	uint32_t *dst = dst_addr;
+	snd_pcm_uframes_t i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(hs16) s;
+	SIMD_NAME(vu32) d;
+
+	for (; i + LANES <= samples; i += LANES) {
+		simd_load(s, src + i);
+		d = simd_convert(s, SIMD_NAME(vu32)) << 16;
+		simd_store(dst + i, d);
+	}
+#endif
+	for (; i < samples; i++)
+		dst[i] = (uint32_t)src[i] << 16;
+}
+
+static SIMD_ATTR
+void SIMD_NAME(conv_32_16)(void *dst_addr, const void *src_addr,
+			   snd_pcm_uframes_t samples)
+{
+	const uint32_t *src = src_addr;
+	uint16_t *dst = dst_addr;
+	snd_pcm_uframes_t i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(vs32) s;
+	SIMD_NAME(hs16) d;
+
+	for (; i + LANES <= samples; i += LANES) {
+		simd_load(s, src + i);
+		d = simd_convert(s >> 16, SIMD_NAME(hs16));
+		simd_store(dst + i, d);
+	}
+#endif
+	for (; i < samples; i++)
+		dst[i] = src[i] >> 16;
+}
+
+/* S24 in 4 bytes, sign extended like sx24() */
+static SIMD_ATTR
+void SIMD_NAME(conv_16_24)(void *dst_addr, const void *src_addr,
+			   snd_pcm_uframes_t samples)
+{
+	const int16_t *src = src_addr;
+	int32_t *dst = dst_addr;
+	snd_pcm_uframes_t i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(hs16) s;
+	SIMD_NAME(vs32) d;
+
+	for (; i + LANES <= samples; i += LANES) {
+		simd_load(s, src + i);
+		d = simd_convert(s, SIMD_NAME(vs32)) * 256;
+		simd_store(dst + i, d);
+	}
+#endif
+	for (; i < samples; i++)
+		dst[i] = src[i] * 256;
+}
+
+static SIMD_ATTR
+void SIMD_NAME(conv_24_16)(void *dst_addr, const void *src_addr,
+			   snd_pcm_uframes_t samples)
+{
+	const uint32_t *src = src_addr;
+	uint16_t *dst = dst_addr;
+	snd_pcm_uframes_t i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(vu32) s;
+	SIMD_NAME(hs16) d;
+
+	for (; i + LANES <= samples; i += LANES) {
+		simd_load(s, src + i);
+		d = simd_convert(s >> 8, SIMD_NAME(hs16));
+		simd_store(dst + i, d);
+	}
+#endif
+	for (; i < samples; i++)
+		dst[i] = src[i] >> 8;
+}
+
+static SIMD_ATTR
+void SIMD_NAME(conv_24_32)(void *dst_addr, const void *src_addr,
+			   snd_pcm_uframes_t samples)
+{
+	const uint32_t *src = src_addr;
+	uint32_t *dst = dst_addr;
+	snd_pcm_uframes_t i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(vu32) s;
+
+	for (; i + LANES <= samples; i += LANES) {
+		simd_load(s, src + i);
+		s <<= 8;
+		simd_store(dst + i, s);
+	}
+#endif
+	for (; i < samples; i++)
+		dst[i] = src[i] << 8;
+}
+
+static SIMD_ATTR
+void SIMD_NAME(conv_32_24)(void *dst_addr, const void *src_addr,
+			   snd_pcm_uframes_t samples)
+{
+	const int32_t *src = src_addr;
+	int32_t *dst = dst_addr;
+	snd_pcm_uframes_t i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(vs32) s;
+
+	for (; i + LANES <= samples; i += LANES) {
+		simd_load(s, src + i);
+		s >>= 8;
+		simd_store(dst + i, s);
+	}
+#endif
+	for (; i < samples; i++)
+		dst[i] = src[i] >> 8;
+}
+
+static SIMD_ATTR
+void SIMD_NAME(conv_24_3_32)(void *dst_addr, const void *src_addr,
+			     snd_pcm_uframes_t samples)
+{
+	const uint8_t *src = src_addr;
+	uint32_t *dst = dst_addr;
+	snd_pcm_uframes_t i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(vu32) d;
+
+	for (; i * 3 + SIMD_BYTES <= samples * 3; i += LANES) {
+		d = SIMD_NAME(load3)(src + i * 3);
+		simd_store(dst + i, d);
+	}
+#endif
+	for (; i < samples; i++)
+		dst[i] = SIMD_NAME(get3)(src + i * 3);
+}
+
+static SIMD_ATTR
+void SIMD_NAME(conv_32_24_3)(void *dst_addr, const void *src_addr,
+			     snd_pcm_uframes_t samples)
+{
+	const uint32_t *src = src_addr;
+	uint8_t *dst = dst_addr;
+	snd_pcm_uframes_t i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(vu32) s;
+
+	for (; i + LANES <= samples; i += LANES) {
+		simd_load(s, src + i);
+		SIMD_NAME(store3)(dst + i * 3, s);
+	}
+#endif
+	for (; i < samples; i++)
+		SIMD_NAME(put3)(dst + i * 3, src[i]);
+}
+
+static SIMD_ATTR
+void SIMD_NAME(conv_16_24_3)(void *dst_addr, const void *src_addr,
+			     snd_pcm_uframes_t samples)
+{
+	const uint16_t *src = src_addr;
+	uint8_t *dst = dst_addr;
+	snd_pcm_uframes_t i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(hs16) s;
+	SIMD_NAME(vu32) d;
+
+	for (; i + LANES <= samples; i += LANES) {
+		simd_load(s, src + i);
+		d = simd_convert(s, SIMD_NAME(vu32)) << 16;
+		SIMD_NAME(store3)(dst + i * 3, d);
+	}
+#endif
+	for (; i < samples; i++)
+		SIMD_NAME(put3)(dst + i * 3, (uint32_t)src[i] << 16);
+}
+
+static SIMD_ATTR
+void SIMD_NAME(conv_24_3_16)(void *dst_addr, const void *src_addr,
+			     snd_pcm_uframes_t samples)
+{
+	const uint8_t *src = src_addr;
+	uint16_t *dst = dst_addr;
+	snd_pcm_uframes_t i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(vu32) s;
+	SIMD_NAME(hs16) d;
+
+	for (; i * 3 + SIMD_BYTES <= samples * 3; i += LANES) {
+		s = SIMD_NAME(load3)(src + i * 3);
+		d = simd_convert(s >> 16, SIMD_NAME(hs16));
+		simd_store(dst + i, d);
+	}
+#endif
+	for (; i < samples; i++)
+		dst[i] = SIMD_NAME(get3)(src + i * 3) >> 16;
+}
+
+#if SIMD_BYTES
+#undef LANES
+#undef UNPACK3
+#undef PACK3
+#undef UNPACK3_ALL
+#undef PACK3_ALL
+#endif
+
+static const struct linear_kernel SIMD_NAME(kernels)[] = {
+	{ LINEAR_CONV_IDX(16, 32), LINEAR_GETPUT_IDX(16), LINEAR_GETPUT_IDX(32),
+	  16, 32, SIMD_NAME(conv_16_32) },
+	{ LINEAR_CONV_IDX(32, 16), LINEAR_GETPUT_IDX(32), LINEAR_GETPUT_IDX(16),
+	  32, 16, SIMD_NAME(conv_32_16) },
+	{ LINEAR_CONV_IDX(16, 24), LINEAR_GETPUT_IDX(16), LINEAR_GETPUT_IDX(24),
+	  16, 32, SIMD_NAME(conv_16_24) },
+	{ LINEAR_CONV_IDX(24, 16), LINEAR_GETPUT_IDX(24), LINEAR_GETPUT_IDX(16),
+	  32, 16, SIMD_NAME(conv_24_16) },
+	{ LINEAR_CONV_IDX(24, 32), LINEAR_GETPUT_IDX(24), LINEAR_GETPUT_IDX(32),
+	  32, 32, SIMD_NAME(conv_24_32) },
+	{ LINEAR_CONV_IDX(32, 24), LINEAR_GETPUT_IDX(32), LINEAR_GETPUT_IDX(24),
+	  32, 32, SIMD_NAME(conv_32_24) },
+#ifdef SND_LITTLE_ENDIAN
+	{ -1, LINEAR_GETPUT_IDX_24_3, LINEAR_GETPUT_IDX(32),
+	  24, 32, SIMD_NAME(conv_24_3_32) },
+	{ -1, LINEAR_GETPUT_IDX(32), LINEAR_GETPUT_IDX_24_3,
+	  32, 24, SIMD_NAME(conv_32_24_3) },
+	{ -1, LINEAR_GETPUT_IDX(16), LINEAR_GETPUT_IDX_24_3,
+	  16, 24, SIMD_NAME(conv_16_24_3) },
+	{ -1, LINEAR_GETPUT_IDX_24_3, LINEAR_GETPUT_IDX(16),
+	  24, 16, SIMD_NAME(conv_24_3_16) },
+#endif
+	{ -1, 0, 0, 0, 0, NULL }
+};
@@ -30,16 +30,13 @@
 #include "pcm_local.h"
 #include "pcm_plugin.h"
 #include "bswap.h"
+#include "pcm_simd.h"
 #include <time.h>
+#include <math.h>
+#include <sound/tlv.h>
 #include <pthread.h>
 #include <dlfcn.h>
 
-#ifndef DOC_HIDDEN
-#define atomic_read(ptr)    __atomic_load_n(ptr, __ATOMIC_SEQ_CST )
-#define atomic_add(ptr, n)  __atomic_add_fetch(ptr, n, __ATOMIC_SEQ_CST)
-#define atomic_dec(ptr)     __atomic_sub_fetch(ptr, 1, __ATOMIC_SEQ_CST)
-#endif
-
 #ifndef PIC
 /* entry for static linking */
 const char *_snd_module_pcm_meter = "";
@@ -47,6 +44,8 @@ const char *_snd_module_pcm_meter = "";
 
 #ifndef DOC_HIDDEN
 #define FREQUENCY 50
+/* frame ranges queued for the meter thread, a power of two */
+#define RANGES 256
 
 struct _snd_pcm_scope {
 	int enabled;
@@ -56,6 +55,12 @@ struct _snd_pcm_scope {
 	struct list_head list;
 };
 
+/* frames copied to the meter buffer, or a reset when frames is 0 */
+struct snd_pcm_meter_range {
+	snd_pcm_uframes_t ptr;
+	snd_pcm_uframes_t frames;
+};
+
 typedef struct _snd_pcm_meter {
 	snd_pcm_generic_t gen;
 	snd_pcm_uframes_t rptr;
@@ -66,23 +71,74 @@ typedef struct _snd_pcm_meter {
 	struct list_head scopes;
 	int closed;
 	int running;
-	int reset;
+	/*
+	 * single producer, single consumer ring from the stream to the
+	 * meter thread, the stream never waits for the thread
+	 */
+	struct snd_pcm_meter_range ranges[RANGES];
+	unsigned int ranges_head;	/* owned by the stream */
+	unsigned int ranges_tail;	/* owned by the meter thread */
+	int overrun;			/* ranges were lost, reset the scopes */
+	unsigned long overruns;
+	snd_pcm_uframes_t written;	/* end of the last queued range */
+	unsigned int starts;		/* bumped by each start */
 	pthread_t thread;
-	pthread_mutex_t update_mutex;
 	pthread_mutex_t running_mutex;
 	pthread_cond_t running_cond;
 	struct timespec delay;
 	void *dl_handle;
 } snd_pcm_meter_t;
 
+static void snd_pcm_meter_push_range(snd_pcm_meter_t *meter,
+				     snd_pcm_uframes_t ptr,
+				     snd_pcm_uframes_t frames)
+{
+	unsigned int head = meter->ranges_head;
+	struct snd_pcm_meter_range *r;
+
+	if (head - __atomic_load_n(&meter->ranges_tail, __ATOMIC_ACQUIRE) >= RANGES) {
+		__atomic_store_n(&meter->overrun, 1, __ATOMIC_RELEASE);
+		return;
+	}
+	r = &meter->ranges[head % RANGES];
+	r->ptr = ptr;
+	r->frames = frames;
+	__atomic_store_n(&meter->ranges_head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* take all queued ranges, return non-zero when the scopes must be reset */
+static int snd_pcm_meter_pop_ranges(snd_pcm_meter_t *meter,
+				    snd_pcm_uframes_t boundary)
+{
+	unsigned int head = __atomic_load_n(&meter->ranges_head, __ATOMIC_ACQUIRE);
+	unsigned int tail = meter->ranges_tail;
+	int reset = 0;
+
+	for (; tail != head; tail++) {
+		const struct snd_pcm_meter_range *r = &meter->ranges[tail % RANGES];
+
+		if (!r->frames)
+			reset = 1;
+		meter->written = (r->ptr + r->frames) % boundary;
+	}
+	__atomic_store_n(&meter->ranges_tail, tail, __ATOMIC_RELEASE);
+	if (__atomic_exchange_n(&meter->overrun, 0, __ATOMIC_ACQUIRE)) {
+		meter->overruns++;
+		reset = 1;
+	}
+	return reset;
+}
+
 static void snd_pcm_meter_add_frames(snd_pcm_t *pcm,
 				     const snd_pcm_channel_area_t *areas,
 				     snd_pcm_uframes_t ptr,
 				     snd_pcm_uframes_t frames)
 {
 	snd_pcm_meter_t *meter = pcm->private_data;
+	snd_pcm_uframes_t start = ptr, count;
 	if (frames > pcm->buffer_size)
 		frames = pcm->buffer_size;
+	count = frames;
 	while (frames > 0) {
 		snd_pcm_uframes_t n = frames;
 		snd_pcm_uframes_t dst_offset = ptr % meter->buf_size;
@@ -101,6 +157,8 @@ static void snd_pcm_meter_add_frames(snd_pcm_t *pcm,
 		if (ptr == pcm->boundary)
 			ptr = 0;
 	}
+	if (count)
+		snd_pcm_meter_push_range(meter, start, count);
 }
 
 static void snd_pcm_meter_update_main(snd_pcm_t *pcm)
@@ -109,42 +167,9 @@ static void snd_pcm_meter_update_main(snd_pcm_t *pcm)
 	snd_pcm_sframes_t frames;
 	snd_pcm_uframes_t rptr, old_rptr;
 	const snd_pcm_channel_area_t *areas;
-	int locked;
-	locked = (pthread_mutex_trylock(&meter->update_mutex) >= 0);
-	areas = snd_pcm_mmap_areas(pcm);
-	rptr = *pcm->hw.ptr;
-	old_rptr = meter->rptr;
-	meter->rptr = rptr;
-	frames = rptr - old_rptr;
-	if (frames < 0)
-		frames += pcm->boundary;
-	if (frames > 0) {
-		assert((snd_pcm_uframes_t) frames <= pcm->buffer_size);
-		snd_pcm_meter_add_frames(pcm, areas, old_rptr,
-					 (snd_pcm_uframes_t) frames);
-	}
-	if (locked)
-		pthread_mutex_unlock(&meter->update_mutex);
-}
-
-static int snd_pcm_meter_update_scope(snd_pcm_t *pcm)
-{
-	snd_pcm_meter_t *meter = pcm->private_data;
-	snd_pcm_sframes_t frames;
-	snd_pcm_uframes_t rptr, old_rptr;
-	const snd_pcm_channel_area_t *areas;
-	int reset = 0;
-	/* Wait main thread */
-	pthread_mutex_lock(&meter->update_mutex);
 	areas = snd_pcm_mmap_areas(pcm);
- _again:
 	rptr = *pcm->hw.ptr;
 	old_rptr = meter->rptr;
-	if (atomic_read(&meter->reset)) {
-		reset = 1;
-		atomic_dec(&meter->reset);
-		goto _again;
-	}
 	meter->rptr = rptr;
 	frames = rptr - old_rptr;
 	if (frames < 0)
@@ -154,8 +179,6 @@ static int snd_pcm_meter_update_scope(snd_pcm_t *pcm)
 		snd_pcm_meter_add_frames(pcm, areas, old_rptr,
 					 (snd_pcm_uframes_t) frames);
 	}
-	pthread_mutex_unlock(&meter->update_mutex);
-	return reset;
 }
 
 static int snd_pcm_scope_remove(snd_pcm_scope_t *scope)
@@ -191,6 +214,7 @@ static void *snd_pcm_meter_thread(void *data)
 	snd_pcm_t *spcm = meter->gen.slave;
 	struct list_head *pos;
 	snd_pcm_scope_t *scope;
+	unsigned int starts = 0;
 	int reset;
 	list_for_each(pos, &meter->scopes) {
 		scope = list_entry(pos, snd_pcm_scope_t, list);
@@ -200,7 +224,6 @@ static void *snd_pcm_meter_thread(void *data)
 		snd_pcm_sframes_t now;
 		snd_pcm_status_t status;
 		int err;
-		pthread_mutex_lock(&meter->running_mutex);
 		err = snd_pcm_status(spcm, &status);
 		assert(err >= 0);
 		if (status.state != SND_PCM_STATE_RUNNING &&
@@ -213,31 +236,27 @@ static void *snd_pcm_meter_thread(void *data)
 				}
 				meter->running = 0;
 			}
-			pthread_cond_wait(&meter->running_cond,
-					  &meter->running_mutex);
+			/* the callbacks run without the mutex, start never waits for them */
+			pthread_mutex_lock(&meter->running_mutex);
+			while (__atomic_load_n(&meter->starts, __ATOMIC_ACQUIRE) == starts &&
+			       !meter->closed)
+				pthread_cond_wait(&meter->running_cond,
+						  &meter->running_mutex);
+			starts = __atomic_load_n(&meter->starts, __ATOMIC_ACQUIRE);
 			pthread_mutex_unlock(&meter->running_mutex);
 			continue;
 		}
-		pthread_mutex_unlock(&meter->running_mutex);
+		/* all frames copied since the last round in one batch */
+		reset = snd_pcm_meter_pop_ranges(meter, pcm->boundary);
 		if (pcm->stream == SND_PCM_STREAM_PLAYBACK) {
 			now = status.appl_ptr - status.delay;
 			if (now < 0)
 				now += pcm->boundary;
 		} else {
-			now = status.appl_ptr + status.delay;
-			if ((snd_pcm_uframes_t) now >= pcm->boundary)
-				now -= pcm->boundary;
+			/* up to the frames already copied by the stream */
+			now = meter->written;
 		}
 		meter->now = now;
-		if (pcm->stream == SND_PCM_STREAM_CAPTURE)
-			reset = snd_pcm_meter_update_scope(pcm);
-		else {
-			reset = 0;
-			while (atomic_read(&meter->reset)) {
-				reset = 1;
-				atomic_dec(&meter->reset);
-			}
-		}
 		if (reset) {
 			list_for_each(pos, &meter->scopes) {
 				scope = list_entry(pos, snd_pcm_scope_t, list);
@@ -274,7 +293,6 @@ static int snd_pcm_meter_close(snd_pcm_t *pcm)
 	snd_pcm_meter_t *meter = pcm->private_data;
 	struct list_head *pos, *npos;
 	int err = 0;
-	pthread_mutex_destroy(&meter->update_mutex);
 	pthread_mutex_destroy(&meter->running_mutex);
 	pthread_cond_destroy(&meter->running_cond);
 	if (meter->gen.close_slave)
@@ -294,7 +312,6 @@ static int snd_pcm_meter_prepare(snd_pcm_t *pcm)
 {
 	snd_pcm_meter_t *meter = pcm->private_data;
 	int err;
-	atomic_add(&meter->reset, 1);
 	err = snd_pcm_prepare(meter->gen.slave);
 	if (err >= 0) {
 		if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
@@ -302,6 +319,7 @@ static int snd_pcm_meter_prepare(snd_pcm_t *pcm)
 		else
 			meter->rptr = *pcm->hw.ptr;
 	}
+	snd_pcm_meter_push_range(meter, meter->rptr, 0);
 	return err;
 }
 
@@ -320,11 +338,14 @@ static int snd_pcm_meter_start(snd_pcm_t *pcm)
 {
 	snd_pcm_meter_t *meter = pcm->private_data;
 	int err;
-	pthread_mutex_lock(&meter->running_mutex);
 	err = snd_pcm_start(meter->gen.slave);
-	if (err >= 0)
+	if (err >= 0) {
+		__atomic_add_fetch(&meter->starts, 1, __ATOMIC_RELEASE);
+		/* only held by the meter thread to check for a start */
+		pthread_mutex_lock(&meter->running_mutex);
 		pthread_cond_signal(&meter->running_cond);
-	pthread_mutex_unlock(&meter->running_mutex);
+		pthread_mutex_unlock(&meter->running_mutex);
+	}
 	return err;
 }
 
@@ -452,8 +473,11 @@ static int snd_pcm_meter_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 				      snd_pcm_meter_hw_params_slave);
 	if (err < 0)
 		return err;
-	/* more than 1 second of buffer */
-	meter->buf_size = slave->buffer_size;
+	/*
+	 * more than 1 second of buffer, and room for a whole buffer of
+	 * new frames ahead of the ones the scopes read
+	 */
+	meter->buf_size = slave->buffer_size * 2;
 	while (meter->buf_size < slave->rate)
 		meter->buf_size *= 2;
 	buf_size_bytes = snd_pcm_frames_to_bytes(slave, meter->buf_size);
@@ -473,6 +497,10 @@ static int snd_pcm_meter_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 		a->step = slave->sample_bits;
 	}
 	meter->closed = 0;
+	meter->ranges_head = meter->ranges_tail = 0;
+	meter->overrun = 0;
+	meter->starts = 0;
+	meter->written = meter->rptr;
 	err = pthread_create(&meter->thread, NULL, snd_pcm_meter_thread, pcm);
 	assert(err == 0);
 	return 0;
@@ -499,6 +527,9 @@ static void snd_pcm_meter_dump(snd_pcm_t *pcm, snd_output_t *out)
 {
 	snd_pcm_meter_t *meter = pcm->private_data;
 	snd_output_printf(out, "Meter PCM\n");
+	if (meter->overruns)
+		snd_output_printf(out, "  Scope resets after overruns: %lu\n",
+				  meter->overruns);
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -599,7 +630,6 @@ int snd_pcm_meter_open(snd_pcm_t **pcmp, const char *name, unsigned int frequenc
 	snd_pcm_link_appl_ptr(pcm, slave);
 	*pcmp = pcm;
 
-	pthread_mutex_init(&meter->update_mutex, NULL);
 	pthread_mutex_init(&meter->running_mutex, NULL);
 	pthread_cond_init(&meter->running_cond, NULL);
 	return 0;
@@ -733,11 +763,30 @@ pcm.name {
 }
 \endcode
 
+The scope type "level" is built in.  It measures the peak and RMS level
+of each channel and the EBU R128 momentary and short-term loudness, read
+with snd_pcm_scope_level_get_channel() and
+snd_pcm_scope_level_get_loudness().  With a card, the values are also
+published as read-only mixer controls "NAME Peak Level", "NAME RMS Level"
+and "NAME Loudness" (momentary, short-term), in 0.01 dB steps.  A control
+is written only when its values have changed.  Integer controls of these
+names which the card already provides (as a control plugin may) are
+written instead of user controls.
+
+\code
+pcm_scope.name {
+	type level
+	[card INT/STR]		# Card for the level controls
+	[control STR]		# Control name prefix (default: scope ID)
+}
+\endcode
+
 \subsection pcm_plugins_meter_funcref Function reference
 
 <UL>
   <LI>snd_pcm_meter_open()
   <LI>_snd_pcm_meter_open()
+  <LI>snd_pcm_scope_level_open()
 </UL>
 
 */
@@ -1224,6 +1273,786 @@ int16_t *snd_pcm_scope_s16_get_channel_buffer(snd_pcm_scope_t *scope,
 	return s16->buf_areas[channel].addr;
 }
 
+#ifndef DOC_HIDDEN
+#define LEVEL_RUN		1024	/* samples converted at once */
+#define LEVEL_BLOCKS		30	/* 100 ms loudness blocks, 3 s */
+#define LEVEL_MOMENTARY		4	/* blocks, 400 ms */
+#define LEVEL_CTL_MIN		-14400	/* controls are in 0.01 dB / LU */
+#define LEVEL_CTL_COUNT		128	/* most values of a user control */
+
+struct level_kernels {
+	void (*s16)(float *dst, const void *src, unsigned int n);
+	void (*s32)(float *dst, const void *src, unsigned int n);
+	void (*sum)(const float *src, unsigned int n, float *peak, double *sum);
+};
+
+#ifdef PCM_SIMD
+#define SIMD_BYTES	16
+#define SIMD_ATTR
+#define SIMD_NAME(x)	simd_##x##_v128
+#include "pcm_meter_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+
+#ifdef PCM_SIMD_AVX2
+#define SIMD_BYTES	32
+#define SIMD_ATTR	PCM_SIMD_AVX2_ATTR
+#define SIMD_NAME(x)	simd_##x##_avx2
+#include "pcm_meter_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif
+#else
+#define SIMD_BYTES	0
+#define SIMD_ATTR
+#define SIMD_NAME(x)	generic_##x
+#include "pcm_meter_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif /* PCM_SIMD */
+
+/*
+ * the values of all channels read by snd_pcm_scope_level_get_*(); a
+ * snapshot replaced for more channels is kept until the scope is
+ * closed, a reader may still be looking at it
+ */
+struct level_snap {
+	struct level_snap *prev;
+	unsigned int channels;
+	float val[];		/* the peaks, then the RMS levels */
+};
+
+/* one second order section, a0 normalized to 1 */
+struct level_biquad {
+	double b0, b1, b2, a1, a2;
+};
+
+typedef struct _snd_pcm_scope_level {
+	snd_pcm_t *pcm;
+	const struct level_kernels *k;
+	unsigned int channels;
+	snd_pcm_format_t format;	/* S16, S32, FLOAT or converted to S32 */
+	int conv_index;
+	int32_t conv[LEVEL_RUN];
+	float tmp[LEVEL_RUN];
+	snd_pcm_uframes_t old;
+	/* BS.1770 K-weighting, pre-filter and RLB high pass */
+	struct level_biquad kw[2];
+	double *z;			/* 4 filter states per channel */
+	double *weight;			/* of each channel in the loudness */
+	unsigned int block_frames;
+	unsigned int block_pos;
+	float *peak;			/* of this update */
+	double *sum;			/* of squares in the current block */
+	double ksum;			/* weighted sum of the K-weighted squares */
+	double *blk_ms;			/* mean squares, LEVEL_BLOCKS x channels */
+	double blk_kms[LEVEL_BLOCKS];	/* weighted K-weighted mean squares */
+	unsigned int blocks;		/* completed blocks, up to LEVEL_BLOCKS */
+	unsigned int blk_idx;		/* of the next block */
+	/* the snapshot read by snd_pcm_scope_level_get_*(), a sequence lock */
+	unsigned int seq;
+	unsigned int snap_channels;
+	struct level_snap *snap;
+	float snap_momentary;
+	float snap_short_term;
+	/* optional user controls */
+	int card;
+	char *ctl_name;
+	snd_ctl_t *ctl;
+	snd_ctl_elem_value_t ctl_peak, ctl_rms, ctl_loudness;
+	unsigned int ctl_added;		/* bits of the controls added here */
+} snd_pcm_scope_level_t;
+
+static float level_dB(double power)
+{
+	return power > 0 ? 10 * log10(power) : -INFINITY;
+}
+
+/* the filters of ITU-R BS.1770-4, at any rate */
+static void level_kweight_init(snd_pcm_scope_level_t *level, unsigned int rate)
+{
+	double f0 = 1681.974450955533, gain = 3.999843853973347;
+	double q = 0.7071752369554196;
+	double k = tan(M_PI * f0 / rate);
+	double vh = pow(10.0, gain / 20.0);
+	double vb = pow(vh, 0.4996667741545416);
+	double a0 = 1.0 + k / q + k * k;
+	struct level_biquad *f = &level->kw[0];
+
+	f->b0 = (vh + vb * k / q + k * k) / a0;
+	f->b1 = 2.0 * (k * k - vh) / a0;
+	f->b2 = (vh - vb * k / q + k * k) / a0;
+	f->a1 = 2.0 * (k * k - 1.0) / a0;
+	f->a2 = (1.0 - k / q + k * k) / a0;
+
+	f0 = 38.13547087602444;
+	q = 0.5003270373238773;
+	k = tan(M_PI * f0 / rate);
+	a0 = 1.0 + k / q + k * k;
+	f = &level->kw[1];
+	f->b0 = 1.0;
+	f->b1 = -2.0;
+	f->b2 = 1.0;
+	f->a1 = 2.0 * (k * k - 1.0) / a0;
+	f->a2 = (1.0 - k / q + k * k) / a0;
+}
+
+/* sum of the squares of the K-weighted samples */
+static double level_kweight(snd_pcm_scope_level_t *level, unsigned int ch,
+			    const float *x, unsigned int n)
+{
+	const struct level_biquad *f1 = &level->kw[0], *f2 = &level->kw[1];
+	double *z = level->z + ch * 4;
+	double z0 = z[0], z1 = z[1], z2 = z[2], z3 = z[3];
+	double sum = 0.0;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		double y1 = f1->b0 * x[i] + z0;
+		double y2 = y1 + z2;
+
+		z0 = f1->b1 * x[i] - f1->a1 * y1 + z1;
+		z1 = f1->b2 * x[i] - f1->a2 * y1;
+		z2 = -2.0 * y1 - f2->a1 * y2 + z3;
+		z3 = y1 - f2->a2 * y2;
+		sum += y2 * y2;
+	}
+	/* no denormals in silence */
+	z[0] = fabs(z0) < 1e-30 ? 0.0 : z0;
+	z[1] = fabs(z1) < 1e-30 ? 0.0 : z1;
+	z[2] = fabs(z2) < 1e-30 ? 0.0 : z2;
+	z[3] = fabs(z3) < 1e-30 ? 0.0 : z3;
+	return sum;
+}
+
+/* the weight of a channel position in the loudness */
+static double level_channel_weight(unsigned int pos)
+{
+	switch (pos) {
+	case SND_CHMAP_LFE:
+		return 0.0;
+	case SND_CHMAP_SL:
+	case SND_CHMAP_SR:
+	case SND_CHMAP_RL:
+	case SND_CHMAP_RR:
+		return 1.41;
+	default:
+		return 1.0;
+	}
+}
+
+static void level_block_done(snd_pcm_scope_level_t *level)
+{
+	double *ms = level->blk_ms + level->blk_idx * level->channels;
+	unsigned int c;
+
+	for (c = 0; c < level->channels; c++) {
+		ms[c] = level->sum[c] / level->block_frames;
+		level->sum[c] = 0.0;
+	}
+	level->blk_kms[level->blk_idx] = level->ksum / level->block_frames;
+	level->ksum = 0.0;
+	level->blk_idx = (level->blk_idx + 1) % LEVEL_BLOCKS;
+	if (level->blocks < LEVEL_BLOCKS)
+		level->blocks++;
+	level->block_pos = 0;
+}
+
+/* mean of the last blocks, per channel or the loudness with ch < 0 */
+static double level_blocks_mean(snd_pcm_scope_level_t *level, int ch,
+				unsigned int blocks)
+{
+	unsigned int i, idx = level->blk_idx;
+	double sum = 0.0;
+
+	if (blocks > level->blocks)
+		blocks = level->blocks;
+	if (!blocks)
+		return 0.0;
+	for (i = 0; i < blocks; i++) {
+		idx = (idx + LEVEL_BLOCKS - 1) % LEVEL_BLOCKS;
+		if (ch < 0)
+			sum += level->blk_kms[idx];
+		else
+			sum += level->blk_ms[idx * level->channels + ch];
+	}
+	return sum / blocks;
+}
+
+/* set a value of the control, 1 when it has changed */
+static int level_ctl_write(snd_ctl_elem_value_t *elem, unsigned int idx,
+			   float dB)
+{
+	long val = dB < LEVEL_CTL_MIN / 100.0 ? LEVEL_CTL_MIN : lrintf(dB * 100);
+
+	if (val > 0)
+		val = 0;
+	if (idx >= LEVEL_CTL_COUNT || elem->value.integer.value[idx] == val)
+		return 0;
+	elem->value.integer.value[idx] = val;
+	return 1;
+}
+
+/* the snapshot is written between these, readers retry meanwhile */
+static void level_write_begin(snd_pcm_scope_level_t *level)
+{
+	__atomic_store_n(&level->seq, level->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void level_write_end(snd_pcm_scope_level_t *level)
+{
+	__atomic_store_n(&level->seq, level->seq + 1, __ATOMIC_RELEASE);
+}
+
+static void level_publish(snd_pcm_scope_level_t *level)
+{
+	struct level_snap *snap = level->snap;
+	float *snap_peak = snap->val, *snap_rms = snap->val + snap->channels;
+	int peak = 0, rms = 0, loudness = 0;
+	unsigned int c;
+
+	level_write_begin(level);
+	for (c = 0; c < level->channels; c++) {
+		snap_peak[c] = level_dB((double)level->peak[c] * level->peak[c]);
+		snap_rms[c] = level_dB(level_blocks_mean(level, c, LEVEL_MOMENTARY));
+	}
+	level->snap_momentary = -0.691 +
+		level_dB(level_blocks_mean(level, -1, LEVEL_MOMENTARY));
+	level->snap_short_term = -0.691 +
+		level_dB(level_blocks_mean(level, -1, LEVEL_BLOCKS));
+	level_write_end(level);
+
+	if (!level->ctl)
+		return;
+	for (c = 0; c < level->channels; c++) {
+		peak |= level_ctl_write(&level->ctl_peak, c, snap_peak[c]);
+		rms |= level_ctl_write(&level->ctl_rms, c, snap_rms[c]);
+	}
+	loudness |= level_ctl_write(&level->ctl_loudness, 0, level->snap_momentary);
+	loudness |= level_ctl_write(&level->ctl_loudness, 1, level->snap_short_term);
+	/* an ioctl for each control, so only for the changed ones */
+	if (peak)
+		snd_ctl_elem_write(level->ctl, &level->ctl_peak);
+	if (rms)
+		snd_ctl_elem_write(level->ctl, &level->ctl_rms);
+	if (loudness)
+		snd_ctl_elem_write(level->ctl, &level->ctl_loudness);
+}
+
+static void level_ctl_close(snd_pcm_scope_level_t *level)
+{
+	snd_ctl_elem_value_t *elems[3] = {
+		&level->ctl_peak, &level->ctl_rms, &level->ctl_loudness
+	};
+	unsigned int i;
+
+	if (!level->ctl)
+		return;
+	for (i = 0; i < 3; i++) {
+		if (!(level->ctl_added & (1 << i)))
+			continue;
+		snd_ctl_elem_unlock(level->ctl, &elems[i]->id);
+		snd_ctl_elem_remove(level->ctl, &elems[i]->id);
+	}
+	snd_ctl_close(level->ctl);
+	level->ctl = NULL;
+	level->ctl_added = 0;
+}
+
+/*
+ * use an integer control of this name which the card (a control plugin)
+ * provides itself
+ */
+static int level_ctl_find(snd_pcm_scope_level_t *level,
+			  snd_ctl_elem_value_t *elem, const snd_ctl_elem_id_t *id)
+{
+	snd_ctl_elem_info_t info = {0};
+
+	info.id = *id;
+	if (snd_ctl_elem_info(level->ctl, &info) < 0 ||
+	    info.type != SND_CTL_ELEM_TYPE_INTEGER ||
+	    !snd_ctl_elem_info_is_writable(&info))
+		return -ENOENT;
+	memset(elem, 0, sizeof(*elem));
+	elem->id = info.id;
+	return snd_ctl_elem_read(level->ctl, elem);
+}
+
+/*
+ * add a user control of count values in 0.01 dB, locked so that only
+ * the scope writes it; the values are kept to write only the changes
+ */
+static int level_ctl_add(snd_pcm_scope_level_t *level,
+			 snd_ctl_elem_value_t *elem, const char *suffix,
+			 unsigned int count, unsigned int bit)
+{
+	snd_ctl_elem_info_t cinfo = {0};
+	char name[SNDRV_CTL_ELEM_ID_NAME_MAXLEN];
+	unsigned int tlv[4];
+	int err;
+
+	snprintf(name, sizeof(name), "%s %s", level->ctl_name, suffix);
+	snd_ctl_elem_id_set_interface(&cinfo.id, SND_CTL_ELEM_IFACE_MIXER);
+	snd_ctl_elem_id_set_name(&cinfo.id, name);
+	/* left over by an earlier user */
+	snd_ctl_elem_remove(level->ctl, &cinfo.id);
+	if (count > LEVEL_CTL_COUNT)
+		count = LEVEL_CTL_COUNT;
+	err = snd_ctl_add_integer_elem_set(level->ctl, &cinfo, 1, count,
+					   LEVEL_CTL_MIN, 0, 1);
+	if (err < 0)
+		return level_ctl_find(level, elem, &cinfo.id) < 0 ? err : 0;
+	tlv[SNDRV_CTL_TLVO_TYPE] = SND_CTL_TLVT_DB_SCALE;
+	tlv[SNDRV_CTL_TLVO_LEN] = 2 * sizeof(int);
+	tlv[SNDRV_CTL_TLVO_DB_SCALE_MIN] = LEVEL_CTL_MIN;
+	tlv[SNDRV_CTL_TLVO_DB_SCALE_MUTE_AND_STEP] = 1;
+	snd_ctl_elem_tlv_write(level->ctl, &cinfo.id, tlv);
+	memset(elem, 0, sizeof(*elem));
+	elem->id = cinfo.id;
+	level->ctl_added |= bit;
+	err = snd_ctl_elem_lock(level->ctl, &elem->id);
+	if (err < 0)
+		return err;
+	return snd_ctl_elem_read(level->ctl, elem);
+}
+
+static int level_ctl_open(snd_pcm_scope_level_t *level)
+{
+	char tmp_name[32];
+	int err;
+
+	sprintf(tmp_name, "hw:%d", level->card);
+	err = snd_ctl_open(&level->ctl, tmp_name, 0);
+	if (err < 0) {
+		SNDERR("Cannot open CTL %s", tmp_name);
+		return err;
+	}
+	memset(&level->ctl_peak, 0, sizeof(level->ctl_peak));
+	memset(&level->ctl_rms, 0, sizeof(level->ctl_rms));
+	memset(&level->ctl_loudness, 0, sizeof(level->ctl_loudness));
+	err = level_ctl_add(level, &level->ctl_peak, "Peak Level",
+			    level->channels, 1 << 0);
+	if (err >= 0)
+		err = level_ctl_add(level, &level->ctl_rms, "RMS Level",
+				    level->channels, 1 << 1);
+	if (err >= 0)
+		err = level_ctl_add(level, &level->ctl_loudness, "Loudness", 2,
+				    1 << 2);
+	if (err < 0) {
+		SNDERR("Cannot add the %s level controls", level->ctl_name);
+		level_ctl_close(level);
+	}
+	return err;
+}
+
+static void level_free(snd_pcm_scope_level_t *level)
+{
+	free(level->z);
+	free(level->weight);
+	free(level->peak);
+	free(level->sum);
+	free(level->blk_ms);
+	level->z = level->weight = level->sum = level->blk_ms = NULL;
+	level->peak = NULL;
+}
+
+static void level_reset(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_level_t *level = scope->private_data;
+	snd_pcm_meter_t *meter = level->pcm->private_data;
+	unsigned int c;
+
+	level->old = meter->now;
+	memset(level->z, 0, level->channels * 4 * sizeof(*level->z));
+	for (c = 0; c < level->channels; c++) {
+		level->peak[c] = 0.0f;
+		level->sum[c] = 0.0;
+	}
+	level->ksum = 0.0;
+	level->block_pos = 0;
+	level->blocks = 0;
+	level->blk_idx = 0;
+	level_publish(level);
+}
+
+static int level_enable(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_level_t *level = scope->private_data;
+	snd_pcm_meter_t *meter = level->pcm->private_data;
+	snd_pcm_t *spcm = meter->gen.slave;
+	snd_pcm_chmap_t *map;
+	struct level_snap *snap;
+	unsigned int c;
+
+	level->format = spcm->format;
+	level->conv_index = -1;
+	switch (spcm->format) {
+	case SND_PCM_FORMAT_S16:
+	case SND_PCM_FORMAT_S32:
+	case SND_PCM_FORMAT_FLOAT:
+		break;
+	default:
+		if (!snd_pcm_format_linear(spcm->format))
+			return -EINVAL;
+		level->format = SND_PCM_FORMAT_S32;
+		level->conv_index = snd_pcm_linear_convert_index(spcm->format,
+								 SND_PCM_FORMAT_S32);
+		break;
+	}
+#ifdef PCM_SIMD
+#ifdef PCM_SIMD_AVX2
+	if (snd_pcm_simd_features() & SND_PCM_SIMD_AVX2)
+		level->k = &simd_level_kernels_avx2;
+	else
+#endif
+		level->k = &simd_level_kernels_v128;
+#else
+	level->k = &generic_level_kernels;
+#endif
+	level->channels = spcm->channels;
+	level->z = calloc(level->channels * 4, sizeof(*level->z));
+	level->weight = calloc(level->channels, sizeof(*level->weight));
+	level->peak = calloc(level->channels, sizeof(*level->peak));
+	level->sum = calloc(level->channels, sizeof(*level->sum));
+	level->blk_ms = calloc(level->channels * LEVEL_BLOCKS,
+			       sizeof(*level->blk_ms));
+	if (!level->z || !level->weight || !level->peak || !level->sum ||
+	    !level->blk_ms) {
+		level_free(level);
+		return -ENOMEM;
+	}
+	snap = level->snap;
+	if (!snap || snap->channels < level->channels) {
+		snap = calloc(1, sizeof(*snap) +
+			      2 * level->channels * sizeof(snap->val[0]));
+		if (!snap) {
+			level_free(level);
+			return -ENOMEM;
+		}
+		snap->prev = level->snap;
+		snap->channels = level->channels;
+	}
+	level_write_begin(level);
+	__atomic_store_n(&level->snap, snap, __ATOMIC_RELAXED);
+	__atomic_store_n(&level->snap_channels, level->channels, __ATOMIC_RELAXED);
+	level_write_end(level);
+	map = snd_pcm_get_chmap(spcm);
+	for (c = 0; c < level->channels; c++)
+		level->weight[c] = map && c < map->channels ?
+			level_channel_weight(map->pos[c] & SND_CHMAP_POSITION_MASK) :
+			1.0;
+	free(map);
+	level_kweight_init(level, spcm->rate);
+	level->block_frames = spcm->rate / 10;
+	if (!level->block_frames)
+		level->block_frames = 1;
+	if (level->card >= 0 && level_ctl_open(level) < 0) {
+		level_free(level);
+		return -EINVAL;
+	}
+	level_reset(scope);
+	return 0;
+}
+
+static void level_disable(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_level_t *level = scope->private_data;
+
+	level_ctl_close(level);
+	level_free(level);
+}
+
+static void level_close(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_level_t *level = scope->private_data;
+	struct level_snap *snap, *prev;
+
+	for (snap = level->snap; snap; snap = prev) {
+		prev = snap->prev;
+		free(snap);
+	}
+	free(level->ctl_name);
+	free(level);
+}
+
+static void level_start(snd_pcm_scope_t *scope ATTRIBUTE_UNUSED)
+{
+}
+
+static void level_stop(snd_pcm_scope_t *scope ATTRIBUTE_UNUSED)
+{
+}
+
+static void level_update(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_level_t *level = scope->private_data;
+	snd_pcm_meter_t *meter = level->pcm->private_data;
+	snd_pcm_t *spcm = meter->gen.slave;
+	snd_pcm_sframes_t size;
+	snd_pcm_uframes_t offset;
+	unsigned int c;
+
+	size = meter->now - level->old;
+	if (size < 0)
+		size += spcm->boundary;
+	if (size > (snd_pcm_sframes_t)level->pcm->buffer_size)
+		size = level->pcm->buffer_size;
+	offset = level->old % meter->buf_size;
+	for (c = 0; c < level->channels; c++)
+		level->peak[c] = 0.0f;
+	while (size > 0) {
+		snd_pcm_uframes_t frames = size;
+		snd_pcm_uframes_t cont = meter->buf_size - offset;
+		if (frames > cont)
+			frames = cont;
+		if (frames > LEVEL_RUN)
+			frames = LEVEL_RUN;
+		if (frames > level->block_frames - level->block_pos)
+			frames = level->block_frames - level->block_pos;
+		for (c = 0; c < level->channels; c++) {
+			const void *src = snd_pcm_channel_area_addr(&meter->buf_areas[c],
+								    offset);
+			const float *x = level->tmp;
+
+			if (level->conv_index >= 0) {
+				snd_pcm_channel_area_t area = {
+					.addr = level->conv,
+					.first = 0,
+					.step = 32,
+				};
+				snd_pcm_linear_convert(&area, 0,
+						       &meter->buf_areas[c], offset,
+						       1, frames, level->conv_index);
+				src = level->conv;
+			}
+			switch (level->format) {
+			case SND_PCM_FORMAT_S16:
+				level->k->s16(level->tmp, src, frames);
+				break;
+			case SND_PCM_FORMAT_S32:
+				level->k->s32(level->tmp, src, frames);
+				break;
+			default:
+				x = src;
+				break;
+			}
+			level->k->sum(x, frames, &level->peak[c], &level->sum[c]);
+			if (level->weight[c] != 0.0)
+				level->ksum += level->weight[c] *
+					level_kweight(level, c, x, frames);
+		}
+		level->block_pos += frames;
+		if (level->block_pos == level->block_frames)
+			level_block_done(level);
+		offset += frames;
+		if (offset == meter->buf_size)
+			offset = 0;
+		size -= frames;
+	}
+	level->old = meter->now;
+	level_publish(level);
+}
+
+static const snd_pcm_scope_ops_t level_ops = {
+	.enable = level_enable,
+	.disable = level_disable,
+	.close = level_close,
+	.start = level_start,
+	.stop = level_stop,
+	.update = level_update,
+	.reset = level_reset,
+};
+
+/* copy the snapshot, retried while the meter thread updates it */
+static int level_read(snd_pcm_scope_level_t *level, unsigned int channel,
+		      float *peak, float *rms, float *momentary,
+		      float *short_term)
+{
+	const struct level_snap *snap;
+	unsigned int seq, channels;
+	int err;
+
+	for (;;) {
+		seq = __atomic_load_n(&level->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		snap = __atomic_load_n(&level->snap, __ATOMIC_RELAXED);
+		channels = __atomic_load_n(&level->snap_channels, __ATOMIC_RELAXED);
+		err = 0;
+		if (!channels)
+			err = -EBADFD;
+		else if (channel >= channels)
+			err = -EINVAL;
+		if (!err) {
+			if (peak)
+				*peak = snap->val[channel];
+			if (rms)
+				*rms = snap->val[snap->channels + channel];
+			if (momentary)
+				*momentary = level->snap_momentary;
+			if (short_term)
+				*short_term = level->snap_short_term;
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&level->seq, __ATOMIC_RELAXED) == seq)
+			return err;
+	}
+}
+#endif
+
+/**
+ * \brief Add a level pseudo scope to a #SND_PCM_TYPE_METER PCM
+ * \param pcm The pcm handle
+ * \param name Scope name
+ * \param scopep Pointer to newly created and added scope
+ * \return 0 on success otherwise a negative error code
+ *
+ * The level scope measures the peak and RMS level of each channel and
+ * the EBU R128 momentary and short-term loudness of the stream.  The
+ * values are read with #snd_pcm_scope_level_get_channel and
+ * #snd_pcm_scope_level_get_loudness from any thread, without locking.
+ * Linear and float formats are supported.
+ */
+int snd_pcm_scope_level_open(snd_pcm_t *pcm, const char *name,
+			     snd_pcm_scope_t **scopep)
+{
+	snd_pcm_meter_t *meter;
+	snd_pcm_scope_t *scope;
+	snd_pcm_scope_level_t *level;
+	assert(pcm->type == SND_PCM_TYPE_METER);
+	meter = pcm->private_data;
+	scope = calloc(1, sizeof(*scope));
+	if (!scope)
+		return -ENOMEM;
+	level = calloc(1, sizeof(*level));
+	if (!level) {
+		free(scope);
+		return -ENOMEM;
+	}
+	if (name)
+		scope->name = strdup(name);
+	level->pcm = pcm;
+	level->card = -1;
+	scope->ops = &level_ops;
+	scope->private_data = level;
+	list_add_tail(&scope->list, &meter->scopes);
+	*scopep = scope;
+	return 0;
+}
+
+/**
+ * \brief Get the levels of a channel from a level pseudo scope
+ * \param scope level pseudo scope handle
+ * \param channel Channel
+ * \param peak Returns the peak level of the last update in dBFS
+ * \param rms Returns the RMS level of the last 400 ms in dBFS
+ * \return 0 on success otherwise a negative error code
+ *
+ * Silence is returned as -INFINITY.
+ */
+int snd_pcm_scope_level_get_channel(snd_pcm_scope_t *scope,
+				    unsigned int channel,
+				    double *peak, double *rms)
+{
+	snd_pcm_scope_level_t *level;
+	float p, r;
+	int err;
+	assert(scope->ops == &level_ops);
+	level = scope->private_data;
+	err = level_read(level, channel, &p, &r, NULL, NULL);
+	if (err < 0)
+		return err;
+	if (peak)
+		*peak = p;
+	if (rms)
+		*rms = r;
+	return 0;
+}
+
+/**
+ * \brief Get the loudness from a level pseudo scope
+ * \param scope level pseudo scope handle
+ * \param momentary Returns the momentary (400 ms) loudness in LUFS
+ * \param short_term Returns the short-term (3 s) loudness in LUFS
+ * \return 0 on success otherwise a negative error code
+ *
+ * The loudness is measured as in ITU-R BS.1770, surround channels of
+ * the channel map are weighted and LFE channels are left out.  Silence
+ * is returned as -INFINITY.
+ */
+int snd_pcm_scope_level_get_loudness(snd_pcm_scope_t *scope,
+				     double *momentary, double *short_term)
+{
+	snd_pcm_scope_level_t *level;
+	float m, s;
+	int err;
+	assert(scope->ops == &level_ops);
+	level = scope->private_data;
+	err = level_read(level, 0, NULL, NULL, &m, &s);
+	if (err < 0)
+		return err;
+	if (momentary)
+		*momentary = m;
+	if (short_term)
+		*short_term = s;
+	return 0;
+}
+
+#ifndef DOC_HIDDEN
+/* the "level" scope type of the meter configuration */
+int _snd_pcm_scope_level_open(snd_pcm_t *pcm, const char *name,
+			      snd_config_t *root ATTRIBUTE_UNUSED,
+			      snd_config_t *conf)
+{
+	snd_config_iterator_t i, next;
+	snd_pcm_scope_t *scope;
+	snd_pcm_scope_level_t *level;
+	const char *ctl_name = NULL;
+	int card = -1;
+	int err;
+
+	snd_config_for_each(i, next, conf) {
+		snd_config_t *n = snd_config_iterator_entry(i);
+		const char *id;
+		if (snd_config_get_id(n, &id) < 0)
+			continue;
+		if (strcmp(id, "comment") == 0 || strcmp(id, "type") == 0)
+			continue;
+		if (strcmp(id, "card") == 0) {
+			card = snd_config_get_card(n);
+			if (card < 0)
+				return card;
+			continue;
+		}
+		if (strcmp(id, "control") == 0) {
+			err = snd_config_get_string(n, &ctl_name);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return -EINVAL;
+			}
+			continue;
+		}
+		SNDERR("Unknown field %s", id);
+		return -EINVAL;
+	}
+	err = snd_pcm_scope_level_open(pcm, name, &scope);
+	if (err < 0)
+		return err;
+	level = scope->private_data;
+	level->card = card;
+	level->ctl_name = strdup(ctl_name ? ctl_name : name);
+	if (!level->ctl_name) {
+		snd_pcm_scope_remove(scope);
+		return -ENOMEM;
+	}
+	return 0;
+}
+#endif
+
 /**
  * \brief allocate an invalid #snd_pcm_scope_t using standard malloc
  * \param ptr returned pointer
@@ -0,0 +1,130 @@
+/**
+ * \file pcm/pcm_meter_simd.h
+ * \ingroup PCM_Plugins
+ * \brief PCM Meter Plugin Interface - level scope kernels
+ */
+/*
+ *  PCM - Meter plugin
+ *
+ *  This file is included from pcm_meter.c several times, with
+ *  SIMD_BYTES (vector size, 0 for plain C), SIMD_ATTR (function
+ *  attributes) and SIMD_NAME() (symbol suffix) defined.
+ *
+ *  The kernels work on a run of samples of one channel: conversion to
+ *  float in the -1.0 .. 1.0 range, and the peak and the sum of squares of
+ *  the float samples.  The sums are accumulated per lane in float, the
+ *  runs are short enough for that.
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#if SIMD_BYTES
+typedef int16_t SIMD_NAME(hs16) __attribute__((vector_size(SIMD_BYTES / 2)));
+typedef int32_t SIMD_NAME(vs32) __attribute__((vector_size(SIMD_BYTES)));
+typedef float SIMD_NAME(vf32) __attribute__((vector_size(SIMD_BYTES)));
+
+/* 32-bit lanes in one vector */
+#define LANES		(SIMD_BYTES / 4)
+#endif
+
+static SIMD_ATTR
+void SIMD_NAME(level_s16)(float *dst, const void *src_addr, unsigned int n)
+{
+	const int16_t *src = src_addr;
+	unsigned int i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(hs16) s16;
+	SIMD_NAME(vf32) d;
+
+	for (; i + LANES <= n; i += LANES) {
+		simd_load(s16, src + i);
+		d = simd_convert(simd_convert(s16, SIMD_NAME(vs32)),
+				 SIMD_NAME(vf32)) * (1.0f / 32768);
+		simd_store(dst + i, d);
+	}
+#endif
+	for (; i < n; i++)
+		dst[i] = src[i] * (1.0f / 32768);
+}
+
+static SIMD_ATTR
+void SIMD_NAME(level_s32)(float *dst, const void *src_addr, unsigned int n)
+{
+	const int32_t *src = src_addr;
+	unsigned int i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(vs32) s;
+	SIMD_NAME(vf32) d;
+
+	for (; i + LANES <= n; i += LANES) {
+		simd_load(s, src + i);
+		d = simd_convert(s, SIMD_NAME(vf32)) * (1.0f / 2147483648.0f);
+		simd_store(dst + i, d);
+	}
+#endif
+	for (; i < n; i++)
+		dst[i] = src[i] * (1.0f / 2147483648.0f);
+}
+
+/* max(|x|) and sum(x * x) of the samples */
+static SIMD_ATTR
+void SIMD_NAME(level_sum)(const float *src, unsigned int n,
+			  float *peak, double *sum)
+{
+	float p = 0.0f, s = 0.0f;
+	unsigned int i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(vf32) x, vp = { 0 }, vs = { 0 };
+	SIMD_NAME(vs32) m;
+	unsigned int l;
+
+	for (; i + LANES <= n; i += LANES) {
+		simd_load(x, src + i);
+		vs += x * x;
+		/* clear the sign bits */
+		x = (SIMD_NAME(vf32))((SIMD_NAME(vs32))x & 0x7fffffff);
+		m = vp > x;
+		vp = (SIMD_NAME(vf32))(((SIMD_NAME(vs32))vp & m) |
+				       ((SIMD_NAME(vs32))x & ~m));
+	}
+	for (l = 0; l < LANES; l++) {
+		if (vp[l] > p)
+			p = vp[l];
+		s += vs[l];
+	}
+#endif
+	for (; i < n; i++) {
+		float a = fabsf(src[i]);
+
+		if (a > p)
+			p = a;
+		s += src[i] * src[i];
+	}
+	if (p > *peak)
+		*peak = p;
+	*sum += s;
+}
+
+static const struct level_kernels SIMD_NAME(level_kernels) = {
+	.s16 = SIMD_NAME(level_s16),
+	.s32 = SIMD_NAME(level_s32),
+	.sum = SIMD_NAME(level_sum),
+};
+
+#if SIMD_BYTES
+#undef LANES
+#endif
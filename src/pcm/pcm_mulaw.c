@@ -30,6 +30,9 @@
 #include "pcm_plugin.h"
 #include "plugin_ops.h"
 #include "bswap.h"
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #ifndef PIC
 /* entry for static linking */
@@ -155,6 +158,46 @@ static int ulaw_to_s16(unsigned char u_val)
 	return ((u_val & 0x80) ? (0x84 - t) : (t - 0x84));
 }
 
+/*
+ * The conversions above go through tables built once: the linear value
+ * of every code, and the code of the magnitude >> 2 before the sign mask
+ * is applied.  The bias is a multiple of 4, so the two low bits of the
+ * magnitude never change the code and the results are identical.
+ */
+static int16_t ulaw_dec_table[256];
+static unsigned char ulaw_enc_table[(0x8000 >> 2) + 1];
+
+static void ulaw_init_tables(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < 256; i++)
+		ulaw_dec_table[i] = ulaw_to_s16(i);
+	for (i = 0; i <= (0x8000 >> 2); i++)
+		ulaw_enc_table[i] = s16_to_ulaw(i << 2) ^ 0xff;
+}
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_once_t ulaw_tables_once = PTHREAD_ONCE_INIT;
+#endif
+
+static void ulaw_tables(void)
+{
+#ifdef HAVE_LIBPTHREAD
+	pthread_once(&ulaw_tables_once, ulaw_init_tables);
+#else
+	if (!ulaw_dec_table[0])
+		ulaw_init_tables();
+#endif
+}
+
+static inline unsigned char ulaw_encode(int16_t sample)
+{
+	if (sample < 0)
+		return ulaw_enc_table[-(int)sample >> 2] ^ 0x7f;
+	return ulaw_enc_table[sample >> 2] ^ 0xff;
+}
+
 #ifndef DOC_HIDDEN
 
 void snd_pcm_mulaw_decode(const snd_pcm_channel_area_t *dst_areas,
@@ -169,6 +212,7 @@ void snd_pcm_mulaw_decode(const snd_pcm_channel_area_t *dst_areas,
 #undef PUT16_LABELS
 	void *put = put16_labels[putidx];
 	unsigned int channel;
+	ulaw_tables();
 	for (channel = 0; channel < channels; ++channel) {
 		const unsigned char *src;
 		char *dst;
@@ -182,7 +226,7 @@ void snd_pcm_mulaw_decode(const snd_pcm_channel_area_t *dst_areas,
 		dst_step = snd_pcm_channel_area_step(dst_area);
 		frames1 = frames;
 		while (frames1-- > 0) {
-			int16_t sample = ulaw_to_s16(*src);
+			int16_t sample = ulaw_dec_table[*src];
 			goto *put;
 #define PUT16_END after
 #include "plugin_ops.h"
@@ -207,6 +251,7 @@ void snd_pcm_mulaw_encode(const snd_pcm_channel_area_t *dst_areas,
 	void *get = get16_labels[getidx];
 	unsigned int channel;
 	int16_t sample = 0;
+	ulaw_tables();
 	for (channel = 0; channel < channels; ++channel) {
 		const char *src;
 		char *dst;
@@ -225,15 +270,116 @@ void snd_pcm_mulaw_encode(const snd_pcm_channel_area_t *dst_areas,
 #include "plugin_ops.h"
 #undef GET16_END
 		after:
-			*dst = s16_to_ulaw(sample);
+			*dst = ulaw_encode(sample);
 			src += src_step;
 			dst += dst_step;
 		}
 	}
 }
 
+/* native S16 on the linear side, without the get/put labels */
+static void snd_pcm_mulaw_decode_s16(const snd_pcm_channel_area_t *dst_areas,
+				     snd_pcm_uframes_t dst_offset,
+				     const snd_pcm_channel_area_t *src_areas,
+				     snd_pcm_uframes_t src_offset,
+				     unsigned int channels, snd_pcm_uframes_t frames,
+				     unsigned int putidx ATTRIBUTE_UNUSED)
+{
+	unsigned int channel;
+	ulaw_tables();
+	for (channel = 0; channel < channels; ++channel) {
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		const unsigned char *src = snd_pcm_channel_area_addr(src_area, src_offset);
+		int16_t *dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		int src_step = snd_pcm_channel_area_step(src_area);
+		int dst_step = snd_pcm_channel_area_step(dst_area) / sizeof(int16_t);
+		snd_pcm_uframes_t i;
+
+		if (src_step == 1 && dst_step == 1) {
+			snd_pcm_mulaw_to_s16(dst, src, frames);
+			continue;
+		}
+		for (i = 0; i < frames; i++)
+			dst[i * dst_step] = ulaw_dec_table[src[i * src_step]];
+	}
+}
+
+static void snd_pcm_mulaw_encode_s16(const snd_pcm_channel_area_t *dst_areas,
+				     snd_pcm_uframes_t dst_offset,
+				     const snd_pcm_channel_area_t *src_areas,
+				     snd_pcm_uframes_t src_offset,
+				     unsigned int channels, snd_pcm_uframes_t frames,
+				     unsigned int getidx ATTRIBUTE_UNUSED)
+{
+	unsigned int channel;
+	ulaw_tables();
+	for (channel = 0; channel < channels; ++channel) {
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		const int16_t *src = snd_pcm_channel_area_addr(src_area, src_offset);
+		unsigned char *dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		int src_step = snd_pcm_channel_area_step(src_area) / sizeof(int16_t);
+		int dst_step = snd_pcm_channel_area_step(dst_area);
+		snd_pcm_uframes_t i;
+
+		if (src_step == 1 && dst_step == 1) {
+			snd_pcm_s16_to_mulaw(dst, src, frames);
+			continue;
+		}
+		for (i = 0; i < frames; i++)
+			dst[i * dst_step] = ulaw_encode(src[i * src_step]);
+	}
+}
+
 #endif /* DOC_HIDDEN */
 
+/**
+ * \brief Convert mu-Law samples to 16-bit linear
+ * \param dst destination buffer (native endian S16 samples)
+ * \param src source buffer (one mu-Law code per byte)
+ * \param samples count of samples
+ */
+void snd_pcm_mulaw_to_s16(int16_t *dst, const unsigned char *src,
+			  unsigned int samples)
+{
+	unsigned int i = 0;
+
+	ulaw_tables();
+	for (; i + 4 <= samples; i += 4) {
+		dst[i] = ulaw_dec_table[src[i]];
+		dst[i + 1] = ulaw_dec_table[src[i + 1]];
+		dst[i + 2] = ulaw_dec_table[src[i + 2]];
+		dst[i + 3] = ulaw_dec_table[src[i + 3]];
+	}
+	for (; i < samples; i++)
+		dst[i] = ulaw_dec_table[src[i]];
+}
+
+/**
+ * \brief Convert 16-bit linear samples to mu-Law
+ * \param dst destination buffer (one mu-Law code per byte)
+ * \param src source buffer (native endian S16 samples)
+ * \param samples count of samples
+ *
+ * The codes are identical to the ones of the mu-Law plugin.
+ */
+void snd_pcm_s16_to_mulaw(unsigned char *dst, const int16_t *src,
+			  unsigned int samples)
+{
+	unsigned int i = 0;
+
+	ulaw_tables();
+	for (; i + 4 <= samples; i += 4) {
+		dst[i] = ulaw_encode(src[i]);
+		dst[i + 1] = ulaw_encode(src[i + 1]);
+		dst[i + 2] = ulaw_encode(src[i + 2]);
+		dst[i + 3] = ulaw_encode(src[i + 3]);
+	}
+	for (; i < samples; i++)
+		dst[i] = ulaw_encode(src[i]);
+}
+
 static int snd_pcm_mulaw_hw_refine_cprepare(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 {
 	snd_pcm_mulaw_t *mulaw = pcm->private_data;
@@ -349,6 +495,12 @@ static int snd_pcm_mulaw_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 			mulaw->func = snd_pcm_mulaw_encode;
 		}
 	}
+	if (format == SND_PCM_FORMAT_S16 || mulaw->sformat == SND_PCM_FORMAT_S16) {
+		if (mulaw->func == snd_pcm_mulaw_encode)
+			mulaw->func = snd_pcm_mulaw_encode_s16;
+		else
+			mulaw->func = snd_pcm_mulaw_decode_s16;
+	}
 	return 0;
 }
 
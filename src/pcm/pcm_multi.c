@@ -28,6 +28,7 @@
   
 #include "pcm_local.h"
 #include "pcm_generic.h"
+#include "pcm_workers.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -41,11 +42,32 @@ const char *_snd_module_pcm_multi = "";
 
 #ifndef DOC_HIDDEN
 
+typedef struct _snd_pcm_multi snd_pcm_multi_t;
+
+/* clock of a slave, measured with the hw_ptr and its timestamps */
+typedef struct {
+	snd_pcm_uframes_t hw_ptr;	/* at the last update */
+	unsigned long long frames;	/* played or captured since prepare */
+	unsigned long long start_frames;
+	double start;			/* of the measuring window, in seconds */
+	double rate;			/* frames per second, 0 while unknown */
+} snd_pcm_multi_clock_t;
+
+#include "pcm_multi_drift.c"
+
 typedef struct {
 	snd_pcm_t *pcm;
 	unsigned int channels_count;
 	int close_slave;
 	snd_pcm_t *linked;
+	snd_pcm_multi_t *multi;
+	snd_pcm_sframes_t result;	/* of the last slave operation */
+	/* latency of the slave operations */
+	unsigned long long ops;
+	unsigned long long ns_total;
+	unsigned long long ns_max;
+	snd_pcm_multi_clock_t clock;
+	snd_pcm_multi_drift_t *drift;	/* NULL for the master */
 } snd_pcm_multi_slave_t;
 
 typedef struct {
@@ -53,22 +75,385 @@ typedef struct {
 	unsigned int slave_channel;
 } snd_pcm_multi_channel_t;
 
-typedef struct {
+enum {
+	MULTI_OP_COMMIT,
+	MULTI_OP_AVAIL,
+	MULTI_OP_HWSYNC,
+	MULTI_OP_PREPARE,
+	MULTI_OP_RESET,
+	MULTI_OP_DRIFT,
+};
+
+
+struct _snd_pcm_multi {
 	snd_pcm_uframes_t appl_ptr, hw_ptr;
 	unsigned int slaves_count;
 	unsigned int master_slave;
 	snd_pcm_multi_slave_t *slaves;
 	unsigned int channels_count;
 	snd_pcm_multi_channel_t *channels;
-} snd_pcm_multi_t;
+	int drift;			/* compensate the slave clocks */
+	snd_pcm_uframes_t drift_hw_ptr;	/* master position of the last update */
+#ifdef HAVE_LIBPTHREAD
+	/* worker threads of the slaves #1-(N-1) */
+	snd_pcm_workers_t *workers;
+	int op;
+	snd_pcm_uframes_t offset, size;
+#endif
+};
 
 #endif
 
+/*
+ * playback: pass the committed frames on to the slave, returns -EPIPE
+ * when the slave buffer has no room for them
+ */
+static snd_pcm_sframes_t multi_drift_write(snd_pcm_multi_slave_t *slave,
+					   snd_pcm_uframes_t offset,
+					   snd_pcm_uframes_t size)
+{
+	snd_pcm_multi_drift_t *drift = slave->drift;
+	snd_pcm_uframes_t done = 0;
+
+	while (done < size) {
+		const snd_pcm_channel_area_t *areas;
+		snd_pcm_uframes_t soffset, sframes = slave->pcm->buffer_size;
+		snd_pcm_uframes_t used, written;
+		snd_pcm_sframes_t result;
+
+		result = snd_pcm_mmap_begin(slave->pcm, &areas, &soffset, &sframes);
+		if (result < 0)
+			return result;
+		if (!sframes) {
+			/*
+			 * the slave buffer is full, the slave is too far
+			 * behind to catch up: an overrun of the compensation
+			 */
+			drift->xruns += size - done;
+			return -EPIPE;
+		}
+		written = multi_drift_resample(drift, slave->channels_count,
+					       1.0 / drift->ratio,
+					       drift->areas, offset + done,
+					       size - done, areas, soffset,
+					       sframes, &used);
+		result = snd_pcm_mmap_commit(slave->pcm, soffset, written);
+		if (result < 0)
+			return result;
+		done += used;
+	}
+	return size;
+}
+
+/* capture: resample the slave frames up to the hw_ptr of the master */
+static snd_pcm_sframes_t multi_drift_read(snd_pcm_multi_slave_t *slave,
+					  snd_pcm_uframes_t hw_ptr)
+{
+	snd_pcm_multi_drift_t *drift = slave->drift;
+	snd_pcm_sframes_t frames = hw_ptr - drift->filled;
+
+	if (frames < 0)
+		frames += drift->boundary;
+	while (frames > 0) {
+		snd_pcm_uframes_t offset = drift->filled % drift->buffer_size;
+		snd_pcm_uframes_t cont = drift->buffer_size - offset;
+		const snd_pcm_channel_area_t *areas;
+		snd_pcm_uframes_t soffset, sframes = slave->pcm->buffer_size;
+		snd_pcm_uframes_t used = 0, written, k;
+		snd_pcm_sframes_t result;
+		unsigned int c;
+
+		if (cont > (snd_pcm_uframes_t)frames)
+			cont = frames;
+		result = snd_pcm_mmap_begin(slave->pcm, &areas, &soffset, &sframes);
+		if (result < 0)
+			return result;
+		if (sframes) {
+			written = multi_drift_resample(drift, slave->channels_count,
+						       drift->ratio, areas, soffset,
+						       sframes, drift->areas,
+						       offset, cont, &used);
+			result = snd_pcm_mmap_commit(slave->pcm, soffset, used);
+			if (result < 0)
+				return result;
+		} else {
+			/* the slave is late, repeat the last frame */
+			for (k = 0; k < cont; k++) {
+				for (c = 0; c < slave->channels_count; c++)
+					multi_drift_put(&drift->areas[c],
+							offset + k, drift->format,
+							drift->cur[c]);
+			}
+			drift->xruns += cont;
+			written = cont;
+		}
+		drift->filled += written;
+		if (drift->filled >= drift->boundary)
+			drift->filled -= drift->boundary;
+		frames -= written;
+	}
+	drift->lag = snd_pcm_mmap_avail(slave->pcm);
+	return 0;
+}
+
+static void multi_clock_update(snd_pcm_multi_slave_t *slave)
+{
+	snd_pcm_multi_clock_t *clock = &slave->clock;
+	snd_pcm_uframes_t avail, hw_ptr = *slave->pcm->hw.ptr;
+	snd_pcm_sframes_t frames;
+	snd_htimestamp_t tstamp;
+	double now, rate;
+
+	if (snd_pcm_htimestamp(slave->pcm, &avail, &tstamp) < 0 ||
+	    (!tstamp.tv_sec && !tstamp.tv_nsec))
+		return;
+	frames = hw_ptr - clock->hw_ptr;
+	if (frames < 0)
+		frames += slave->pcm->boundary;
+	clock->hw_ptr = hw_ptr;
+	clock->frames += frames;
+	now = tstamp.tv_sec + tstamp.tv_nsec / 1e9;
+	if (!clock->start) {
+		clock->start = now;
+		clock->start_frames = clock->frames;
+		return;
+	}
+	if (now - clock->start < MULTI_DRIFT_WINDOW)
+		return;
+	rate = (clock->frames - clock->start_frames) / (now - clock->start);
+	clock->rate = clock->rate ? clock->rate + (rate - clock->rate) * 0.25 : rate;
+	clock->start = now;
+	clock->start_frames = clock->frames;
+}
+
+/* once per period of the master, the new ratio of each slave */
+static void multi_drift_update(snd_pcm_t *pcm)
+{
+	snd_pcm_multi_t *multi = pcm->private_data;
+	snd_pcm_multi_slave_t *master = &multi->slaves[multi->master_slave];
+	snd_pcm_uframes_t hw_ptr = *master->pcm->hw.ptr;
+	snd_pcm_sframes_t frames = hw_ptr - multi->drift_hw_ptr;
+	unsigned int i;
+
+	if (frames < 0)
+		frames += pcm->boundary;
+	if ((snd_pcm_uframes_t)frames < pcm->period_size)
+		return;
+	multi->drift_hw_ptr = hw_ptr;
+	for (i = 0; i < multi->slaves_count; ++i)
+		multi_clock_update(&multi->slaves[i]);
+	for (i = 0; i < multi->slaves_count; ++i) {
+		snd_pcm_multi_slave_t *slave = &multi->slaves[i];
+		snd_pcm_multi_drift_t *drift = slave->drift;
+		double error, ratio = 1.0;
+
+		if (!drift)
+			continue;
+		if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
+			error = master->result - slave->result;
+		else
+			error = (double)drift->lag - pcm->period_size;
+		if (master->clock.rate && slave->clock.rate)
+			ratio = slave->clock.rate / master->clock.rate;
+		multi_drift_control(drift, pcm->stream, error, ratio, frames);
+	}
+}
+
+static void multi_drift_reset(snd_pcm_multi_t *multi)
+{
+	unsigned int i;
+
+	for (i = 0; i < multi->slaves_count; ++i) {
+		snd_pcm_multi_slave_t *slave = &multi->slaves[i];
+		snd_pcm_multi_drift_t *drift = slave->drift;
+
+		slave->clock.hw_ptr = 0;
+		slave->clock.start = 0;
+		if (!drift)
+			continue;
+		memset(drift->prev, 0, 2 * slave->channels_count * sizeof(double));
+		drift->pos = 1.0;
+		drift->error = 0;
+		drift->integral = 0;
+		drift->filled = 0;
+		drift->lag = 0;
+	}
+	multi->drift_hw_ptr = 0;
+}
+
+static void multi_drift_free(snd_pcm_multi_t *multi)
+{
+	unsigned int i;
+
+	for (i = 0; i < multi->slaves_count; ++i) {
+		snd_pcm_multi_drift_t *drift = multi->slaves[i].drift;
+
+		if (!drift)
+			continue;
+		free(drift->buf);
+		free(drift->areas);
+		free(drift->prev);
+		free(drift);
+		multi->slaves[i].drift = NULL;
+	}
+}
+
+static int multi_drift_alloc(snd_pcm_t *pcm)
+{
+	snd_pcm_multi_t *multi = pcm->private_data;
+	unsigned int i, c;
+
+	/* the formats of multi_drift_get() and multi_drift_put() */
+	switch (pcm->format) {
+	case SND_PCM_FORMAT_S16:
+	case SND_PCM_FORMAT_S32:
+	case SND_PCM_FORMAT_FLOAT:
+		break;
+	default:
+		SNDERR("drift compensation supports only S16, S32 or FLOAT");
+		return -EINVAL;
+	}
+	for (i = 0; i < multi->slaves_count; ++i) {
+		snd_pcm_multi_slave_t *slave = &multi->slaves[i];
+		unsigned int channels = slave->channels_count;
+		snd_pcm_multi_drift_t *drift;
+
+		memset(&slave->clock, 0, sizeof(slave->clock));
+		if (i == multi->master_slave)
+			continue;
+		drift = calloc(1, sizeof(*drift));
+		if (!drift)
+			goto _nomem;
+		slave->drift = drift;
+		drift->buf = calloc(pcm->buffer_size * channels,
+				    pcm->sample_bits / 8);
+		drift->areas = calloc(channels, sizeof(*drift->areas));
+		drift->prev = calloc(2 * channels, sizeof(double));
+		if (!drift->buf || !drift->areas || !drift->prev)
+			goto _nomem;
+		for (c = 0; c < channels; c++) {
+			drift->areas[c].addr = drift->buf;
+			drift->areas[c].first = c * pcm->sample_bits;
+			drift->areas[c].step = channels * pcm->sample_bits;
+		}
+		drift->cur = drift->prev + channels;
+		drift->format = pcm->format;
+		drift->buffer_size = pcm->buffer_size;
+		drift->boundary = pcm->boundary;
+		drift->ratio = 1.0;
+	}
+	multi_drift_reset(multi);
+	return 0;
+
+ _nomem:
+	multi_drift_free(multi);
+	return -ENOMEM;
+}
+
+static void multi_slave_run(snd_pcm_multi_slave_t *slave, int op,
+			    snd_pcm_uframes_t offset, snd_pcm_uframes_t size)
+{
+	struct timespec t0, t1;
+	unsigned long long ns;
+#ifdef HAVE_LIBPTHREAD
+	/* the latency is measured for the workers only */
+	int timed = slave->multi->workers != NULL;
+#else
+	int timed = 0;
+#endif
+
+	if (timed)
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+	switch (op) {
+	case MULTI_OP_COMMIT:
+		if (!slave->drift)
+			slave->result = snd_pcm_mmap_commit(slave->pcm, offset, size);
+		else if (slave->pcm->stream == SND_PCM_STREAM_PLAYBACK)
+			slave->result = multi_drift_write(slave, offset, size);
+		else
+			slave->result = size;	/* read at avail_update */
+		break;
+	case MULTI_OP_AVAIL:
+		slave->result = snd_pcm_avail_update(slave->pcm);
+		break;
+	case MULTI_OP_HWSYNC:
+		slave->result = snd_pcm_hwsync(slave->pcm);
+		break;
+	case MULTI_OP_PREPARE:
+		slave->result = snd_pcm_prepare(slave->pcm);
+		break;
+	case MULTI_OP_RESET:
+		slave->result = snd_pcm_reset(slave->pcm);
+		break;
+	case MULTI_OP_DRIFT:
+		slave->result = slave->drift ? multi_drift_read(slave, offset) : 0;
+		break;
+	}
+	if (!timed)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ns = (t1.tv_sec - t0.tv_sec) * 1000000000ULL + t1.tv_nsec - t0.tv_nsec;
+	slave->ops++;
+	slave->ns_total += ns;
+	if (ns > slave->ns_max)
+		slave->ns_max = ns;
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void multi_job(void *private_data, unsigned int idx)
+{
+	snd_pcm_multi_t *multi = private_data;
+
+	multi_slave_run(&multi->slaves[idx], multi->op, multi->offset, multi->size);
+}
+
+static void multi_stop_threads(snd_pcm_multi_t *multi)
+{
+	snd_pcm_workers_stop(multi->workers);
+	multi->workers = NULL;
+}
+
+/*
+ * start a worker for each slave but the first one, which is driven
+ * from the calling thread
+ */
+static int multi_start_threads(snd_pcm_multi_t *multi, const int *cpus)
+{
+	if (multi->slaves_count < 2)
+		return 0;
+	return snd_pcm_workers_start(&multi->workers, "multi",
+				     multi->slaves_count - 1, cpus + 1);
+}
+#endif /* HAVE_LIBPTHREAD */
+
+/* run the operation on all slaves, in parallel with the worker threads */
+static void multi_run(snd_pcm_multi_t *multi, int op,
+		      snd_pcm_uframes_t offset, snd_pcm_uframes_t size)
+{
+	unsigned int i;
+
+#ifdef HAVE_LIBPTHREAD
+	if (multi->workers) {
+		multi->op = op;
+		multi->offset = offset;
+		multi->size = size;
+		snd_pcm_workers_run(multi->workers, multi_job, multi);
+		return;
+	}
+#endif
+	for (i = 0; i < multi->slaves_count; ++i)
+		multi_slave_run(&multi->slaves[i], op, offset, size);
+}
+
 static int snd_pcm_multi_close(snd_pcm_t *pcm)
 {
 	snd_pcm_multi_t *multi = pcm->private_data;
 	unsigned int i;
 	int ret = 0;
+#ifdef HAVE_LIBPTHREAD
+	multi_stop_threads(multi);
+#endif
+	multi_drift_free(multi);
 	for (i = 0; i < multi->slaves_count; ++i) {
 		snd_pcm_multi_slave_t *slave = &multi->slaves[i];
 		if (slave->close_slave) {
@@ -158,6 +543,18 @@ static int snd_pcm_multi_hw_refine_cprepare(snd_pcm_t *pcm, snd_pcm_hw_params_t
 				    multi->channels_count, 0);
 	if (err < 0)
 		return err;
+	if (multi->drift) {
+		/* the formats the resampler handles */
+		snd_pcm_format_mask_t format_mask;
+		snd_pcm_format_mask_none(&format_mask);
+		snd_pcm_format_mask_set(&format_mask, SND_PCM_FORMAT_S16);
+		snd_pcm_format_mask_set(&format_mask, SND_PCM_FORMAT_S32);
+		snd_pcm_format_mask_set(&format_mask, SND_PCM_FORMAT_FLOAT);
+		err = _snd_pcm_hw_param_set_mask(params, SND_PCM_HW_PARAM_FORMAT,
+						 &format_mask);
+		if (err < 0)
+			return err;
+	}
 	params->info = ~0U;
 	return 0;
 }
@@ -349,6 +746,9 @@ static int snd_pcm_multi_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 			snd_pcm_multi_hw_refine_cchange(pcm, i, params, &sparams[i]);
 			return err;
 		}
+		multi->slaves[i].ops = 0;
+		multi->slaves[i].ns_total = 0;
+		multi->slaves[i].ns_max = 0;
 	}
 	reset_links(multi);
 	return 0;
@@ -377,11 +777,15 @@ static int snd_pcm_multi_hw_free(snd_pcm_t *pcm)
 static int snd_pcm_multi_sw_params(snd_pcm_t *pcm, snd_pcm_sw_params_t *params)
 {
 	snd_pcm_multi_t *multi = pcm->private_data;
+	snd_pcm_sw_params_t sparams = *params;
 	unsigned int i;
 	int err;
+	/* the drift is measured with the slave timestamps */
+	if (multi->drift)
+		sparams.tstamp_mode = SND_PCM_TSTAMP_ENABLE;
 	for (i = 0; i < multi->slaves_count; ++i) {
 		snd_pcm_t *slave = multi->slaves[i].pcm;
-		err = snd_pcm_sw_params(slave, params);
+		err = snd_pcm_sw_params(slave, &sparams);
 		if (err < 0)
 			return err;
 	}
@@ -417,6 +821,11 @@ static void snd_pcm_multi_hwptr_update(snd_pcm_t *pcm)
 	snd_pcm_multi_t *multi = pcm->private_data;
 	snd_pcm_uframes_t hw_ptr = 0, slave_hw_ptr, avail, last_avail;
 	unsigned int i;
+	/* the other slaves follow the master with their own clocks */
+	if (multi->drift) {
+		multi->hw_ptr = *multi->slaves[multi->master_slave].pcm->hw.ptr;
+		return;
+	}
 	/* the logic is really simple, choose the lowest hw_ptr from slaves */
 	if (pcm->stream == SND_PCM_STREAM_PLAYBACK) {
 		last_avail = 0;
@@ -446,11 +855,10 @@ static int snd_pcm_multi_hwsync(snd_pcm_t *pcm)
 {
 	snd_pcm_multi_t *multi = pcm->private_data;
 	unsigned int i;
-	int err;
+	multi_run(multi, MULTI_OP_HWSYNC, 0, 0);
 	for (i = 0; i < multi->slaves_count; ++i) {
-		err = snd_pcm_hwsync(multi->slaves[i].pcm);
-		if (err < 0)
-			return err;
+		if (multi->slaves[i].result < 0)
+			return multi->slaves[i].result;
 	}
 	snd_pcm_multi_hwptr_update(pcm);
 	return 0;
@@ -478,14 +886,26 @@ static snd_pcm_sframes_t snd_pcm_multi_avail_update(snd_pcm_t *pcm)
 	snd_pcm_multi_t *multi = pcm->private_data;
 	snd_pcm_sframes_t ret = LONG_MAX;
 	unsigned int i;
+	multi_run(multi, MULTI_OP_AVAIL, 0, 0);
 	for (i = 0; i < multi->slaves_count; ++i) {
-		snd_pcm_sframes_t avail;
-		avail = snd_pcm_avail_update(multi->slaves[i].pcm);
+		snd_pcm_sframes_t avail = multi->slaves[i].result;
 		if (avail < 0)
 			return avail;
 		if (ret > avail)
 			ret = avail;
 	}
+	if (multi->drift) {
+		multi_drift_update(pcm);
+		snd_pcm_multi_hwptr_update(pcm);
+		if (pcm->stream == SND_PCM_STREAM_CAPTURE) {
+			multi_run(multi, MULTI_OP_DRIFT, multi->hw_ptr, 0);
+			for (i = 0; i < multi->slaves_count; ++i) {
+				if (multi->slaves[i].result < 0)
+					return multi->slaves[i].result;
+			}
+		}
+		return multi->slaves[multi->master_slave].result;
+	}
 	snd_pcm_multi_hwptr_update(pcm);
 	return ret;
 }
@@ -501,32 +921,34 @@ static int snd_pcm_multi_htimestamp(snd_pcm_t *pcm, snd_pcm_uframes_t *avail,
 static int snd_pcm_multi_prepare(snd_pcm_t *pcm)
 {
 	snd_pcm_multi_t *multi = pcm->private_data;
-	int result = 0, err;
+	int result = 0;
 	unsigned int i;
+	/* We call prepare to each slave even if it's linked.
+	 * This is to make sure to sync non-mmaped control/status.
+	 */
+	multi_run(multi, MULTI_OP_PREPARE, 0, 0);
 	for (i = 0; i < multi->slaves_count; ++i) {
-		/* We call prepare to each slave even if it's linked.
-		 * This is to make sure to sync non-mmaped control/status.
-		 */
-		err = snd_pcm_prepare(multi->slaves[i].pcm);
-		if (err < 0)
-			result = err;
+		if (multi->slaves[i].result < 0)
+			result = multi->slaves[i].result;
 	}
 	multi->hw_ptr = multi->appl_ptr = 0;
+	multi_drift_reset(multi);
 	return result;
 }
 
 static int snd_pcm_multi_reset(snd_pcm_t *pcm)
 {
 	snd_pcm_multi_t *multi = pcm->private_data;
-	int result = 0, err;
+	int result = 0;
 	unsigned int i;
+	/* Reset each slave, as well as in prepare */
+	multi_run(multi, MULTI_OP_RESET, 0, 0);
 	for (i = 0; i < multi->slaves_count; ++i) {
-		/* Reset each slave, as well as in prepare */
-		err = snd_pcm_reset(multi->slaves[i].pcm);
-		if (err < 0) 
-			result = err;
+		if (multi->slaves[i].result < 0)
+			result = multi->slaves[i].result;
 	}
 	multi->hw_ptr = multi->appl_ptr = 0;
+	multi_drift_reset(multi);
 	return result;
 }
 
@@ -610,6 +1032,10 @@ static int snd_pcm_multi_channel_info(snd_pcm_t *pcm, snd_pcm_channel_info_t *in
 	int err;
 	if (c->slave_idx < 0)
 		return -ENXIO;
+	if (multi->slaves[c->slave_idx].drift && pcm->mmap_channels) {
+		*info = pcm->mmap_channels[channel];
+		return 0;
+	}
 	info->channel = c->slave_channel;
 	err = snd_pcm_channel_info(multi->slaves[c->slave_idx].pcm, info);
 	info->channel = channel;
@@ -622,6 +1048,10 @@ static snd_pcm_sframes_t snd_pcm_multi_rewindable(snd_pcm_t *pcm)
 	unsigned int i;
 	snd_pcm_sframes_t frames = LONG_MAX;
 
+	/* resampled frames can't be taken back */
+	if (multi->drift)
+		return 0;
+
 	for (i = 0; i < multi->slaves_count; ++i) {
 		snd_pcm_sframes_t f = snd_pcm_rewindable(multi->slaves[i].pcm);
 		if (f <= 0)
@@ -640,6 +1070,10 @@ static snd_pcm_sframes_t snd_pcm_multi_forwardable(snd_pcm_t *pcm)
 	unsigned int i;
 	snd_pcm_sframes_t frames = LONG_MAX;
 
+	/* resampled frames can't be taken back */
+	if (multi->drift)
+		return 0;
+
 	for (i = 0; i < multi->slaves_count; ++i) {
 		snd_pcm_sframes_t f = snd_pcm_forwardable(multi->slaves[i].pcm);
 		if (f <= 0)
@@ -657,6 +1091,8 @@ static snd_pcm_sframes_t snd_pcm_multi_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t
 	snd_pcm_multi_t *multi = pcm->private_data;
 	unsigned int i;
 	snd_pcm_uframes_t pos[multi->slaves_count];
+	if (multi->drift)
+		return 0;
 	memset(pos, 0, sizeof(pos));
 	for (i = 0; i < multi->slaves_count; ++i) {
 		snd_pcm_t *slave_i = multi->slaves[i].pcm;
@@ -688,6 +1124,8 @@ static snd_pcm_sframes_t snd_pcm_multi_forward(snd_pcm_t *pcm, snd_pcm_uframes_t
 	snd_pcm_multi_t *multi = pcm->private_data;
 	unsigned int i;
 	snd_pcm_uframes_t pos[multi->slaves_count];
+	if (multi->drift)
+		return 0;
 	memset(pos, 0, sizeof(pos));
 	for (i = 0; i < multi->slaves_count; ++i) {
 		snd_pcm_t *slave_i = multi->slaves[i].pcm;
@@ -783,13 +1221,12 @@ static snd_pcm_sframes_t snd_pcm_multi_mmap_commit(snd_pcm_t *pcm,
 						   snd_pcm_uframes_t size)
 {
 	snd_pcm_multi_t *multi = pcm->private_data;
-	snd_pcm_t *slave;
 	unsigned int i;
 	snd_pcm_sframes_t result;
 
+	multi_run(multi, MULTI_OP_COMMIT, offset, size);
 	for (i = 0; i < multi->slaves_count; ++i) {
-		slave = multi->slaves[i].pcm;
-		result = snd_pcm_mmap_commit(slave, offset, size);
+		result = multi->slaves[i].result;
 		if (result < 0)
 			return result;
 		if ((snd_pcm_uframes_t)result != size)
@@ -801,6 +1238,7 @@ static snd_pcm_sframes_t snd_pcm_multi_mmap_commit(snd_pcm_t *pcm,
 
 static int snd_pcm_multi_munmap(snd_pcm_t *pcm)
 {
+	multi_drift_free(pcm->private_data);
 	free(pcm->mmap_channels);
 	free(pcm->running_areas);
 	pcm->mmap_channels = NULL;
@@ -821,15 +1259,34 @@ static int snd_pcm_multi_mmap(snd_pcm_t *pcm)
 		snd_pcm_multi_munmap(pcm);
 		return -ENOMEM;
 	}
+	if (multi->drift) {
+		int err = multi_drift_alloc(pcm);
+		if (err < 0) {
+			snd_pcm_multi_munmap(pcm);
+			return err;
+		}
+	}
 
 	/* Copy the slave mmapped buffer data */
 	for (c = 0; c < pcm->channels; c++) {
 		snd_pcm_multi_channel_t *chan = &multi->channels[c];
+		snd_pcm_multi_drift_t *drift;
 		snd_pcm_t *slave;
 		if (chan->slave_idx < 0) {
 			snd_pcm_multi_munmap(pcm);
 			return -ENXIO;
 		}
+		drift = multi->slaves[chan->slave_idx].drift;
+		if (drift) {
+			snd_pcm_channel_info_t *info = &pcm->mmap_channels[c];
+			info->channel = c;
+			info->addr = drift->buf;
+			info->first = drift->areas[chan->slave_channel].first;
+			info->step = drift->areas[chan->slave_channel].step;
+			info->type = SND_PCM_AREA_LOCAL;
+			pcm->running_areas[c] = drift->areas[chan->slave_channel];
+			continue;
+		}
 		slave = multi->slaves[chan->slave_idx].pcm;
 		pcm->mmap_channels[c] =
 			slave->mmap_channels[chan->slave_channel];
@@ -996,6 +1453,40 @@ static void snd_pcm_multi_dump(snd_pcm_t *pcm, snd_output_t *out)
 		snd_output_printf(out, "    %d: slave %d, channel %d\n", 
 			k, c->slave_idx, c->slave_channel);
 	}
+#ifdef HAVE_LIBPTHREAD
+	if (multi->workers) {
+		snd_output_printf(out, "  Worker threads: %u\n",
+				  multi->workers->count);
+		snd_output_printf(out, "  Slave latency:\n");
+		for (k = 0; k < multi->slaves_count; ++k) {
+			snd_pcm_multi_slave_t *slave = &multi->slaves[k];
+			snd_output_printf(out, "    %d: %llu ops, avg %llu ns, max %llu ns",
+					  k, slave->ops,
+					  slave->ops ? slave->ns_total / slave->ops : 0,
+					  slave->ns_max);
+			if (k > 0 && multi->workers->workers[k - 1].cpu >= 0)
+				snd_output_printf(out, ", CPU %d",
+						  multi->workers->workers[k - 1].cpu);
+			snd_output_printf(out, "\n");
+		}
+	}
+#endif
+	if (multi->drift) {
+		snd_output_printf(out, "  Drift compensation:\n");
+		for (k = 0; k < multi->slaves_count; ++k) {
+			snd_pcm_multi_slave_t *slave = &multi->slaves[k];
+			if (k == multi->master_slave) {
+				snd_output_printf(out, "    %d: master, %.3f Hz\n",
+						  k, slave->clock.rate);
+				continue;
+			}
+			if (!slave->drift)
+				continue;
+			snd_output_printf(out, "    %d: %.3f Hz, ratio %.6f, fill error %.1f frames, %llu frames dropped or repeated\n",
+					  k, slave->clock.rate, slave->drift->ratio,
+					  slave->drift->error, slave->drift->xruns);
+		}
+	}
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -1056,29 +1547,13 @@ static const snd_pcm_fast_ops_t snd_pcm_multi_fast_ops = {
 	.may_wait_for_avail_min = snd_pcm_multi_may_wait_for_avail_min,
 };
 
-/**
- * \brief Creates a new Multi PCM
- * \param pcmp Returns created PCM handle
- * \param name Name of PCM
- * \param slaves_count Count of slaves
- * \param master_slave Master slave number
- * \param slaves_pcm Array with slave PCMs
- * \param schannels_count Array with slave channel counts
- * \param channels_count Count of channels
- * \param sidxs Array with channels indexes to slaves
- * \param schannels Array with slave channels
- * \param close_slaves When set, the slave PCM handle is closed
- * \retval zero on success otherwise a negative error code
- * \warning Using of this function might be dangerous in the sense
- *          of compatibility reasons. The prototype might be freely
- *          changed in future.
- */
-int snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
-		       unsigned int slaves_count, unsigned int master_slave,
-		       snd_pcm_t **slaves_pcm, unsigned int *schannels_count,
-		       unsigned int channels_count,
-		       int *sidxs, unsigned int *schannels,
-		       int close_slaves)
+/* snd_pcm_multi_open() with the options of the configuration */
+static int multi_open(snd_pcm_t **pcmp, const char *name,
+		      unsigned int slaves_count, unsigned int master_slave,
+		      snd_pcm_t **slaves_pcm, unsigned int *schannels_count,
+		      unsigned int channels_count,
+		      int *sidxs, unsigned int *schannels,
+		      int drift, int close_slaves)
 {
 	snd_pcm_t *pcm;
 	snd_pcm_multi_t *multi;
@@ -1100,6 +1575,7 @@ int snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 	
 	multi->slaves_count = slaves_count;
 	multi->master_slave = master_slave;
+	multi->drift = drift;
 	multi->slaves = calloc(slaves_count, sizeof(*multi->slaves));
 	if (!multi->slaves) {
 		free(multi);
@@ -1118,6 +1594,7 @@ int snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 		slave->pcm = slaves_pcm[i];
 		slave->channels_count = schannels_count[i];
 		slave->close_slave = close_slaves;
+		slave->multi = multi;
 	}
 	for (i = 0; i < channels_count; ++i) {
 		snd_pcm_multi_channel_t *bind = &multi->channels[i];
@@ -1152,6 +1629,35 @@ int snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 	return 0;
 }
 
+/**
+ * \brief Creates a new Multi PCM
+ * \param pcmp Returns created PCM handle
+ * \param name Name of PCM
+ * \param slaves_count Count of slaves
+ * \param master_slave Master slave number
+ * \param slaves_pcm Array with slave PCMs
+ * \param schannels_count Array with slave channel counts
+ * \param channels_count Count of channels
+ * \param sidxs Array with channels indexes to slaves
+ * \param schannels Array with slave channels
+ * \param close_slaves When set, the slave PCM handle is closed
+ * \retval zero on success otherwise a negative error code
+ * \warning Using of this function might be dangerous in the sense
+ *          of compatibility reasons. The prototype might be freely
+ *          changed in future.
+ */
+int snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
+		       unsigned int slaves_count, unsigned int master_slave,
+		       snd_pcm_t **slaves_pcm, unsigned int *schannels_count,
+		       unsigned int channels_count,
+		       int *sidxs, unsigned int *schannels,
+		       int close_slaves)
+{
+	return multi_open(pcmp, name, slaves_count, master_slave,
+			  slaves_pcm, schannels_count, channels_count,
+			  sidxs, schannels, 0, close_slaves);
+}
+
 /*! \page pcm_plugins
 
 \section pcm_plugins_multi Plugin: Multiple streams to One
@@ -1178,9 +1684,36 @@ pcm.name {
 		}
 	}
 	[master INT]		# Define the master slave
+	[drift BOOL]		# Compensate the clock drift of the slaves
+	[threads BOOL]		# Run the slaves on worker threads
+	[cpus {			# Pin the worker threads to CPUs
+		ID INT		# CPU of the slave ID, not the first one
+	}]
 }
 \endcode
 
+With threads, the commit, avail_update, hwsync, prepare and reset calls
+are passed to all slaves in parallel, each slave but the first one on its
+own worker thread, and the call returns when all slaves are done.  The
+first slave runs on the calling thread, so it cannot be given a CPU in
+cpus.  The CPUs can be set only where the system supports the thread
+affinity.  One
+slow slave then doesn't delay the others.  Handing a call over to the
+workers costs some microseconds, so this pays off only for slaves with
+slow calls.  The dump shows the time each slave takes for these calls.
+
+With drift, the slaves may run on different clocks, as separate USB
+devices do.  Only the master slave is accessed directly, the other slaves
+get their own buffer and their frames are resampled with linear
+interpolation at a ratio that follows the clock of the slave.  The clock
+rates are measured from the slave hw_ptr and timestamps, and the ratio is
+corrected by the difference of the buffer fill to the master, so the
+latency of the slaves stays bounded.  This works with S16, S32 and FLOAT
+samples only, and the PCM can't be rewound or forwarded.  When a playback
+slave falls so far behind that its buffer has no room for the frames, the
+write fails with -EPIPE like an xrun.  The dump shows the measured rates
+and ratios.
+
 For example, to bind two PCM streams with two-channel stereo (hw:0,0 and
 hw:0,1) as one 4-channel stereo PCM stream, define like this:
 \code
@@ -1258,6 +1791,10 @@ int _snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 	unsigned int slaves_count = 0;
 	long master_slave = 0;
 	unsigned int channels_count = 0;
+	int threads = 0;
+	int drift = 0;
+	snd_config_t *cpus = NULL;
+	int *slaves_cpu = NULL;
 	snd_config_for_each(i, inext, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
 		const char *id;
@@ -1288,6 +1825,28 @@ int _snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 			}
 			continue;
 		}
+		if (strcmp(id, "drift") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			drift = err;
+			continue;
+		}
+		if (strcmp(id, "threads") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			threads = err;
+			continue;
+		}
+		if (strcmp(id, "cpus") == 0) {
+			if (snd_config_get_type(n) != SND_CONFIG_TYPE_COMPOUND) {
+				SNDERR("Invalid type for %s", id);
+				return -EINVAL;
+			}
+			cpus = n;
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -1299,6 +1858,10 @@ int _snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 		SNDERR("bindings is not defined");
 		return -EINVAL;
 	}
+	if (cpus && !threads) {
+		SNDERR("cpus can be used only with threads");
+		return -EINVAL;
+	}
 	snd_config_for_each(i, inext, slaves) {
 		++slaves_count;
 	}
@@ -1330,8 +1893,9 @@ int _snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 	slaves_channels = calloc(slaves_count, sizeof(*slaves_channels));
 	channels_sidx = calloc(channels_count, sizeof(*channels_sidx));
 	channels_schannel = calloc(channels_count, sizeof(*channels_schannel));
+	slaves_cpu = calloc(slaves_count, sizeof(*slaves_cpu));
 	if (!slaves_id || !slaves_conf || !slaves_pcm || !slaves_channels ||
-	    !channels_sidx || !channels_schannel) {
+	    !channels_sidx || !channels_schannel || !slaves_cpu) {
 		err = -ENOMEM;
 		goto _free;
 	}
@@ -1350,9 +1914,42 @@ int _snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 		if (err < 0)
 			goto _free;
 		slaves_channels[idx] = channels;
+		slaves_cpu[idx] = -1;
 		++idx;
 	}
 
+	if (cpus) {
+		snd_config_for_each(i, inext, cpus) {
+			snd_config_t *m = snd_config_iterator_entry(i);
+			const char *id;
+			long cpu;
+			unsigned int k;
+			if (snd_config_get_id(m, &id) < 0)
+				continue;
+			for (k = 0; k < slaves_count; ++k) {
+				if (strcmp(slaves_id[k], id) == 0)
+					break;
+			}
+			if (k == slaves_count) {
+				SNDERR("Unknown slave %s in cpus", id);
+				err = -EINVAL;
+				goto _free;
+			}
+			if (k == 0) {
+				SNDERR("The first slave %s runs on the calling thread, it cannot be pinned", id);
+				err = -EINVAL;
+				goto _free;
+			}
+			err = snd_config_get_integer(m, &cpu);
+			if (err < 0 || cpu < 0 || cpu >= SND_PCM_WORKERS_CPUS) {
+				SNDERR("Invalid CPU for slave %s", id);
+				err = -EINVAL;
+				goto _free;
+			}
+			slaves_cpu[k] = cpu;
+		}
+	}
+
 	snd_config_for_each(i, inext, bindings) {
 		snd_config_t *m = snd_config_iterator_entry(i);
 		long cchannel = -1;
@@ -1431,11 +2028,26 @@ int _snd_pcm_multi_open(snd_pcm_t **pcmp, const char *name,
 		snd_config_delete(slaves_conf[idx]);
 		slaves_conf[idx] = NULL;
 	}
-	err = snd_pcm_multi_open(pcmp, name, slaves_count, master_slave,
-				 slaves_pcm, slaves_channels,
-				 channels_count,
-				 channels_sidx, channels_schannel,
-				 1);
+	err = multi_open(pcmp, name, slaves_count, master_slave,
+			 slaves_pcm, slaves_channels,
+			 channels_count,
+			 channels_sidx, channels_schannel,
+			 drift, 1);
+#ifdef HAVE_LIBPTHREAD
+	if (err >= 0 && threads) {
+		err = multi_start_threads((*pcmp)->private_data, slaves_cpu);
+		if (err < 0) {
+			SNDERR("Cannot start the multi worker threads");
+			snd_pcm_close(*pcmp);
+			*pcmp = NULL;
+			/* the slaves are closed with the multi PCM */
+			for (idx = 0; idx < slaves_count; ++idx)
+				slaves_pcm[idx] = NULL;
+		}
+	}
+#else
+	(void)threads;
+#endif
 _free:
 	if (err < 0) {
 		for (idx = 0; idx < slaves_count; ++idx) {
@@ -1455,6 +2067,7 @@ _free:
 	free(channels_sidx);
 	free(channels_schannel);
 	free(slaves_id);
+	free(slaves_cpu);
 	return err;
 }
 #ifndef DOC_HIDDEN
@@ -0,0 +1,166 @@
+/**
+ * \file pcm/pcm_multi_drift.c
+ * \ingroup PCM_Plugins
+ * \brief PCM Multi Streams to One Conversion Plugin Interface - drift compensation
+ */
+/*
+ *  PCM - Multi
+ *
+ *  This file is included from pcm_multi.c.
+ *
+ *  Drift compensation: the master slave is driven directly, every other
+ *  slave gets its own buffer on the multi side and the frames are
+ *  interpolated between that buffer and the slave buffer, with the ratio
+ *  following the measured clock of the slave.
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#define MULTI_DRIFT_MAX		0.005	/* largest deviation of the ratio */
+#define MULTI_DRIFT_WINDOW	2.0	/* seconds per clock rate measurement */
+#define MULTI_DRIFT_SMOOTH	0.05	/* of the fill error, per update */
+#define MULTI_DRIFT_KP		4e-6	/* per frame of fill error */
+#define MULTI_DRIFT_KI		4e-12	/* per frame of error and frame of time */
+
+/* resampler of a slave which runs on its own clock */
+typedef struct {
+	snd_pcm_format_t format;
+	snd_pcm_uframes_t buffer_size;
+	snd_pcm_uframes_t boundary;
+	char *buf;			/* multi side buffer of the slave channels */
+	snd_pcm_channel_area_t *areas;
+	double *prev, *cur;		/* the frames interpolated between */
+	double pos;			/* position between prev and cur */
+	double ratio;			/* slave frames per multi frame */
+	double error;			/* smoothed buffer fill error in frames */
+	double integral;
+	snd_pcm_uframes_t filled;	/* capture: multi frames resampled */
+	snd_pcm_uframes_t lag;		/* capture: slave frames left over */
+	unsigned long long xruns;	/* frames dropped or repeated */
+} snd_pcm_multi_drift_t;
+
+static inline double multi_drift_get(const snd_pcm_channel_area_t *area,
+				     snd_pcm_uframes_t offset,
+				     snd_pcm_format_t format)
+{
+	const void *addr = snd_pcm_channel_area_addr(area, offset);
+
+	switch (format) {
+	case SND_PCM_FORMAT_S16:
+		return *(const int16_t *)addr;
+	case SND_PCM_FORMAT_S32:
+		return *(const int32_t *)addr;
+	default:	/* SND_PCM_FORMAT_FLOAT */
+		return *(const float *)addr;
+	}
+}
+
+/* the value lies between two samples, so it is always in range */
+static inline void multi_drift_put(const snd_pcm_channel_area_t *area,
+				   snd_pcm_uframes_t offset,
+				   snd_pcm_format_t format, double value)
+{
+	void *addr = snd_pcm_channel_area_addr(area, offset);
+
+	switch (format) {
+	case SND_PCM_FORMAT_S16:
+		*(int16_t *)addr = lrint(value);
+		break;
+	case SND_PCM_FORMAT_S32:
+		*(int32_t *)addr = lrint(value);
+		break;
+	default:	/* SND_PCM_FORMAT_FLOAT */
+		*(float *)addr = value;
+		break;
+	}
+}
+
+/*
+ * interpolate contiguous frames, advancing step source frames per
+ * destination frame; stops when dst_frames are written or src_frames
+ * are used up and returns the written frames
+ */
+static snd_pcm_uframes_t multi_drift_resample(snd_pcm_multi_drift_t *drift,
+					      unsigned int channels, double step,
+					      const snd_pcm_channel_area_t *src_areas,
+					      snd_pcm_uframes_t src_offset,
+					      snd_pcm_uframes_t src_frames,
+					      const snd_pcm_channel_area_t *dst_areas,
+					      snd_pcm_uframes_t dst_offset,
+					      snd_pcm_uframes_t dst_frames,
+					      snd_pcm_uframes_t *src_used)
+{
+	snd_pcm_format_t format = drift->format;
+	snd_pcm_uframes_t src = 0, dst = 0;
+	unsigned int c;
+
+	while (dst < dst_frames) {
+		while (drift->pos >= 1.0) {
+			if (src == src_frames)
+				goto _end;
+			for (c = 0; c < channels; c++) {
+				drift->prev[c] = drift->cur[c];
+				drift->cur[c] = multi_drift_get(&src_areas[c],
+								src_offset + src,
+								format);
+			}
+			src++;
+			drift->pos -= 1.0;
+		}
+		for (c = 0; c < channels; c++)
+			multi_drift_put(&dst_areas[c], dst_offset + dst, format,
+					drift->prev[c] + (drift->cur[c] - drift->prev[c]) * drift->pos);
+		dst++;
+		drift->pos += step;
+	}
+ _end:
+	*src_used = src;
+	return dst;
+}
+
+/*
+ * the PI loop, once per period of the master: the ratio is the measured
+ * clock ratio, corrected by the buffer fill error of the slave in frames
+ * (more queued than the master in playback, more left over than a period
+ * in capture), frames is the time since the last update
+ */
+static void multi_drift_control(snd_pcm_multi_drift_t *drift,
+				snd_pcm_stream_t stream, double error,
+				double ratio, snd_pcm_uframes_t frames)
+{
+	double adjust;
+
+	drift->error += (error - drift->error) * MULTI_DRIFT_SMOOTH;
+	drift->integral += MULTI_DRIFT_KI * drift->error * frames;
+	if (drift->integral > MULTI_DRIFT_MAX)
+		drift->integral = MULTI_DRIFT_MAX;
+	else if (drift->integral < -MULTI_DRIFT_MAX)
+		drift->integral = -MULTI_DRIFT_MAX;
+	if (fabs(ratio - 1.0) > MULTI_DRIFT_MAX)
+		ratio = 1.0;
+	adjust = MULTI_DRIFT_KP * drift->error + drift->integral;
+	/* too much queued in playback, too much left in capture */
+	if (stream == SND_PCM_STREAM_PLAYBACK)
+		ratio *= 1.0 - adjust;
+	else
+		ratio *= 1.0 + adjust;
+	if (ratio > 1.0 + MULTI_DRIFT_MAX)
+		ratio = 1.0 + MULTI_DRIFT_MAX;
+	else if (ratio < 1.0 - MULTI_DRIFT_MAX)
+		ratio = 1.0 - MULTI_DRIFT_MAX;
+	drift->ratio = ratio;
+}
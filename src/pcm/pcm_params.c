@@ -1970,8 +1970,8 @@ static const snd_mask_t refine_masks[SND_PCM_HW_PARAM_LAST_MASK - SND_PCM_HW_PAR
 			PCM_BIT(SNDRV_PCM_FORMAT_FLOAT_BE) |
 			PCM_BIT(SNDRV_PCM_FORMAT_FLOAT64_LE) |
 			PCM_BIT(SNDRV_PCM_FORMAT_FLOAT64_BE) |
-			PCM_BIT(SNDRV_PCM_FORMAT_IEC958_SUBFRAME) |
-			PCM_BIT(SNDRV_PCM_FORMAT_IEC958_SUBFRAME) |
+			PCM_BIT(SNDRV_PCM_FORMAT_IEC958_SUBFRAME_LE) |
+			PCM_BIT(SNDRV_PCM_FORMAT_IEC958_SUBFRAME_BE) |
 			PCM_BIT(SNDRV_PCM_FORMAT_MU_LAW) |
 			PCM_BIT(SNDRV_PCM_FORMAT_A_LAW) |
 			PCM_BIT(SNDRV_PCM_FORMAT_IMA_ADPCM) |
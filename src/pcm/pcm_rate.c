@@ -32,7 +32,11 @@
 #include "pcm_rate.h"
 #include "plugin_ops.h"
 #include "bswap.h"
+#include "list.h"
 #include <inttypes.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #if 0
 #define DEBUG_REFINE
@@ -47,6 +51,17 @@ const char *_snd_module_pcm_rate = "";
 
 typedef struct _snd_pcm_rate snd_pcm_rate_t;
 
+/* everything the converter state and the temporary areas depend on */
+typedef struct {
+	const char *type;
+	void *open_func;
+	snd_pcm_rate_info_t info;
+	snd_pcm_format_t orig_in_format;
+	snd_pcm_format_t orig_out_format;
+	int need_src_buf;
+	int need_dst_buf;
+} rate_cache_key_t;
+
 struct _snd_pcm_rate {
 	snd_pcm_generic_t gen;
 	snd_pcm_uframes_t appl_ptr, hw_ptr, last_slave_hw_ptr;
@@ -74,6 +89,10 @@ struct _snd_pcm_rate {
 	uint64_t in_formats;
 	uint64_t out_formats;
 	unsigned int format_flags;
+	char *type;		/* converter name, NULL if not cacheable */
+	rate_cache_key_t key;	/* setup of the initialized converter */
+	int parked;		/* hw_free'd, but the converter is still set up */
+	int cache_hit;		/* the converter was taken from the cache */
 };
 
 #define SND_PCM_RATE_PLUGIN_VERSION_OLD	0x010001	/* old rate plugin */
@@ -118,6 +137,226 @@ static void rate_free_tmp_buf(snd_pcm_channel_area_t **ptr)
 	}
 }
 
+/*
+ * Process-wide cache of set up converters
+ *
+ * At close, a rate PCM hands its initialized converter over together
+ * with the temporary areas.  The next rate PCM opened with the same
+ * converter type and the same hw_params takes them at hw_params instead
+ * of running the converter init and the allocations again.  When the
+ * cache is full, the least recently stored entry is dropped.
+ */
+#define RATE_CACHE_SIZE		4
+
+typedef struct {
+	struct list_head list;		/* most recently stored first */
+	rate_cache_key_t key;		/* key.type is owned by the entry */
+	void *obj;
+	snd_pcm_rate_ops_t ops;
+	snd_pcm_channel_area_t *pareas;
+	snd_pcm_channel_area_t *sareas;
+	snd_pcm_channel_area_t *src_buf;
+	snd_pcm_channel_area_t *dst_buf;
+	unsigned int src_conv_idx;
+	unsigned int dst_conv_idx;
+} rate_cache_entry_t;
+
+static LIST_HEAD(rate_cache_list);
+static unsigned int rate_cache_entries;
+static unsigned long rate_cache_hits, rate_cache_misses;
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t rate_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void rate_cache_lock(void)
+{
+	pthread_mutex_lock(&rate_cache_mutex);
+}
+
+static inline void rate_cache_unlock(void)
+{
+	pthread_mutex_unlock(&rate_cache_mutex);
+}
+#else
+static inline void rate_cache_lock(void) {}
+static inline void rate_cache_unlock(void) {}
+#endif
+
+static int rate_side_info_equal(const snd_pcm_rate_side_info_t *a,
+				const snd_pcm_rate_side_info_t *b)
+{
+	return a->format == b->format && a->rate == b->rate &&
+	       a->buffer_size == b->buffer_size &&
+	       a->period_size == b->period_size;
+}
+
+static int rate_cache_key_equal(const rate_cache_key_t *a,
+				const rate_cache_key_t *b)
+{
+	return a->type && b->type && strcmp(a->type, b->type) == 0 &&
+	       a->open_func == b->open_func &&
+	       rate_side_info_equal(&a->info.in, &b->info.in) &&
+	       rate_side_info_equal(&a->info.out, &b->info.out) &&
+	       a->info.channels == b->info.channels &&
+	       a->orig_in_format == b->orig_in_format &&
+	       a->orig_out_format == b->orig_out_format &&
+	       a->need_src_buf == b->need_src_buf &&
+	       a->need_dst_buf == b->need_dst_buf;
+}
+
+static void rate_cache_entry_free(rate_cache_entry_t *e)
+{
+	if (e->ops.free)
+		e->ops.free(e->obj);
+	if (e->ops.close)
+		e->ops.close(e->obj);
+	if (e->key.open_func)
+		snd_dlobj_cache_put(e->key.open_func);
+	rate_free_tmp_buf(&e->pareas);
+	rate_free_tmp_buf(&e->sareas);
+	rate_free_tmp_buf(&e->src_buf);
+	rate_free_tmp_buf(&e->dst_buf);
+	free((char *)e->key.type);
+	free(e);
+}
+
+/* hand the set up converter of a closing PCM over to the cache */
+static int rate_cache_put(snd_pcm_rate_t *rate)
+{
+	rate_cache_entry_t *e, *victim = NULL;
+
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return -ENOMEM;
+	e->key = rate->key;
+	e->obj = rate->obj;
+	e->ops = rate->ops;
+	e->pareas = rate->pareas;
+	e->sareas = rate->sareas;
+	e->src_buf = rate->src_buf;
+	e->dst_buf = rate->dst_buf;
+	e->src_conv_idx = rate->src_conv_idx;
+	e->dst_conv_idx = rate->dst_conv_idx;
+
+	/* the entry owns the converter, the name and the library reference now */
+	rate->obj = NULL;
+	rate->type = NULL;
+	rate->open_func = NULL;
+	rate->pareas = rate->sareas = NULL;
+	rate->src_buf = rate->dst_buf = NULL;
+	rate->parked = 0;
+
+	rate_cache_lock();
+	list_add(&e->list, &rate_cache_list);
+	if (++rate_cache_entries > RATE_CACHE_SIZE) {
+		victim = list_entry(rate_cache_list.prev, rate_cache_entry_t, list);
+		list_del(&victim->list);
+		rate_cache_entries--;
+	}
+	rate_cache_unlock();
+
+	if (victim)
+		rate_cache_entry_free(victim);
+	return 0;
+}
+
+/* take a matching converter from the cache, returns 1 on success */
+static int rate_cache_get(snd_pcm_rate_t *rate, const rate_cache_key_t *key)
+{
+	struct list_head *pos;
+	rate_cache_entry_t *e = NULL;
+
+	rate_cache_lock();
+	list_for_each(pos, &rate_cache_list) {
+		rate_cache_entry_t *c = list_entry(pos, rate_cache_entry_t, list);
+		if (rate_cache_key_equal(&c->key, key)) {
+			e = c;
+			break;
+		}
+	}
+	if (e) {
+		list_del(&e->list);
+		rate_cache_entries--;
+		rate_cache_hits++;
+	} else {
+		rate_cache_misses++;
+	}
+	rate_cache_unlock();
+	if (!e)
+		return 0;
+
+	/* drop the unused converter from the open, the ops are the same */
+	if (rate->ops.close)
+		rate->ops.close(rate->obj);
+	rate->obj = e->obj;
+	rate->pareas = e->pareas;
+	rate->sareas = e->sareas;
+	rate->src_buf = e->src_buf;
+	rate->dst_buf = e->dst_buf;
+	rate->src_conv_idx = e->src_conv_idx;
+	rate->dst_conv_idx = e->dst_conv_idx;
+	/* the PCM holds its own library reference */
+	if (e->key.open_func)
+		snd_dlobj_cache_put(e->key.open_func);
+	free((char *)e->key.type);
+	free(e);
+	return 1;
+}
+
+static void rate_cache_dump(snd_pcm_rate_t *rate, snd_output_t *out)
+{
+	struct list_head *pos;
+
+	rate_cache_lock();
+	snd_output_printf(out, "Converter cache: %u/%u entries, %lu hits, %lu misses%s\n",
+			  rate_cache_entries, RATE_CACHE_SIZE,
+			  rate_cache_hits, rate_cache_misses,
+			  rate->cache_hit ? " (this converter was cached)" : "");
+	list_for_each(pos, &rate_cache_list) {
+		rate_cache_entry_t *e = list_entry(pos, rate_cache_entry_t, list);
+		snd_output_printf(out, "  %s: %u channels, %s %u Hz -> %s %u Hz\n",
+				  e->key.type, e->key.info.channels,
+				  snd_pcm_format_name(e->key.info.in.format),
+				  e->key.info.in.rate,
+				  snd_pcm_format_name(e->key.info.out.format),
+				  e->key.info.out.rate);
+	}
+	rate_cache_unlock();
+}
+
+/**
+ * \brief Release all converters held in the rate converter cache
+ */
+void snd_pcm_rate_cache_cleanup(void)
+{
+	rate_cache_entry_t *e;
+
+	for (;;) {
+		rate_cache_lock();
+		if (list_empty(&rate_cache_list)) {
+			rate_cache_unlock();
+			break;
+		}
+		e = list_entry(rate_cache_list.next, rate_cache_entry_t, list);
+		list_del(&e->list);
+		rate_cache_entries--;
+		rate_cache_unlock();
+		rate_cache_entry_free(e);
+	}
+}
+
+/* release the converter setup and the temporary areas of hw_params */
+static void rate_free_setup(snd_pcm_rate_t *rate)
+{
+	rate_free_tmp_buf(&rate->pareas);
+	rate_free_tmp_buf(&rate->sareas);
+	if (rate->ops.free)
+		rate->ops.free(rate->obj);
+	rate_free_tmp_buf(&rate->src_buf);
+	rate_free_tmp_buf(&rate->dst_buf);
+	rate->parked = 0;
+}
+
 static int snd_pcm_rate_hw_refine_cprepare(snd_pcm_t *pcm ATTRIBUTE_UNUSED, snd_pcm_hw_params_t *params)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
@@ -128,6 +367,10 @@ static int snd_pcm_rate_hw_refine_cprepare(snd_pcm_t *pcm ATTRIBUTE_UNUSED, snd_
 					 &access_mask);
 	if (err < 0)
 		return err;
+	/* float is passed through when the converter takes it on both sides */
+	if (rate->sformat == SND_PCM_FORMAT_UNKNOWN &&
+	    (rate->in_formats & rate->out_formats & (1ULL << SND_PCM_FORMAT_FLOAT)))
+		snd_pcm_format_mask_set(&format_mask, SND_PCM_FORMAT_FLOAT);
 	err = _snd_pcm_hw_param_set_mask(params, SND_PCM_HW_PARAM_FORMAT,
 					 &format_mask);
 	if (err < 0)
@@ -287,6 +530,8 @@ static int get_best_format(uint64_t mask, snd_pcm_format_t orig)
 	int match = -1;
 	int f, score;
 
+	if (mask & (1ULL << orig))
+		return orig;
 	for (f = 0; f <= SND_PCM_FORMAT_LAST; f++) {
 		if (!(mask & (1ULL << f)))
 			continue;
@@ -355,6 +600,7 @@ static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 	snd_pcm_rate_side_info_t *sinfo, *cinfo;
 	unsigned int channels, acc;
 	int need_src_buf, need_dst_buf;
+	rate_cache_key_t key;
 	int err = snd_pcm_hw_params_slave(pcm, params,
 					  snd_pcm_rate_hw_refine_cchange,
 					  snd_pcm_rate_hw_refine_sprepare,
@@ -395,11 +641,54 @@ static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 	sinfo->buffer_size = slave->buffer_size;
 	sinfo->period_size = slave->period_size;
 
+	rate->orig_in_format = rate->info.in.format;
+	rate->orig_out_format = rate->info.out.format;
+	if (choose_preferred_format(rate) < 0) {
+		SNDERR("No matching format in rate plugin");
+		return -EINVAL;
+	}
+
+	need_src_buf = need_dst_buf = 0;
+
+	if ((rate->format_flags & SND_PCM_RATE_FLAG_INTERLEAVED) &&
+	    !(acc == SND_PCM_ACCESS_MMAP_INTERLEAVED ||
+	      acc == SND_PCM_ACCESS_RW_INTERLEAVED)) {
+		need_src_buf = need_dst_buf = 1;
+	} else {
+		if (rate->orig_in_format != rate->info.in.format)
+			need_src_buf = 1;
+		if (rate->orig_out_format != rate->info.out.format)
+			need_dst_buf = 1;
+	}
+
+	key.type = rate->type;
+	key.open_func = rate->open_func;
+	key.info = rate->info;
+	key.orig_in_format = rate->orig_in_format;
+	key.orig_out_format = rate->orig_out_format;
+	key.need_src_buf = need_src_buf;
+	key.need_dst_buf = need_dst_buf;
+
+	/* the converter of the previous hw_params is kept until now */
+	if (rate->parked) {
+		if (rate_cache_key_equal(&rate->key, &key)) {
+			rate->parked = 0;
+			return 0;
+		}
+		rate_free_setup(rate);
+	}
+
 	if (CHECK_SANITY(rate->pareas)) {
 		SNDMSG("rate plugin already in use");
 		return -EBUSY;
 	}
 
+	rate->cache_hit = rate->type && rate_cache_get(rate, &key);
+	if (rate->cache_hit) {
+		rate->key = key;
+		return 0;
+	}
+
 	rate->pareas = rate_alloc_tmp_buf(cinfo->format, channels,
 					  cinfo->period_size);
 	rate->sareas = rate_alloc_tmp_buf(sinfo->format, channels,
@@ -409,14 +698,6 @@ static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 		goto error_pareas;
 	}
 
-	rate->orig_in_format = rate->info.in.format;
-	rate->orig_out_format = rate->info.out.format;
-	if (choose_preferred_format(rate) < 0) {
-		SNDERR("No matching format in rate plugin");
-		err = -EINVAL;
-		goto error_pareas;
-	}
-
 	err = rate->ops.init(rate->obj, &rate->info);
 	if (err < 0)
 		goto error_init;
@@ -424,19 +705,6 @@ static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 	rate_free_tmp_buf(&rate->src_buf);
 	rate_free_tmp_buf(&rate->dst_buf);
 
-	need_src_buf = need_dst_buf = 0;
-
-	if ((rate->format_flags & SND_PCM_RATE_FLAG_INTERLEAVED) &&
-	    !(acc == SND_PCM_ACCESS_MMAP_INTERLEAVED ||
-	      acc == SND_PCM_ACCESS_RW_INTERLEAVED)) {
-		need_src_buf = need_dst_buf = 1;
-	} else {
-		if (rate->orig_in_format != rate->info.in.format)
-			need_src_buf = 1;
-		if (rate->orig_out_format != rate->info.out.format)
-			need_dst_buf = 1;
-	}
-
 	if (need_src_buf) {
 		rate->src_conv_idx =
 			snd_pcm_linear_convert_index(rate->orig_in_format,
@@ -461,6 +729,7 @@ static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 		}
 	}
 
+	rate->key = key;
 	return 0;
 
  error:
@@ -479,12 +748,11 @@ static int snd_pcm_rate_hw_free(snd_pcm_t *pcm)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
 
-	rate_free_tmp_buf(&rate->pareas);
-	rate_free_tmp_buf(&rate->sareas);
-	if (rate->ops.free)
-		rate->ops.free(rate->obj);
-	rate_free_tmp_buf(&rate->src_buf);
-	rate_free_tmp_buf(&rate->dst_buf);
+	/* keep a cacheable converter set up for the next hw_params or close */
+	if (rate->type && rate->pareas)
+		rate->parked = 1;
+	else
+		rate_free_setup(rate);
 	return snd_pcm_hw_free(rate->gen.slave);
 }
 
@@ -1262,6 +1530,7 @@ static void snd_pcm_rate_dump(snd_pcm_t *pcm, snd_output_t *out)
 	if (rate->ops.dump)
 		rate->ops.dump(rate->obj, out);
 	snd_output_printf(out, "Protocol version: %x\n", rate->plugin_version);
+	rate_cache_dump(rate, out);
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -1274,10 +1543,13 @@ static int snd_pcm_rate_close(snd_pcm_t *pcm)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
 
-	if (rate->ops.close)
+	if (rate->parked && rate_cache_put(rate) < 0)
+		rate_free_setup(rate);
+	if (rate->obj && rate->ops.close)
 		rate->ops.close(rate->obj);
 	if (rate->open_func)
 		snd_dlobj_cache_put(rate->open_func);
+	free(rate->type);
 	return snd_pcm_generic_close(pcm);
 }
 
@@ -1392,10 +1664,38 @@ static void rate_initial_setup(snd_pcm_rate_t *rate)
 	}
 }
 
+extern int SND_PCM_RATE_PLUGIN_ENTRY(linear) (unsigned int version, void **objp, snd_pcm_rate_ops_t *ops);
+extern int SND_PCM_RATE_PLUGIN_ENTRY(polyphase) (unsigned int version, void **objp, snd_pcm_rate_ops_t *ops);
+extern int SND_PCM_RATE_PLUGIN_ENTRY(polyphase_fast) (unsigned int version, void **objp, snd_pcm_rate_ops_t *ops);
+extern int SND_PCM_RATE_PLUGIN_ENTRY(polyphase_medium) (unsigned int version, void **objp, snd_pcm_rate_ops_t *ops);
+extern int SND_PCM_RATE_PLUGIN_ENTRY(polyphase_best) (unsigned int version, void **objp, snd_pcm_rate_ops_t *ops);
+
+/* converters linked into the library */
+static const struct {
+	const char *type;
+	snd_pcm_rate_open_func_t open_func;
+} builtin_rate_plugins[] = {
+	{ "linear", SND_PCM_RATE_PLUGIN_ENTRY(linear) },
+	{ "polyphase", SND_PCM_RATE_PLUGIN_ENTRY(polyphase) },
+	{ "polyphase_fast", SND_PCM_RATE_PLUGIN_ENTRY(polyphase_fast) },
+	{ "polyphase_medium", SND_PCM_RATE_PLUGIN_ENTRY(polyphase_medium) },
+	{ "polyphase_best", SND_PCM_RATE_PLUGIN_ENTRY(polyphase_best) },
+};
+
+static snd_pcm_rate_open_func_t builtin_rate_open_func(const char *type)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(builtin_rate_plugins); i++)
+		if (strcmp(type, builtin_rate_plugins[i].type) == 0)
+			return builtin_rate_plugins[i].open_func;
+	return NULL;
+}
+
 #ifdef PIC
 static int is_builtin_plugin(const char *type)
 {
-	return strcmp(type, "linear") == 0;
+	return builtin_rate_open_func(type) != NULL;
 }
 
 static const char *const default_rate_plugins[] = {
@@ -1500,10 +1800,10 @@ int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 	snd_pcm_t *pcm;
 	snd_pcm_rate_t *rate;
 	const char *type = NULL;
+	int cacheable = 1;
 	int err;
 #ifndef PIC
 	snd_pcm_rate_open_func_t open_func;
-	extern int SND_PCM_RATE_PLUGIN_ENTRY(linear) (unsigned int version, void **objp, snd_pcm_rate_ops_t *ops);
 #endif
 
 	assert(pcmp && slave);
@@ -1570,6 +1870,8 @@ int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 			free(rate);
 			return -EINVAL;
 		}
+		/* the converter options are not a part of the cache key */
+		cacheable = 0;
 		err = rate_open_func(rate, type, converter, 1);
 	} else {
 		SNDERR("Invalid type for rate converter");
@@ -1584,8 +1886,14 @@ int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 		return -ENOENT;
 	}
 #else
-	type = "linear";
-	open_func = SND_PCM_RATE_PLUGIN_ENTRY(linear);
+	/* only a single builtin converter given by name is accepted */
+	open_func = NULL;
+	if (converter && !snd_config_get_string(converter, &type))
+		open_func = builtin_rate_open_func(type);
+	if (!open_func) {
+		type = "linear";
+		open_func = SND_PCM_RATE_PLUGIN_ENTRY(linear);
+	}
 	err = open_func(SND_PCM_RATE_PLUGIN_VERSION, &rate->obj, &rate->ops);
 	if (err < 0) {
 		snd_pcm_free(pcm);
@@ -1603,6 +1911,8 @@ int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 	}
 
 	rate_initial_setup(rate);
+	if (cacheable)
+		rate->type = strdup(type);
 
 	pcm->ops = &snd_pcm_rate_ops;
 	pcm->fast_ops = &snd_pcm_rate_fast_ops;
@@ -1649,6 +1959,19 @@ pcm.name {
 }
 \endcode
 
+The converters "linear" (linear interpolation) and "polyphase" (windowed-sinc
+FIR filter) are built into the library, the others are loaded from
+libasound_module_rate_*.so.  The polyphase converter comes in the quality
+presets "polyphase_fast", "polyphase_medium" and "polyphase_best";
+"polyphase" is the same as "polyphase_medium".  The polyphase converter is
+used only when it is named; the default list is "speexrate" and "linear",
+the first one available is used.
+
+A converter given by name (not by a compound with options) is kept set up
+after the PCM is closed, and a rate PCM opened later with the same
+converter and hw_params takes it over.  Up to four converters are kept,
+the cache state is shown by snd_pcm_dump().
+
 \subsection pcm_plugins_rate_funcref Function reference
 
 <UL>
@@ -24,6 +24,7 @@
 #include "pcm_plugin.h"
 #include "pcm_rate.h"
 #include "plugin_ops.h"
+#include "pcm_simd.h"
 #include "bswap.h"
 #include <inttypes.h>
 
@@ -38,12 +39,18 @@ struct rate_linear {
 	unsigned int pitch;
 	unsigned int pitch_shift;	/* for expand interpolation */
 	unsigned int channels;
+	unsigned int width;		/* sample width in bits for the interleaved path */
 	int16_t *old_sample;
+	float *old_float;
 	void (*func)(struct rate_linear *rate,
 		     const snd_pcm_channel_area_t *dst_areas,
 		     snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
 		     const snd_pcm_channel_area_t *src_areas,
 		     snd_pcm_uframes_t src_offset, unsigned int src_frames);
+	/* frame by frame conversion of interleaved buffers (optional) */
+	void (*frames_func)(struct rate_linear *rate,
+			    void *dst, unsigned int dst_frames,
+			    const void *src, unsigned int src_frames);
 };
 
 static snd_pcm_uframes_t input_frames(void *obj, snd_pcm_uframes_t frames)
@@ -307,6 +314,129 @@ static void linear_shrink_s16(struct rate_linear *rate,
 	}
 }
 
+static void linear_expand_float(struct rate_linear *rate,
+				const snd_pcm_channel_area_t *dst_areas,
+				snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
+				const snd_pcm_channel_area_t *src_areas,
+				snd_pcm_uframes_t src_offset, unsigned int src_frames)
+{
+	unsigned int channel;
+	unsigned int src_frames1;
+	unsigned int dst_frames1;
+	unsigned int get_threshold = rate->pitch;
+	unsigned int pos;
+
+	for (channel = 0; channel < rate->channels; ++channel) {
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		const float *src;
+		float *dst;
+		int src_step, dst_step;
+		float old_sample = 0;
+		float new_sample;
+		src = snd_pcm_channel_area_addr(src_area, src_offset);
+		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		src_step = snd_pcm_channel_area_step(src_area) >> 2;
+		dst_step = snd_pcm_channel_area_step(dst_area) >> 2;
+		src_frames1 = 0;
+		dst_frames1 = 0;
+		new_sample = rate->old_float[channel];
+		pos = get_threshold;
+		while (dst_frames1 < dst_frames) {
+			if (pos >= get_threshold) {
+				pos -= get_threshold;
+				old_sample = new_sample;
+				if (src_frames1 < src_frames)
+					new_sample = *src;
+			}
+			*dst = old_sample + (new_sample - old_sample) * ((float)pos / get_threshold);
+			dst += dst_step;
+			dst_frames1++;
+			pos += LINEAR_DIV;
+			if (pos >= get_threshold) {
+				src += src_step;
+				src_frames1++;
+			}
+		}
+		rate->old_float[channel] = new_sample;
+	}
+}
+
+static void linear_shrink_float(struct rate_linear *rate,
+				const snd_pcm_channel_area_t *dst_areas,
+				snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
+				const snd_pcm_channel_area_t *src_areas,
+				snd_pcm_uframes_t src_offset, unsigned int src_frames)
+{
+	unsigned int get_increment = rate->pitch;
+	unsigned int channel;
+	unsigned int src_frames1;
+	unsigned int dst_frames1;
+	unsigned int pos;
+
+	for (channel = 0; channel < rate->channels; ++channel) {
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		const float *src;
+		float *dst;
+		int src_step, dst_step;
+		float old_sample = 0;
+		float new_sample;
+		pos = LINEAR_DIV - get_increment; /* Force first sample to be copied */
+		src = snd_pcm_channel_area_addr(src_area, src_offset);
+		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		src_step = snd_pcm_channel_area_step(src_area) >> 2;
+		dst_step = snd_pcm_channel_area_step(dst_area) >> 2;
+		src_frames1 = 0;
+		dst_frames1 = 0;
+		while (src_frames1 < src_frames) {
+			new_sample = *src;
+			src += src_step;
+			src_frames1++;
+			pos += get_increment;
+			if (pos >= LINEAR_DIV) {
+				pos -= LINEAR_DIV;
+				if (CHECK_SANITY(dst_frames1 >= dst_frames)) {
+					SNDERR("dst_frames overflow");
+					break;
+				}
+				*dst = new_sample + (old_sample - new_sample) * ((float)pos / get_increment);
+				dst += dst_step;
+				dst_frames1++;
+			}
+			old_sample = new_sample;
+		}
+	}
+}
+
+#ifdef PCM_SIMD
+#define SIMD_BYTES	16
+#define SIMD_ATTR
+#define SIMD_NAME(x)	simd_##x##_v128
+#include "pcm_rate_linear.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+
+#ifdef PCM_SIMD_AVX2
+#define SIMD_BYTES	32
+#define SIMD_ATTR	PCM_SIMD_AVX2_ATTR
+#define SIMD_NAME(x)	simd_##x##_avx2
+#include "pcm_rate_linear.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif
+#else
+#define SIMD_BYTES	0
+#define SIMD_ATTR
+#define SIMD_NAME(x)	generic_##x
+#include "pcm_rate_linear.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif /* PCM_SIMD */
+
 static void linear_convert(void *obj, 
 			   const snd_pcm_channel_area_t *dst_areas,
 			   snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
@@ -314,6 +444,18 @@ static void linear_convert(void *obj,
 			   snd_pcm_uframes_t src_offset, unsigned int src_frames)
 {
 	struct rate_linear *rate = obj;
+
+	if (rate->frames_func) {
+		char *dst = snd_pcm_areas_interleaved_addr(dst_areas, dst_offset,
+							   rate->channels, rate->width);
+		char *src = snd_pcm_areas_interleaved_addr(src_areas, src_offset,
+							   rate->channels, rate->width);
+
+		if (dst && src) {
+			rate->frames_func(rate, dst, dst_frames, src, src_frames);
+			return;
+		}
+	}
 	rate->func(rate, dst_areas, dst_offset, dst_frames,
 		   src_areas, src_offset, src_frames);
 }
@@ -324,11 +466,53 @@ static void linear_free(void *obj)
 
 	free(rate->old_sample);
 	rate->old_sample = NULL;
+	free(rate->old_float);
+	rate->old_float = NULL;
+}
+
+/* select the frame by frame functions for interleaved S16 or FLOAT */
+static void linear_select_frames_func(struct rate_linear *rate, int expand,
+				      snd_pcm_format_t format)
+{
+	rate->frames_func = NULL;
+	if (format != SND_PCM_FORMAT_S16 && format != SND_PCM_FORMAT_FLOAT)
+		return;
+	rate->width = snd_pcm_format_physical_width(format);
+#ifdef PCM_SIMD
+#ifdef PCM_SIMD_AVX2
+	if (snd_pcm_simd_features() & SND_PCM_SIMD_AVX2) {
+		if (format == SND_PCM_FORMAT_S16)
+			rate->frames_func = expand ? simd_expand_s16_avx2 : simd_shrink_s16_avx2;
+		else
+			rate->frames_func = expand ? simd_expand_float_avx2 : simd_shrink_float_avx2;
+		return;
+	}
+#endif
+	if (format == SND_PCM_FORMAT_S16)
+		rate->frames_func = expand ? simd_expand_s16_v128 : simd_shrink_s16_v128;
+	else
+		rate->frames_func = expand ? simd_expand_float_v128 : simd_shrink_float_v128;
+#else
+	if (format == SND_PCM_FORMAT_S16)
+		rate->frames_func = expand ? generic_expand_s16 : generic_shrink_s16;
+	else
+		rate->frames_func = expand ? generic_expand_float : generic_shrink_float;
+#endif
 }
 
 static int linear_init(void *obj, snd_pcm_rate_info_t *info)
 {
 	struct rate_linear *rate = obj;
+	int expand = info->in.rate < info->out.rate;
+
+	if (info->in.format == SND_PCM_FORMAT_FLOAT ||
+	    info->out.format == SND_PCM_FORMAT_FLOAT) {
+		/* float is only converted to float */
+		if (info->in.format != info->out.format)
+			return -EINVAL;
+		rate->func = expand ? linear_expand_float : linear_shrink_float;
+		goto __setup;
+	}
 
 	rate->get_idx = snd_pcm_linear_get_index(info->in.format, SND_PCM_FORMAT_S16);
 	rate->put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S16, info->out.format);
@@ -345,14 +529,25 @@ static int linear_init(void *obj, snd_pcm_rate_info_t *info)
 			rate->func = linear_shrink;
 		/* pitch is get_increment */
 	}
+ __setup:
 	rate->pitch = (((uint64_t)info->out.rate * LINEAR_DIV) +
 		       (info->in.rate / 2)) / info->in.rate;
 	rate->channels = info->channels;
+	if (info->in.format == info->out.format)
+		linear_select_frames_func(rate, expand, info->in.format);
+	else
+		rate->frames_func = NULL;
 
-	free(rate->old_sample);
-	rate->old_sample = malloc(sizeof(*rate->old_sample) * rate->channels);
-	if (! rate->old_sample)
-		return -ENOMEM;
+	linear_free(rate);
+	if (info->in.format == SND_PCM_FORMAT_FLOAT) {
+		rate->old_float = calloc(rate->channels, sizeof(*rate->old_float));
+		if (! rate->old_float)
+			return -ENOMEM;
+	} else {
+		rate->old_sample = malloc(sizeof(*rate->old_sample) * rate->channels);
+		if (! rate->old_sample)
+			return -ENOMEM;
+	}
 
 	return 0;
 }
@@ -397,6 +592,8 @@ static void linear_reset(void *obj)
 	/* for expand */
 	if (rate->old_sample)
 		memset(rate->old_sample, 0, sizeof(*rate->old_sample) * rate->channels);
+	if (rate->old_float)
+		memset(rate->old_float, 0, sizeof(*rate->old_float) * rate->channels);
 }
 
 static void linear_close(void *obj)
@@ -412,6 +609,22 @@ static int get_supported_rates(ATTRIBUTE_UNUSED void *rate,
 	return 0;
 }
 
+static int get_supported_formats(ATTRIBUTE_UNUSED void *obj,
+				 uint64_t *in_formats, uint64_t *out_formats,
+				 unsigned int *flags)
+{
+	uint64_t formats = 1ULL << SND_PCM_FORMAT_FLOAT;
+	int format;
+
+	/* all linear formats through get16/put16, or float to float */
+	for (format = 0; format < 64; format++)
+		if (snd_pcm_format_linear(format) == 1)
+			formats |= 1ULL << format;
+	*in_formats = *out_formats = formats;
+	*flags = 0;
+	return 0;
+}
+
 static void linear_dump(ATTRIBUTE_UNUSED void *rate, snd_output_t *out)
 {
 	snd_output_printf(out, "Converter: linear-interpolation\n");
@@ -429,6 +642,7 @@ static const snd_pcm_rate_ops_t linear_ops = {
 	.version = SND_PCM_RATE_PLUGIN_VERSION,
 	.get_supported_rates = get_supported_rates,
 	.dump = linear_dump,
+	.get_supported_formats = get_supported_formats,
 };
 
 int SND_PCM_RATE_PLUGIN_ENTRY(linear) (ATTRIBUTE_UNUSED unsigned int version,
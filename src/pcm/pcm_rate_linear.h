@@ -0,0 +1,229 @@
+/**
+ * \file pcm/pcm_rate_linear.h
+ * \ingroup PCM_Plugins
+ * \brief PCM Rate Plugin Interface - linear converter interleaved code
+ */
+/*
+ *  Linear rate converter plugin
+ *
+ *  This file is included from pcm_rate_linear.c several times, with
+ *  SIMD_BYTES (vector size, 0 for plain C), SIMD_ATTR (function
+ *  attributes) and SIMD_NAME() (symbol suffix) defined.
+ *
+ *  The functions convert interleaved frames frame by frame, the weights
+ *  are computed once per frame and all channels are interpolated with
+ *  them.  The position and weight arithmetic is the same as in the
+ *  channel-by-channel functions, the S16 results are identical.
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#if SIMD_BYTES
+typedef int16_t SIMD_NAME(hs16) __attribute__((vector_size(SIMD_BYTES / 2)));
+typedef int32_t SIMD_NAME(vs32) __attribute__((vector_size(SIMD_BYTES)));
+typedef float SIMD_NAME(vf32) __attribute__((vector_size(SIMD_BYTES)));
+
+/* 32-bit lanes in one vector */
+#define LANES		(SIMD_BYTES / 4)
+#endif
+
+static inline __attribute__((always_inline)) SIMD_ATTR
+void SIMD_NAME(blend_s16)(int16_t *dst, const int16_t *old, const int16_t *new,
+			  int old_weight, int new_weight, unsigned int channels)
+{
+	unsigned int c = 0;
+#if SIMD_BYTES
+	SIMD_NAME(hs16) o16, n16;
+	SIMD_NAME(vs32) o, n;
+
+	for (; c + LANES <= channels; c += LANES) {
+		simd_load(o16, old + c);
+		simd_load(n16, new + c);
+		o = simd_convert(o16, SIMD_NAME(vs32));
+		n = simd_convert(n16, SIMD_NAME(vs32));
+		o = (o * old_weight + n * new_weight) >> 16;
+		o16 = simd_convert(o, SIMD_NAME(hs16));
+		simd_store(dst + c, o16);
+	}
+#endif
+	for (; c < channels; c++)
+		dst[c] = (old[c] * old_weight + new[c] * new_weight) >> 16;
+}
+
+/* old + (new - old) * weight */
+static inline __attribute__((always_inline)) SIMD_ATTR
+void SIMD_NAME(blend_float)(float *dst, const float *old, const float *new,
+			    float weight, unsigned int channels)
+{
+	unsigned int c = 0;
+#if SIMD_BYTES
+	SIMD_NAME(vf32) o, n;
+
+	for (; c + LANES <= channels; c += LANES) {
+		simd_load(o, old + c);
+		simd_load(n, new + c);
+		o += (n - o) * weight;
+		simd_store(dst + c, o);
+	}
+#endif
+	for (; c < channels; c++)
+		dst[c] = old[c] + (new[c] - old[c]) * weight;
+}
+
+static SIMD_ATTR
+void SIMD_NAME(expand_s16)(struct rate_linear *rate,
+			   void *dst_frames_addr, unsigned int dst_frames,
+			   const void *src_frames_addr, unsigned int src_frames)
+{
+	unsigned int channels = rate->channels;
+	unsigned int get_threshold = rate->pitch;
+	unsigned int pos = get_threshold;
+	unsigned int src_frames1 = 0;
+	unsigned int dst_frames1;
+	const int16_t *src = src_frames_addr;
+	int16_t *dst = dst_frames_addr;
+	const int16_t *old_frame = rate->old_sample;
+	const int16_t *new_frame = rate->old_sample;
+	int new_weight;
+
+	for (dst_frames1 = 0; dst_frames1 < dst_frames; dst_frames1++) {
+		if (pos >= get_threshold) {
+			pos -= get_threshold;
+			old_frame = new_frame;
+			if (src_frames1 < src_frames)
+				new_frame = src;
+		}
+		new_weight = (pos << (16 - rate->pitch_shift)) / (get_threshold >> rate->pitch_shift);
+		SIMD_NAME(blend_s16)(dst, old_frame, new_frame,
+				     0x10000 - new_weight, new_weight, channels);
+		dst += channels;
+		pos += LINEAR_DIV;
+		if (pos >= get_threshold) {
+			src += channels;
+			src_frames1++;
+		}
+	}
+	if (new_frame != rate->old_sample)
+		memcpy(rate->old_sample, new_frame, channels * sizeof(*new_frame));
+}
+
+static SIMD_ATTR
+void SIMD_NAME(shrink_s16)(struct rate_linear *rate,
+			   void *dst_frames_addr, unsigned int dst_frames,
+			   const void *src_frames_addr, unsigned int src_frames)
+{
+	unsigned int channels = rate->channels;
+	unsigned int get_increment = rate->pitch;
+	unsigned int pos = LINEAR_DIV - get_increment; /* Force first sample to be copied */
+	unsigned int src_frames1;
+	unsigned int dst_frames1 = 0;
+	const int16_t *src = src_frames_addr;
+	int16_t *dst = dst_frames_addr;
+	const int16_t *old_frame = rate->old_sample;
+	int old_weight;
+
+	/* the first frame is interpolated from silence */
+	memset(rate->old_sample, 0, channels * sizeof(*rate->old_sample));
+	for (src_frames1 = 0; src_frames1 < src_frames; src_frames1++) {
+		pos += get_increment;
+		if (pos >= LINEAR_DIV) {
+			pos -= LINEAR_DIV;
+			if (CHECK_SANITY(dst_frames1 >= dst_frames)) {
+				SNDERR("dst_frames overflow");
+				break;
+			}
+			old_weight = (pos << (32 - LINEAR_DIV_SHIFT)) / (get_increment >> (LINEAR_DIV_SHIFT - 16));
+			SIMD_NAME(blend_s16)(dst, old_frame, src,
+					     old_weight, 0x10000 - old_weight, channels);
+			dst += channels;
+			dst_frames1++;
+		}
+		old_frame = src;
+		src += channels;
+	}
+}
+
+static SIMD_ATTR
+void SIMD_NAME(expand_float)(struct rate_linear *rate,
+			     void *dst_frames_addr, unsigned int dst_frames,
+			     const void *src_frames_addr, unsigned int src_frames)
+{
+	unsigned int channels = rate->channels;
+	unsigned int get_threshold = rate->pitch;
+	unsigned int pos = get_threshold;
+	unsigned int src_frames1 = 0;
+	unsigned int dst_frames1;
+	const float *src = src_frames_addr;
+	float *dst = dst_frames_addr;
+	const float *old_frame = rate->old_float;
+	const float *new_frame = rate->old_float;
+
+	for (dst_frames1 = 0; dst_frames1 < dst_frames; dst_frames1++) {
+		if (pos >= get_threshold) {
+			pos -= get_threshold;
+			old_frame = new_frame;
+			if (src_frames1 < src_frames)
+				new_frame = src;
+		}
+		SIMD_NAME(blend_float)(dst, old_frame, new_frame,
+				       (float)pos / get_threshold, channels);
+		dst += channels;
+		pos += LINEAR_DIV;
+		if (pos >= get_threshold) {
+			src += channels;
+			src_frames1++;
+		}
+	}
+	if (new_frame != rate->old_float)
+		memcpy(rate->old_float, new_frame, channels * sizeof(*new_frame));
+}
+
+static SIMD_ATTR
+void SIMD_NAME(shrink_float)(struct rate_linear *rate,
+			     void *dst_frames_addr, unsigned int dst_frames,
+			     const void *src_frames_addr, unsigned int src_frames)
+{
+	unsigned int channels = rate->channels;
+	unsigned int get_increment = rate->pitch;
+	unsigned int pos = LINEAR_DIV - get_increment; /* Force first sample to be copied */
+	unsigned int src_frames1;
+	unsigned int dst_frames1 = 0;
+	const float *src = src_frames_addr;
+	float *dst = dst_frames_addr;
+	const float *old_frame = rate->old_float;
+
+	/* the first frame is interpolated from silence */
+	memset(rate->old_float, 0, channels * sizeof(*rate->old_float));
+	for (src_frames1 = 0; src_frames1 < src_frames; src_frames1++) {
+		pos += get_increment;
+		if (pos >= LINEAR_DIV) {
+			pos -= LINEAR_DIV;
+			if (CHECK_SANITY(dst_frames1 >= dst_frames)) {
+				SNDERR("dst_frames overflow");
+				break;
+			}
+			SIMD_NAME(blend_float)(dst, src, old_frame,
+					       (float)pos / get_increment, channels);
+			dst += channels;
+			dst_frames1++;
+		}
+		old_frame = src;
+		src += channels;
+	}
+}
+
+#undef LANES
@@ -0,0 +1,472 @@
+/*
+ *  Polyphase rate converter plugin
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Windowed-sinc (Kaiser) FIR converter.  The conversion ratio is the
+ * ratio of the period sizes reduced to M:L, so a period is always
+ * converted to exactly one slave period.  The filter is split into L
+ * phases which are computed once at hw_params; each output frame takes
+ * the next phase and steps M/L frames forward in the input.  When the
+ * table for all L phases would be too big, a fixed number of phases is
+ * computed and the coefficients are interpolated between them.
+ *
+ * The samples are converted to float, the inner products run on the
+ * SIMD unit when available.  The CPU cost per output frame is constant
+ * (taps * channels multiply-adds).
+ */
+
+#include "pcm_local.h"
+#include "pcm_plugin.h"
+#include "pcm_rate.h"
+#include "pcm_simd.h"
+#include <math.h>
+
+#define POLYPHASE_TAPS_ALIGN	8	/* multiple of the widest vector */
+#define POLYPHASE_TAPS_MAX	1024
+#define POLYPHASE_TABLE_MAX	65536	/* coefficients in the phase table */
+
+struct polyphase_quality {
+	const char *name;
+	unsigned int taps;	/* filter length at 1:1, in input frames */
+	float rolloff;		/* cutoff relative to the lower Nyquist frequency */
+	float beta;		/* Kaiser window parameter */
+};
+
+static const struct polyphase_quality polyphase_fast = { "fast", 16, 0.80f, 5.0f };
+static const struct polyphase_quality polyphase_medium = { "medium", 32, 0.88f, 7.0f };
+static const struct polyphase_quality polyphase_best = { "best", 64, 0.91f, 9.0f };
+
+struct rate_polyphase {
+	const struct polyphase_quality *quality;
+	unsigned int channels;
+	unsigned int in_step;		/* M, input frames per L output frames */
+	unsigned int out_step;		/* L */
+	unsigned int taps;
+	unsigned int phases;		/* rows in the table (+1 when interpolated) */
+	int interpolate;
+	float *table;			/* phases * taps coefficients */
+	float *coef;			/* interpolated coefficients */
+	float *buf;			/* per channel: taps - 1 history + period */
+	unsigned int buf_stride;
+	unsigned int buf_frames;	/* max. input frames per call */
+	unsigned int pos;		/* first tap of the next output frame */
+	unsigned int phase;		/* 0 .. L - 1 */
+	snd_pcm_format_t in_format;
+	snd_pcm_format_t out_format;
+	float (*dot)(const float *coef, const float *x, unsigned int taps);
+};
+
+static float polyphase_dot(const float *coef, const float *x, unsigned int taps)
+{
+	float sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < taps; i++)
+		sum += coef[i] * x[i];
+	return sum;
+}
+
+#ifdef PCM_SIMD
+#define SIMD_BYTES	16
+#define SIMD_ATTR
+#define SIMD_NAME(x)	simd_##x##_v128
+#include "pcm_rate_polyphase.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+
+#ifdef PCM_SIMD_AVX2
+#define SIMD_BYTES	32
+#define SIMD_ATTR	PCM_SIMD_AVX2_ATTR
+#define SIMD_NAME(x)	simd_##x##_avx2
+#include "pcm_rate_polyphase.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif
+#endif /* PCM_SIMD */
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+	while (b) {
+		unsigned int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* zeroth order modified Bessel function of the first kind */
+static double bessel_i0(double x)
+{
+	double sum = 1, term = 1;
+	unsigned int k;
+
+	for (k = 1; k < 64 && term > sum * 1e-12; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+/*
+ * row r is the filter for the output frame lying r / (phases - 1) or
+ * r / phases frames (interpolated or not) after the center tap
+ */
+static void polyphase_make_table(struct rate_polyphase *rate)
+{
+	const struct polyphase_quality *q = rate->quality;
+	unsigned int taps = rate->taps;
+	unsigned int div = rate->interpolate ? rate->phases - 1 : rate->phases;
+	double half = taps / 2;
+	double fc = q->rolloff;
+	double ibeta = 1 / bessel_i0(q->beta);
+	unsigned int r, k;
+
+	/* fc is twice the cutoff in cycles per input frame */
+	if (rate->out_step < rate->in_step)
+		fc = fc * rate->out_step / rate->in_step;
+	for (r = 0; r < rate->phases; r++) {
+		float *row = rate->table + r * taps;
+		double sum = 0;
+
+		for (k = 0; k < taps; k++) {
+			double x = (double)k - (half - 1) - (double)r / div;
+			double t = x / half;
+			double h = fc;
+
+			if (x != 0)
+				h = sin(M_PI * fc * x) / (M_PI * x);
+			if (t > -1 && t < 1)
+				h *= bessel_i0(q->beta * sqrt(1 - t * t)) * ibeta;
+			else
+				h = 0;
+			row[k] = h;
+			sum += h;
+		}
+		/* unity gain at DC for all phases */
+		for (k = 0; k < taps; k++)
+			row[k] /= sum;
+	}
+}
+
+static const float *polyphase_coef(struct rate_polyphase *rate)
+{
+	unsigned int taps = rate->taps;
+	uint64_t idx;
+	const float *c0, *c1;
+	float frac;
+	unsigned int k;
+
+	if (!rate->interpolate)
+		return rate->table + rate->phase * taps;
+	idx = (uint64_t)rate->phase * (rate->phases - 1);
+	c0 = rate->table + (idx / rate->out_step) * taps;
+	c1 = c0 + taps;
+	frac = (float)(idx % rate->out_step) / rate->out_step;
+	for (k = 0; k < taps; k++)
+		rate->coef[k] = c0[k] + frac * (c1[k] - c0[k]);
+	return rate->coef;
+}
+
+static void polyphase_get(struct rate_polyphase *rate,
+			  const snd_pcm_channel_area_t *src_areas,
+			  snd_pcm_uframes_t src_offset, unsigned int src_frames)
+{
+	unsigned int channel, n;
+
+	for (channel = 0; channel < rate->channels; ++channel) {
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const char *src = snd_pcm_channel_area_addr(src_area, src_offset);
+		int src_step = snd_pcm_channel_area_step(src_area);
+		float *x = rate->buf + channel * rate->buf_stride + rate->taps - 1;
+
+		if (rate->in_format == SND_PCM_FORMAT_S16) {
+			for (n = 0; n < src_frames; n++, src += src_step)
+				x[n] = *(const int16_t *)src * (1.0f / 32768.0f);
+		} else {
+			for (n = 0; n < src_frames; n++, src += src_step)
+				x[n] = *(const int32_t *)src * (1.0f / 2147483648.0f);
+		}
+	}
+}
+
+static inline void polyphase_put(struct rate_polyphase *rate, char *dst,
+				 float sample)
+{
+	if (rate->out_format == SND_PCM_FORMAT_S16) {
+		sample *= 32768.0f;
+		if (sample >= 32767.0f)
+			*(int16_t *)dst = 32767;
+		else if (sample <= -32768.0f)
+			*(int16_t *)dst = -32768;
+		else
+			*(int16_t *)dst = lrintf(sample);
+	} else {
+		/* 2147483520 is the largest float below 2^31 */
+		sample *= 2147483648.0f;
+		if (sample >= 2147483520.0f)
+			*(int32_t *)dst = 0x7fffffff;
+		else if (sample <= -2147483648.0f)
+			*(int32_t *)dst = -0x7fffffff - 1;
+		else
+			*(int32_t *)dst = lrintf(sample);
+	}
+}
+
+static void polyphase_convert(void *obj,
+			      const snd_pcm_channel_area_t *dst_areas,
+			      snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
+			      const snd_pcm_channel_area_t *src_areas,
+			      snd_pcm_uframes_t src_offset, unsigned int src_frames)
+{
+	struct rate_polyphase *rate = obj;
+	unsigned int taps = rate->taps;
+	unsigned int avail, pos, channel, n;
+
+	if (CHECK_SANITY(src_frames > rate->buf_frames)) {
+		SNDERR("src_frames overflow");
+		src_frames = rate->buf_frames;
+	}
+	polyphase_get(rate, src_areas, src_offset, src_frames);
+
+	/* the last tap may not pass the received input */
+	avail = taps - 1 + src_frames;
+	for (n = 0; n < dst_frames; n++) {
+		const float *coef = polyphase_coef(rate);
+
+		pos = rate->pos;
+		if (pos + taps > avail)
+			pos = avail - taps;
+		for (channel = 0; channel < rate->channels; ++channel) {
+			const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+			const float *x = rate->buf + channel * rate->buf_stride + pos;
+
+			polyphase_put(rate,
+				      snd_pcm_channel_area_addr(dst_area, dst_offset + n),
+				      rate->dot(coef, x, taps));
+		}
+		rate->phase += rate->in_step;
+		rate->pos += rate->phase / rate->out_step;
+		rate->phase %= rate->out_step;
+	}
+
+	/* keep the last taps - 1 frames as the history for the next call */
+	for (channel = 0; channel < rate->channels; ++channel) {
+		float *x = rate->buf + channel * rate->buf_stride;
+
+		memmove(x, x + src_frames, (taps - 1) * sizeof(*x));
+	}
+	rate->pos = rate->pos >= src_frames ? rate->pos - src_frames : 0;
+}
+
+static snd_pcm_uframes_t input_frames(void *obj, snd_pcm_uframes_t frames)
+{
+	struct rate_polyphase *rate = obj;
+	if (frames == 0)
+		return 0;
+	return muldiv_near(frames, rate->in_step, rate->out_step);
+}
+
+static snd_pcm_uframes_t output_frames(void *obj, snd_pcm_uframes_t frames)
+{
+	struct rate_polyphase *rate = obj;
+	if (frames == 0)
+		return 0;
+	return muldiv_near(frames, rate->out_step, rate->in_step);
+}
+
+static void polyphase_free(void *obj)
+{
+	struct rate_polyphase *rate = obj;
+
+	free(rate->table);
+	rate->table = NULL;
+	free(rate->coef);
+	rate->coef = NULL;
+	free(rate->buf);
+	rate->buf = NULL;
+}
+
+static void polyphase_reset(void *obj)
+{
+	struct rate_polyphase *rate = obj;
+
+	rate->pos = 0;
+	rate->phase = 0;
+	if (rate->buf)
+		memset(rate->buf, 0,
+		       rate->buf_stride * rate->channels * sizeof(*rate->buf));
+}
+
+static int polyphase_init(void *obj, snd_pcm_rate_info_t *info)
+{
+	struct rate_polyphase *rate = obj;
+	unsigned int in, out, div;
+
+	polyphase_free(rate);
+
+	/* convert whole periods exactly, see linear_adjust_pitch() */
+	in = info->in.period_size;
+	out = info->out.period_size;
+	if (!in || !out) {
+		in = info->in.rate;
+		out = info->out.rate;
+	}
+	div = gcd(in, out);
+	rate->in_step = in / div;
+	rate->out_step = out / div;
+	rate->channels = info->channels;
+	rate->in_format = info->in.format;
+	rate->out_format = info->out.format;
+
+	/* widen the filter for the lower cutoff when downsampling */
+	rate->taps = rate->quality->taps;
+	if (rate->in_step > rate->out_step)
+		rate->taps = ((uint64_t)rate->taps * rate->in_step +
+			      rate->out_step - 1) / rate->out_step;
+	if (rate->taps > POLYPHASE_TAPS_MAX)
+		rate->taps = POLYPHASE_TAPS_MAX;
+	rate->taps = (rate->taps + POLYPHASE_TAPS_ALIGN - 1) &
+		~(POLYPHASE_TAPS_ALIGN - 1);
+
+	rate->interpolate = (uint64_t)rate->out_step * rate->taps > POLYPHASE_TABLE_MAX;
+	if (rate->interpolate) {
+		rate->phases = POLYPHASE_TABLE_MAX / rate->taps;
+		rate->coef = malloc(rate->taps * sizeof(*rate->coef));
+		if (!rate->coef)
+			goto error;
+	} else {
+		rate->phases = rate->out_step;
+	}
+	rate->table = malloc(rate->phases * rate->taps * sizeof(*rate->table));
+	if (!rate->table)
+		goto error;
+	polyphase_make_table(rate);
+
+	rate->buf_frames = info->in.period_size;
+	rate->buf_stride = rate->taps - 1 + rate->buf_frames;
+	rate->buf = malloc(rate->buf_stride * rate->channels * sizeof(*rate->buf));
+	if (!rate->buf)
+		goto error;
+	polyphase_reset(rate);
+
+	rate->dot = polyphase_dot;
+#ifdef PCM_SIMD
+	rate->dot = simd_dot_v128;
+#ifdef PCM_SIMD_AVX2
+	if (snd_pcm_simd_features() & SND_PCM_SIMD_AVX2)
+		rate->dot = simd_dot_avx2;
+#endif
+#endif
+	return 0;
+
+ error:
+	polyphase_free(rate);
+	return -ENOMEM;
+}
+
+static void polyphase_close(void *obj)
+{
+	free(obj);
+}
+
+static int get_supported_rates(ATTRIBUTE_UNUSED void *rate,
+			       unsigned int *rate_min, unsigned int *rate_max)
+{
+	*rate_min = SND_PCM_PLUGIN_RATE_MIN;
+	*rate_max = SND_PCM_PLUGIN_RATE_MAX;
+	return 0;
+}
+
+static int get_supported_formats(ATTRIBUTE_UNUSED void *obj,
+				 uint64_t *in_formats, uint64_t *out_formats,
+				 unsigned int *flags)
+{
+	*in_formats = *out_formats =
+		(1ULL << SND_PCM_FORMAT_S16) | (1ULL << SND_PCM_FORMAT_S32);
+	*flags = 0;
+	return 0;
+}
+
+static void polyphase_dump(void *obj, snd_output_t *out)
+{
+	struct rate_polyphase *rate = obj;
+
+	snd_output_printf(out, "Converter: polyphase-sinc (%s)\n",
+			  rate->quality->name);
+	if (rate->table)
+		snd_output_printf(out, "Ratio: %u/%u, taps: %u, phases: %u%s\n",
+				  rate->out_step, rate->in_step, rate->taps,
+				  rate->phases,
+				  rate->interpolate ? " (interpolated)" : "");
+}
+
+static const snd_pcm_rate_ops_t polyphase_ops = {
+	.close = polyphase_close,
+	.init = polyphase_init,
+	.free = polyphase_free,
+	.reset = polyphase_reset,
+	.convert = polyphase_convert,
+	.input_frames = input_frames,
+	.output_frames = output_frames,
+	.version = SND_PCM_RATE_PLUGIN_VERSION,
+	.get_supported_rates = get_supported_rates,
+	.dump = polyphase_dump,
+	.get_supported_formats = get_supported_formats,
+};
+
+static int polyphase_open(void **objp, snd_pcm_rate_ops_t *ops,
+			  const struct polyphase_quality *quality)
+{
+	struct rate_polyphase *rate;
+
+	rate = calloc(1, sizeof(*rate));
+	if (! rate)
+		return -ENOMEM;
+
+	rate->quality = quality;
+	rate->in_step = rate->out_step = 1;
+	*objp = rate;
+	*ops = polyphase_ops;
+	return 0;
+}
+
+int SND_PCM_RATE_PLUGIN_ENTRY(polyphase) (ATTRIBUTE_UNUSED unsigned int version,
+					  void **objp, snd_pcm_rate_ops_t *ops)
+{
+	return polyphase_open(objp, ops, &polyphase_medium);
+}
+
+int SND_PCM_RATE_PLUGIN_ENTRY(polyphase_fast) (ATTRIBUTE_UNUSED unsigned int version,
+					       void **objp, snd_pcm_rate_ops_t *ops)
+{
+	return polyphase_open(objp, ops, &polyphase_fast);
+}
+
+int SND_PCM_RATE_PLUGIN_ENTRY(polyphase_medium) (ATTRIBUTE_UNUSED unsigned int version,
+						 void **objp, snd_pcm_rate_ops_t *ops)
+{
+	return polyphase_open(objp, ops, &polyphase_medium);
+}
+
+int SND_PCM_RATE_PLUGIN_ENTRY(polyphase_best) (ATTRIBUTE_UNUSED unsigned int version,
+					       void **objp, snd_pcm_rate_ops_t *ops)
+{
+	return polyphase_open(objp, ops, &polyphase_best);
+}
@@ -0,0 +1,52 @@
+/**
+ * \file pcm/pcm_rate_polyphase.h
+ * \ingroup PCM_Plugins
+ * \brief PCM Rate Plugin Interface - polyphase converter vector code
+ */
+/*
+ *  Polyphase rate converter plugin
+ *
+ *  This file is included from pcm_rate_polyphase.c several times, with
+ *  SIMD_BYTES (vector size), SIMD_ATTR (function attributes) and
+ *  SIMD_NAME() (symbol suffix) defined.
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+typedef float SIMD_NAME(vf32) __attribute__((vector_size(SIMD_BYTES)));
+
+/* the number of taps is always a multiple of POLYPHASE_TAPS_ALIGN */
+#if SIMD_BYTES / 4 > POLYPHASE_TAPS_ALIGN
+#error "POLYPHASE_TAPS_ALIGN is too small"
+#endif
+
+static SIMD_ATTR float SIMD_NAME(dot)(const float *coef, const float *x,
+				      unsigned int taps)
+{
+	SIMD_NAME(vf32) acc = { 0 }, c, v;
+	float sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < taps; i += SIMD_BYTES / 4) {
+		simd_load(c, coef + i);
+		simd_load(v, x + i);
+		acc += c * v;
+	}
+	for (i = 0; i < SIMD_BYTES / 4; i++)
+		sum += acc[i];
+	return sum;
+}
@@ -30,8 +30,16 @@
 #include "pcm_plugin.h"
 #include "plugin_ops.h"
 #include "bswap.h"
+#include "pcm_simd.h"
 #include <math.h>
 
+/*
+ * The matrix mixer gives the same samples as the generic code only when
+ * every product is rounded before it is added, the file is built with
+ * -ffp-contract=off not to let the compiler fuse them (fma on ARM64,
+ * POWER or with -mfma), see Makefile.am.
+ */
+
 #ifndef PIC
 /* entry for static linking */
 const char *_snd_module_pcm_route = "";
@@ -58,6 +66,46 @@ typedef struct {
 
 typedef struct snd_pcm_route_ttable_dst snd_pcm_route_ttable_dst_t;
 
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+/* frames mixed in one pass of the matrix mixer */
+#define ROUTE_MATRIX_BLOCK	256
+
+/* snd_pcm_route_matrix_t.perm values besides source channels */
+#define ROUTE_MATRIX_SILENCE	(-1)
+#define ROUTE_MATRIX_MIXED	(-2)
+
+/*
+ * The ttable compiled for the formats and channel counts of the setup.
+ * Each destination channel is either silent, a plain copy of one
+ * source channel or a sparse row of coefficients (CSR layout) which is
+ * summed over blocks of frames converted to float once per source.
+ */
+typedef struct {
+	enum {
+		ROUTE_MATRIX_OFF,
+		ROUTE_MATRIX_IDENTITY,
+		ROUTE_MATRIX_PERMUTE,
+		ROUTE_MATRIX_MIX,
+	} mode;
+	unsigned int src_channels;
+	unsigned int dst_channels;
+	int copy;		/* same format without padding, copy the samples */
+	int *perm;		/* source channel or ROUTE_MATRIX_* per destination */
+	unsigned int *row;	/* dst_channels + 1 offsets to idx and coef */
+	unsigned int *idx;	/* block row of the source channel */
+	float *coef;
+	unsigned int nused;	/* source channels read by the mixed rows */
+	unsigned int *used;	/* source channel of each block row */
+	float *block;		/* nused * ROUTE_MATRIX_BLOCK samples */
+	int32_t *tmp;		/* ROUTE_MATRIX_BLOCK samples */
+	unsigned int s32_get_idx, s32_put_idx;
+	void (*s32_to_float)(float *dst, const int32_t *src, unsigned int frames);
+	void (*mix)(int32_t *dst, const float *rows,
+		    const unsigned int *idx, const float *coef,
+		    unsigned int ncoefs, unsigned int frames);
+} snd_pcm_route_matrix_t;
+#endif
+
 typedef struct {
 	enum {UINT64, FLOAT} sum_idx;
 	unsigned int get_idx;
@@ -69,6 +117,10 @@ typedef struct {
 	unsigned int nsrcs;
 	unsigned int ndsts;
 	snd_pcm_route_ttable_dst_t *dsts;
+	snd_pcm_format_t src_sfmt;
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+	snd_pcm_route_matrix_t matrix;
+#endif
 } snd_pcm_route_params_t;
 
 
@@ -395,6 +447,419 @@ static void snd_pcm_route_convert1_many(const snd_pcm_channel_area_t *dst_area,
 	}
 }
 
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+
+/* rint() and saturation of a sum, the vector code does the same */
+static inline int32_t route_float_to_s32(float sum)
+{
+	sum = rintf(sum);
+	if (sum >= 2147483648.0f)
+		return 0x7fffffff;	/* maximum positive value */
+	if (sum < -2147483648.0f)
+		return (int32_t)0x80000000;	/* maximum negative value */
+	return sum;
+}
+
+#ifdef PCM_SIMD
+#define SIMD_BYTES	16
+#define SIMD_ATTR
+#define SIMD_NAME(x)	simd_##x##_v128
+#include "pcm_route_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+
+#ifdef PCM_SIMD_AVX2
+#define SIMD_BYTES	32
+#define SIMD_ATTR	PCM_SIMD_AVX2_ATTR
+#define SIMD_NAME(x)	simd_##x##_avx2
+#include "pcm_route_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif
+#else
+#define SIMD_BYTES	0
+#define SIMD_ATTR
+#define SIMD_NAME(x)	generic_##x
+#include "pcm_route_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif /* PCM_SIMD */
+
+static void route_matrix_free(snd_pcm_route_matrix_t *m)
+{
+	free(m->perm);
+	free(m->row);
+	free(m->idx);
+	free(m->coef);
+	free(m->used);
+	free(m->block);
+	free(m->tmp);
+	memset(m, 0, sizeof(*m));
+}
+
+static void route_matrix_select_funcs(snd_pcm_route_matrix_t *m)
+{
+#ifdef PCM_SIMD
+#ifdef PCM_SIMD_AVX2
+	if (snd_pcm_simd_features() & SND_PCM_SIMD_AVX2) {
+		m->s32_to_float = simd_route_s32_to_float_avx2;
+		m->mix = simd_route_mix_avx2;
+		return;
+	}
+#endif
+	m->s32_to_float = simd_route_s32_to_float_v128;
+	m->mix = simd_route_mix_v128;
+#else
+	m->s32_to_float = generic_route_s32_to_float;
+	m->mix = generic_route_mix;
+#endif
+}
+
+/* compile the ttable for the given channel counts */
+static int route_matrix_setup(snd_pcm_route_params_t *params,
+			      unsigned int src_channels,
+			      unsigned int dst_channels)
+{
+	snd_pcm_route_matrix_t *m = &params->matrix;
+	unsigned int dst, k, pos = 0, ncoefs = 0;
+	int identity = src_channels == dst_channels;
+	int *slot = NULL;
+
+	route_matrix_free(m);
+	m->perm = calloc(dst_channels, sizeof(*m->perm));
+	m->row = calloc(dst_channels + 1, sizeof(*m->row));
+	if (!m->perm || !m->row)
+		goto _nomem;
+	for (dst = 0; dst < dst_channels; dst++) {
+		const snd_pcm_route_ttable_dst_t *d = &params->dsts[dst];
+		unsigned int n = 0, last = 0;
+
+		if (dst < params->ndsts) {
+			for (k = 0; k < d->nsrcs; k++) {
+				if ((unsigned int)d->srcs[k].channel < src_channels) {
+					n++;
+					last = k;
+				}
+			}
+		}
+		/* the same cases as in snd_pcm_route_convert1_many() */
+		if (n == 0)
+			m->perm[dst] = ROUTE_MATRIX_SILENCE;
+		else if (n == 1 && d->srcs[last].as_int == SND_PCM_PLUGIN_ROUTE_RESOLUTION)
+			m->perm[dst] = d->srcs[last].channel;
+		else {
+			m->perm[dst] = ROUTE_MATRIX_MIXED;
+			ncoefs += n;
+		}
+		if (m->perm[dst] != (int)dst)
+			identity = 0;
+	}
+	m->src_channels = src_channels;
+	m->dst_channels = dst_channels;
+	m->copy = params->src_sfmt == params->dst_sfmt &&
+		  snd_pcm_format_width(params->dst_sfmt) ==
+		  snd_pcm_format_physical_width(params->dst_sfmt);
+	if (ncoefs == 0) {
+		m->mode = identity ? ROUTE_MATRIX_IDENTITY : ROUTE_MATRIX_PERMUTE;
+		return 0;
+	}
+
+	m->idx = calloc(ncoefs, sizeof(*m->idx));
+	m->coef = calloc(ncoefs, sizeof(*m->coef));
+	m->used = calloc(src_channels, sizeof(*m->used));
+	slot = malloc(src_channels * sizeof(*slot));
+	if (!m->idx || !m->coef || !m->used || !slot)
+		goto _nomem;
+	for (k = 0; k < src_channels; k++)
+		slot[k] = -1;
+	for (dst = 0; dst < dst_channels; dst++) {
+		const snd_pcm_route_ttable_dst_t *d = &params->dsts[dst];
+
+		m->row[dst] = pos;
+		if (m->perm[dst] != ROUTE_MATRIX_MIXED)
+			continue;
+		for (k = 0; k < d->nsrcs; k++) {
+			unsigned int channel = d->srcs[k].channel;
+
+			if (channel >= src_channels)
+				continue;
+			if (slot[channel] < 0) {
+				slot[channel] = m->nused;
+				m->used[m->nused++] = channel;
+			}
+			m->idx[pos] = slot[channel];
+			m->coef[pos] = d->srcs[k].as_float;
+			pos++;
+		}
+	}
+	m->row[dst_channels] = pos;
+	free(slot);
+	m->block = malloc(m->nused * ROUTE_MATRIX_BLOCK * sizeof(*m->block));
+	m->tmp = malloc(ROUTE_MATRIX_BLOCK * sizeof(*m->tmp));
+	if (!m->block || !m->tmp)
+		goto _nomem;
+	m->s32_get_idx = snd_pcm_linear_get_index(SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S32);
+	m->s32_put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S32);
+	route_matrix_select_funcs(m);
+	m->mode = ROUTE_MATRIX_MIX;
+	return 0;
+
+ _nomem:
+	free(slot);
+	route_matrix_free(m);
+	return -ENOMEM;
+}
+
+/* convert one channel without mixing, like snd_pcm_route_convert1_one() */
+static void route_matrix_copy1(const snd_pcm_channel_area_t *dst_area,
+			       snd_pcm_uframes_t dst_offset,
+			       const snd_pcm_channel_area_t *src_area,
+			       snd_pcm_uframes_t src_offset,
+			       snd_pcm_uframes_t frames,
+			       const snd_pcm_route_params_t *params)
+{
+	if (params->matrix.copy)
+		snd_pcm_area_copy(dst_area, dst_offset, src_area, src_offset,
+				  frames, params->dst_sfmt);
+	else if (params->use_getput)
+		snd_pcm_linear_getput(dst_area, dst_offset, src_area, src_offset,
+				      1, frames, params->get_idx, params->put_idx);
+	else
+		snd_pcm_linear_convert(dst_area, dst_offset, src_area, src_offset,
+				       1, frames, params->conv_idx);
+}
+
+/* the silent and copied destination channels */
+static void route_matrix_copy(const snd_pcm_channel_area_t *dst_areas,
+			      snd_pcm_uframes_t dst_offset,
+			      const snd_pcm_channel_area_t *src_areas,
+			      snd_pcm_uframes_t src_offset,
+			      snd_pcm_uframes_t frames,
+			      const snd_pcm_route_params_t *params)
+{
+	const snd_pcm_route_matrix_t *m = &params->matrix;
+	unsigned int dst;
+
+	for (dst = 0; dst < m->dst_channels; dst++) {
+		int src = m->perm[dst];
+
+		if (src == ROUTE_MATRIX_SILENCE)
+			snd_pcm_area_silence(&dst_areas[dst], dst_offset,
+					     frames, params->dst_sfmt);
+		else if (src >= 0)
+			route_matrix_copy1(&dst_areas[dst], dst_offset,
+					   &src_areas[src], src_offset,
+					   frames, params);
+	}
+}
+
+#define ROUTE_PERMUTE(type) do { \
+	const type *s = src; \
+	type *d = dst; \
+	while (frames-- > 0) { \
+		for (c = 0; c < m->dst_channels; c++) { \
+			if (m->perm[c] >= 0) \
+				d[c] = s[m->perm[c]]; \
+		} \
+		s += m->src_channels; \
+		d += m->dst_channels; \
+	} \
+} while (0)
+
+static void route_matrix_permute(const snd_pcm_channel_area_t *dst_areas,
+				 snd_pcm_uframes_t dst_offset,
+				 const snd_pcm_channel_area_t *src_areas,
+				 snd_pcm_uframes_t src_offset,
+				 snd_pcm_uframes_t frames,
+				 const snd_pcm_route_params_t *params)
+{
+	const snd_pcm_route_matrix_t *m = &params->matrix;
+	unsigned int width = snd_pcm_format_physical_width(params->dst_sfmt);
+	unsigned int c;
+	void *dst;
+	const void *src;
+
+	if (!m->copy || (width != 16 && width != 32))
+		goto _copy;
+	dst = snd_pcm_areas_interleaved_addr(dst_areas, dst_offset, m->dst_channels, width);
+	src = snd_pcm_areas_interleaved_addr(src_areas, src_offset, m->src_channels, width);
+	if (!dst || !src)
+		goto _copy;
+	for (c = 0; c < m->dst_channels; c++) {
+		if (m->perm[c] == ROUTE_MATRIX_SILENCE)
+			snd_pcm_area_silence(&dst_areas[c], dst_offset,
+					     frames, params->dst_sfmt);
+	}
+	if (width == 16)
+		ROUTE_PERMUTE(uint16_t);
+	else
+		ROUTE_PERMUTE(uint32_t);
+	return;
+
+ _copy:
+	route_matrix_copy(dst_areas, dst_offset, src_areas, src_offset,
+			  frames, params);
+}
+
+/* one source channel to float, the values are the 32-bit samples */
+static void route_matrix_load(const snd_pcm_route_params_t *params,
+			      float *dst,
+			      const snd_pcm_channel_area_t *src_area,
+			      snd_pcm_uframes_t src_offset,
+			      unsigned int frames)
+{
+	const snd_pcm_route_matrix_t *m = &params->matrix;
+	const char *src = snd_pcm_channel_area_addr(src_area, src_offset);
+	int src_step = snd_pcm_channel_area_step(src_area);
+	snd_pcm_channel_area_t tmp_area;
+	unsigned int i;
+
+	switch (params->src_sfmt) {
+	case SND_PCM_FORMAT_S16:
+		for (i = 0; i < frames; i++, src += src_step)
+			dst[i] = (int32_t)((uint32_t)*(const uint16_t *)src << 16);
+		return;
+	case SND_PCM_FORMAT_S32:
+		for (i = 0; i < frames; i++, src += src_step)
+			dst[i] = *(const int32_t *)src;
+		return;
+	default:
+		break;
+	}
+	tmp_area.addr = m->tmp;
+	tmp_area.first = 0;
+	tmp_area.step = 32;
+	snd_pcm_linear_getput(&tmp_area, 0, src_area, src_offset, 1, frames,
+			      params->get_idx, m->s32_put_idx);
+	m->s32_to_float(dst, m->tmp, frames);
+}
+
+/* 32-bit samples to one destination channel */
+static void route_matrix_store(const snd_pcm_route_params_t *params,
+			       const snd_pcm_channel_area_t *dst_area,
+			       snd_pcm_uframes_t dst_offset,
+			       const int32_t *src,
+			       unsigned int frames)
+{
+	const snd_pcm_route_matrix_t *m = &params->matrix;
+	char *dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+	int dst_step = snd_pcm_channel_area_step(dst_area);
+	snd_pcm_channel_area_t tmp_area;
+	unsigned int i;
+
+	switch (params->dst_sfmt) {
+	case SND_PCM_FORMAT_S16:
+		for (i = 0; i < frames; i++, dst += dst_step)
+			*(uint16_t *)dst = (uint32_t)src[i] >> 16;
+		return;
+	case SND_PCM_FORMAT_S32:
+		for (i = 0; i < frames; i++, dst += dst_step)
+			*(int32_t *)dst = src[i];
+		return;
+	default:
+		break;
+	}
+	tmp_area.addr = (void *)src;
+	tmp_area.first = 0;
+	tmp_area.step = 32;
+	snd_pcm_linear_getput(dst_area, dst_offset, &tmp_area, 0, 1, frames,
+			      m->s32_get_idx, params->put_idx);
+}
+
+static void route_matrix_mix(const snd_pcm_channel_area_t *dst_areas,
+			     snd_pcm_uframes_t dst_offset,
+			     const snd_pcm_channel_area_t *src_areas,
+			     snd_pcm_uframes_t src_offset,
+			     snd_pcm_uframes_t frames,
+			     const snd_pcm_route_params_t *params)
+{
+	const snd_pcm_route_matrix_t *m = &params->matrix;
+	snd_pcm_uframes_t pos;
+	unsigned int n, u, dst;
+
+	for (pos = 0; pos < frames; pos += n) {
+		n = frames - pos;
+		if (n > ROUTE_MATRIX_BLOCK)
+			n = ROUTE_MATRIX_BLOCK;
+		/* each source is converted once for all the rows using it */
+		for (u = 0; u < m->nused; u++)
+			route_matrix_load(params, m->block + u * ROUTE_MATRIX_BLOCK,
+					  &src_areas[m->used[u]],
+					  src_offset + pos, n);
+		for (dst = 0; dst < m->dst_channels; dst++) {
+			unsigned int row = m->row[dst];
+
+			if (m->perm[dst] != ROUTE_MATRIX_MIXED)
+				continue;
+			m->mix(m->tmp, m->block, m->idx + row, m->coef + row,
+			       m->row[dst + 1] - row, n);
+			route_matrix_store(params, &dst_areas[dst],
+					   dst_offset + pos, m->tmp, n);
+		}
+	}
+	route_matrix_copy(dst_areas, dst_offset, src_areas, src_offset,
+			  frames, params);
+}
+
+/* return 0 if the matrix does not apply, the generic code is used then */
+static int route_matrix_convert(const snd_pcm_channel_area_t *dst_areas,
+				snd_pcm_uframes_t dst_offset,
+				const snd_pcm_channel_area_t *src_areas,
+				snd_pcm_uframes_t src_offset,
+				unsigned int src_channels,
+				unsigned int dst_channels,
+				snd_pcm_uframes_t frames,
+				const snd_pcm_route_params_t *params)
+{
+	const snd_pcm_route_matrix_t *m = &params->matrix;
+	unsigned int c;
+
+	if (m->mode == ROUTE_MATRIX_OFF ||
+	    src_channels != m->src_channels || dst_channels != m->dst_channels)
+		return 0;
+	for (c = 0; c < dst_channels; c++) {
+		if (m->perm[c] >= 0 && !src_areas[m->perm[c]].addr)
+			return 0;
+	}
+	for (c = 0; c < m->nused; c++) {
+		if (!src_areas[m->used[c]].addr)
+			return 0;
+	}
+
+	switch (m->mode) {
+	case ROUTE_MATRIX_IDENTITY:
+		if (m->copy)
+			snd_pcm_areas_copy(dst_areas, dst_offset,
+					   src_areas, src_offset,
+					   dst_channels, frames, params->dst_sfmt);
+		else if (params->use_getput)
+			snd_pcm_linear_getput(dst_areas, dst_offset,
+					      src_areas, src_offset,
+					      dst_channels, frames,
+					      params->get_idx, params->put_idx);
+		else
+			snd_pcm_linear_convert(dst_areas, dst_offset,
+					       src_areas, src_offset,
+					       dst_channels, frames,
+					       params->conv_idx);
+		break;
+	case ROUTE_MATRIX_PERMUTE:
+		route_matrix_permute(dst_areas, dst_offset, src_areas, src_offset,
+				     frames, params);
+		break;
+	default:
+		route_matrix_mix(dst_areas, dst_offset, src_areas, src_offset,
+				 frames, params);
+		break;
+	}
+	return 1;
+}
+
+#endif /* SND_PCM_PLUGIN_ROUTE_FLOAT */
+
 #endif /* DOC_HIDDEN */
 
 static void snd_pcm_route_convert(const snd_pcm_channel_area_t *dst_areas,
@@ -410,6 +875,11 @@ static void snd_pcm_route_convert(const snd_pcm_channel_area_t *dst_areas,
 	snd_pcm_route_ttable_dst_t *dstp;
 	const snd_pcm_channel_area_t *dst_area;
 
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+	if (route_matrix_convert(dst_areas, dst_offset, src_areas, src_offset,
+				 src_channels, dst_channels, frames, params))
+		return;
+#endif
 	dstp = params->dsts;
 	dst_area = dst_areas;
 	for (dst_channel = 0; dst_channel < dst_channels; ++dst_channel) {
@@ -440,6 +910,9 @@ static int snd_pcm_route_close(snd_pcm_t *pcm)
 		}
 		free(params->dsts);
 	}
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+	route_matrix_free(&params->matrix);
+#endif
 	free(route->chmap);
 	snd_pcm_free_chmaps(route->chmap_override);
 	return snd_pcm_generic_close(pcm);
@@ -549,6 +1022,7 @@ static int snd_pcm_route_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 	snd_pcm_route_t *route = pcm->private_data;
 	snd_pcm_t *slave = route->plug.gen.slave;
 	snd_pcm_format_t src_format, dst_format;
+	unsigned int channels;
 	int err = snd_pcm_hw_params_slave(pcm, params,
 					  snd_pcm_route_hw_refine_cchange,
 					  snd_pcm_route_hw_refine_sprepare,
@@ -577,8 +1051,18 @@ static int snd_pcm_route_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 	route->params.conv_idx = snd_pcm_linear_convert_index(src_format, dst_format);
 	route->params.src_size = snd_pcm_format_width(src_format) / 8;
 	route->params.dst_sfmt = dst_format;
+	route->params.src_sfmt = src_format;
 #if SND_PCM_PLUGIN_ROUTE_FLOAT
 	route->params.sum_idx = FLOAT;
+	err = INTERNAL(snd_pcm_hw_params_get_channels)(params, &channels);
+	if (err < 0)
+		return err;
+	if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
+		err = route_matrix_setup(&route->params, channels, slave->channels);
+	else
+		err = route_matrix_setup(&route->params, slave->channels, channels);
+	if (err < 0)
+		return err;
 #else
 	route->params.sum_idx = UINT64;
 #endif
@@ -715,6 +1199,23 @@ static void snd_pcm_route_dump(snd_pcm_t *pcm, snd_output_t *out)
 		}
 		snd_output_putc(out, '\n');
 	}
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+	if (pcm->setup) {
+		static const char *const modes[] = {
+			[ROUTE_MATRIX_OFF] = "off",
+			[ROUTE_MATRIX_IDENTITY] = "identity",
+			[ROUTE_MATRIX_PERMUTE] = "permutation",
+			[ROUTE_MATRIX_MIX] = "mix",
+		};
+		const snd_pcm_route_matrix_t *m = &route->params.matrix;
+
+		snd_output_printf(out, "  Matrix: %s", modes[m->mode]);
+		if (m->mode == ROUTE_MATRIX_MIX)
+			snd_output_printf(out, " (%u coefficients, %u sources)",
+					  m->row[m->dst_channels], m->nused);
+		snd_output_putc(out, '\n');
+	}
+#endif
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -1239,6 +1740,12 @@ The format and rate must match for both of them.
 SCHANNEL can be a channel name instead of a number (e g FL, LFE).
 If so, a matching channel map will be selected for the slave.
 
+The transfer table is compiled for the setup: an identity table copies or
+converts all channels in one pass, a pure permutation shuffles the samples
+frame by frame and the remaining tables (down- and upmixes) are summed as
+a sparse matrix over blocks of frames, each source channel being converted
+only once per block.
+
 \code
 pcm.name {
         type route              # Route & Volume conversion PCM
@@ -0,0 +1,117 @@
+/**
+ * \file pcm/pcm_route_simd.h
+ * \ingroup PCM_Plugins
+ * \brief PCM Route & Volume Plugin Interface - matrix mixer code
+ */
+/*
+ *  Route & Volume Plugin
+ *
+ *  This file is included from pcm_route.c several times, with
+ *  SIMD_BYTES (vector size, 0 for plain C), SIMD_ATTR (function
+ *  attributes) and SIMD_NAME() (symbol suffix) defined.
+ *
+ *  The sums are accumulated in the same order and precision as in
+ *  snd_pcm_route_convert1_many(), so the results are identical except
+ *  that a sum of exactly 2^31 saturates instead of wrapping around.
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#if SIMD_BYTES
+typedef int32_t SIMD_NAME(vs32) __attribute__((vector_size(SIMD_BYTES)));
+typedef float SIMD_NAME(vf32) __attribute__((vector_size(SIMD_BYTES)));
+
+/* 32-bit lanes in one vector */
+#define LANES		(SIMD_BYTES / 4)
+
+/* rint() and the saturation of route_float_to_s32() for all lanes */
+static inline __attribute__((always_inline)) SIMD_ATTR
+SIMD_NAME(vs32) SIMD_NAME(float_to_s32)(SIMD_NAME(vf32) x)
+{
+	SIMD_NAME(vs32) bits = (SIMD_NAME(vs32))x;
+	SIMD_NAME(vs32) sign = bits & (int32_t)0x80000000;
+	SIMD_NAME(vs32) small, hi, lo;
+	SIMD_NAME(vf32) t, r;
+
+	/* x + 2^23 - 2^23 rounds to an integer in the current rounding mode */
+	t = (SIMD_NAME(vf32))(sign | 0x4b000000);
+	r = (x + t) - t;
+	small = (bits & 0x7fffffff) < 0x4b000000;
+	r = (SIMD_NAME(vf32))((small & (SIMD_NAME(vs32))r) | (~small & bits));
+	hi = r >= 2147483648.0f;
+	lo = r < -2147483648.0f;
+	r = (SIMD_NAME(vf32))((SIMD_NAME(vs32))r & ~(hi | lo));
+	bits = simd_convert(r, SIMD_NAME(vs32));
+	return bits | (hi & 0x7fffffff) | (lo & (int32_t)0x80000000);
+}
+#endif
+
+static SIMD_ATTR
+void SIMD_NAME(route_s32_to_float)(float *dst, const int32_t *src,
+				   unsigned int frames)
+{
+	unsigned int i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(vs32) s;
+	SIMD_NAME(vf32) d;
+
+	for (; i + LANES <= frames; i += LANES) {
+		simd_load(s, src + i);
+		d = simd_convert(s, SIMD_NAME(vf32));
+		simd_store(dst + i, d);
+	}
+#endif
+	for (; i < frames; i++)
+		dst[i] = src[i];
+}
+
+/*
+ * Mix one destination channel, rows holds ROUTE_MATRIX_BLOCK samples
+ * of each used source channel
+ */
+static SIMD_ATTR
+void SIMD_NAME(route_mix)(int32_t *dst, const float *rows,
+			  const unsigned int *idx, const float *coef,
+			  unsigned int ncoefs, unsigned int frames)
+{
+	unsigned int i = 0, k;
+#if SIMD_BYTES
+	SIMD_NAME(vf32) sum, s;
+	SIMD_NAME(vs32) d;
+
+	for (; i + LANES <= frames; i += LANES) {
+		sum = (SIMD_NAME(vf32)) { 0 };
+		for (k = 0; k < ncoefs; k++) {
+			simd_load(s, rows + idx[k] * ROUTE_MATRIX_BLOCK + i);
+			sum += s * coef[k];
+		}
+		d = SIMD_NAME(float_to_s32)(sum);
+		simd_store(dst + i, d);
+	}
+#endif
+	for (; i < frames; i++) {
+		float sum = 0.0;
+
+		for (k = 0; k < ncoefs; k++)
+			sum += rows[idx[k] * ROUTE_MATRIX_BLOCK + i] * coef[k];
+		dst[i] = route_float_to_s32(sum);
+	}
+}
+
+#if SIMD_BYTES
+#undef LANES
+#endif
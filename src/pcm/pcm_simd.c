@@ -0,0 +1,467 @@
+/*
+ *  PCM Interface - SIMD helpers
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "pcm_local.h"
+#include "pcm_simd.h"
+#include <string.h>
+
+#ifndef DOC_HIDDEN
+
+/*
+ * Generic (scalar) kernels
+ *
+ * The frame is the outer loop, so the interleaved side is accessed
+ * sequentially and each channel buffer is streamed once.
+ */
+
+#define INTERLEAVE_FUNC(name, type)					\
+static void name(void *dst, unsigned int dst_channels,			\
+		 const void *const *src, unsigned int channels,		\
+		 unsigned int frames)					\
+{									\
+	type *d = dst;							\
+	unsigned int f, c;						\
+	for (f = 0; f < frames; f++) {					\
+		for (c = 0; c < channels; c++)				\
+			d[c] = ((const type *)src[c])[f];		\
+		d += dst_channels;					\
+	}								\
+}
+
+#define DEINTERLEAVE_FUNC(name, type)					\
+static void name(void *const *dst, const void *src,			\
+		 unsigned int src_channels, unsigned int channels,	\
+		 unsigned int frames)					\
+{									\
+	const type *s = src;						\
+	unsigned int f, c;						\
+	for (f = 0; f < frames; f++) {					\
+		for (c = 0; c < channels; c++)				\
+			((type *)dst[c])[f] = s[c];			\
+		s += src_channels;					\
+	}								\
+}
+
+INTERLEAVE_FUNC(interleave_8, uint8_t)
+INTERLEAVE_FUNC(interleave_16, uint16_t)
+INTERLEAVE_FUNC(interleave_32, uint32_t)
+INTERLEAVE_FUNC(interleave_64, uint64_t)
+DEINTERLEAVE_FUNC(deinterleave_8, uint8_t)
+DEINTERLEAVE_FUNC(deinterleave_16, uint16_t)
+DEINTERLEAVE_FUNC(deinterleave_32, uint32_t)
+DEINTERLEAVE_FUNC(deinterleave_64, uint64_t)
+
+static void interleave_24(void *dst, unsigned int dst_channels,
+			  const void *const *src, unsigned int channels,
+			  unsigned int frames)
+{
+	uint8_t *d = dst;
+	unsigned int f, c;
+	for (f = 0; f < frames; f++) {
+		for (c = 0; c < channels; c++)
+			memcpy(d + c * 3, (const uint8_t *)src[c] + f * 3, 3);
+		d += dst_channels * 3;
+	}
+}
+
+static void deinterleave_24(void *const *dst, const void *src,
+			    unsigned int src_channels, unsigned int channels,
+			    unsigned int frames)
+{
+	const uint8_t *s = src;
+	unsigned int f, c;
+	for (f = 0; f < frames; f++) {
+		for (c = 0; c < channels; c++)
+			memcpy((uint8_t *)dst[c] + f * 3, s + c * 3, 3);
+		s += src_channels * 3;
+	}
+}
+
+#ifdef PCM_SIMD
+
+#define SIMD_BYTES	16
+#define SIMD_ATTR
+#define SIMD_NAME(x)	x##_v128
+#include "pcm_simd_area.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+
+#ifdef PCM_SIMD_AVX2
+#define SIMD_BYTES	32
+#define SIMD_ATTR	PCM_SIMD_AVX2_ATTR
+#define SIMD_NAME(x)	x##_avx2
+#include "pcm_simd_area.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif
+
+/* in-register transpose of 8x8 16-bit samples */
+#define TRANSPOSE_8X8_S16(r) do {					\
+	snd_v8s16 t0, t1, t2, t3, t4, t5, t6, t7;			\
+	t0 = simd_shuffle(r[0], r[1], 0, 8, 1, 9, 2, 10, 3, 11);	\
+	t1 = simd_shuffle(r[0], r[1], 4, 12, 5, 13, 6, 14, 7, 15);	\
+	t2 = simd_shuffle(r[2], r[3], 0, 8, 1, 9, 2, 10, 3, 11);	\
+	t3 = simd_shuffle(r[2], r[3], 4, 12, 5, 13, 6, 14, 7, 15);	\
+	t4 = simd_shuffle(r[4], r[5], 0, 8, 1, 9, 2, 10, 3, 11);	\
+	t5 = simd_shuffle(r[4], r[5], 4, 12, 5, 13, 6, 14, 7, 15);	\
+	t6 = simd_shuffle(r[6], r[7], 0, 8, 1, 9, 2, 10, 3, 11);	\
+	t7 = simd_shuffle(r[6], r[7], 4, 12, 5, 13, 6, 14, 7, 15);	\
+	r[0] = simd_shuffle(t0, t2, 0, 1, 8, 9, 2, 3, 10, 11);		\
+	r[1] = simd_shuffle(t0, t2, 4, 5, 12, 13, 6, 7, 14, 15);	\
+	r[2] = simd_shuffle(t1, t3, 0, 1, 8, 9, 2, 3, 10, 11);		\
+	r[3] = simd_shuffle(t1, t3, 4, 5, 12, 13, 6, 7, 14, 15);	\
+	r[4] = simd_shuffle(t4, t6, 0, 1, 8, 9, 2, 3, 10, 11);		\
+	r[5] = simd_shuffle(t4, t6, 4, 5, 12, 13, 6, 7, 14, 15);	\
+	r[6] = simd_shuffle(t5, t7, 0, 1, 8, 9, 2, 3, 10, 11);		\
+	r[7] = simd_shuffle(t5, t7, 4, 5, 12, 13, 6, 7, 14, 15);	\
+	t0 = simd_shuffle(r[0], r[4], 0, 1, 2, 3, 8, 9, 10, 11);	\
+	t1 = simd_shuffle(r[0], r[4], 4, 5, 6, 7, 12, 13, 14, 15);	\
+	t2 = simd_shuffle(r[1], r[5], 0, 1, 2, 3, 8, 9, 10, 11);	\
+	t3 = simd_shuffle(r[1], r[5], 4, 5, 6, 7, 12, 13, 14, 15);	\
+	t4 = simd_shuffle(r[2], r[6], 0, 1, 2, 3, 8, 9, 10, 11);	\
+	t5 = simd_shuffle(r[2], r[6], 4, 5, 6, 7, 12, 13, 14, 15);	\
+	t6 = simd_shuffle(r[3], r[7], 0, 1, 2, 3, 8, 9, 10, 11);	\
+	t7 = simd_shuffle(r[3], r[7], 4, 5, 6, 7, 12, 13, 14, 15);	\
+	r[0] = t0; r[1] = t1; r[2] = t2; r[3] = t3;			\
+	r[4] = t4; r[5] = t5; r[6] = t6; r[7] = t7;			\
+} while (0)
+
+/* in-register transpose of 4x4 32-bit samples */
+#define TRANSPOSE_4X4_S32(r) do {					\
+	snd_v4s32 t0, t1, t2, t3;					\
+	t0 = simd_shuffle(r[0], r[1], 0, 4, 1, 5);			\
+	t1 = simd_shuffle(r[0], r[1], 2, 6, 3, 7);			\
+	t2 = simd_shuffle(r[2], r[3], 0, 4, 1, 5);			\
+	t3 = simd_shuffle(r[2], r[3], 2, 6, 3, 7);			\
+	r[0] = simd_shuffle(t0, t2, 0, 1, 4, 5);			\
+	r[1] = simd_shuffle(t0, t2, 2, 3, 6, 7);			\
+	r[2] = simd_shuffle(t1, t3, 0, 1, 4, 5);			\
+	r[3] = simd_shuffle(t1, t3, 2, 3, 6, 7);			\
+} while (0)
+
+/*
+ * Channels are transposed in groups of 8 (16-bit) or 4 (32-bit) samples.
+ * The frames are walked in blocks, so the interleaved block stays in the
+ * cache while the channel groups are processed and only a few channel
+ * buffers are streamed at once (they are often 4k aliased).
+ */
+#define TRANSPOSE_BLOCK	64
+
+#define VEC		snd_v8s16
+#define TRANSPOSE	TRANSPOSE_8X8_S16
+static void interleave_16_v128(void *dst, unsigned int dst_channels,
+			       const void *const *src, unsigned int channels,
+			       unsigned int frames)
+{
+	int16_t *d = dst;
+	unsigned int blk, f, c, i, groups = channels / 8;
+	unsigned int vframes = frames / 8 * 8;
+	VEC r[8];
+
+	for (blk = 0; blk < vframes; blk += TRANSPOSE_BLOCK) {
+		unsigned int end = blk + TRANSPOSE_BLOCK;
+		if (end > vframes)
+			end = vframes;
+		for (c = 0; c < groups * 8; c += 8) {
+			for (f = blk; f < end; f += 8) {
+				for (i = 0; i < 8; i++)
+					simd_load(r[i], (const int16_t *)src[c + i] + f);
+				TRANSPOSE(r);
+				for (i = 0; i < 8; i++)
+					simd_store(d + (f + i) * dst_channels + c, r[i]);
+			}
+		}
+	}
+	if (groups * 8 < channels)
+		interleave_16(d + groups * 8, dst_channels,
+			      src + groups * 8, channels - groups * 8, vframes);
+	d += vframes * dst_channels;
+	for (f = vframes; f < frames; f++) {
+		for (c = 0; c < channels; c++)
+			d[c] = ((const int16_t *)src[c])[f];
+		d += dst_channels;
+	}
+}
+
+static void deinterleave_16_v128(void *const *dst, const void *src,
+				 unsigned int src_channels, unsigned int channels,
+				 unsigned int frames)
+{
+	const int16_t *s = src;
+	unsigned int blk, f, c, i, groups = channels / 8;
+	unsigned int vframes = frames / 8 * 8;
+	VEC r[8];
+
+	for (blk = 0; blk < vframes; blk += TRANSPOSE_BLOCK) {
+		unsigned int end = blk + TRANSPOSE_BLOCK;
+		if (end > vframes)
+			end = vframes;
+		for (c = 0; c < groups * 8; c += 8) {
+			for (f = blk; f < end; f += 8) {
+				for (i = 0; i < 8; i++)
+					simd_load(r[i], s + (f + i) * src_channels + c);
+				TRANSPOSE(r);
+				for (i = 0; i < 8; i++)
+					simd_store((int16_t *)dst[c + i] + f, r[i]);
+			}
+		}
+	}
+	if (groups * 8 < channels)
+		deinterleave_16(dst + groups * 8, s + groups * 8,
+				src_channels, channels - groups * 8, vframes);
+	s += vframes * src_channels;
+	for (f = vframes; f < frames; f++) {
+		for (c = 0; c < channels; c++)
+			((int16_t *)dst[c])[f] = s[c];
+		s += src_channels;
+	}
+}
+#undef VEC
+#undef TRANSPOSE
+
+#define VEC		snd_v4s32
+#define TRANSPOSE	TRANSPOSE_4X4_S32
+static void interleave_32_v128(void *dst, unsigned int dst_channels,
+			       const void *const *src, unsigned int channels,
+			       unsigned int frames)
+{
+	int32_t *d = dst;
+	unsigned int blk, f, c, i, groups = channels / 4;
+	unsigned int vframes = frames / 4 * 4;
+	VEC r[4];
+
+	for (blk = 0; blk < vframes; blk += TRANSPOSE_BLOCK) {
+		unsigned int end = blk + TRANSPOSE_BLOCK;
+		if (end > vframes)
+			end = vframes;
+		for (c = 0; c < groups * 4; c += 4) {
+			for (f = blk; f < end; f += 4) {
+				for (i = 0; i < 4; i++)
+					simd_load(r[i], (const int32_t *)src[c + i] + f);
+				TRANSPOSE(r);
+				for (i = 0; i < 4; i++)
+					simd_store(d + (f + i) * dst_channels + c, r[i]);
+			}
+		}
+	}
+	if (groups * 4 < channels)
+		interleave_32(d + groups * 4, dst_channels,
+			      src + groups * 4, channels - groups * 4, vframes);
+	d += vframes * dst_channels;
+	for (f = vframes; f < frames; f++) {
+		for (c = 0; c < channels; c++)
+			d[c] = ((const int32_t *)src[c])[f];
+		d += dst_channels;
+	}
+}
+
+static void deinterleave_32_v128(void *const *dst, const void *src,
+				 unsigned int src_channels, unsigned int channels,
+				 unsigned int frames)
+{
+	const int32_t *s = src;
+	unsigned int blk, f, c, i, groups = channels / 4;
+	unsigned int vframes = frames / 4 * 4;
+	VEC r[4];
+
+	for (blk = 0; blk < vframes; blk += TRANSPOSE_BLOCK) {
+		unsigned int end = blk + TRANSPOSE_BLOCK;
+		if (end > vframes)
+			end = vframes;
+		for (c = 0; c < groups * 4; c += 4) {
+			for (f = blk; f < end; f += 4) {
+				for (i = 0; i < 4; i++)
+					simd_load(r[i], s + (f + i) * src_channels + c);
+				TRANSPOSE(r);
+				for (i = 0; i < 4; i++)
+					simd_store((int32_t *)dst[c + i] + f, r[i]);
+			}
+		}
+	}
+	if (groups * 4 < channels)
+		deinterleave_32(dst + groups * 4, s + groups * 4,
+				src_channels, channels - groups * 4, vframes);
+	s += vframes * src_channels;
+	for (f = vframes; f < frames; f++) {
+		for (c = 0; c < channels; c++)
+			((int32_t *)dst[c])[f] = s[c];
+		s += src_channels;
+	}
+}
+#undef VEC
+#undef TRANSPOSE
+
+#endif /* PCM_SIMD */
+
+static unsigned int simd_features;
+
+#ifdef PCM_SIMD
+static struct {
+	void (*interleave2_16)(int16_t *dst, const int16_t *l,
+			       const int16_t *r, unsigned int frames);
+	void (*deinterleave2_16)(int16_t *l, int16_t *r,
+				 const int16_t *src, unsigned int frames);
+	void (*interleave2_32)(int32_t *dst, const int32_t *l,
+			       const int32_t *r, unsigned int frames);
+	void (*deinterleave2_32)(int32_t *l, int32_t *r,
+				 const int32_t *src, unsigned int frames);
+} simd_ops = {
+	.interleave2_16 = interleave2_16_v128,
+	.deinterleave2_16 = deinterleave2_16_v128,
+	.interleave2_32 = interleave2_32_v128,
+	.deinterleave2_32 = deinterleave2_32_v128,
+};
+#endif
+
+void snd_pcm_simd_init(void) __attribute__ ((constructor));
+
+/*
+ * Pick the kernels for the running CPU; called once when the library
+ * is loaded.
+ */
+void snd_pcm_simd_init(void)
+{
+#ifdef PCM_SIMD
+	simd_features = SND_PCM_SIMD_VEC128;
+#endif
+#ifdef PCM_SIMD_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		simd_features |= SND_PCM_SIMD_AVX2;
+		simd_ops.interleave2_16 = interleave2_16_avx2;
+		simd_ops.deinterleave2_16 = deinterleave2_16_avx2;
+		simd_ops.interleave2_32 = interleave2_32_avx2;
+		simd_ops.deinterleave2_32 = deinterleave2_32_avx2;
+	}
+#endif
+}
+
+/**
+ * \brief Return the SIMD extensions used by the PCM sample kernels
+ * \return bitmask of SND_PCM_SIMD_* flags
+ */
+unsigned int snd_pcm_simd_features(void)
+{
+	return simd_features;
+}
+
+/**
+ * \brief Interleave non-interleaved channel buffers
+ * \param dst destination address of the first channel in the first frame
+ * \param dst_channels channels in one destination frame (frame stride)
+ * \param src source buffers, one for each channel, samples are contiguous
+ * \param channels channels to interleave
+ * \param frames frames to interleave
+ * \param width physical sample width in bits
+ * \return 0 on success, -EINVAL if the width is not supported
+ */
+int snd_pcm_simd_interleave(void *dst, unsigned int dst_channels,
+			    const void *const *src, unsigned int channels,
+			    unsigned int frames, unsigned int width)
+{
+	switch (width) {
+	case 8:
+		interleave_8(dst, dst_channels, src, channels, frames);
+		break;
+	case 16:
+#ifdef PCM_SIMD
+		if (channels == 2 && dst_channels == 2)
+			simd_ops.interleave2_16(dst, src[0], src[1], frames);
+		else if (channels >= 8)
+			interleave_16_v128(dst, dst_channels, src, channels, frames);
+		else
+#endif
+			interleave_16(dst, dst_channels, src, channels, frames);
+		break;
+	case 24:
+		interleave_24(dst, dst_channels, src, channels, frames);
+		break;
+	case 32:
+#ifdef PCM_SIMD
+		if (channels == 2 && dst_channels == 2)
+			simd_ops.interleave2_32(dst, src[0], src[1], frames);
+		else if (channels >= 4)
+			interleave_32_v128(dst, dst_channels, src, channels, frames);
+		else
+#endif
+			interleave_32(dst, dst_channels, src, channels, frames);
+		break;
+	case 64:
+		interleave_64(dst, dst_channels, src, channels, frames);
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/**
+ * \brief Split interleaved frames to non-interleaved channel buffers
+ * \param dst destination buffers, one for each channel
+ * \param src source address of the first channel in the first frame
+ * \param src_channels channels in one source frame (frame stride)
+ * \param channels channels to deinterleave
+ * \param frames frames to deinterleave
+ * \param width physical sample width in bits
+ * \return 0 on success, -EINVAL if the width is not supported
+ */
+int snd_pcm_simd_deinterleave(void *const *dst, const void *src,
+			      unsigned int src_channels, unsigned int channels,
+			      unsigned int frames, unsigned int width)
+{
+	switch (width) {
+	case 8:
+		deinterleave_8(dst, src, src_channels, channels, frames);
+		break;
+	case 16:
+#ifdef PCM_SIMD
+		if (channels == 2 && src_channels == 2)
+			simd_ops.deinterleave2_16(dst[0], dst[1], src, frames);
+		else if (channels >= 8)
+			deinterleave_16_v128(dst, src, src_channels, channels, frames);
+		else
+#endif
+			deinterleave_16(dst, src, src_channels, channels, frames);
+		break;
+	case 24:
+		deinterleave_24(dst, src, src_channels, channels, frames);
+		break;
+	case 32:
+#ifdef PCM_SIMD
+		if (channels == 2 && src_channels == 2)
+			simd_ops.deinterleave2_32(dst[0], dst[1], src, frames);
+		else if (channels >= 4)
+			deinterleave_32_v128(dst, src, src_channels, channels, frames);
+		else
+#endif
+			deinterleave_32(dst, src, src_channels, channels, frames);
+		break;
+	case 64:
+		deinterleave_64(dst, src, src_channels, channels, frames);
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+#endif /* DOC_HIDDEN */
@@ -0,0 +1,118 @@
+/*
+ *  PCM Interface - SIMD helpers
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __PCM_SIMD_H
+#define __PCM_SIMD_H
+
+#include <stdint.h>
+
+/*
+ * The kernels are written with the GCC/clang generic vector extensions,
+ * so the same source is compiled to SSE2 on x86 and to NEON on ARM.
+ * Other targets (or older compilers) use the plain C loops only.
+ */
+#if (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 12)) && \
+    (defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define PCM_SIMD	1
+#endif
+
+/*
+ * x86-64 is guaranteed to have SSE2 only, AVX2 variants of the kernels
+ * are chosen at runtime (see snd_pcm_simd_init()).
+ */
+#if defined(PCM_SIMD) && defined(__x86_64__)
+#define PCM_SIMD_AVX2	1
+#define PCM_SIMD_AVX2_ATTR __attribute__((target("avx2")))
+#endif
+
+#ifdef PCM_SIMD
+
+typedef uint8_t snd_v16u8 __attribute__((vector_size(16)));
+typedef int16_t snd_v8s16 __attribute__((vector_size(16)));
+typedef uint16_t snd_v8u16 __attribute__((vector_size(16)));
+typedef int32_t snd_v4s32 __attribute__((vector_size(16)));
+typedef uint32_t snd_v4u32 __attribute__((vector_size(16)));
+typedef float snd_v4f32 __attribute__((vector_size(16)));
+
+/* unaligned vector load / store */
+#define simd_load(v, p)		__builtin_memcpy(&(v), (p), sizeof(v))
+#define simd_store(p, v)	__builtin_memcpy((p), &(v), sizeof(v))
+#define simd_shuffle		__builtin_shufflevector
+#define simd_convert		__builtin_convertvector
+
+#endif /* PCM_SIMD */
+
+/* snd_pcm_simd_features() bits */
+#define SND_PCM_SIMD_VEC128	(1<<0)	/* SSE2 / NEON */
+#define SND_PCM_SIMD_AVX2	(1<<1)
+
+unsigned int snd_pcm_simd_features(void);
+
+/*
+ * Return the address of the sample at offset of the first channel, if the
+ * areas describe one interleaved buffer, otherwise NULL.  The channels may
+ * share addr (first = c * width) or have an own addr for each sample
+ * (addr + c * width / 8, first = 0) as set up by rate_alloc_tmp_buf().
+ */
+static inline char *snd_pcm_areas_interleaved_addr(const snd_pcm_channel_area_t *areas,
+						   snd_pcm_uframes_t offset,
+						   unsigned int channels,
+						   unsigned int width)
+{
+	const char *base;
+	unsigned int c, bit;
+
+	if (!areas->addr || areas->first % 8 ||
+	    areas->step != channels * width)
+		return NULL;
+	base = (const char *)areas->addr + areas->first / 8;
+	for (c = 1; c < channels; c++) {
+		bit = c * width;
+		if (areas[c].step != areas->step ||
+		    areas[c].first % 8 != bit % 8 ||
+		    (const char *)areas[c].addr + areas[c].first / 8 != base + bit / 8)
+			return NULL;
+	}
+	return snd_pcm_channel_area_addr(areas, offset);
+}
+
+/* 1 when each channel has its own packed buffer of samples, otherwise 0 */
+static inline int snd_pcm_areas_noninterleaved(const snd_pcm_channel_area_t *areas,
+					       unsigned int channels,
+					       unsigned int width)
+{
+	unsigned int c;
+
+	for (c = 0; c < channels; c++) {
+		if (!areas[c].addr || areas[c].first % 8 ||
+		    areas[c].step != width)
+			return 0;
+	}
+	return 1;
+}
+
+int snd_pcm_simd_interleave(void *dst, unsigned int dst_channels,
+			    const void *const *src, unsigned int channels,
+			    unsigned int frames, unsigned int width);
+int snd_pcm_simd_deinterleave(void *const *dst, const void *src,
+			      unsigned int src_channels, unsigned int channels,
+			      unsigned int frames, unsigned int width);
+
+#endif /* __PCM_SIMD_H */
@@ -0,0 +1,149 @@
+/*
+ *  PCM Interface - vector width dependent area kernels
+ *
+ *  This file is included from pcm_simd.c several times, with
+ *  SIMD_BYTES (vector size), SIMD_ATTR (function attributes) and
+ *  SIMD_NAME() (symbol suffix) defined.
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+typedef int16_t SIMD_NAME(vs16) __attribute__((vector_size(SIMD_BYTES)));
+typedef int32_t SIMD_NAME(vs32) __attribute__((vector_size(SIMD_BYTES)));
+
+#if SIMD_BYTES == 16
+#define ZIP_LO16	0, 8, 1, 9, 2, 10, 3, 11
+#define ZIP_HI16	4, 12, 5, 13, 6, 14, 7, 15
+#define EVEN16		0, 2, 4, 6, 8, 10, 12, 14
+#define ODD16		1, 3, 5, 7, 9, 11, 13, 15
+#define ZIP_LO32	0, 4, 1, 5
+#define ZIP_HI32	2, 6, 3, 7
+#define EVEN32		0, 2, 4, 6
+#define ODD32		1, 3, 5, 7
+#elif SIMD_BYTES == 32
+#define ZIP_LO16	0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23
+#define ZIP_HI16	8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31
+#define EVEN16		0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30
+#define ODD16		1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31
+#define ZIP_LO32	0, 8, 1, 9, 2, 10, 3, 11
+#define ZIP_HI32	4, 12, 5, 13, 6, 14, 7, 15
+#define EVEN32		0, 2, 4, 6, 8, 10, 12, 14
+#define ODD32		1, 3, 5, 7, 9, 11, 13, 15
+#else
+#error "unsupported SIMD_BYTES"
+#endif
+
+static SIMD_ATTR void SIMD_NAME(interleave2_16)(int16_t *dst, const int16_t *l,
+						const int16_t *r, unsigned int frames)
+{
+	const unsigned int n = SIMD_BYTES / 2;
+	SIMD_NAME(vs16) a, b, lo, hi;
+
+	for (; frames >= n; frames -= n) {
+		simd_load(a, l);
+		simd_load(b, r);
+		lo = simd_shuffle(a, b, ZIP_LO16);
+		hi = simd_shuffle(a, b, ZIP_HI16);
+		simd_store(dst, lo);
+		simd_store(dst + n, hi);
+		l += n;
+		r += n;
+		dst += 2 * n;
+	}
+	while (frames-- > 0) {
+		*dst++ = *l++;
+		*dst++ = *r++;
+	}
+}
+
+static SIMD_ATTR void SIMD_NAME(deinterleave2_16)(int16_t *l, int16_t *r,
+						  const int16_t *src, unsigned int frames)
+{
+	const unsigned int n = SIMD_BYTES / 2;
+	SIMD_NAME(vs16) a, b, even, odd;
+
+	for (; frames >= n; frames -= n) {
+		simd_load(a, src);
+		simd_load(b, src + n);
+		even = simd_shuffle(a, b, EVEN16);
+		odd = simd_shuffle(a, b, ODD16);
+		simd_store(l, even);
+		simd_store(r, odd);
+		src += 2 * n;
+		l += n;
+		r += n;
+	}
+	while (frames-- > 0) {
+		*l++ = *src++;
+		*r++ = *src++;
+	}
+}
+
+static SIMD_ATTR void SIMD_NAME(interleave2_32)(int32_t *dst, const int32_t *l,
+						const int32_t *r, unsigned int frames)
+{
+	const unsigned int n = SIMD_BYTES / 4;
+	SIMD_NAME(vs32) a, b, lo, hi;
+
+	for (; frames >= n; frames -= n) {
+		simd_load(a, l);
+		simd_load(b, r);
+		lo = simd_shuffle(a, b, ZIP_LO32);
+		hi = simd_shuffle(a, b, ZIP_HI32);
+		simd_store(dst, lo);
+		simd_store(dst + n, hi);
+		l += n;
+		r += n;
+		dst += 2 * n;
+	}
+	while (frames-- > 0) {
+		*dst++ = *l++;
+		*dst++ = *r++;
+	}
+}
+
+static SIMD_ATTR void SIMD_NAME(deinterleave2_32)(int32_t *l, int32_t *r,
+						  const int32_t *src, unsigned int frames)
+{
+	const unsigned int n = SIMD_BYTES / 4;
+	SIMD_NAME(vs32) a, b, even, odd;
+
+	for (; frames >= n; frames -= n) {
+		simd_load(a, src);
+		simd_load(b, src + n);
+		even = simd_shuffle(a, b, EVEN32);
+		odd = simd_shuffle(a, b, ODD32);
+		simd_store(l, even);
+		simd_store(r, odd);
+		src += 2 * n;
+		l += n;
+		r += n;
+	}
+	while (frames-- > 0) {
+		*l++ = *src++;
+		*r++ = *src++;
+	}
+}
+
+#undef ZIP_LO16
+#undef ZIP_HI16
+#undef EVEN16
+#undef ODD16
+#undef ZIP_LO32
+#undef ZIP_HI32
+#undef EVEN32
+#undef ODD32
@@ -29,8 +29,13 @@
 #include "pcm_local.h"
 #include "pcm_plugin.h"
 #include "bswap.h"
+#include "pcm_simd.h"
 #include <math.h>
 #include <sound/tlv.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#include <signal.h>
+#endif
 
 #ifndef PIC
 /* entry for static linking */
@@ -39,6 +44,15 @@ const char *_snd_module_pcm_softvol = "";
 
 #ifndef DOC_HIDDEN
 
+typedef void (*softvol_gain_func_t)(void *dst, const void *src,
+				    const unsigned int *gain,
+				    unsigned int samples);
+
+struct softvol_kernel {
+	snd_pcm_format_t format;
+	softvol_gain_func_t func;
+};
+
 typedef struct {
 	/* This field need to be the first */
 	snd_pcm_plugin_t plug;
@@ -52,8 +66,34 @@ typedef struct {
 	double min_dB;
 	double max_dB;
 	unsigned int *dB_value;
+	int ramp;			/* SOFTVOL_RAMP_* */
+	unsigned int channels;		/* channels of the gain buffers */
+	unsigned int *gain;		/* applied gains, then the new ones */
+	int gain_valid;
+	double *ramp_gain;		/* current ramp gains */
+	double *ramp_step;		/* ramp increments or factors */
+	snd_pcm_uframes_t ramp_left;	/* frames until the ramp ends */
+	unsigned int *block;		/* gains of SOFTVOL_BLOCK frames */
+	unsigned int block_frames;	/* steady gains in block */
+	unsigned int block_max;		/* the largest gain in block */
+	softvol_gain_func_t gain_func;	/* vector kernel of the format */
+	int events;			/* follow the control by its events */
+	unsigned int vol_cache;		/* cur_vol[0] | cur_vol[1] << 16 */
+#ifdef HAVE_LIBPTHREAD
+	int event_started;		/* the thread is to be joined */
+	int event_running;		/* vol_cache is valid, atomic */
+	int event_pipe[2];
+	pthread_t event_thread;
+#endif
 } snd_pcm_softvol_t;
 
+#define SOFTVOL_RAMP_NONE	0
+#define SOFTVOL_RAMP_LINEAR	1
+#define SOFTVOL_RAMP_EXPONENTIAL	2
+
+#define SOFTVOL_BLOCK		64	/* frames converted at once */
+#define RAMP_EXP_FLOOR		1.0	/* -96 dB */
+
 #define VOL_SCALE_SHIFT		16
 #define VOL_SCALE_MASK          ((1 << VOL_SCALE_SHIFT) - 1)
 
@@ -173,286 +213,603 @@ static inline short MULTI_DIV_short(short a, unsigned int b, int swap)
 	return swap ? (short)bswap_16((short)fraction) : (short)fraction;
 }
 
-#endif /* DOC_HIDDEN */
+/* one sample scaled by a 16.16 gain, 0xffff passes the sample unchanged */
+static inline short softvol_s16(short s, unsigned int gain, int swap)
+{
+	return gain == 0xffff ? s : MULTI_DIV_short(s, gain, swap);
+}
 
-/*
- * apply volumue attenuation
- *
- * TODO: use SIMD operations
- */
+static inline int softvol_s32(int s, unsigned int gain, int swap)
+{
+	return gain == 0xffff ? s : MULTI_DIV_int(s, gain, swap);
+}
 
-#ifndef DOC_HIDDEN
-#define CONVERT_AREA(TYPE, swap) do {	\
-	unsigned int ch, fr; \
-	TYPE *src, *dst; \
-	for (ch = 0; ch < channels; ch++) { \
-		src_area = &src_areas[ch]; \
-		dst_area = &dst_areas[ch]; \
-		src = snd_pcm_channel_area_addr(src_area, src_offset); \
-		dst = snd_pcm_channel_area_addr(dst_area, dst_offset); \
-		src_step = snd_pcm_channel_area_step(src_area) / sizeof(TYPE); \
-		dst_step = snd_pcm_channel_area_step(dst_area) / sizeof(TYPE); \
-		GET_VOL_SCALE; \
-		fr = frames; \
-		if (! vol_scale) { \
-			while (fr--) { \
-				*dst = 0; \
-				dst += dst_step; \
-			} \
-		} else if (vol_scale == 0xffff) { \
-			while (fr--) { \
-				*dst = *src; \
-				src += src_step; \
-				dst += dst_step; \
-			} \
-		} else { \
-			while (fr--) { \
-				*dst = (TYPE) MULTI_DIV_##TYPE(*src, vol_scale, swap); \
-				src += src_step; \
-				dst += dst_step; \
-			} \
-		} \
-	} \
-} while (0)
+/* S24_LE in 32 bits, the upper byte is ignored */
+static inline int softvol_s24(int s, unsigned int gain)
+{
+	if (gain == 0xffff)
+		return s;
+	return MULTI_DIV_24((int)((unsigned int)s << 8) >> 8, gain);
+}
 
-#define CONVERT_AREA_S24_3LE() do {					\
-	unsigned int ch, fr;						\
-	unsigned char *src, *dst;					\
-	int tmp;							\
-	for (ch = 0; ch < channels; ch++) {				\
-		src_area = &src_areas[ch];				\
-		dst_area = &dst_areas[ch];				\
-		src = snd_pcm_channel_area_addr(src_area, src_offset);	\
-		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);	\
-		src_step = snd_pcm_channel_area_step(src_area);		\
-		dst_step = snd_pcm_channel_area_step(dst_area);		\
-		GET_VOL_SCALE;						\
-		fr = frames;						\
-		if (! vol_scale) {					\
-			while (fr--) {					\
-				dst[0] = dst[1] = dst[2] = 0;		\
-				dst += dst_step;			\
-			}						\
-		} else if (vol_scale == 0xffff) {			\
-			while (fr--) {					\
-				dst[0] = src[0];			\
-				dst[1] = src[1];			\
-				dst[2] = src[2];			\
-				src += dst_step;			\
-				dst += src_step;			\
-			}						\
-		} else {						\
-			while (fr--) {					\
-				tmp = src[0] |				\
-				      (src[1] << 8) |			\
-				      (((signed char *) src)[2] << 16);	\
-				tmp = MULTI_DIV_24(tmp, vol_scale);	\
-				dst[0] = tmp;				\
-				dst[1] = tmp >> 8;			\
-				dst[2] = tmp >> 16;			\
-				src += dst_step;			\
-				dst += src_step;			\
-			}						\
-		}							\
-	}								\
-} while (0)
+static inline void softvol_s24_3(unsigned char *dst, const unsigned char *src,
+				 unsigned int gain)
+{
+	int tmp;
 
-#define CONVERT_AREA_S24_LE() do {					\
-	unsigned int ch, fr;						\
-	int *src, *dst;							\
-	int tmp;							\
-	for (ch = 0; ch < channels; ch++) {				\
-		src_area = &src_areas[ch];				\
-		dst_area = &dst_areas[ch];				\
-		src = snd_pcm_channel_area_addr(src_area, src_offset);	\
-		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);	\
-		src_step = snd_pcm_channel_area_step(src_area)		\
-				/ sizeof(int);				\
-		dst_step = snd_pcm_channel_area_step(dst_area)		\
-				/ sizeof(int);				\
-		GET_VOL_SCALE;						\
-		fr = frames;						\
-		if (! vol_scale) {					\
-			while (fr--) {					\
-				*dst = 0;				\
-				dst += dst_step;			\
-			}						\
-		} else if (vol_scale == 0xffff) {			\
-			while (fr--) {					\
-				*dst = *src;				\
-				src += dst_step;			\
-				dst += src_step;			\
-			}						\
-		} else {						\
-			while (fr--) {					\
-				tmp = *src << 8;			\
-				tmp = (signed int) tmp >> 8;		\
-				*dst = MULTI_DIV_24(tmp, vol_scale);	\
-				src += dst_step;			\
-				dst += src_step;			\
-			}						\
-		}							\
-	}								\
-} while (0)
-		
-#define GET_VOL_SCALE \
-	switch (ch) { \
-	case 0: \
-	case 2: \
-		vol_scale = (channels == ch + 1) ? vol_c : vol[0]; \
-		break; \
-	case 4: \
-	case 5: \
-		vol_scale = vol_c; \
-		break; \
-	default: \
-		vol_scale = vol[ch & 1]; \
-		break; \
+	if (gain == 0xffff) {
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+		return;
 	}
+	tmp = src[0] | (src[1] << 8) | (((signed char *) src)[2] << 16);
+	tmp = MULTI_DIV_24(tmp, gain);
+	dst[0] = tmp;
+	dst[1] = tmp >> 8;
+	dst[2] = tmp >> 16;
+}
+
+static inline float softvol_float(float s, unsigned int gain)
+{
+	return gain == 0xffff ? s : s * ((float)gain * (1.0f / 65536));
+}
+
+static inline unsigned int softvol_float_bits(unsigned int s,
+					      unsigned int gain, int swap)
+{
+	union {
+		unsigned int i;
+		float f;
+	} v;
+
+	v.i = swap ? bswap_32(s) : s;
+	v.f = softvol_float(v.f, gain);
+	return swap ? bswap_32(v.i) : v.i;
+}
+
+#ifdef PCM_SIMD
+#define SIMD_BYTES	16
+#define SIMD_ATTR
+#define SIMD_NAME(x)	simd_##x##_v128
+#include "pcm_softvol_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+
+#ifdef PCM_SIMD_AVX2
+#define SIMD_BYTES	32
+#define SIMD_ATTR	PCM_SIMD_AVX2_ATTR
+#define SIMD_NAME(x)	simd_##x##_avx2
+#include "pcm_softvol_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif
+#else
+#define SIMD_BYTES	0
+#define SIMD_ATTR
+#define SIMD_NAME(x)	generic_##x
+#include "pcm_softvol_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif /* PCM_SIMD */
 
 #endif /* DOC_HIDDEN */
 
-/* 2-channel stereo control */
-static void softvol_convert_stereo_vol(snd_pcm_softvol_t *svol,
-				       const snd_pcm_channel_area_t *dst_areas,
-				       snd_pcm_uframes_t dst_offset,
-				       const snd_pcm_channel_area_t *src_areas,
-				       snd_pcm_uframes_t src_offset,
-				       unsigned int channels,
-				       snd_pcm_uframes_t frames)
+static softvol_gain_func_t softvol_gain_func(snd_pcm_format_t format)
 {
-	const snd_pcm_channel_area_t *dst_area, *src_area;
-	unsigned int src_step, dst_step;
-	unsigned int vol_scale, vol[2], vol_c;
+	const struct softvol_kernel *kernel;
 
-	if (svol->cur_vol[0] == 0 && svol->cur_vol[1] == 0) {
-		snd_pcm_areas_silence(dst_areas, dst_offset, channels, frames,
-				      svol->sformat);
-		return;
-	} else if (svol->zero_dB_val && svol->cur_vol[0] == svol->zero_dB_val &&
-		   svol->cur_vol[1] == svol->zero_dB_val) {
-		snd_pcm_areas_copy(dst_areas, dst_offset, src_areas, src_offset,
-				   channels, frames, svol->sformat);
-		return;
+#ifdef PCM_SIMD
+#ifdef PCM_SIMD_AVX2
+	if (snd_pcm_simd_features() & SND_PCM_SIMD_AVX2)
+		kernel = simd_kernels_avx2;
+	else
+#endif
+		kernel = simd_kernels_v128;
+#else
+	kernel = generic_kernels;
+#endif
+	for (; kernel->func; kernel++) {
+		if (kernel->format == format)
+			return kernel->func;
 	}
+	return NULL;
+}
+
+/*
+ * apply volume attenuation
+ */
+
+#ifndef DOC_HIDDEN
+#define SOFTVOL_APPLY(TYPE, STMT) do { \
+	const TYPE *src = snd_pcm_channel_area_addr(src_area, src_offset); \
+	TYPE *dst = snd_pcm_channel_area_addr(dst_area, dst_offset); \
+	unsigned int src_step = snd_pcm_channel_area_step(src_area) / sizeof(TYPE); \
+	unsigned int dst_step = snd_pcm_channel_area_step(dst_area) / sizeof(TYPE); \
+	while (frames--) { \
+		STMT; \
+		src += src_step; \
+		dst += dst_step; \
+		gain += gain_step; \
+	} \
+} while (0)
+#endif /* DOC_HIDDEN */
+
+/* scale one channel, the gains of successive frames are gain_step apart */
+static void softvol_apply(snd_pcm_softvol_t *svol,
+			  const snd_pcm_channel_area_t *dst_area,
+			  snd_pcm_uframes_t dst_offset,
+			  const snd_pcm_channel_area_t *src_area,
+			  snd_pcm_uframes_t src_offset,
+			  const unsigned int *gain, unsigned int gain_step,
+			  snd_pcm_uframes_t frames)
+{
+	int swap = !snd_pcm_format_cpu_endian(svol->sformat);
 
-	if (svol->max_val == 1) {
-		vol[0] = svol->cur_vol[0] ? 0xffff : 0;
-		vol[1] = svol->cur_vol[1] ? 0xffff : 0;
-		vol_c = vol[0] | vol[1];
-	} else {
-		vol[0] = svol->dB_value[svol->cur_vol[0]];
-		vol[1] = svol->dB_value[svol->cur_vol[1]];
-		vol_c = svol->dB_value[(svol->cur_vol[0] + svol->cur_vol[1]) / 2];
-	}
 	switch (svol->sformat) {
 	case SND_PCM_FORMAT_S16_LE:
 	case SND_PCM_FORMAT_S16_BE:
 		/* 16bit samples */
-		CONVERT_AREA(short, 
-			     !snd_pcm_format_cpu_endian(svol->sformat));
+		SOFTVOL_APPLY(short, *dst = softvol_s16(*src, *gain, swap));
 		break;
 	case SND_PCM_FORMAT_S32_LE:
 	case SND_PCM_FORMAT_S32_BE:
 		/* 32bit samples */
-		CONVERT_AREA(int,
-			     !snd_pcm_format_cpu_endian(svol->sformat));
+		SOFTVOL_APPLY(int, *dst = softvol_s32(*src, *gain, swap));
 		break;
 	case SND_PCM_FORMAT_S24_LE:
 		/* 24bit samples */
-		CONVERT_AREA_S24_LE();
+		SOFTVOL_APPLY(int, *dst = softvol_s24(*src, *gain));
 		break;
 	case SND_PCM_FORMAT_S24_3LE:
-		CONVERT_AREA_S24_3LE();
+		SOFTVOL_APPLY(unsigned char, softvol_s24_3(dst, src, *gain));
+		break;
+	case SND_PCM_FORMAT_FLOAT_LE:
+	case SND_PCM_FORMAT_FLOAT_BE:
+		SOFTVOL_APPLY(unsigned int,
+			      *dst = softvol_float_bits(*src, *gain, swap));
 		break;
 	default:
 		break;
 	}
 }
 
-#undef GET_VOL_SCALE
-#define GET_VOL_SCALE
-
-/* mono control */
-static void softvol_convert_mono_vol(snd_pcm_softvol_t *svol,
-				     const snd_pcm_channel_area_t *dst_areas,
-				     snd_pcm_uframes_t dst_offset,
-				     const snd_pcm_channel_area_t *src_areas,
-				     snd_pcm_uframes_t src_offset,
-				     unsigned int channels,
-				     snd_pcm_uframes_t frames)
+/*
+ * the gain of each channel for the current control values
+ *
+ * When the control is stereo, the channels are mapped as mono, 2.0, 2.1,
+ * 4.0, 4.1, 5.1 or 7.1; the center and LFE channels get the average.
+ */
+static void softvol_channel_gains(snd_pcm_softvol_t *svol,
+				  unsigned int *gain, unsigned int channels)
+{
+	unsigned int cur0 = svol->cur_vol[0];
+	unsigned int cur1 = svol->cchannels == 1 ? cur0 : svol->cur_vol[1];
+	unsigned int ch, vol[2], vol_c;
+
+	if (cur0 == 0 && cur1 == 0) {
+		vol[0] = vol[1] = vol_c = 0;
+	} else if (svol->zero_dB_val && cur0 == svol->zero_dB_val &&
+		   cur1 == svol->zero_dB_val) {
+		vol[0] = vol[1] = vol_c = 0xffff;
+	} else if (svol->max_val == 1) {
+		vol[0] = cur0 ? 0xffff : 0;
+		vol[1] = cur1 ? 0xffff : 0;
+		vol_c = vol[0] | vol[1];
+	} else {
+		vol[0] = svol->dB_value[cur0];
+		vol[1] = svol->dB_value[cur1];
+		vol_c = svol->dB_value[(cur0 + cur1) / 2];
+	}
+	for (ch = 0; ch < channels; ch++) {
+		switch (ch) {
+		case 0:
+		case 2:
+			gain[ch] = (channels == ch + 1) ? vol_c : vol[0];
+			break;
+		case 4:
+		case 5:
+			gain[ch] = vol_c;
+			break;
+		default:
+			gain[ch] = vol[ch & 1];
+			break;
+		}
+	}
+}
+
+/* 0xffff means unity, ramp towards the exact 1.0 */
+static inline double softvol_ramp_value(unsigned int gain)
+{
+	return gain == 0xffff ? (double)(1 << VOL_SCALE_SHIFT) : gain;
+}
+
+/*
+ * pick up a volume change, with a ramp it is spread over the next
+ * period_size frames starting from the gains applied right now
+ */
+static void softvol_update_gains(snd_pcm_softvol_t *svol,
+				 unsigned int channels,
+				 snd_pcm_uframes_t period_size)
 {
-	const snd_pcm_channel_area_t *dst_area, *src_area;
-	unsigned int src_step, dst_step;
-	unsigned int vol_scale;
+	unsigned int *target = svol->gain + channels;
+	unsigned int ch;
+	double from, to;
 
-	if (svol->cur_vol[0] == 0) {
-		snd_pcm_areas_silence(dst_areas, dst_offset, channels, frames,
-				      svol->sformat);
+	softvol_channel_gains(svol, target, channels);
+	if (svol->gain_valid &&
+	    !memcmp(svol->gain, target, channels * sizeof(*target)))
 		return;
-	} else if (svol->zero_dB_val && svol->cur_vol[0] == svol->zero_dB_val) {
-		snd_pcm_areas_copy(dst_areas, dst_offset, src_areas, src_offset,
-				   channels, frames, svol->sformat);
+	svol->block_frames = 0;
+	if (svol->ramp == SOFTVOL_RAMP_NONE || !svol->gain_valid ||
+	    !period_size) {
+		memcpy(svol->gain, target, channels * sizeof(*target));
+		svol->gain_valid = 1;
+		svol->ramp_left = 0;
 		return;
 	}
+	for (ch = 0; ch < channels; ch++) {
+		from = svol->ramp_left ? svol->ramp_gain[ch] :
+			softvol_ramp_value(svol->gain[ch]);
+		to = softvol_ramp_value(target[ch]);
+		if (svol->ramp == SOFTVOL_RAMP_LINEAR) {
+			svol->ramp_step[ch] = (to - from) / period_size;
+		} else {
+			/* constant dB steps, silence is approached at -96 dB */
+			if (from < RAMP_EXP_FLOOR)
+				from = RAMP_EXP_FLOOR;
+			if (to < RAMP_EXP_FLOOR)
+				to = RAMP_EXP_FLOOR;
+			svol->ramp_step[ch] = pow(to / from, 1.0 / period_size);
+		}
+		svol->ramp_gain[ch] = from;
+	}
+	memcpy(svol->gain, target, channels * sizeof(*target));
+	svol->ramp_left = period_size;
+}
 
-	if (svol->max_val == 1)
-		vol_scale = svol->cur_vol[0] ? 0xffff : 0;
-	else
-		vol_scale = svol->dB_value[svol->cur_vol[0]];
-	switch (svol->sformat) {
-	case SND_PCM_FORMAT_S16_LE:
-	case SND_PCM_FORMAT_S16_BE:
-		/* 16bit samples */
-		CONVERT_AREA(short, 
-			     !snd_pcm_format_cpu_endian(svol->sformat));
-		break;
-	case SND_PCM_FORMAT_S32_LE:
-	case SND_PCM_FORMAT_S32_BE:
-		/* 32bit samples */
-		CONVERT_AREA(int,
-			     !snd_pcm_format_cpu_endian(svol->sformat));
-		break;
-	case SND_PCM_FORMAT_S24_LE:
-		/* 24bit samples */
-		CONVERT_AREA_S24_LE();
-		break;
-	case SND_PCM_FORMAT_S24_3LE:
-		CONVERT_AREA_S24_3LE();
-		break;
-	default:
-		break;
+/* the gains of the next frames of the ramp */
+static void softvol_ramp_block(snd_pcm_softvol_t *svol,
+				       unsigned int channels,
+				       unsigned int frames)
+{
+	unsigned int *block = svol->block;
+	unsigned int ch, fr, g, max = 0;
+	double v;
+
+	for (fr = 0; fr < frames; fr++) {
+		for (ch = 0; ch < channels; ch++) {
+			if (svol->ramp == SOFTVOL_RAMP_LINEAR)
+				v = svol->ramp_gain[ch] + svol->ramp_step[ch];
+			else
+				v = svol->ramp_gain[ch] * svol->ramp_step[ch];
+			svol->ramp_gain[ch] = v;
+			if (svol->ramp_left == 1) {
+				/* land on the target exactly */
+				g = svol->gain[ch];
+			} else {
+				g = (unsigned int)(v + 0.5);
+				if (g == 1 << VOL_SCALE_SHIFT)
+					g = 0xffff;
+			}
+			if (g > max)
+				max = g;
+			*block++ = g;
+		}
+		svol->ramp_left--;
+	}
+	svol->block_frames = 0;
+	svol->block_max = max;
+}
+
+/* SOFTVOL_BLOCK frames of the steady gains */
+static void softvol_steady_block(snd_pcm_softvol_t *svol,
+					 unsigned int channels)
+{
+	unsigned int ch, fr, max = 0;
+
+	for (ch = 0; ch < channels; ch++) {
+		if (svol->gain[ch] > max)
+			max = svol->gain[ch];
+	}
+	for (fr = 0; fr < SOFTVOL_BLOCK; fr++)
+		memcpy(svol->block + fr * channels, svol->gain,
+		       channels * sizeof(*svol->gain));
+	svol->block_frames = SOFTVOL_BLOCK;
+	svol->block_max = max;
+}
+
+static int softvol_all_gains(snd_pcm_softvol_t *svol, unsigned int channels,
+			     unsigned int gain)
+{
+	unsigned int ch;
+
+	for (ch = 0; ch < channels; ch++) {
+		if (svol->gain[ch] != gain)
+			return 0;
+	}
+	return 1;
+}
+
+static void softvol_convert(snd_pcm_softvol_t *svol,
+			    const snd_pcm_channel_area_t *dst_areas,
+			    snd_pcm_uframes_t dst_offset,
+			    const snd_pcm_channel_area_t *src_areas,
+			    snd_pcm_uframes_t src_offset,
+			    unsigned int channels,
+			    snd_pcm_uframes_t frames,
+			    snd_pcm_uframes_t period_size)
+{
+	unsigned int width = snd_pcm_format_physical_width(svol->sformat);
+	unsigned int ch, n;
+	char *dst, *src;
+
+	softvol_update_gains(svol, channels, period_size);
+	if (!svol->ramp_left) {
+		if (softvol_all_gains(svol, channels, 0)) {
+			snd_pcm_areas_silence(dst_areas, dst_offset, channels,
+					      frames, svol->sformat);
+			return;
+		}
+		if (softvol_all_gains(svol, channels, 0xffff)) {
+			snd_pcm_areas_copy(dst_areas, dst_offset, src_areas,
+					   src_offset, channels, frames,
+					   svol->sformat);
+			return;
+		}
+	}
+
+	dst = snd_pcm_areas_interleaved_addr(dst_areas, dst_offset, channels, width);
+	src = snd_pcm_areas_interleaved_addr(src_areas, src_offset, channels, width);
+	while (frames > 0) {
+		n = frames < SOFTVOL_BLOCK ? frames : SOFTVOL_BLOCK;
+		if (svol->ramp_left) {
+			if (n > svol->ramp_left)
+				n = svol->ramp_left;
+			softvol_ramp_block(svol, channels, n);
+		} else if (!svol->block_frames) {
+			softvol_steady_block(svol, channels);
+		}
+		if (dst && src && svol->gain_func && svol->block_max <= 0xffff) {
+			/* the vector kernels don't amplify */
+			svol->gain_func(dst, src, svol->block, n * channels);
+		} else {
+			for (ch = 0; ch < channels; ch++)
+				softvol_apply(svol, &dst_areas[ch], dst_offset,
+					      &src_areas[ch], src_offset,
+					      svol->block + ch, channels, n);
+		}
+		if (dst && src) {
+			dst += n * channels * width / 8;
+			src += n * channels * width / 8;
+		}
+		dst_offset += n;
+		src_offset += n;
+		frames -= n;
+	}
+}
+
+/* read the control values into vol */
+static int softvol_read_control(snd_pcm_softvol_t *svol,
+				snd_ctl_elem_value_t *elem, unsigned int *vol)
+{
+	unsigned int val;
+	unsigned int i;
+	int err;
+
+	err = snd_ctl_elem_read(svol->ctl, elem);
+	if (err < 0)
+		return err;
+	for (i = 0; i < svol->cchannels; i++) {
+		val = elem->value.integer.value[i];
+		if (val > svol->max_val)
+			val = svol->max_val;
+		vol[i] = val;
 	}
+	return 0;
 }
 
 /*
  * get the current volume value from driver
  *
- * TODO: mmap support?
+ * In the event mode, the value cached by the event thread is taken
+ * instead, without a system call.
  */
 static void get_current_volume(snd_pcm_softvol_t *svol)
 {
-	unsigned int val;
-	unsigned int i;
+#ifdef HAVE_LIBPTHREAD
+	if (__atomic_load_n(&svol->event_running, __ATOMIC_ACQUIRE)) {
+		unsigned int val = __atomic_load_n(&svol->vol_cache,
+						   __ATOMIC_RELAXED);
+		svol->cur_vol[0] = val & 0xffff;
+		svol->cur_vol[1] = val >> 16;
+		return;
+	}
+#endif
+	softvol_read_control(svol, &svol->elem, svol->cur_vol);
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void softvol_cache_volume(snd_pcm_softvol_t *svol,
+				 snd_ctl_elem_value_t *elem)
+{
+	unsigned int vol[2] = { 0, 0 };
 
-	if (snd_ctl_elem_read(svol->ctl, &svol->elem) < 0)
+	if (softvol_read_control(svol, elem, vol) < 0)
 		return;
-	for (i = 0; i < svol->cchannels; i++) {
-		val = svol->elem.value.integer.value[i];
-		if (val > svol->max_val)
-			val = svol->max_val;
-		svol->cur_vol[i] = val;
+	__atomic_store_n(&svol->vol_cache, vol[0] | vol[1] << 16,
+			 __ATOMIC_RELAXED);
+}
+
+/*
+ * The thread owns the control handle while it runs; it waits for the
+ * change events of the element and caches the new values.  The handle
+ * stays in the blocking mode, one event is read for each wakeup.
+ *
+ * When the control fails (the card is gone), the thread gives the handle
+ * back and the volume is read from the control again.
+ */
+static void *softvol_event_thread(void *arg)
+{
+	snd_pcm_softvol_t *svol = arg;
+	snd_ctl_elem_value_t elem = svol->elem;
+	snd_ctl_event_t event;
+	struct pollfd *pfds;
+	unsigned short revents;
+	sigset_t sigs;
+	int n, err;
+
+	/* the signals are for the threads of the application */
+	sigfillset(&sigs);
+	pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+	n = snd_ctl_poll_descriptors_count(svol->ctl);
+	if (n < 0)
+		goto _failed;
+	pfds = alloca(sizeof(*pfds) * (n + 1));
+	n = snd_ctl_poll_descriptors(svol->ctl, pfds, n);
+	pfds[n].fd = svol->event_pipe[0];
+	pfds[n].events = POLLIN;
+	for (;;) {
+		if (poll(pfds, n + 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (pfds[n].revents)
+			return NULL;
+		if (snd_ctl_poll_descriptors_revents(svol->ctl, pfds, n,
+						     &revents) < 0)
+			break;
+		if (revents & (POLLERR | POLLHUP | POLLNVAL))
+			break;
+		if (!(revents & POLLIN))
+			continue;
+		err = snd_ctl_read(svol->ctl, &event);
+		if (err == 0 || err == -EAGAIN)
+			continue;
+		if (err < 0)
+			break;
+		if (event.type == SND_CTL_EVENT_ELEM &&
+		    event.data.elem.mask != SND_CTL_EVENT_MASK_REMOVE &&
+		    !snd_ctl_elem_id_compare_set(&event.data.elem.id,
+						 &elem.id))
+			softvol_cache_volume(svol, &elem);
 	}
+ _failed:
+	snd_ctl_subscribe_events(svol->ctl, 0);
+	__atomic_store_n(&svol->event_running, 0, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/* a pipe closed on exec, the thread is woken up through it to quit */
+static int softvol_event_pipe(int fds[2])
+{
+#ifdef O_CLOEXEC
+	if (pipe2(fds, O_CLOEXEC) < 0)
+		return -errno;
+#else
+	if (pipe(fds) < 0)
+		return -errno;
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+	return 0;
+}
+
+static int softvol_start_events(snd_pcm_softvol_t *svol)
+{
+	int err;
+
+	if (svol->event_started)
+		return 0;
+	/* subscribe before the first read not to miss a change */
+	err = snd_ctl_subscribe_events(svol->ctl, 1);
+	if (err < 0)
+		return err;
+	softvol_cache_volume(svol, &svol->elem);
+	err = softvol_event_pipe(svol->event_pipe);
+	if (err < 0)
+		goto _unsubscribe;
+	err = -pthread_create(&svol->event_thread, NULL,
+			      softvol_event_thread, svol);
+	if (err < 0) {
+		close(svol->event_pipe[0]);
+		close(svol->event_pipe[1]);
+		goto _unsubscribe;
+	}
+	svol->event_started = 1;
+	__atomic_store_n(&svol->event_running, 1, __ATOMIC_RELEASE);
+	return 0;
+
+ _unsubscribe:
+	snd_ctl_subscribe_events(svol->ctl, 0);
+	return err;
+}
+
+static void softvol_stop_events(snd_pcm_softvol_t *svol)
+{
+	if (!svol->event_started)
+		return;
+	if (write(svol->event_pipe[1], "", 1) != 1)
+		SYSERR("cannot stop the softvol event thread");
+	pthread_join(svol->event_thread, NULL);
+	close(svol->event_pipe[0]);
+	close(svol->event_pipe[1]);
+	svol->event_started = 0;
+	svol->event_running = 0;
+}
+#endif /* HAVE_LIBPTHREAD */
+
+static void softvol_free_gains(snd_pcm_softvol_t *svol)
+{
+	free(svol->gain);
+	free(svol->ramp_gain);
+	free(svol->ramp_step);
+	free(svol->block);
+	svol->gain = NULL;
+	svol->ramp_gain = NULL;
+	svol->ramp_step = NULL;
+	svol->block = NULL;
+	svol->channels = 0;
+}
+
+static int softvol_alloc_gains(snd_pcm_softvol_t *svol, unsigned int channels)
+{
+	svol->gain_valid = 0;
+	svol->ramp_left = 0;
+	svol->block_frames = 0;
+	if (svol->channels == channels)
+		return 0;
+	softvol_free_gains(svol);
+	svol->gain = calloc(channels * 2, sizeof(*svol->gain));
+	svol->ramp_gain = calloc(channels, sizeof(*svol->ramp_gain));
+	svol->ramp_step = calloc(channels, sizeof(*svol->ramp_step));
+	svol->block = calloc(channels * SOFTVOL_BLOCK, sizeof(*svol->block));
+	if (!svol->gain || !svol->ramp_gain || !svol->ramp_step ||
+	    !svol->block) {
+		softvol_free_gains(svol);
+		return -ENOMEM;
+	}
+	svol->channels = channels;
+	return 0;
 }
 
 static void softvol_free(snd_pcm_softvol_t *svol)
 {
+#ifdef HAVE_LIBPTHREAD
+	softvol_stop_events(svol);
+#endif
 	if (svol->plug.gen.close_slave)
 		snd_pcm_close(svol->plug.gen.slave);
 	if (svol->ctl)
 		snd_ctl_close(svol->ctl);
 	if (svol->dB_value && svol->dB_value != preset_dB_value)
 		free(svol->dB_value);
+	softvol_free_gains(svol);
 	free(svol);
 }
 
@@ -475,7 +832,9 @@ static int snd_pcm_softvol_hw_refine_cprepare(snd_pcm_t *pcm,
 			(1ULL << SND_PCM_FORMAT_S16_BE) |
 			(1ULL << SND_PCM_FORMAT_S24_LE) |
 			(1ULL << SND_PCM_FORMAT_S32_LE) |
- 			(1ULL << SND_PCM_FORMAT_S32_BE),
+ 			(1ULL << SND_PCM_FORMAT_S32_BE) |
+			(1ULL << SND_PCM_FORMAT_FLOAT_LE) |
+			(1ULL << SND_PCM_FORMAT_FLOAT_BE),
 			(1ULL << (SND_PCM_FORMAT_S24_3LE - 32))
 		}
 	};
@@ -631,13 +990,26 @@ static int snd_pcm_softvol_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * param
 	    slave->format != SND_PCM_FORMAT_S24_3LE && 
 	    slave->format != SND_PCM_FORMAT_S24_LE &&
 	    slave->format != SND_PCM_FORMAT_S32_LE &&
-	    slave->format != SND_PCM_FORMAT_S32_BE) {
+	    slave->format != SND_PCM_FORMAT_S32_BE &&
+	    slave->format != SND_PCM_FORMAT_FLOAT_LE &&
+	    slave->format != SND_PCM_FORMAT_FLOAT_BE) {
 		SNDERR("softvol supports only S16_LE, S16_BE, S24_LE, S24_3LE, "
-		       "S32_LE or S32_BE");
+		       "S32_LE, S32_BE, FLOAT_LE or FLOAT_BE");
 		return -EINVAL;
 	}
 	svol->sformat = slave->format;
-	return 0;
+	svol->gain_func = softvol_gain_func(slave->format);
+#ifdef HAVE_LIBPTHREAD
+	if (svol->events) {
+		err = softvol_start_events(svol);
+		if (err < 0) {
+			SNDERR("cannot follow the control events, "
+			       "reading it on each transfer");
+			svol->events = 0;
+		}
+	}
+#endif
+	return softvol_alloc_gains(svol, slave->channels);
 }
 
 static snd_pcm_uframes_t
@@ -653,12 +1025,8 @@ snd_pcm_softvol_write_areas(snd_pcm_t *pcm,
 	if (size > *slave_sizep)
 		size = *slave_sizep;
 	get_current_volume(svol);
-	if (svol->cchannels == 1)
-		softvol_convert_mono_vol(svol, slave_areas, slave_offset,
-					 areas, offset, pcm->channels, size);
-	else
-		softvol_convert_stereo_vol(svol, slave_areas, slave_offset,
-					   areas, offset, pcm->channels, size);
+	softvol_convert(svol, slave_areas, slave_offset, areas, offset,
+			pcm->channels, size, pcm->period_size);
 	*slave_sizep = size;
 	return size;
 }
@@ -676,12 +1044,8 @@ snd_pcm_softvol_read_areas(snd_pcm_t *pcm,
 	if (size > *slave_sizep)
 		size = *slave_sizep;
 	get_current_volume(svol);
-	if (svol->cchannels == 1)
-		softvol_convert_mono_vol(svol, areas, offset, slave_areas,
-					 slave_offset, pcm->channels, size);
-	else
-		softvol_convert_stereo_vol(svol, areas, offset, slave_areas,
-					   slave_offset, pcm->channels, size);
+	softvol_convert(svol, areas, offset, slave_areas, slave_offset,
+			pcm->channels, size, pcm->period_size);
 	*slave_sizep = size;
 	return size;
 }
@@ -698,6 +1062,12 @@ static void snd_pcm_softvol_dump(snd_pcm_t *pcm, snd_output_t *out)
 		snd_output_printf(out, "max_dB: %g\n", svol->max_dB);
 		snd_output_printf(out, "resolution: %d\n", svol->max_val + 1);
 	}
+	if (svol->ramp != SOFTVOL_RAMP_NONE)
+		snd_output_printf(out, "ramp: %s\n",
+				  svol->ramp == SOFTVOL_RAMP_LINEAR ?
+				  "linear" : "exponential");
+	if (svol->events)
+		snd_output_printf(out, "events: yes\n");
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -893,30 +1263,14 @@ static const snd_pcm_ops_t snd_pcm_softvol_ops = {
 	.set_chmap = snd_pcm_generic_set_chmap,
 };
 
-/**
- * \brief Creates a new SoftVolume PCM
- * \param pcmp Returns created PCM handle
- * \param name Name of PCM
- * \param sformat Slave format
- * \param ctl_card card index of the control
- * \param ctl_id The control element
- * \param cchannels PCM channels
- * \param min_dB minimal dB value
- * \param max_dB maximal dB value
- * \param resolution resolution of control
- * \param slave Slave PCM handle
- * \param close_slave When set, the slave PCM handle is closed with copy PCM
- * \retval zero on success otherwise a negative error code
- * \warning Using of this function might be dangerous in the sense
- *          of compatibility reasons. The prototype might be freely
- *          changed in future.
- */
-int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
-			 snd_pcm_format_t sformat,
-			 int ctl_card, snd_ctl_elem_id_t *ctl_id,
-			 int cchannels,
-			 double min_dB, double max_dB, int resolution,
-			 snd_pcm_t *slave, int close_slave)
+/* snd_pcm_softvol_open() with the options of the configuration */
+static int softvol_open(snd_pcm_t **pcmp, const char *name,
+			snd_pcm_format_t sformat,
+			int ctl_card, snd_ctl_elem_id_t *ctl_id,
+			int cchannels,
+			double min_dB, double max_dB, int resolution,
+			int ramp, int events,
+			snd_pcm_t *slave, int close_slave)
 {
 	snd_pcm_t *pcm;
 	snd_pcm_softvol_t *svol;
@@ -928,7 +1282,9 @@ int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 	    sformat != SND_PCM_FORMAT_S24_3LE && 
 	    sformat != SND_PCM_FORMAT_S24_LE &&
 	    sformat != SND_PCM_FORMAT_S32_LE &&
-	    sformat != SND_PCM_FORMAT_S32_BE)
+	    sformat != SND_PCM_FORMAT_S32_BE &&
+	    sformat != SND_PCM_FORMAT_FLOAT_LE &&
+	    sformat != SND_PCM_FORMAT_FLOAT_BE)
 		return -EINVAL;
 	svol = calloc(1, sizeof(*svol));
 	if (! svol)
@@ -951,6 +1307,8 @@ int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 	snd_pcm_plugin_init(&svol->plug);
 	svol->sformat = sformat;
 	svol->cchannels = cchannels;
+	svol->ramp = ramp;
+	svol->events = events;
 	svol->plug.read = snd_pcm_softvol_read_areas;
 	svol->plug.write = snd_pcm_softvol_write_areas;
 	svol->plug.undo_read = snd_pcm_plugin_undo_read_generic;
@@ -982,6 +1340,36 @@ int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 	return 0;
 }
 
+/**
+ * \brief Creates a new SoftVolume PCM
+ * \param pcmp Returns created PCM handle
+ * \param name Name of PCM
+ * \param sformat Slave format
+ * \param ctl_card card index of the control
+ * \param ctl_id The control element
+ * \param cchannels PCM channels
+ * \param min_dB minimal dB value
+ * \param max_dB maximal dB value
+ * \param resolution resolution of control
+ * \param slave Slave PCM handle
+ * \param close_slave When set, the slave PCM handle is closed with copy PCM
+ * \retval zero on success otherwise a negative error code
+ * \warning Using of this function might be dangerous in the sense
+ *          of compatibility reasons. The prototype might be freely
+ *          changed in future.
+ */
+int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
+			 snd_pcm_format_t sformat,
+			 int ctl_card, snd_ctl_elem_id_t *ctl_id,
+			 int cchannels,
+			 double min_dB, double max_dB, int resolution,
+			 snd_pcm_t *slave, int close_slave)
+{
+	return softvol_open(pcmp, name, sformat, ctl_card, ctl_id, cchannels,
+			    min_dB, max_dB, resolution, SOFTVOL_RAMP_NONE, 0,
+			    slave, close_slave);
+}
+
 static int _snd_pcm_parse_control_id(snd_config_t *conf, snd_ctl_elem_id_t *ctl_id,
 				     int *cardp, int *cchannels)
 {
@@ -1122,9 +1510,22 @@ pcm.name {
 	[max_dB REAL]           # maximal dB value (default:   0.0)
 	[resolution INT]        # resolution (default: 256)
 				# resolution = 2 means a mute switch
+	[ramp STR]              # volume ramp: none, linear or exponential
+				# (default: none)
+	[events BOOL]           # follow the control by its change events
+				# (default: no)
 }
 \endcode
 
+With a ramp, a volume change doesn't jump: the gain moves from the old
+to the new value over one period, either in equal steps (linear) or in
+equal dB steps (exponential), so the control can be moved while playing
+without clicks.
+
+By default, the control value is read on each transfer.  With events,
+a thread waits for the change events of the control and caches the
+value, so the transfers don't need a system call to get it.
+
 \subsection pcm_plugins_softvol_funcref Function reference
 
 <UL>
@@ -1162,6 +1563,8 @@ int _snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 	double min_dB = PRESET_MIN_DB;
 	double max_dB = ZERO_DB;
 	int card = -1, cchannels = 2;
+	int ramp = SOFTVOL_RAMP_NONE;
+	int events = 0;
 
 	snd_config_for_each(i, next, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
@@ -1204,6 +1607,32 @@ int _snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 			}
 			continue;
 		}
+		if (strcmp(id, "ramp") == 0) {
+			const char *str;
+			err = snd_config_get_string(n, &str);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return err;
+			}
+			if (strcmp(str, "none") == 0)
+				ramp = SOFTVOL_RAMP_NONE;
+			else if (strcmp(str, "linear") == 0)
+				ramp = SOFTVOL_RAMP_LINEAR;
+			else if (strcmp(str, "exponential") == 0)
+				ramp = SOFTVOL_RAMP_EXPONENTIAL;
+			else {
+				SNDERR("Invalid ramp %s", str);
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "events") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			events = err;
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -1246,8 +1675,10 @@ int _snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 		    sformat != SND_PCM_FORMAT_S24_3LE && 
 		    sformat != SND_PCM_FORMAT_S24_LE &&
 		    sformat != SND_PCM_FORMAT_S32_LE &&
-		    sformat != SND_PCM_FORMAT_S32_BE) {
-			SNDERR("only S16_LE, S16_BE, S24_LE, S24_3LE, S32_LE or S32_BE format is supported");
+		    sformat != SND_PCM_FORMAT_S32_BE &&
+		    sformat != SND_PCM_FORMAT_FLOAT_LE &&
+		    sformat != SND_PCM_FORMAT_FLOAT_BE) {
+			SNDERR("only S16_LE, S16_BE, S24_LE, S24_3LE, S32_LE, S32_BE, FLOAT_LE or FLOAT_BE format is supported");
 			snd_config_delete(sconf);
 			return -EINVAL;
 		}
@@ -1260,9 +1691,9 @@ int _snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 			snd_pcm_close(spcm);
 			return err;
 		}
-		err = snd_pcm_softvol_open(pcmp, name, sformat, card, &ctl_id,
-					   cchannels, min_dB, max_dB,
-					   resolution, spcm, 1);
+		err = softvol_open(pcmp, name, sformat, card, &ctl_id,
+				   cchannels, min_dB, max_dB, resolution,
+				   ramp, events, spcm, 1);
 		if (err < 0)
 			snd_pcm_close(spcm);
 	}
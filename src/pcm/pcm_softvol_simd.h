@@ -0,0 +1,237 @@
+/**
+ * \file pcm/pcm_softvol_simd.h
+ * \ingroup PCM_Plugins
+ * \brief PCM Soft Volume Plugin Interface - gain kernels
+ */
+/*
+ *  PCM - Soft Volume Plugin
+ *
+ *  This file is included from pcm_softvol.c several times, with
+ *  SIMD_BYTES (vector size, 0 for plain C), SIMD_ATTR (function
+ *  attributes) and SIMD_NAME() (symbol suffix) defined.
+ *
+ *  Each kernel scales a run of contiguous native endian samples, every
+ *  sample by its own 16.16 gain.  The gains must not exceed 0xffff, which
+ *  passes the sample unchanged; the results are identical to the
+ *  MULTI_DIV_*() helpers.  The 24 bit formats are handled for little
+ *  endian hosts only.  The table at the end maps the formats to the
+ *  kernels.
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#if SIMD_BYTES
+typedef uint8_t SIMD_NAME(vu8) __attribute__((vector_size(SIMD_BYTES)));
+typedef int16_t SIMD_NAME(hs16) __attribute__((vector_size(SIMD_BYTES / 2)));
+typedef int32_t SIMD_NAME(vs32) __attribute__((vector_size(SIMD_BYTES)));
+typedef uint32_t SIMD_NAME(vu32) __attribute__((vector_size(SIMD_BYTES)));
+typedef float SIMD_NAME(vf32) __attribute__((vector_size(SIMD_BYTES)));
+
+/* 32-bit lanes in one vector */
+#define LANES		(SIMD_BYTES / 4)
+
+/* MULTI_DIV_32x16() for all lanes, (hi << 16 | lo) * g >> 16 */
+static inline __attribute__((always_inline)) SIMD_ATTR
+SIMD_NAME(vs32) SIMD_NAME(mul_32x16)(SIMD_NAME(vs32) s, SIMD_NAME(vu32) g)
+{
+	SIMD_NAME(vs32) hi = s >> 16;
+	SIMD_NAME(vu32) lo = (SIMD_NAME(vu32))s & 0xffff;
+
+	return hi * (SIMD_NAME(vs32))g + (SIMD_NAME(vs32))((lo * g) >> 16);
+}
+
+/* d where the gain is below 0xffff, s where it is 0xffff */
+static inline __attribute__((always_inline)) SIMD_ATTR
+SIMD_NAME(vs32) SIMD_NAME(unity)(SIMD_NAME(vs32) d, SIMD_NAME(vs32) s,
+				 SIMD_NAME(vu32) g)
+{
+	SIMD_NAME(vs32) mask = g == 0xffff;
+
+	return (d & ~mask) | (s & mask);
+}
+#endif
+
+static SIMD_ATTR
+void SIMD_NAME(gain_s16)(void *dst_addr, const void *src_addr,
+			 const unsigned int *gain, unsigned int samples)
+{
+	const int16_t *src = src_addr;
+	int16_t *dst = dst_addr;
+	unsigned int i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(hs16) s16;
+	SIMD_NAME(vs32) s, d;
+	SIMD_NAME(vu32) g;
+
+	for (; i + LANES <= samples; i += LANES) {
+		simd_load(s16, src + i);
+		simd_load(g, gain + i);
+		s = simd_convert(s16, SIMD_NAME(vs32));
+		d = (s * (SIMD_NAME(vs32))g) >> VOL_SCALE_SHIFT;
+		d = SIMD_NAME(unity)(d, s, g);
+		s16 = simd_convert(d, SIMD_NAME(hs16));
+		simd_store(dst + i, s16);
+	}
+#endif
+	for (; i < samples; i++)
+		dst[i] = softvol_s16(src[i], gain[i], 0);
+}
+
+static SIMD_ATTR
+void SIMD_NAME(gain_s32)(void *dst_addr, const void *src_addr,
+			 const unsigned int *gain, unsigned int samples)
+{
+	const int32_t *src = src_addr;
+	int32_t *dst = dst_addr;
+	unsigned int i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(vs32) s, d;
+	SIMD_NAME(vu32) g;
+
+	for (; i + LANES <= samples; i += LANES) {
+		simd_load(s, src + i);
+		simd_load(g, gain + i);
+		d = SIMD_NAME(mul_32x16)(s, g);
+		d = SIMD_NAME(unity)(d, s, g);
+		simd_store(dst + i, d);
+	}
+#endif
+	for (; i < samples; i++)
+		dst[i] = softvol_s32(src[i], gain[i], 0);
+}
+
+static SIMD_ATTR
+void SIMD_NAME(gain_float)(void *dst_addr, const void *src_addr,
+			   const unsigned int *gain, unsigned int samples)
+{
+	const float *src = src_addr;
+	float *dst = dst_addr;
+	unsigned int i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(vf32) s, d;
+	SIMD_NAME(vu32) g;
+
+	for (; i + LANES <= samples; i += LANES) {
+		simd_load(s, src + i);
+		simd_load(g, gain + i);
+		d = s * (simd_convert(g, SIMD_NAME(vf32)) * (1.0f / 65536));
+		d = (SIMD_NAME(vf32))SIMD_NAME(unity)((SIMD_NAME(vs32))d,
+						      (SIMD_NAME(vs32))s, g);
+		simd_store(dst + i, d);
+	}
+#endif
+	for (; i < samples; i++)
+		dst[i] = softvol_float(src[i], gain[i]);
+}
+
+#ifdef SND_LITTLE_ENDIAN
+static SIMD_ATTR
+void SIMD_NAME(gain_s24)(void *dst_addr, const void *src_addr,
+			 const unsigned int *gain, unsigned int samples)
+{
+	const int32_t *src = src_addr;
+	int32_t *dst = dst_addr;
+	unsigned int i = 0;
+#if SIMD_BYTES
+	SIMD_NAME(vs32) s, d;
+	SIMD_NAME(vu32) g;
+
+	for (; i + LANES <= samples; i += LANES) {
+		simd_load(s, src + i);
+		simd_load(g, gain + i);
+		d = (SIMD_NAME(vs32))((SIMD_NAME(vu32))s << 8) >> 8;
+		d = SIMD_NAME(mul_32x16)(d, g);
+		d = SIMD_NAME(unity)(d, s, g);
+		simd_store(dst + i, d);
+	}
+#endif
+	for (; i < samples; i++)
+		dst[i] = softvol_s24(src[i], gain[i]);
+}
+
+/*
+ * byte shuffles between 3 byte samples and the upper bytes of 32-bit lanes;
+ * plain SSE2 has no byte shuffle and is faster without them
+ */
+#if SIMD_BYTES && (SIMD_BYTES > 16 || !defined(__SSE2__) || defined(__SSSE3__))
+#define SHUFFLE3	1
+#define UNPACK3(i)	SIMD_BYTES, 3 * (i), 3 * (i) + 1, 3 * (i) + 2
+#define PACK3(i)	4 * (i) + 1, 4 * (i) + 2, 4 * (i) + 3
+#if SIMD_BYTES == 16
+#define UNPACK3_ALL	UNPACK3(0), UNPACK3(1), UNPACK3(2), UNPACK3(3)
+#define PACK3_ALL	PACK3(0), PACK3(1), PACK3(2), PACK3(3), 0, 0, 0, 0
+#else
+#define UNPACK3_ALL	UNPACK3(0), UNPACK3(1), UNPACK3(2), UNPACK3(3), \
+			UNPACK3(4), UNPACK3(5), UNPACK3(6), UNPACK3(7)
+#define PACK3_ALL	PACK3(0), PACK3(1), PACK3(2), PACK3(3), \
+			PACK3(4), PACK3(5), PACK3(6), PACK3(7), \
+			0, 0, 0, 0, 0, 0, 0, 0
+#endif
+#endif
+
+static SIMD_ATTR
+void SIMD_NAME(gain_s24_3)(void *dst_addr, const void *src_addr,
+			   const unsigned int *gain, unsigned int samples)
+{
+	const uint8_t *src = src_addr;
+	uint8_t *dst = dst_addr;
+	unsigned int i = 0;
+#ifdef SHUFFLE3
+	SIMD_NAME(vu8) v, zero = { 0 };
+	SIMD_NAME(vs32) s, d;
+	SIMD_NAME(vu32) g;
+
+	/* a whole vector is read, stay SIMD_BYTES inside the samples */
+	for (; i * 3 + SIMD_BYTES <= samples * 3; i += LANES) {
+		simd_load(v, src + i * 3);
+		simd_load(g, gain + i);
+		v = simd_shuffle(v, zero, UNPACK3_ALL);
+		s = (SIMD_NAME(vs32))v >> 8;
+		d = SIMD_NAME(mul_32x16)(s, g);
+		d = SIMD_NAME(unity)(d, s, g);
+		v = (SIMD_NAME(vu8))((SIMD_NAME(vu32))d << 8);
+		v = simd_shuffle(v, v, PACK3_ALL);
+		__builtin_memcpy(dst + i * 3, &v, LANES * 3);
+	}
+#endif
+	for (; i < samples; i++)
+		softvol_s24_3(dst + i * 3, src + i * 3, gain[i]);
+}
+
+#ifdef SHUFFLE3
+#undef SHUFFLE3
+#undef UNPACK3
+#undef PACK3
+#undef UNPACK3_ALL
+#undef PACK3_ALL
+#endif
+#endif /* SND_LITTLE_ENDIAN */
+
+static const struct softvol_kernel SIMD_NAME(kernels)[] = {
+	{ SND_PCM_FORMAT_S16, SIMD_NAME(gain_s16) },
+	{ SND_PCM_FORMAT_S32, SIMD_NAME(gain_s32) },
+	{ SND_PCM_FORMAT_FLOAT, SIMD_NAME(gain_float) },
+#ifdef SND_LITTLE_ENDIAN
+	{ SND_PCM_FORMAT_S24_LE, SIMD_NAME(gain_s24) },
+	{ SND_PCM_FORMAT_S24_3LE, SIMD_NAME(gain_s24_3) },
+#endif
+	{ SND_PCM_FORMAT_UNKNOWN, NULL }
+};
+
+#if SIMD_BYTES
+#undef LANES
+#endif
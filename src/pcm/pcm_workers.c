@@ -0,0 +1,160 @@
+/*
+ *  PCM - Worker threads of the plugins
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "pcm_local.h"
+#include "pcm_workers.h"
+#include <stdlib.h>
+
+#ifdef HAVE_LIBPTHREAD
+
+static void *snd_pcm_worker(void *arg)
+{
+	snd_pcm_worker_t *worker = arg;
+	snd_pcm_workers_t *pool = worker->pool;
+	unsigned int generation = 0;
+	snd_pcm_workers_job_t job;
+	void *private_data;
+
+#ifdef HAVE_SCHED_SETAFFINITY
+	if (worker->cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(worker->cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+			SYSERR("cannot pin the %s worker to CPU %d",
+			       pool->name, worker->cpu);
+			worker->cpu = -1;
+		}
+	}
+#endif
+	pthread_mutex_lock(&pool->mutex);
+	for (;;) {
+		while (pool->generation == generation && !pool->quit)
+			pthread_cond_wait(&pool->start_cond, &pool->mutex);
+		if (pool->quit)
+			break;
+		generation = pool->generation;
+		job = pool->job;
+		private_data = pool->private_data;
+		pthread_mutex_unlock(&pool->mutex);
+		job(private_data, worker->idx);
+		pthread_mutex_lock(&pool->mutex);
+		if (--pool->pending == 0)
+			pthread_cond_signal(&pool->done_cond);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+/**
+ * \brief Stop the worker threads and free the pool
+ * \param pool the pool, may be NULL
+ */
+void snd_pcm_workers_stop(snd_pcm_workers_t *pool)
+{
+	unsigned int idx;
+
+	if (!pool)
+		return;
+	pthread_mutex_lock(&pool->mutex);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->start_cond);
+	pthread_mutex_unlock(&pool->mutex);
+	for (idx = 0; idx < pool->count; idx++) {
+		if (pool->workers[idx].thread_started)
+			pthread_join(pool->workers[idx].thread, NULL);
+	}
+	pthread_cond_destroy(&pool->start_cond);
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->workers);
+	free(pool);
+}
+
+/**
+ * \brief Start a pool of worker threads
+ * \param poolp the returned pool
+ * \param name the plugin name for the error messages
+ * \param count the count of threads
+ * \param cpus the CPU to pin each thread to or -1, may be NULL
+ * \return 0 on success otherwise a negative error code
+ */
+int snd_pcm_workers_start(snd_pcm_workers_t **poolp, const char *name,
+			  unsigned int count, const int *cpus)
+{
+	snd_pcm_workers_t *pool;
+	unsigned int idx;
+	int err;
+
+	pool = calloc(1, sizeof(*pool));
+	if (pool == NULL)
+		return -ENOMEM;
+	pool->workers = calloc(count, sizeof(*pool->workers));
+	if (pool->workers == NULL) {
+		free(pool);
+		return -ENOMEM;
+	}
+	pool->name = name;
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->start_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+	pool->count = count;
+	for (idx = 0; idx < count; idx++) {
+		snd_pcm_worker_t *worker = &pool->workers[idx];
+
+		worker->pool = pool;
+		worker->idx = idx + 1;
+		worker->cpu = cpus && SND_PCM_WORKERS_CPUS ? cpus[idx] : -1;
+		err = pthread_create(&worker->thread, NULL, snd_pcm_worker, worker);
+		if (err) {
+			snd_pcm_workers_stop(pool);
+			return -err;
+		}
+		worker->thread_started = 1;
+	}
+	*poolp = pool;
+	return 0;
+}
+
+/**
+ * \brief Run a job on the calling thread and on all workers
+ * \param pool the pool
+ * \param job the job, called with the index 0 to count
+ * \param private_data passed to the job
+ */
+void snd_pcm_workers_run(snd_pcm_workers_t *pool, snd_pcm_workers_job_t job,
+			 void *private_data)
+{
+	pthread_mutex_lock(&pool->mutex);
+	pool->job = job;
+	pool->private_data = private_data;
+	pool->pending = pool->count;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start_cond);
+	pthread_mutex_unlock(&pool->mutex);
+	job(private_data, 0);
+	pthread_mutex_lock(&pool->mutex);
+	while (pool->pending)
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+#endif /* HAVE_LIBPTHREAD */
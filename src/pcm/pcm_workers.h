@@ -0,0 +1,86 @@
+/*
+ *  PCM - Worker threads of the plugins
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __PCM_WORKERS_H
+#define __PCM_WORKERS_H
+
+#ifdef HAVE_LIBPTHREAD
+
+#include <pthread.h>
+#ifdef HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
+
+/*
+ * A pool of threads which run one job at a time: snd_pcm_workers_run()
+ * calls the job with index 0 from the calling thread and with the
+ * indexes 1-count from the workers, and returns when all are done.
+ */
+
+/* the workers can be pinned to the CPUs below, none without affinity */
+#ifdef HAVE_SCHED_SETAFFINITY
+#define SND_PCM_WORKERS_CPUS	CPU_SETSIZE
+#else
+#define SND_PCM_WORKERS_CPUS	0
+#endif
+
+typedef void (*snd_pcm_workers_job_t)(void *private_data, unsigned int idx);
+
+typedef struct snd_pcm_workers snd_pcm_workers_t;
+
+typedef struct {
+	snd_pcm_workers_t *pool;
+	unsigned int idx;
+	int cpu;			/* the worker is pinned to, or -1 */
+	int thread_started;
+	pthread_t thread;
+} snd_pcm_worker_t;
+
+struct snd_pcm_workers {
+	const char *name;		/* for the error messages */
+	unsigned int count;
+	snd_pcm_worker_t *workers;
+	pthread_mutex_t mutex;
+	pthread_cond_t start_cond;
+	pthread_cond_t done_cond;
+	unsigned int generation;	/* bumped for each job */
+	unsigned int pending;		/* workers still running it */
+	int quit;
+	snd_pcm_workers_job_t job;
+	void *private_data;
+};
+
+/* make local functions really local */
+#define snd_pcm_workers_start \
+	snd1_pcm_workers_start
+#define snd_pcm_workers_stop \
+	snd1_pcm_workers_stop
+#define snd_pcm_workers_run \
+	snd1_pcm_workers_run
+
+int snd_pcm_workers_start(snd_pcm_workers_t **poolp, const char *name,
+			  unsigned int count, const int *cpus);
+void snd_pcm_workers_stop(snd_pcm_workers_t *pool);
+void snd_pcm_workers_run(snd_pcm_workers_t *pool, snd_pcm_workers_job_t job,
+			 void *private_data);
+
+#endif /* HAVE_LIBPTHREAD */
+
+#endif /* __PCM_WORKERS_H */
@@ -0,0 +1,246 @@
+/*
+ * A control plugin for the tests, standing in for a card.
+ *
+ * Its controls are shared by all the handles of the process: a stereo
+ * user switch, "Test Playback Switch", and the level controls of a meter
+ * scope named "Test" in 0.01 dB, which "Test Level Writes" counts the
+ * writes to.  A change through one handle queues a change event on every
+ * subscribed handle.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <alsa/asoundlib.h>
+#include <alsa/control_external.h>
+
+#define TEST_HANDLES	8
+#define TEST_ACCESS_USER	(1 << 29)	/* SNDRV_CTL_ELEM_ACCESS_USER */
+#define TEST_LEVEL_MIN	-14400
+
+enum {
+	TEST_SWITCH,
+	TEST_PEAK,
+	TEST_RMS,
+	TEST_LOUDNESS,
+	TEST_WRITES,
+	TEST_ELEMS
+};
+
+static const struct {
+	const char *name;
+	unsigned int count;
+	long min, max;
+	unsigned int access;
+} test_elems[TEST_ELEMS] = {
+	[TEST_SWITCH] = { "Test Playback Switch", 2, 0, 1,
+			  SND_CTL_EXT_ACCESS_READWRITE | TEST_ACCESS_USER },
+	[TEST_PEAK] = { "Test Peak Level", 2, TEST_LEVEL_MIN, 0,
+			SND_CTL_EXT_ACCESS_READWRITE },
+	[TEST_RMS] = { "Test RMS Level", 2, TEST_LEVEL_MIN, 0,
+		       SND_CTL_EXT_ACCESS_READWRITE },
+	[TEST_LOUDNESS] = { "Test Loudness", 2, TEST_LEVEL_MIN, 0,
+			    SND_CTL_EXT_ACCESS_READWRITE },
+	/* the writes to the peak, RMS and loudness controls */
+	[TEST_WRITES] = { "Test Level Writes", 3, 0, 0x7fffffff,
+			  SND_CTL_EXT_ACCESS_READ },
+};
+
+typedef struct {
+	snd_ctl_ext_t ext;
+	int pipe[2];
+} ctl_test_t;
+
+static pthread_mutex_t test_lock = PTHREAD_MUTEX_INITIALIZER;
+static long test_value[TEST_ELEMS][3];
+static ctl_test_t *test_handles[TEST_HANDLES];
+
+static void ctl_test_close(snd_ctl_ext_t *ext)
+{
+	ctl_test_t *test = ext->private_data;
+	unsigned int i;
+
+	pthread_mutex_lock(&test_lock);
+	for (i = 0; i < TEST_HANDLES; i++) {
+		if (test_handles[i] == test)
+			test_handles[i] = NULL;
+	}
+	pthread_mutex_unlock(&test_lock);
+	close(test->pipe[0]);
+	close(test->pipe[1]);
+	free(test);
+}
+
+static int ctl_test_elem_count(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED)
+{
+	return TEST_ELEMS;
+}
+
+static int ctl_test_elem_list(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+			      unsigned int offset, snd_ctl_elem_id_t *id)
+{
+	if (offset >= TEST_ELEMS)
+		return -EINVAL;
+	snd_ctl_elem_id_set_interface(id, SND_CTL_ELEM_IFACE_MIXER);
+	snd_ctl_elem_id_set_name(id, test_elems[offset].name);
+	return 0;
+}
+
+static snd_ctl_ext_key_t ctl_test_find_elem(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+					    const snd_ctl_elem_id_t *id)
+{
+	snd_ctl_ext_key_t key;
+
+	if (snd_ctl_elem_id_get_interface(id) != SND_CTL_ELEM_IFACE_MIXER)
+		return SND_CTL_EXT_KEY_NOT_FOUND;
+	for (key = 0; key < TEST_ELEMS; key++) {
+		if (!strcmp(snd_ctl_elem_id_get_name(id), test_elems[key].name))
+			return key;
+	}
+	return SND_CTL_EXT_KEY_NOT_FOUND;
+}
+
+static int ctl_test_get_attribute(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+				  snd_ctl_ext_key_t key,
+				  int *type, unsigned int *acc,
+				  unsigned int *count)
+{
+	*type = SND_CTL_ELEM_TYPE_INTEGER;
+	*acc = test_elems[key].access;
+	*count = test_elems[key].count;
+	return 0;
+}
+
+static int ctl_test_get_integer_info(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+				     snd_ctl_ext_key_t key,
+				     long *imin, long *imax, long *istep)
+{
+	*imin = test_elems[key].min;
+	*imax = test_elems[key].max;
+	*istep = 1;
+	return 0;
+}
+
+static int ctl_test_read_integer(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+				 snd_ctl_ext_key_t key, long *value)
+{
+	pthread_mutex_lock(&test_lock);
+	memcpy(value, test_value[key], test_elems[key].count * sizeof(*value));
+	pthread_mutex_unlock(&test_lock);
+	return 0;
+}
+
+/* queues a change event of the control on the subscribed handles */
+static int ctl_test_changed(snd_ctl_ext_key_t key)
+{
+	char c = key;
+	unsigned int i;
+
+	for (i = 0; i < TEST_HANDLES; i++) {
+		if (test_handles[i] && test_handles[i]->ext.subscribed &&
+		    write(test_handles[i]->pipe[1], &c, 1) != 1)
+			return -EIO;
+	}
+	return 1;
+}
+
+static int ctl_test_write_integer(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+				  snd_ctl_ext_key_t key, long *value)
+{
+	size_t size = test_elems[key].count * sizeof(*value);
+	int changed;
+
+	pthread_mutex_lock(&test_lock);
+	changed = memcmp(value, test_value[key], size) != 0;
+	memcpy(test_value[key], value, size);
+	if (changed)
+		changed = ctl_test_changed(key);
+	if (key >= TEST_PEAK && key <= TEST_LOUDNESS) {
+		test_value[TEST_WRITES][key - TEST_PEAK]++;
+		if (changed >= 0)
+			ctl_test_changed(TEST_WRITES);
+	}
+	pthread_mutex_unlock(&test_lock);
+	return changed;
+}
+
+static void ctl_test_subscribe_events(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+				      int subscribe ATTRIBUTE_UNUSED)
+{
+}
+
+static int ctl_test_read_event(snd_ctl_ext_t *ext, snd_ctl_elem_id_t *id,
+			       unsigned int *event_mask)
+{
+	ctl_test_t *test = ext->private_data;
+	char c;
+
+	if (read(test->pipe[0], &c, 1) != 1)
+		return -EAGAIN;
+	snd_ctl_elem_id_set_interface(id, SND_CTL_ELEM_IFACE_MIXER);
+	snd_ctl_elem_id_set_name(id, test_elems[(unsigned char)c].name);
+	*event_mask = SND_CTL_EVENT_MASK_VALUE;
+	return 1;
+}
+
+static const snd_ctl_ext_callback_t ctl_test_callback = {
+	.close = ctl_test_close,
+	.elem_count = ctl_test_elem_count,
+	.elem_list = ctl_test_elem_list,
+	.find_elem = ctl_test_find_elem,
+	.get_attribute = ctl_test_get_attribute,
+	.get_integer_info = ctl_test_get_integer_info,
+	.read_integer = ctl_test_read_integer,
+	.write_integer = ctl_test_write_integer,
+	.subscribe_events = ctl_test_subscribe_events,
+	.read_event = ctl_test_read_event,
+};
+
+SND_CTL_PLUGIN_DEFINE_FUNC(test)
+{
+	ctl_test_t *test;
+	unsigned int i;
+	int err;
+
+	(void)root;
+	(void)conf;
+	test = calloc(1, sizeof(*test));
+	if (!test)
+		return -ENOMEM;
+	if (pipe(test->pipe) < 0) {
+		err = -errno;
+		free(test);
+		return err;
+	}
+	fcntl(test->pipe[0], F_SETFL, O_NONBLOCK);
+	test->ext.version = SND_CTL_EXT_VERSION;
+	test->ext.card_idx = 0;
+	strcpy(test->ext.id, "Test");
+	strcpy(test->ext.driver, "Test");
+	strcpy(test->ext.name, "Test");
+	strcpy(test->ext.longname, "Test control plugin");
+	strcpy(test->ext.mixername, "Test");
+	test->ext.poll_fd = test->pipe[0];
+	test->ext.callback = &ctl_test_callback;
+	test->ext.private_data = test;
+	err = snd_ctl_ext_create(&test->ext, name, mode);
+	if (err < 0) {
+		close(test->pipe[0]);
+		close(test->pipe[1]);
+		free(test);
+		return err;
+	}
+	pthread_mutex_lock(&test_lock);
+	for (i = 0; i < TEST_HANDLES; i++) {
+		if (!test_handles[i]) {
+			test_handles[i] = test;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&test_lock);
+	*handlep = test->ext.handle;
+	return 0;
+}
+
+SND_CTL_PLUGIN_SYMBOL(test);
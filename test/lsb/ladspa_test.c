@@ -0,0 +1,122 @@
+/*
+ * LADSPA plugins for the tests.
+ *
+ * "test_gain" is a one pole filter with a gain control, its output
+ * depends on all the samples the instance has seen.  "test_mix" mixes
+ * two channels into each other, so it cannot be duplicated.
+ */
+#include <stdlib.h>
+#include "ladspa.h"
+
+typedef struct {
+	LADSPA_Data *port[4];
+	LADSPA_Data state;
+} ladspa_test_t;
+
+static LADSPA_Handle test_instantiate(const LADSPA_Descriptor *desc,
+				      unsigned long rate)
+{
+	(void)desc;
+	(void)rate;
+	return calloc(1, sizeof(ladspa_test_t));
+}
+
+static void test_connect_port(LADSPA_Handle handle, unsigned long port,
+			      LADSPA_Data *data)
+{
+	((ladspa_test_t *)handle)->port[port] = data;
+}
+
+static void test_activate(LADSPA_Handle handle)
+{
+	((ladspa_test_t *)handle)->state = 0;
+}
+
+static void test_cleanup(LADSPA_Handle handle)
+{
+	free(handle);
+}
+
+static void test_gain_run(LADSPA_Handle handle, unsigned long frames)
+{
+	ladspa_test_t *test = handle;
+	LADSPA_Data gain = *test->port[2];
+	unsigned long i;
+
+	for (i = 0; i < frames; i++) {
+		test->state = test->state * 0.5f + test->port[0][i] * gain;
+		test->port[1][i] = test->state;
+	}
+}
+
+static void test_mix_run(LADSPA_Handle handle, unsigned long frames)
+{
+	ladspa_test_t *test = handle;
+	unsigned long i;
+
+	for (i = 0; i < frames; i++) {
+		LADSPA_Data a = test->port[0][i], b = test->port[1][i];
+
+		test->port[2][i] = a + b * 0.5f;
+		test->port[3][i] = b - a * 0.5f;
+	}
+}
+
+static const LADSPA_PortDescriptor gain_ports[] = {
+	LADSPA_PORT_INPUT | LADSPA_PORT_AUDIO,
+	LADSPA_PORT_OUTPUT | LADSPA_PORT_AUDIO,
+	LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+};
+static const char *const gain_names[] = { "In", "Out", "Gain" };
+static const LADSPA_PortRangeHint gain_hints[3];
+
+static const LADSPA_PortDescriptor mix_ports[] = {
+	LADSPA_PORT_INPUT | LADSPA_PORT_AUDIO,
+	LADSPA_PORT_INPUT | LADSPA_PORT_AUDIO,
+	LADSPA_PORT_OUTPUT | LADSPA_PORT_AUDIO,
+	LADSPA_PORT_OUTPUT | LADSPA_PORT_AUDIO,
+};
+static const char *const mix_names[] = { "InL", "InR", "OutL", "OutR" };
+static const LADSPA_PortRangeHint mix_hints[4];
+
+static const LADSPA_Descriptor test_descriptors[] = {
+	{
+		.UniqueID = 9001,
+		.Label = "test_gain",
+		.Name = "Test gain",
+		.Maker = "alsa-lib",
+		.Copyright = "None",
+		.PortCount = 3,
+		.PortDescriptors = gain_ports,
+		.PortNames = gain_names,
+		.PortRangeHints = gain_hints,
+		.instantiate = test_instantiate,
+		.connect_port = test_connect_port,
+		.activate = test_activate,
+		.run = test_gain_run,
+		.cleanup = test_cleanup,
+	},
+	{
+		.UniqueID = 9002,
+		.Label = "test_mix",
+		.Name = "Test mix",
+		.Maker = "alsa-lib",
+		.Copyright = "None",
+		.PortCount = 4,
+		.PortDescriptors = mix_ports,
+		.PortNames = mix_names,
+		.PortRangeHints = mix_hints,
+		.instantiate = test_instantiate,
+		.connect_port = test_connect_port,
+		.activate = test_activate,
+		.run = test_mix_run,
+		.cleanup = test_cleanup,
+	},
+};
+
+const LADSPA_Descriptor *ladspa_descriptor(unsigned long idx)
+{
+	if (idx >= sizeof(test_descriptors) / sizeof(test_descriptors[0]))
+		return NULL;
+	return &test_descriptors[idx];
+}
@@ -0,0 +1,296 @@
+/*
+ * The Ima-ADPCM block codec is built into this test from the library
+ * sources: every kernel, for 1 to 20 channels, against an encoder and a
+ * decoder written here from the IMA recommendation, and the round trip
+ * of the public helpers.
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pcm_local.h"
+/* not the public header of the same name */
+#include "../../src/pcm/pcm_plugin.h"
+#include "pcm_simd.h"
+#include "test.h"
+
+static const char IndexAdjust[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static const short StepSize[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+#include "pcm_adpcm_block.c"
+
+#ifdef PCM_SIMD
+/* the plain C kernels, which the library builds only without vectors */
+#define SIMD_BYTES	0
+#define SIMD_ATTR
+#define SIMD_NAME(x)	generic_##x
+#include "pcm_adpcm_simd.h"
+#undef SIMD_BYTES
+#undef SIMD_ATTR
+#undef SIMD_NAME
+#endif
+
+#define MAX_CHANNELS	20
+#define GROUPS		25
+#define FRAMES		(1 + GROUPS * 8)
+#define BYTES		(MAX_CHANNELS * 4 * (1 + GROUPS))
+
+/* the reference coder, one sample at a time */
+
+struct ref_state {
+	int pred;
+	int idx;
+};
+
+static int ref_decode_nibble(struct ref_state *st, unsigned int code)
+{
+	int step = StepSize[st->idx];
+	int diff = step >> 3;
+
+	if (code & 4)
+		diff += step;
+	if (code & 2)
+		diff += step >> 1;
+	if (code & 1)
+		diff += step >> 2;
+	if (code & 8)
+		st->pred -= diff;
+	else
+		st->pred += diff;
+	if (st->pred > 32767)
+		st->pred = 32767;
+	if (st->pred < -32768)
+		st->pred = -32768;
+	st->idx += IndexAdjust[code & 7];
+	if (st->idx < 0)
+		st->idx = 0;
+	if (st->idx > 88)
+		st->idx = 88;
+	return st->pred;
+}
+
+static unsigned int ref_encode_sample(struct ref_state *st, int sample)
+{
+	int diff = sample - st->pred;
+	int step = StepSize[st->idx];
+	unsigned int code = 0;
+
+	if (diff < 0) {
+		code = 8;
+		diff = -diff;
+	}
+	if (diff >= step) {
+		code |= 4;
+		diff -= step;
+	}
+	step >>= 1;
+	if (diff >= step) {
+		code |= 2;
+		diff -= step;
+	}
+	step >>= 1;
+	if (diff >= step)
+		code |= 1;
+	/* the predictor follows the decoder */
+	ref_decode_nibble(st, code);
+	return code;
+}
+
+static void ref_encode(unsigned char *dst, const int16_t *src,
+		       unsigned int channels, unsigned char *step_idx)
+{
+	unsigned int c, g, k;
+
+	for (c = 0; c < channels; c++) {
+		struct ref_state st = { src[c], step_idx[c] };
+		unsigned char *d = dst + channels * 4 + c * 4;
+
+		dst[c * 4] = src[c] & 0xff;
+		dst[c * 4 + 1] = (src[c] >> 8) & 0xff;
+		dst[c * 4 + 2] = step_idx[c];
+		dst[c * 4 + 3] = 0;
+		for (g = 0; g < GROUPS; g++) {
+			memset(d, 0, 4);
+			for (k = 0; k < 8; k++) {
+				int s = src[(1 + g * 8 + k) * channels + c];
+
+				d[k / 2] |= ref_encode_sample(&st, s) << (k % 2 * 4);
+			}
+			d += channels * 4;
+		}
+		step_idx[c] = st.idx;
+	}
+}
+
+static void ref_decode(int16_t *dst, const unsigned char *src,
+		       unsigned int channels)
+{
+	unsigned int c, g, k;
+
+	for (c = 0; c < channels; c++) {
+		struct ref_state st;
+		const unsigned char *s = src + channels * 4 + c * 4;
+
+		st.pred = (int16_t)(src[c * 4] | src[c * 4 + 1] << 8);
+		st.idx = src[c * 4 + 2];
+		dst[c] = st.pred;
+		for (g = 0; g < GROUPS; g++) {
+			for (k = 0; k < 8; k++)
+				dst[(1 + g * 8 + k) * channels + c] =
+					ref_decode_nibble(&st, s[k / 2] >> (k % 2 * 4) & 0xf);
+			s += channels * 4;
+		}
+	}
+}
+
+static unsigned int rnd_state = 1;
+
+static unsigned int rnd(void)
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return rnd_state >> 16;
+}
+
+/*
+ * Tones of a different pitch in each channel, a full scale square wave
+ * which drives the predictor into the clamps and noise.
+ */
+static void fill(int16_t *samples, unsigned int channels)
+{
+	unsigned int i, c;
+
+	for (i = 0; i < FRAMES; i++)
+		for (c = 0; c < channels; c++) {
+			int16_t *s = &samples[i * channels + c];
+
+			switch (c % 3) {
+			case 0:
+				*s = 12000 * sin(i * 0.05 * (c + 1));
+				break;
+			case 1:
+				*s = (i / 17) % 2 ? 32767 : -32768;
+				break;
+			default:
+				*s = rnd();
+				break;
+			}
+		}
+}
+
+static int16_t src[FRAMES * MAX_CHANNELS];
+static int16_t out[FRAMES * MAX_CHANNELS], ref_out[FRAMES * MAX_CHANNELS];
+static unsigned char block[BYTES], ref_block[BYTES];
+
+static void check_kernels(const char *name, const struct adpcm_kernels *kern)
+{
+	unsigned char step_idx[MAX_CHANNELS], ref_idx[MAX_CHANNELS];
+	unsigned int channels, c, i;
+	size_t bytes;
+
+	for (channels = 1; channels <= MAX_CHANNELS; channels++) {
+		int fails = any_test_failed;
+
+		any_test_failed = 0;
+		bytes = channels * 4 * (1 + GROUPS);
+		fill(src, channels);
+		for (c = 0; c < channels; c++)
+			step_idx[c] = ref_idx[c] = rnd() % 89;
+		TEST_CHECK(adpcm_block_encode(kern, block, src, channels, FRAMES,
+					      step_idx) == (ssize_t)bytes);
+		ref_encode(ref_block, src, channels, ref_idx);
+		TEST_CHECK(memcmp(block, ref_block, bytes) == 0);
+		TEST_CHECK(memcmp(step_idx, ref_idx, channels) == 0);
+
+		TEST_CHECK(adpcm_block_decode(kern, out, block, channels,
+					      bytes) == FRAMES);
+		ref_decode(ref_out, block, channels);
+		TEST_CHECK(memcmp(out, ref_out, FRAMES * channels * 2) == 0);
+
+		/* every code in every state */
+		for (i = 0; i < bytes; i++)
+			block[i] = rnd();
+		for (c = 0; c < channels; c++) {
+			block[c * 4 + 2] = rnd() % 89;
+			block[c * 4 + 3] = 0;
+		}
+		TEST_CHECK(adpcm_block_decode(kern, out, block, channels,
+					      bytes) == FRAMES);
+		ref_decode(ref_out, block, channels);
+		TEST_CHECK(memcmp(out, ref_out, FRAMES * channels * 2) == 0);
+
+		if (any_test_failed)
+			fprintf(stderr, "%s kernels, %u channels\n", name, channels);
+		any_test_failed |= fails;
+	}
+}
+
+/* the public helpers: sizes, errors and the round trip of a tone */
+static void check_helpers(void)
+{
+	unsigned int channels, i;
+	ssize_t bytes;
+
+	TEST_CHECK(snd_pcm_adpcm_block_bytes(2, 2041) == 2048);
+	TEST_CHECK(snd_pcm_adpcm_block_bytes(2, 2040) == 0);
+	TEST_CHECK(snd_pcm_adpcm_block_bytes(0, 505) == 0);
+	TEST_CHECK(snd_pcm_adpcm_block_frames(2, 2048) == 2041);
+	TEST_CHECK(snd_pcm_adpcm_block_frames(2, 2047) == 0);
+	TEST_CHECK(snd_pcm_adpcm_block_frames(1, 0) == 0);
+	TEST_CHECK(snd_pcm_adpcm_block_encode(block, src, 1, 8, NULL) == -EINVAL);
+
+	for (channels = 1; channels <= MAX_CHANNELS; channels++) {
+		unsigned char ref_idx[MAX_CHANNELS] = { 0 };
+		double err = 0;
+
+		for (i = 0; i < FRAMES * channels; i++)
+			src[i] = 8000 * sin(i / channels * 0.03);
+		bytes = snd_pcm_adpcm_block_encode(block, src, channels, FRAMES, NULL);
+		TEST_CHECK(bytes == (ssize_t)(channels * 4 * (1 + GROUPS)));
+		if (bytes < 0)
+			continue;
+		ref_encode(ref_block, src, channels, ref_idx);
+		TEST_CHECK(memcmp(block, ref_block, bytes) == 0);
+		TEST_CHECK(snd_pcm_adpcm_block_decode(out, block, channels,
+						      bytes) == FRAMES);
+		ref_decode(ref_out, block, channels);
+		TEST_CHECK(memcmp(out, ref_out, FRAMES * channels * 2) == 0);
+		/* the step size adapts within the first frames */
+		for (i = 16 * channels; i < FRAMES * channels; i++)
+			err += fabs(out[i] - src[i]);
+		TEST_CHECK(err / ((FRAMES - 16) * channels) < 100);
+
+		/* a broken header is refused */
+		block[2] = 89;
+		TEST_CHECK(snd_pcm_adpcm_block_decode(out, block, channels,
+						      bytes) == -EINVAL);
+		block[2] = 0;
+		block[3] = 1;
+		TEST_CHECK(snd_pcm_adpcm_block_decode(out, block, channels,
+						      bytes) == -EINVAL);
+	}
+}
+
+int main(void)
+{
+	check_kernels("generic", &generic_adpcm_kernels);
+#ifdef PCM_SIMD
+	check_kernels("128-bit", &simd_adpcm_kernels_v128);
+#ifdef PCM_SIMD_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		check_kernels("AVX2", &simd_adpcm_kernels_avx2);
+#endif
+#endif
+	check_helpers();
+	return TEST_EXIT_CODE();
+}
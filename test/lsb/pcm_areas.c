@@ -0,0 +1,693 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "test.h"
+
+static const unsigned int channels_list[] = { 1, 2, 3, 4, 5, 8, 9, 16, 32, 34 };
+static const unsigned int frames_list[] = { 1, 7, 8, 9, 100 };
+
+static unsigned char sample_byte(unsigned int ch, unsigned int frame,
+				 unsigned int byte)
+{
+	return (ch * 31 + frame * 7 + byte * 131 + 1) & 0xff;
+}
+
+static void check_copy(snd_pcm_format_t format, unsigned int channels,
+		       unsigned int frames)
+{
+	unsigned int width = snd_pcm_format_physical_width(format);
+	unsigned int bytes = width / 8;
+	unsigned int offset = 3, total = frames + offset;
+	snd_pcm_channel_area_t planar[34], inter[34];
+	unsigned char *pbuf, *ibuf, *pbuf2;
+	unsigned int c, f, b;
+	int ok;
+
+	pbuf = malloc(channels * total * bytes);
+	pbuf2 = malloc(channels * total * bytes);
+	ibuf = calloc(channels * total, bytes);
+	if (!pbuf || !pbuf2 || !ibuf)
+		goto out;
+	for (c = 0; c < channels; c++) {
+		planar[c].addr = pbuf;
+		planar[c].first = c * total * width;
+		planar[c].step = width;
+		inter[c].addr = ibuf;
+		inter[c].first = c * width;
+		inter[c].step = channels * width;
+		for (f = 0; f < total; f++)
+			for (b = 0; b < bytes; b++)
+				pbuf[(c * total + f) * bytes + b] = sample_byte(c, f, b);
+	}
+
+	/* non-interleaved -> interleaved */
+	ALSA_CHECK(snd_pcm_areas_copy(inter, offset, planar, offset,
+				      channels, frames, format));
+	ok = 1;
+	for (c = 0; c < channels; c++)
+		for (f = offset; f < total; f++)
+			for (b = 0; b < bytes; b++)
+				if (ibuf[(f * channels + c) * bytes + b] != sample_byte(c, f, b))
+					ok = 0;
+	for (b = 0; b < offset * channels * bytes; b++)
+		if (ibuf[b])
+			ok = 0;
+	TEST_CHECK(ok);
+
+	/* interleaved -> non-interleaved */
+	memset(pbuf2, 0, channels * total * bytes);
+	for (c = 0; c < channels; c++)
+		planar[c].addr = pbuf2;
+	ALSA_CHECK(snd_pcm_areas_copy(planar, offset, inter, offset,
+				      channels, frames, format));
+	ok = 1;
+	for (c = 0; c < channels; c++)
+		for (f = 0; f < total; f++)
+			for (b = 0; b < bytes; b++) {
+				unsigned char v = pbuf2[(c * total + f) * bytes + b];
+				if (f < offset ? v != 0 : v != sample_byte(c, f, b))
+					ok = 0;
+			}
+	TEST_CHECK(ok);
+	if (!ok)
+		fprintf(stderr, "format %s, %u channels, %u frames\n",
+			snd_pcm_format_name(format), channels, frames);
+ out:
+	free(pbuf);
+	free(pbuf2);
+	free(ibuf);
+}
+
+static void test_areas_copy(void)
+{
+	static const snd_pcm_format_t formats[] = {
+		SND_PCM_FORMAT_U8,
+		SND_PCM_FORMAT_S16_LE,
+		SND_PCM_FORMAT_S24_3LE,
+		SND_PCM_FORMAT_S32_LE,
+		SND_PCM_FORMAT_FLOAT64_LE,
+	};
+	unsigned int i, c, f;
+
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+		for (c = 0; c < sizeof(channels_list) / sizeof(channels_list[0]); c++)
+			for (f = 0; f < sizeof(frames_list) / sizeof(frames_list[0]); f++)
+				check_copy(formats[i], channels_list[c], frames_list[f]);
+}
+
+static void check_silence(snd_pcm_format_t format, unsigned int channels,
+			  unsigned int first, unsigned int count,
+			  unsigned int frames)
+{
+	unsigned int width = snd_pcm_format_physical_width(format);
+	unsigned int bytes = width / 8;
+	unsigned int offset = 5, total = frames + offset + 1;
+	snd_pcm_channel_area_t areas[34];
+	unsigned char *buf, sil[8];
+	unsigned int c, f, b;
+	int ok = 1;
+
+	buf = malloc(channels * total * bytes);
+	if (!buf)
+		return;
+	memset(buf, 0x55, channels * total * bytes);
+	snd_pcm_format_set_silence(format, sil, 1);
+	for (c = 0; c < channels; c++) {
+		areas[c].addr = buf;
+		areas[c].first = c * width;
+		areas[c].step = channels * width;
+	}
+	ALSA_CHECK(snd_pcm_areas_silence(areas + first, offset, count,
+					 frames, format));
+	for (f = 0; f < total; f++)
+		for (c = 0; c < channels; c++) {
+			int silenced = f >= offset && f < offset + frames &&
+				       c >= first && c < first + count;
+			for (b = 0; b < bytes; b++) {
+				unsigned char v = buf[(f * channels + c) * bytes + b];
+				if (v != (silenced ? sil[b] : 0x55))
+					ok = 0;
+			}
+		}
+	TEST_CHECK(ok);
+	if (!ok)
+		fprintf(stderr, "format %s, channels %u-%u of %u, %u frames\n",
+			snd_pcm_format_name(format), first, first + count - 1,
+			channels, frames);
+	free(buf);
+}
+
+static void test_areas_silence(void)
+{
+	static const snd_pcm_format_t formats[] = {
+		SND_PCM_FORMAT_U8,
+		SND_PCM_FORMAT_S16_LE,
+		SND_PCM_FORMAT_U16_BE,
+		SND_PCM_FORMAT_U24_3LE,
+		SND_PCM_FORMAT_U24_3BE,
+		SND_PCM_FORMAT_U32_LE,
+		SND_PCM_FORMAT_FLOAT_LE,
+		SND_PCM_FORMAT_DSD_U32_BE,
+	};
+	unsigned int i, f;
+
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+		for (f = 0; f < sizeof(frames_list) / sizeof(frames_list[0]); f++) {
+			/* all channels, contiguous */
+			check_silence(formats[i], 2, 0, 2, frames_list[f]);
+			check_silence(formats[i], 34, 0, 34, frames_list[f]);
+			/* runs of channels inside wider frames */
+			check_silence(formats[i], 8, 2, 4, frames_list[f]);
+			check_silence(formats[i], 34, 1, 32, frames_list[f]);
+			/* single strided channel */
+			check_silence(formats[i], 3, 1, 1, frames_list[f]);
+		}
+}
+
+static unsigned int rnd_state = 1;
+
+static unsigned char rnd_byte(void)
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return rnd_state >> 16;
+}
+
+/*
+ * Play frames through a plugin into a raw file and read the file back.
+ * The plugin definition gets a file slave appended.  Interleaved access
+ * lets the plugins use their interleaved kernels, non-interleaved access
+ * with an interleaved slave makes them fall back to the per-sample code.
+ * Returns the number of bytes read back.
+ */
+static size_t play_plugin(const char *plugin, snd_pcm_format_t format,
+			  unsigned int channels, snd_pcm_access_t access,
+			  const unsigned char *data, unsigned int frames,
+			  unsigned char *out, size_t out_size)
+{
+	char path[] = "/tmp/alsa-test-areas-XXXXXX";
+	char conf_text[1024];
+	unsigned int bytes = snd_pcm_format_physical_width(format) / 8;
+	unsigned char *planar = NULL;
+	void *bufs[34];
+	snd_config_t *conf = NULL;
+	snd_input_t *input;
+	snd_pcm_t *pcm;
+	unsigned int c, f;
+	size_t size = 0;
+	FILE *file;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		any_test_failed = 1;
+		return 0;
+	}
+	close(fd);
+	snprintf(conf_text, sizeof(conf_text),
+		 "pcm.t { %s slave.pcm { type file file \"%s\" format raw "
+		 "slave.pcm { type null } } }\n", plugin, path);
+	if (ALSA_CHECK(snd_config_top(&conf)) < 0)
+		goto out;
+	ALSA_CHECK(snd_input_buffer_open(&input, conf_text, strlen(conf_text)));
+	ALSA_CHECK(snd_config_load(conf, input));
+	snd_input_close(input);
+	if (ALSA_CHECK(snd_pcm_open_lconf(&pcm, "t", SND_PCM_STREAM_PLAYBACK, 0, conf)) < 0)
+		goto out;
+	if (ALSA_CHECK(snd_pcm_set_params(pcm, format, access, channels,
+					  48000, 0, 500000)) < 0) {
+		snd_pcm_close(pcm);
+		goto out;
+	}
+	if (access == SND_PCM_ACCESS_RW_INTERLEAVED) {
+		TEST_CHECK(snd_pcm_writei(pcm, data, frames) == (snd_pcm_sframes_t)frames);
+	} else {
+		planar = malloc(frames * channels * bytes);
+		if (!planar) {
+			snd_pcm_close(pcm);
+			goto out;
+		}
+		for (c = 0; c < channels; c++) {
+			bufs[c] = planar + c * frames * bytes;
+			for (f = 0; f < frames; f++)
+				memcpy(planar + (c * frames + f) * bytes,
+				       data + (f * channels + c) * bytes, bytes);
+		}
+		TEST_CHECK(snd_pcm_writen(pcm, bufs, frames) == (snd_pcm_sframes_t)frames);
+	}
+	snd_pcm_close(pcm);
+	file = fopen(path, "rb");
+	if (file) {
+		size = fread(out, 1, out_size, file);
+		fclose(file);
+	}
+ out:
+	unlink(path);
+	free(planar);
+	if (conf)
+		snd_config_delete(conf);
+	return size;
+}
+
+/* the output of a plugin has to be the same with both access types */
+static void check_plugin_data(const char *plugin, snd_pcm_format_t format,
+			      unsigned int channels, unsigned int frames,
+			      size_t out_frame_bytes, const unsigned char *data)
+{
+	size_t out_size = frames * out_frame_bytes;
+	unsigned char *out[2];
+	size_t size[2];
+
+	out[0] = malloc(out_size + 1);
+	out[1] = malloc(out_size + 1);
+	if (!out[0] || !out[1])
+		goto out;
+	size[0] = play_plugin(plugin, format, channels,
+			      SND_PCM_ACCESS_RW_INTERLEAVED,
+			      data, frames, out[0], out_size + 1);
+	size[1] = play_plugin(plugin, format, channels,
+			      SND_PCM_ACCESS_RW_NONINTERLEAVED,
+			      data, frames, out[1], out_size + 1);
+	TEST_CHECK(size[0] == out_size && size[1] == out_size);
+	TEST_CHECK(memcmp(out[0], out[1], out_size) == 0);
+	if (size[0] != out_size || size[1] != out_size ||
+	    memcmp(out[0], out[1], out_size))
+		fprintf(stderr, "%s: %s, %u channels\n", plugin,
+			snd_pcm_format_name(format), channels);
+ out:
+	free(out[0]);
+	free(out[1]);
+}
+
+static void check_plugin(const char *plugin, snd_pcm_format_t format,
+			 unsigned int channels, unsigned int frames,
+			 size_t out_frame_bytes)
+{
+	unsigned int bytes = snd_pcm_format_physical_width(format) / 8;
+	size_t in_size = frames * channels * bytes;
+	unsigned char *data;
+	unsigned int i;
+
+	data = malloc(in_size);
+	if (!data)
+		return;
+	for (i = 0; i < in_size; i++)
+		data[i] = rnd_byte();
+	check_plugin_data(plugin, format, channels, frames, out_frame_bytes, data);
+	free(data);
+}
+
+/* the linear conversion kernels against the conversion labels */
+static void test_linear_kernels(void)
+{
+	static const struct {
+		snd_pcm_format_t src, dst;
+	} pairs[] = {
+		{ SND_PCM_FORMAT_S16, SND_PCM_FORMAT_S32 },
+		{ SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S16 },
+		{ SND_PCM_FORMAT_S16, SND_PCM_FORMAT_S24 },
+		{ SND_PCM_FORMAT_S24, SND_PCM_FORMAT_S16 },
+		{ SND_PCM_FORMAT_S24, SND_PCM_FORMAT_S32 },
+		{ SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S24 },
+		{ SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_S32_LE },
+		{ SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_S24_3LE },
+		{ SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S24_3LE },
+		{ SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_S16_LE },
+	};
+	static const unsigned int channels[] = { 1, 2, 3, 8 };
+	char plugin[128];
+	unsigned int i, c;
+
+	for (i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++) {
+		snprintf(plugin, sizeof(plugin), "type linear slave.format %s",
+			 snd_pcm_format_name(pairs[i].dst));
+		for (c = 0; c < sizeof(channels) / sizeof(channels[0]); c++)
+			check_plugin(plugin, pairs[i].src, channels[c], 1001,
+				     channels[c] * snd_pcm_format_physical_width(pairs[i].dst) / 8);
+	}
+}
+
+/* the bytes of a sample in the order of format */
+static void put_sample(unsigned char *p, const void *val, unsigned int bytes,
+		       snd_pcm_format_t format)
+{
+	unsigned int b;
+
+	if (snd_pcm_format_cpu_endian(format)) {
+		memcpy(p, val, bytes);
+		return;
+	}
+	for (b = 0; b < bytes; b++)
+		p[b] = ((const unsigned char *)val)[bytes - 1 - b];
+}
+
+/*
+ * Floats beyond full scale, the full scale values, -0.0 and denormals,
+ * which the kernels flush to zero and the labels truncate to zero.
+ */
+static void fill_float(unsigned char *data, unsigned int samples,
+		       snd_pcm_format_t format)
+{
+	unsigned int bytes = snd_pcm_format_physical_width(format) / 8;
+	unsigned int i;
+
+	for (i = 0; i < samples; i++) {
+		double v;
+		float f;
+
+		switch (i % 16) {
+		case 0:
+			v = 1.0;
+			break;
+		case 1:
+			v = -1.0;
+			break;
+		case 2:
+			v = -0.0;
+			break;
+		case 3:
+			v = bytes == 4 ? 1e-40 : 1e-310;
+			break;
+		case 4:
+			v = bytes == 4 ? -1e-40 : -1e-310;
+			break;
+		default:
+			v = (rnd_byte() | rnd_byte() << 8 | rnd_byte() << 16) /
+				(double)(1 << 23) - 1.0;
+			v *= 1.25;
+			break;
+		}
+		if (bytes == 4) {
+			f = v;
+			put_sample(data + i * 4, &f, 4, format);
+		} else {
+			put_sample(data + i * 8, &v, 8, format);
+		}
+	}
+}
+
+static const snd_pcm_format_t lfloat_int_formats[] = {
+	SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S16_BE,
+	SND_PCM_FORMAT_U16_LE, SND_PCM_FORMAT_U16_BE,
+	SND_PCM_FORMAT_S24_LE, SND_PCM_FORMAT_S24_BE,
+	SND_PCM_FORMAT_U24_LE, SND_PCM_FORMAT_U24_BE,
+	SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_S32_BE,
+	SND_PCM_FORMAT_U32_LE, SND_PCM_FORMAT_U32_BE,
+	/* no kernel for these, both runs take the labels */
+	SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_U8,
+};
+
+static const snd_pcm_format_t lfloat_float_formats[] = {
+	SND_PCM_FORMAT_FLOAT_LE, SND_PCM_FORMAT_FLOAT_BE,
+	SND_PCM_FORMAT_FLOAT64_LE, SND_PCM_FORMAT_FLOAT64_BE,
+};
+
+/* the int <-> float kernels against the conversion labels */
+static void test_lfloat_kernels(void)
+{
+	static const unsigned int channels[] = { 1, 3 };
+	unsigned int frames = 1001;
+	unsigned char *data;
+	char plugin[128];
+	unsigned int i, j, c, ibytes, fbytes;
+
+	data = malloc(frames * 3 * 8);
+	if (!data)
+		return;
+	for (i = 0; i < sizeof(lfloat_int_formats) / sizeof(lfloat_int_formats[0]); i++)
+		for (j = 0; j < sizeof(lfloat_float_formats) / sizeof(lfloat_float_formats[0]); j++)
+			for (c = 0; c < sizeof(channels) / sizeof(channels[0]); c++) {
+				ibytes = snd_pcm_format_physical_width(lfloat_int_formats[i]) / 8;
+				fbytes = snd_pcm_format_physical_width(lfloat_float_formats[j]) / 8;
+				snprintf(plugin, sizeof(plugin),
+					 "type lfloat slave.format %s",
+					 snd_pcm_format_name(lfloat_float_formats[j]));
+				check_plugin(plugin, lfloat_int_formats[i], channels[c],
+					     frames, channels[c] * fbytes);
+				snprintf(plugin, sizeof(plugin),
+					 "type lfloat slave.format %s",
+					 snd_pcm_format_name(lfloat_int_formats[i]));
+				fill_float(data, frames * channels[c],
+					   lfloat_float_formats[j]);
+				check_plugin_data(plugin, lfloat_float_formats[j],
+						  channels[c], frames,
+						  channels[c] * ibytes, data);
+			}
+	free(data);
+}
+
+/*
+ * The dithered samples are within one LSB of the truncated ones, and
+ * full scale saturates instead of wrapping.
+ */
+static void check_lfloat_dither(snd_pcm_format_t format, snd_pcm_access_t access)
+{
+	unsigned int width = snd_pcm_format_width(format);
+	unsigned int channels = 2, frames = 1001, i, moved = 0;
+	size_t samples = frames * channels;
+	char plugin[128];
+	float *data;
+	int32_t *out;
+	size_t size;
+	int ok = 1;
+
+	data = malloc(samples * sizeof(*data));
+	out = malloc(samples * 4 + 1);
+	if (!data || !out)
+		goto out;
+	fill_float((unsigned char *)data, samples, SND_PCM_FORMAT_FLOAT);
+	snprintf(plugin, sizeof(plugin), "type lfloat dither yes slave.format %s",
+		 snd_pcm_format_name(format));
+	size = play_plugin(plugin, SND_PCM_FORMAT_FLOAT, channels, access,
+			   (unsigned char *)data, frames,
+			   (unsigned char *)out, samples * 4 + 1);
+	TEST_CHECK(size == samples * (width == 16 ? 2 : 4));
+	if (size != samples * (width == 16 ? 2 : 4))
+		goto out;
+	for (i = 0; i < samples; i++) {
+		int32_t s, ref;
+
+		if (data[i] >= 1.0f)
+			ref = 0x7fffffff;
+		else if (data[i] <= -1.0f)
+			ref = INT32_MIN;
+		else
+			ref = (int32_t)(data[i] * (float)0x80000000UL);
+		ref >>= 32 - width;
+		if (width == 16)
+			s = ((int16_t *)out)[i];
+		else
+			s = (int32_t)((uint32_t)out[i] << 8) >> 8;
+		if (s < ref - 1 || s > ref + 1)
+			ok = 0;
+		if (s != ref)
+			moved++;
+	}
+	TEST_CHECK(ok);
+	/* noise of one LSB moves most of the samples */
+	TEST_CHECK(moved > samples / 4);
+	if (!ok || moved <= samples / 4)
+		fprintf(stderr, "dither to %s, %s\n", snd_pcm_format_name(format),
+			snd_pcm_access_name(access));
+ out:
+	free(data);
+	free(out);
+}
+
+static void test_lfloat_dither(void)
+{
+	check_lfloat_dither(SND_PCM_FORMAT_S16, SND_PCM_ACCESS_RW_INTERLEAVED);
+	check_lfloat_dither(SND_PCM_FORMAT_S16, SND_PCM_ACCESS_RW_NONINTERLEAVED);
+	check_lfloat_dither(SND_PCM_FORMAT_S24, SND_PCM_ACCESS_RW_INTERLEAVED);
+	check_lfloat_dither(SND_PCM_FORMAT_S24, SND_PCM_ACCESS_RW_NONINTERLEAVED);
+}
+
+/* one ttable entry, gain from client channel to slave channel */
+struct route_entry {
+	unsigned int src, dst;
+	float gain;
+};
+
+static int32_t route_get32(const unsigned char *p, snd_pcm_format_t format)
+{
+	if (format == SND_PCM_FORMAT_S16)
+		return (int32_t)((uint32_t)*(const uint16_t *)p << 16);
+	return *(const int32_t *)p;
+}
+
+static void route_put32(unsigned char *p, snd_pcm_format_t format,
+			int32_t sample)
+{
+	if (format == SND_PCM_FORMAT_S16)
+		*(uint16_t *)p = (uint32_t)sample >> 16;
+	else
+		*(int32_t *)p = sample;
+}
+
+/*
+ * The sums of snd_pcm_route_convert1_many() with the float ttable:
+ * the 32-bit samples times the gains added in client channel order,
+ * then rounded and saturated.  A single source with full gain is copied.
+ */
+static void route_reference(const struct route_entry *tt, unsigned int ntt,
+			    snd_pcm_format_t src_format, unsigned int src_channels,
+			    snd_pcm_format_t dst_format, unsigned int dst_channels,
+			    const unsigned char *data, unsigned int frames,
+			    unsigned char *out)
+{
+	unsigned int src_bytes = snd_pcm_format_physical_width(src_format) / 8;
+	unsigned int dst_bytes = snd_pcm_format_physical_width(dst_format) / 8;
+	unsigned int d, s, f, k, n, last;
+	int32_t sample;
+	float sum;
+
+	for (d = 0; d < dst_channels; d++) {
+		n = 0;
+		last = 0;
+		for (k = 0; k < ntt; k++) {
+			if (tt[k].dst == d) {
+				n++;
+				last = k;
+			}
+		}
+		for (f = 0; f < frames; f++) {
+			const unsigned char *frame = data + f * src_channels * src_bytes;
+
+			if (n == 0) {
+				sample = 0;
+			} else if (n == 1 && tt[last].gain == 1.0f) {
+				sample = route_get32(frame + tt[last].src * src_bytes,
+						     src_format);
+			} else {
+				sum = 0.0f;
+				for (s = 0; s < src_channels; s++) {
+					for (k = 0; k < ntt; k++) {
+						if (tt[k].dst != d || tt[k].src != s)
+							continue;
+						sum += (float)route_get32(frame + s * src_bytes,
+									  src_format) * tt[k].gain;
+					}
+				}
+				sum = rintf(sum);
+				if (sum >= 2147483648.0f)
+					sample = 0x7fffffff;
+				else if (sum < -2147483648.0f)
+					sample = (int32_t)0x80000000;
+				else
+					sample = sum;
+			}
+			route_put32(out + (f * dst_channels + d) * dst_bytes,
+				    dst_format, sample);
+		}
+	}
+}
+
+static void check_route(const struct route_entry *tt, unsigned int ntt,
+			snd_pcm_format_t src_format, unsigned int src_channels,
+			snd_pcm_format_t dst_format, unsigned int dst_channels)
+{
+	unsigned int src_bytes = snd_pcm_format_physical_width(src_format) / 8;
+	unsigned int dst_bytes = snd_pcm_format_physical_width(dst_format) / 8;
+	unsigned int frames = 1001;
+	size_t in_size = frames * src_channels * src_bytes;
+	size_t out_size = frames * dst_channels * dst_bytes;
+	unsigned char *data, *out, *ref;
+	char plugin[1024];
+	int len;
+	size_t size;
+	unsigned int i;
+
+	len = snprintf(plugin, sizeof(plugin),
+		       "type route slave.format %s slave.channels %u ttable {",
+		       snd_pcm_format_name(dst_format), dst_channels);
+	for (i = 0; i < ntt; i++)
+		len += snprintf(plugin + len, sizeof(plugin) - len,
+				" %u.%u %.9g", tt[i].src, tt[i].dst, tt[i].gain);
+	snprintf(plugin + len, sizeof(plugin) - len, " }");
+
+	/* the permutation and copy kernels against the per-sample code */
+	check_plugin(plugin, src_format, src_channels, frames,
+		     dst_channels * dst_bytes);
+
+	/* the matrix mixer against the sums of the generic code */
+	data = malloc(in_size);
+	out = malloc(out_size + 1);
+	ref = malloc(out_size);
+	if (!data || !out || !ref)
+		goto out;
+	for (i = 0; i < in_size; i++)
+		data[i] = rnd_byte();
+	size = play_plugin(plugin, src_format, src_channels,
+			   SND_PCM_ACCESS_RW_INTERLEAVED,
+			   data, frames, out, out_size + 1);
+	route_reference(tt, ntt, src_format, src_channels,
+			dst_format, dst_channels, data, frames, ref);
+	TEST_CHECK(size == out_size);
+	TEST_CHECK(memcmp(out, ref, out_size) == 0);
+	if (size != out_size || memcmp(out, ref, out_size))
+		fprintf(stderr, "%s: %s, %u channels\n", plugin,
+			snd_pcm_format_name(src_format), src_channels);
+ out:
+	free(data);
+	free(out);
+	free(ref);
+}
+
+/* the route matrix kernels against the ttable semantics */
+static void test_route_kernels(void)
+{
+	static const struct route_entry swap[] = {
+		{ 0, 1, 1.0f }, { 1, 0, 1.0f },
+	};
+	static const struct route_entry downmix[] = {
+		{ 0, 0, 0.5f }, { 1, 0, 0.5f },
+	};
+	static const struct route_entry surround[] = {
+		{ 0, 0, 1.0f }, { 1, 1, 1.0f },
+		{ 2, 0, 0.7071f }, { 2, 1, 0.7071f },
+		{ 3, 0, 0.25f }, { 3, 1, 0.25f },
+		{ 4, 0, 0.5f }, { 5, 1, 0.5f },
+	};
+	static const struct route_entry gain[] = {
+		{ 0, 0, 1.7f }, { 1, 0, -0.3f }, { 2, 0, 0.9f },
+		{ 1, 1, 0.333f }, { 2, 2, 1.0f }, { 0, 3, 1.0f },
+		{ 0, 4, 2.5f }, { 1, 4, 2.5f }, { 2, 4, 2.5f },
+	};
+	static const struct {
+		const struct route_entry *tt;
+		unsigned int ntt, src_channels, dst_channels;
+	} cases[] = {
+		{ swap, 2, 2, 2 },
+		{ swap, 2, 2, 3 },
+		{ downmix, 2, 2, 1 },
+		{ surround, 8, 6, 2 },
+		{ gain, 9, 3, 6 },
+	};
+	static const struct {
+		snd_pcm_format_t src, dst;
+	} formats[] = {
+		{ SND_PCM_FORMAT_S16, SND_PCM_FORMAT_S16 },
+		{ SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S32 },
+		{ SND_PCM_FORMAT_S16, SND_PCM_FORMAT_S32 },
+		{ SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S16 },
+	};
+	unsigned int i, j;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+		for (j = 0; j < sizeof(formats) / sizeof(formats[0]); j++)
+			check_route(cases[i].tt, cases[i].ntt,
+				    formats[j].src, cases[i].src_channels,
+				    formats[j].dst, cases[i].dst_channels);
+}
+
+int main(void)
+{
+	test_areas_copy();
+	test_areas_silence();
+	test_linear_kernels();
+	test_lfloat_kernels();
+	test_lfloat_dither();
+	test_route_kernels();
+	return TEST_EXIT_CODE();
+}
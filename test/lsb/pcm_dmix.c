@@ -0,0 +1,399 @@
+/*
+ * The dmix mixing loops are built into this test from the library
+ * sources, the vector kernels are compared with the generic code and
+ * the lockless_mix staging rings are driven against a fake slave.
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <sys/sem.h>
+#include <sys/wait.h>
+#include "pcm_direct.h"
+#include "bswap.h"
+#include "test.h"
+
+#include "pcm_dmix_generic.c"
+#include "pcm_dmix_lockless.c"
+
+/* replaces the library helper, selects the kernels to test */
+static unsigned int simd_features;
+
+unsigned int snd_pcm_simd_features(void)
+{
+	return simd_features;
+}
+
+#define FRAMES		203	/* not a multiple of the vector lanes */
+#define CHANNELS	2
+
+static unsigned int rnd_state = 1;
+
+static unsigned int rnd(void)
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return rnd_state >> 1;
+}
+
+static void fill(void *buf, size_t bytes, int loud)
+{
+	unsigned char *p = buf;
+	size_t i;
+
+	for (i = 0; i < bytes; i++)
+		p[i] = rnd();
+	/* some silent and some full scale samples */
+	if (!loud)
+		memset(p, 0, bytes / 4);
+	else
+		memset(p + bytes / 2, 0x7f, bytes / 8);
+}
+
+/* the reference, the plain C loops for the native formats */
+static void select_generic(snd_pcm_direct_t *dmix)
+{
+	dmix->u.dmix.mix_areas_16 = generic_mix_areas_16_native;
+	dmix->u.dmix.mix_areas_32 = generic_mix_areas_32_native;
+	dmix->u.dmix.remix_areas_16 = generic_remix_areas_16_native;
+	dmix->u.dmix.remix_areas_32 = generic_remix_areas_32_native;
+	dmix->u.dmix.mix_areas_24 = generic_mix_areas_24;
+	dmix->u.dmix.remix_areas_24 = generic_remix_areas_24;
+}
+
+/* mix three streams to the first channel and remix one */
+static void run_mix(snd_pcm_direct_t *dmix, unsigned int width,
+		    void *dst, void *src, void *sum, int remix)
+{
+	size_t dst_step = CHANNELS * width, src_step = width;
+	size_t sum_step = CHANNELS * sizeof(int);
+	unsigned int i;
+
+	for (i = 0; i < 3; i++) {
+		char *s = (char *)src + i * FRAMES * width;
+		int rm = remix && i == 2;
+		switch (width) {
+		case 2:
+			(rm ? dmix->u.dmix.remix_areas_16 : dmix->u.dmix.mix_areas_16)
+				(FRAMES, dst, (void *)s, sum, dst_step, src_step, sum_step);
+			break;
+		case 3:
+			(rm ? dmix->u.dmix.remix_areas_24 : dmix->u.dmix.mix_areas_24)
+				(FRAMES, dst, (void *)s, sum, dst_step, src_step, sum_step);
+			break;
+		case 4:
+			(rm ? dmix->u.dmix.remix_areas_32 : dmix->u.dmix.mix_areas_32)
+				(FRAMES, dst, (void *)s, sum, dst_step, src_step, sum_step);
+			break;
+		}
+	}
+}
+
+static void check_mix(snd_pcm_format_t format, unsigned int features)
+{
+	unsigned int width = snd_pcm_format_physical_width(format) / 8;
+	size_t dst_bytes = FRAMES * CHANNELS * width;
+	size_t sum_bytes = FRAMES * CHANNELS * sizeof(int);
+	unsigned char src[3 * FRAMES * 4];
+	unsigned char dst[2][FRAMES * CHANNELS * 4];
+	int sum[2][FRAMES * CHANNELS];
+	snd_pcm_direct_share_t shm;
+	snd_pcm_direct_t dmix;
+	int remix, loud, k;
+
+	memset(&shm, 0, sizeof(shm));
+	memset(&dmix, 0, sizeof(dmix));
+	shm.s.format = format;
+	dmix.shmptr = &shm;
+	for (remix = 0; remix < 2; remix++) {
+		for (loud = 0; loud < 2; loud++) {
+			fill(src, sizeof(src), loud);
+			fill(dst[0], dst_bytes, 0);
+			fill(sum[0], sum_bytes, 0);
+			memcpy(dst[1], dst[0], dst_bytes);
+			memcpy(sum[1], sum[0], sum_bytes);
+			for (k = 0; k < 2; k++) {
+				simd_features = features;
+				if (k)
+					generic_mix_select_callbacks(&dmix);
+				else
+					select_generic(&dmix);
+				run_mix(&dmix, width, dst[k], src, sum[k], remix);
+			}
+			TEST_CHECK(memcmp(dst[0], dst[1], dst_bytes) == 0);
+			TEST_CHECK(memcmp(sum[0], sum[1], sum_bytes) == 0);
+		}
+	}
+}
+
+static void test_mix(void)
+{
+	static const snd_pcm_format_t formats[] = {
+		SND_PCM_FORMAT_S16,
+		SND_PCM_FORMAT_S32,
+#ifdef SNDRV_LITTLE_ENDIAN
+		SND_PCM_FORMAT_S24_3LE,
+#endif
+	};
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(formats); i++) {
+#ifdef PCM_SIMD
+		check_mix(formats[i], SND_PCM_SIMD_VEC128);
+#endif
+#ifdef PCM_SIMD_AVX2
+		if (__builtin_cpu_supports("avx2"))
+			check_mix(formats[i], SND_PCM_SIMD_VEC128 | SND_PCM_SIMD_AVX2);
+#endif
+	}
+}
+
+/* float_sum: mix, mix and remix with the given knee */
+static void run_float(snd_pcm_direct_t *dmix, unsigned int width,
+		      void *dst, void *src, float *sum, float knee)
+{
+	size_t dst_step = CHANNELS * width, src_step = width;
+	size_t sum_step = CHANNELS * sizeof(float);
+	unsigned int i;
+
+	for (i = 0; i < 3; i++)
+		(i == 2 ? dmix->u.dmix.remix_areas_float : dmix->u.dmix.mix_areas_float)
+			(FRAMES, dst, (char *)src + i * FRAMES * width, sum,
+			 dst_step, src_step, sum_step, knee);
+}
+
+static void check_float(snd_pcm_format_t format, unsigned int features,
+			float knee)
+{
+	unsigned int width = snd_pcm_format_physical_width(format) / 8;
+	size_t dst_bytes = FRAMES * CHANNELS * width;
+	unsigned char src[3 * FRAMES * 4];
+	unsigned char dst[2][FRAMES * CHANNELS * 4];
+	float sum[2][FRAMES * CHANNELS];
+	snd_pcm_direct_share_t shm;
+	snd_pcm_direct_t dmix;
+	int k;
+
+	memset(&shm, 0, sizeof(shm));
+	memset(&dmix, 0, sizeof(dmix));
+	shm.s.format = format;
+	dmix.shmptr = &shm;
+	fill(src, sizeof(src), 1);
+	memset(dst, 0, sizeof(dst));
+	memset(sum, 0, sizeof(sum));
+	for (k = 0; k < 2; k++) {
+		simd_features = k ? features : 0;
+		float_mix_select_callbacks(&dmix);
+		if (!k) {
+			dmix.u.dmix.mix_areas_float = width == 2 ?
+				generic_mix_areas_float_16_native :
+				generic_mix_areas_float_32_native;
+			dmix.u.dmix.remix_areas_float = width == 2 ?
+				generic_remix_areas_float_16_native :
+				generic_remix_areas_float_32_native;
+		}
+		run_float(&dmix, width, dst[k], src, sum[k], knee);
+	}
+	TEST_CHECK(memcmp(dst[0], dst[1], dst_bytes) == 0);
+	TEST_CHECK(memcmp(sum[0], sum[1], sizeof(sum[0])) == 0);
+}
+
+/* a single stream passes unchanged with the default knee */
+static void check_float_single(float knee)
+{
+	short src[FRAMES], dst[FRAMES];
+	float sum[FRAMES];
+	int i, changed = 0, above = 0;
+
+	fill(src, sizeof(src), 1);
+	src[0] = -32768;
+	src[1] = 32767;
+	memset(dst, 0, sizeof(dst));
+	generic_mix_areas_float_16_native(FRAMES, dst, src, sum,
+					  sizeof(short), sizeof(short),
+					  sizeof(float), knee);
+	for (i = 0; i < FRAMES; i++) {
+		if (dst[i] != src[i])
+			changed++;
+		/* never louder than the input */
+		TEST_CHECK(abs(dst[i]) <= abs(src[i]));
+		if (abs(src[i]) > knee * 32768)
+			above++;
+	}
+	if (knee >= 1.0f)
+		TEST_CHECK(changed == 0);
+	else
+		TEST_CHECK(changed > 0 && changed <= above);
+}
+
+static void test_float(void)
+{
+	unsigned int i;
+
+	check_float_single(1.0f);
+	check_float_single(0.9f);
+	for (i = 0; i < 2; i++) {
+		snd_pcm_format_t format = i ? SND_PCM_FORMAT_S32 : SND_PCM_FORMAT_S16;
+#ifdef PCM_SIMD
+		check_float(format, SND_PCM_SIMD_VEC128, 1.0f);
+		check_float(format, SND_PCM_SIMD_VEC128, 0.9f);
+#endif
+#ifdef PCM_SIMD_AVX2
+		if (__builtin_cpu_supports("avx2")) {
+			check_float(format, SND_PCM_SIMD_VEC128 | SND_PCM_SIMD_AVX2, 1.0f);
+			check_float(format, SND_PCM_SIMD_VEC128 | SND_PCM_SIMD_AVX2, 0.9f);
+		}
+#endif
+	}
+}
+
+#define RING_FRAMES	256
+#define RING_PERIOD	64
+
+static snd_pcm_direct_share_t ring_shm;
+static snd_pcm_t ring_spcm;
+static volatile snd_pcm_uframes_t ring_hw_ptr;
+static short ring_slave[RING_FRAMES * CHANNELS];
+static snd_pcm_channel_area_t ring_slave_areas[CHANNELS];
+
+static void ring_setup(void)
+{
+	unsigned int chn;
+
+	ring_shm.s.channels = CHANNELS;
+	ring_shm.s.buffer_size = RING_FRAMES;
+	ring_shm.s.format = SND_PCM_FORMAT_S16;
+	for (chn = 0; chn < CHANNELS; chn++) {
+		ring_slave_areas[chn].addr = ring_slave;
+		ring_slave_areas[chn].first = chn * 16;
+		ring_slave_areas[chn].step = CHANNELS * 16;
+	}
+	ring_spcm.running_areas = ring_slave_areas;
+	ring_spcm.hw.ptr = &ring_hw_ptr;
+}
+
+static void ring_init(snd_pcm_direct_t *dmix, key_t key)
+{
+	memset(dmix, 0, sizeof(*dmix));
+	dmix->shmptr = &ring_shm;
+	dmix->spcm = &ring_spcm;
+	dmix->ipc_key = key;
+	dmix->ipc_perm = 0600;
+	dmix->ipc_gid = -1;
+	dmix->interleaved = 1;
+	dmix->channels = CHANNELS;
+	dmix->slave_buffer_size = RING_FRAMES;
+	dmix->slave_period_size = RING_PERIOD;
+	dmix->slave_boundary = RING_FRAMES * 1024;
+	dmix->u.dmix.shmid_mix = -1;
+	dmix->u.dmix.semid_mix = -1;
+	dmix->u.dmix.lockless = (void *) -1;
+}
+
+static int ring_open(snd_pcm_direct_t *dmix, key_t key)
+{
+	ring_init(dmix, key);
+	return lockless_init(dmix);
+}
+
+/* stage frames [from, to) of buf and publish them */
+static void ring_write(snd_pcm_direct_t *dmix, short *buf,
+		       snd_pcm_uframes_t from, snd_pcm_uframes_t to)
+{
+	snd_pcm_channel_area_t areas[CHANNELS];
+	unsigned int chn;
+
+	for (chn = 0; chn < CHANNELS; chn++) {
+		areas[chn].addr = buf;
+		areas[chn].first = chn * 16;
+		areas[chn].step = CHANNELS * 16;
+	}
+	lockless_write_areas(dmix, areas, from, from, to - from);
+	lockless_publish(dmix, from, to);
+}
+
+/* the slave buffer must hold the saturated sum of the published frames */
+static int ring_check(short *a, snd_pcm_uframes_t a_end,
+		      short *b, snd_pcm_uframes_t b_end)
+{
+	unsigned int i;
+	int sum;
+
+	for (i = 0; i < RING_FRAMES * CHANNELS; i++) {
+		sum = 0;
+		if (i < a_end * CHANNELS)
+			sum += a[i];
+		if (i < b_end * CHANNELS)
+			sum += b[i];
+		if (sum > 0x7fff)
+			sum = 0x7fff;
+		else if (sum < -0x8000)
+			sum = -0x8000;
+		if (ring_slave[i] != sum)
+			return 0;
+	}
+	return 1;
+}
+
+static void test_lockless(void)
+{
+	static short a[RING_FRAMES * CHANNELS], b[RING_FRAMES * CHANNELS];
+	snd_pcm_direct_t dmix[LOCKLESS_SLOTS + 1], child;
+	key_t key = 0x44000000 | (getpid() & 0xffff) << 4;
+	unsigned int i;
+	pid_t pid;
+	int err, status;
+
+	ring_setup();
+	fill(a, sizeof(a), 1);
+	fill(b, sizeof(b), 1);
+	ALSA_CHECK(ring_open(&dmix[0], key));
+	ALSA_CHECK(ring_open(&dmix[1], key));
+
+	/* two clients mixed, then one of them takes some frames back */
+	ring_write(&dmix[0], a, 0, 200);
+	ring_write(&dmix[1], b, 0, 150);
+	TEST_CHECK(ring_check(a, 200, b, 150));
+	lockless_rewind(&dmix[1], 100);
+	TEST_CHECK(ring_check(a, 200, b, 100));
+
+	/* a client dies holding its slot and the mixer role */
+	pid = fork();
+	if (pid == 0) {
+		if (ring_open(&child, key) < 0)
+			_exit(1);
+		child.u.dmix.lockless->mixer = child.u.dmix.slot -
+					       child.u.dmix.lockless->slots + 1;
+		_exit(0);
+	}
+	TEST_CHECK(pid > 0 && waitpid(pid, &status, 0) == pid &&
+		   WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	/* the role is taken over when the mixer has not rendered since */
+	ring_write(&dmix[0], a, 200, 220);
+	TEST_CHECK(ring_check(a, 200, b, 100));
+	ring_write(&dmix[0], a, 220, 240);
+	TEST_CHECK(ring_check(a, 240, b, 100));
+	/* and its slot is free again */
+	for (i = 2; i < LOCKLESS_SLOTS; i++)
+		ALSA_CHECK(ring_open(&dmix[i], key));
+	ring_init(&dmix[i], key);
+	ALSA_CHECK(shm_mix_create_or_connect(&dmix[i]));
+	err = lockless_claim_slot(&dmix[i]);
+	TEST_CHECK(err == -EBUSY);
+	shm_mix_discard(&dmix[i]);
+
+	/* the last client removes the shared memory and the semaphores */
+	for (i = 0; i < LOCKLESS_SLOTS; i++)
+		lockless_done(&dmix[i]);
+	TEST_CHECK(shmget(key + 2, 0, 0) < 0 && errno == ENOENT);
+	TEST_CHECK(semget(key + 2, 0, 0) < 0 && errno == ENOENT);
+}
+
+int main(void)
+{
+	test_mix();
+	test_float();
+	test_lockless();
+	return TEST_EXIT_CODE();
+}
@@ -0,0 +1,208 @@
+/*
+ * The drift compensation of the multi plugin is built into this test
+ * from the library sources; the resampler is compared with the exact
+ * interpolation of a ramp and the control loop is run against a slave
+ * on a simulated clock.
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pcm_local.h"
+#include "test.h"
+#include "pcm_multi_drift.c"
+
+#define CHANNELS	2
+#define RAMP_FRAMES	4096
+#define PERIOD		1024
+
+static void drift_init(snd_pcm_multi_drift_t *drift, snd_pcm_format_t format,
+		       double *prev)
+{
+	memset(drift, 0, sizeof(*drift));
+	memset(prev, 0, 2 * CHANNELS * sizeof(double));
+	drift->format = format;
+	drift->prev = prev;
+	drift->cur = prev + CHANNELS;
+	drift->pos = 1.0;
+	drift->ratio = 1.0;
+}
+
+static void init_areas(snd_pcm_channel_area_t *areas, void *buf,
+		       unsigned int bits)
+{
+	unsigned int c;
+
+	for (c = 0; c < CHANNELS; c++) {
+		areas[c].addr = buf;
+		areas[c].first = c * bits;
+		areas[c].step = CHANNELS * bits;
+	}
+}
+
+/*
+ * A ramp resampled in uneven chunks: the output frame k lies at the
+ * source position k * step - 1, the frame before the first one is zero.
+ * Linear interpolation of a ramp is exact, so only the float rounding
+ * is left.
+ */
+static void check_resample_float(double step)
+{
+	static float src[RAMP_FRAMES * CHANNELS], dst[RAMP_FRAMES * 2 * CHANNELS];
+	snd_pcm_channel_area_t src_areas[CHANNELS], dst_areas[CHANNELS];
+	snd_pcm_multi_drift_t drift;
+	double prev[2 * CHANNELS];
+	snd_pcm_uframes_t src_pos = 0, dst_pos = 0, used, chunk = 1;
+	unsigned int i;
+
+	for (i = 0; i < RAMP_FRAMES; i++) {
+		src[i * CHANNELS] = i * 0.5f;
+		src[i * CHANNELS + 1] = -(float)i;
+	}
+	drift_init(&drift, SND_PCM_FORMAT_FLOAT, prev);
+	init_areas(src_areas, src, 32);
+	init_areas(dst_areas, dst, 32);
+	while (src_pos < RAMP_FRAMES) {
+		snd_pcm_uframes_t src_frames = RAMP_FRAMES - src_pos;
+		snd_pcm_uframes_t dst_frames = chunk;
+
+		if (dst_pos + dst_frames > RAMP_FRAMES * 2)
+			break;
+		dst_pos += multi_drift_resample(&drift, CHANNELS, step,
+						src_areas, src_pos, src_frames,
+						dst_areas, dst_pos, dst_frames,
+						&used);
+		src_pos += used;
+		chunk = chunk * 7 % 61 + 1;
+	}
+	TEST_CHECK(src_pos == RAMP_FRAMES);
+	/* every source frame is used once, the output follows the step */
+	TEST_CHECK(fabs(dst_pos * step - RAMP_FRAMES) <= step + 1e-6);
+	for (i = 0; i < dst_pos; i++) {
+		double pos = i * step - 1.0;
+
+		if (pos < 0)
+			pos = 0;
+		if (fabs(dst[i * CHANNELS] - pos * 0.5) > 1e-3 ||
+		    fabs(dst[i * CHANNELS + 1] + pos) > 2e-3)
+			break;
+	}
+	TEST_CHECK(i == dst_pos);
+	if (i != dst_pos)
+		fprintf(stderr, "step %f, frame %u: %f %f\n", step, i,
+			dst[i * CHANNELS], dst[i * CHANNELS + 1]);
+}
+
+/* at the ratio 1 the integer formats come out unchanged, one frame late */
+static void check_resample_identity(snd_pcm_format_t format)
+{
+	static int32_t src[RAMP_FRAMES * CHANNELS], dst[RAMP_FRAMES * CHANNELS];
+	snd_pcm_channel_area_t src_areas[CHANNELS], dst_areas[CHANNELS];
+	snd_pcm_multi_drift_t drift;
+	double prev[2 * CHANNELS];
+	unsigned int bits = snd_pcm_format_physical_width(format);
+	unsigned int i, samples = RAMP_FRAMES * CHANNELS;
+	snd_pcm_uframes_t frames, used;
+	unsigned int state = 1;
+
+	for (i = 0; i < samples; i++) {
+		state = state * 1103515245 + 12345;
+		if (bits == 16)
+			((int16_t *)src)[i] = state >> 16;
+		else
+			src[i] = state;
+	}
+	drift_init(&drift, format, prev);
+	init_areas(src_areas, src, bits);
+	init_areas(dst_areas, dst, bits);
+	frames = multi_drift_resample(&drift, CHANNELS, 1.0,
+				      src_areas, 0, RAMP_FRAMES,
+				      dst_areas, 0, RAMP_FRAMES, &used);
+	TEST_CHECK(frames == RAMP_FRAMES);
+	TEST_CHECK(used == RAMP_FRAMES);
+	for (i = 0; i < CHANNELS; i++) {
+		if (bits == 16)
+			TEST_CHECK(((int16_t *)dst)[i] == 0);
+		else
+			TEST_CHECK(dst[i] == 0);
+	}
+	for (i = CHANNELS; i < samples; i++) {
+		if (bits == 16 ? ((int16_t *)dst)[i] != ((int16_t *)src)[i - CHANNELS] :
+		    dst[i] != src[i - CHANNELS])
+			break;
+	}
+	TEST_CHECK(i == samples);
+}
+
+/*
+ * A slave running at clock times the rate of the master, with the clock
+ * measurement not settled yet (ratio 1).  Per period of the master the
+ * playback slave gets period * ratio frames and plays period * clock of
+ * them; the capture slave records period * clock frames and the multi
+ * takes period * ratio of them.  The loop has to find the clock and keep
+ * the fill error bounded.
+ */
+static void check_control(snd_pcm_stream_t stream, double clock)
+{
+	snd_pcm_multi_drift_t drift;
+	double prev[2 * CHANNELS];
+	double fill = 0, max_fill = 0;
+	unsigned int i;
+
+	drift_init(&drift, SND_PCM_FORMAT_S16, prev);
+	for (i = 0; i < 20000; i++) {
+		double error;
+
+		if (stream == SND_PCM_STREAM_PLAYBACK)
+			fill += PERIOD * drift.ratio - PERIOD * clock;
+		else
+			fill += PERIOD * clock - PERIOD * drift.ratio;
+		/* the error is measured in whole frames */
+		error = floor(fill);
+		multi_drift_control(&drift, stream, error, 1.0, PERIOD);
+		if (fabs(fill) > max_fill)
+			max_fill = fabs(fill);
+	}
+	TEST_CHECK(fabs(drift.ratio - clock) < 1e-5);
+	TEST_CHECK(fabs(fill) < PERIOD / 8);
+	TEST_CHECK(max_fill < 2 * PERIOD);
+	if (any_test_failed)
+		fprintf(stderr, "%s clock %f: ratio %f, fill %f, max %f\n",
+			snd_pcm_stream_name(stream), clock, drift.ratio,
+			fill, max_fill);
+}
+
+/* a measured ratio out of range is not trusted */
+static void check_control_range(void)
+{
+	snd_pcm_multi_drift_t drift;
+	double prev[2 * CHANNELS];
+
+	drift_init(&drift, SND_PCM_FORMAT_S16, prev);
+	multi_drift_control(&drift, SND_PCM_STREAM_PLAYBACK, 0, 1.002, PERIOD);
+	TEST_CHECK(drift.ratio == 1.002);
+	multi_drift_control(&drift, SND_PCM_STREAM_PLAYBACK, 0, 1.5, PERIOD);
+	TEST_CHECK(drift.ratio == 1.0);
+	/* and the correction is clamped */
+	multi_drift_control(&drift, SND_PCM_STREAM_CAPTURE, 1e9, 1.0, PERIOD);
+	TEST_CHECK(drift.ratio == 1.0 + MULTI_DRIFT_MAX);
+}
+
+int main(void)
+{
+	static const double clocks[] = { 1.0003, 0.9997, 1.002, 0.998 };
+	unsigned int i;
+
+	check_resample_float(1.0);
+	check_resample_float(1.0 / 1.003);
+	check_resample_float(1.0 / 0.997);
+	check_resample_float(1.0 / 1.005);
+	check_resample_identity(SND_PCM_FORMAT_S16);
+	check_resample_identity(SND_PCM_FORMAT_S32);
+	for (i = 0; i < sizeof(clocks) / sizeof(clocks[0]); i++) {
+		check_control(SND_PCM_STREAM_PLAYBACK, clocks[i]);
+		check_control(SND_PCM_STREAM_CAPTURE, clocks[i]);
+	}
+	check_control_range();
+	return TEST_EXIT_CODE();
+}
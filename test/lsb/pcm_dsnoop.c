@@ -0,0 +1,257 @@
+/*
+ * The zero copy helpers of dsnoop are built into this test from the
+ * library sources and run against a fake slave ring: the mmap access
+ * offered for the slave layouts, the alignment of the client pointers,
+ * the xrun threshold and the read-only mapping.  The options of one
+ * direct plugin are refused by the others.
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <sys/sem.h>
+#include <sys/wait.h>
+#include "pcm_direct.h"
+#include "test.h"
+#include "pcm_dsnoop_zero_copy.c"
+
+#define SLAVE_CHANNELS	4
+#define SLAVE_FRAMES	4096
+#define SLAVE_PERIOD	1024
+#define SLAVE_SHARED_BLOCKS	2	/* the blocks at the ring addr */
+
+static snd_pcm_t slave;
+static snd_pcm_channel_area_t slave_areas[SLAVE_CHANNELS];
+static snd_pcm_channel_info_t slave_channels[SLAVE_CHANNELS];
+static short *ring;
+
+/*
+ * an interleaved S16 ring, or one block per channel, each with an own addr
+ * or with SLAVE_SHARED_BLOCKS all at the ring addr
+ */
+static void slave_setup(int interleaved)
+{
+	unsigned int chn;
+
+	for (chn = 0; chn < SLAVE_CHANNELS; chn++) {
+		snd_pcm_channel_area_t *a = &slave_areas[chn];
+
+		if (interleaved == SLAVE_SHARED_BLOCKS) {
+			a->addr = ring;
+			a->first = chn * SLAVE_FRAMES * 16;
+			a->step = 16;
+		} else if (interleaved) {
+			a->addr = ring;
+			a->first = chn * 16;
+			a->step = SLAVE_CHANNELS * 16;
+		} else {
+			a->addr = ring + chn * SLAVE_FRAMES;
+			a->first = 0;
+			a->step = 16;
+		}
+		slave_channels[chn].channel = chn;
+		slave_channels[chn].type = SND_PCM_AREA_MMAP;
+		slave_channels[chn].addr = a->addr;
+		slave_channels[chn].first = a->first;
+		slave_channels[chn].step = a->step;
+	}
+	slave.channels = SLAVE_CHANNELS;
+	slave.sample_bits = 16;
+	slave.buffer_size = SLAVE_FRAMES;
+	slave.running_areas = slave_areas;
+	slave.mmap_channels = slave_channels;
+}
+
+static void snoop_init(snd_pcm_direct_t *dsnoop, unsigned int channels,
+		       unsigned int *bindings)
+{
+	memset(dsnoop, 0, sizeof(*dsnoop));
+	dsnoop->spcm = &slave;
+	dsnoop->channels = channels;
+	dsnoop->bindings = bindings;
+	dsnoop->slave_buffer_size = SLAVE_FRAMES;
+	dsnoop->slave_period_size = SLAVE_PERIOD;
+	dsnoop->u.dsnoop.zero_copy = 1;
+}
+
+static void check_access(int interleaved, unsigned int channels,
+			 unsigned int *bindings, int mmap_interleaved,
+			 int mmap_noninterleaved)
+{
+	snd_pcm_direct_t dsnoop;
+	snd_pcm_access_mask_t mask;
+
+	slave_setup(interleaved);
+	snoop_init(&dsnoop, channels, bindings);
+	snoop_zero_copy_access(&dsnoop, &mask);
+	/* the read calls copy into the user buffer, so they always work */
+	TEST_CHECK(snd_pcm_access_mask_test(&mask, SND_PCM_ACCESS_RW_INTERLEAVED));
+	TEST_CHECK(snd_pcm_access_mask_test(&mask, SND_PCM_ACCESS_RW_NONINTERLEAVED));
+	TEST_CHECK(!!snd_pcm_access_mask_test(&mask, SND_PCM_ACCESS_MMAP_INTERLEAVED) ==
+		   mmap_interleaved);
+	TEST_CHECK(!!snd_pcm_access_mask_test(&mask, SND_PCM_ACCESS_MMAP_NONINTERLEAVED) ==
+		   mmap_noninterleaved);
+	TEST_CHECK(!snd_pcm_access_mask_test(&mask, SND_PCM_ACCESS_MMAP_COMPLEX));
+}
+
+static void test_access(void)
+{
+	unsigned int all[] = { 0, 1, 2, 3 };
+	unsigned int swapped[] = { 1, 0, 2, 3 };
+	unsigned int pair[] = { 3, 1 };
+
+	/* the interleaved ring can be shared only as it is */
+	check_access(1, 4, NULL, 1, 0);
+	check_access(1, 4, all, 1, 0);
+	check_access(1, 4, swapped, 0, 0);
+	check_access(1, 2, pair, 0, 0);
+	check_access(1, 2, all, 0, 0);
+	/* the channel blocks can be picked in any order */
+	check_access(0, 4, NULL, 0, 1);
+	check_access(0, 4, swapped, 0, 1);
+	check_access(0, 2, pair, 0, 1);
+}
+
+/* the client offset of a frame is the slave offset */
+static void test_align(void)
+{
+	snd_pcm_direct_t dsnoop;
+	snd_pcm_t pcm;
+
+	slave_setup(1);
+	snoop_init(&dsnoop, SLAVE_CHANNELS, NULL);
+	memset(&pcm, 0, sizeof(pcm));
+	pcm.private_data = &dsnoop;
+	pcm.buffer_size = SLAVE_FRAMES;
+	dsnoop.hw_ptr = 5;
+	dsnoop.appl_ptr = 17;
+	dsnoop.slave_hw_ptr = 7 * SLAVE_FRAMES + 1234;
+	snoop_zero_copy_align(&pcm);
+	TEST_CHECK(dsnoop.hw_ptr == 1234);
+	TEST_CHECK(dsnoop.appl_ptr == 1234);
+
+	/* the last slave period is being overwritten by the hardware */
+	TEST_CHECK(snoop_zero_copy_stop_threshold(&pcm, SLAVE_FRAMES) ==
+		   SLAVE_FRAMES - SLAVE_PERIOD);
+	TEST_CHECK(snoop_zero_copy_stop_threshold(&pcm, SLAVE_FRAMES * 4) ==
+		   SLAVE_FRAMES - SLAVE_PERIOD);
+	TEST_CHECK(snoop_zero_copy_stop_threshold(&pcm, SLAVE_PERIOD) ==
+		   SLAVE_PERIOD);
+}
+
+/* write one sample in a child, returns the signal it died from */
+static int write_in_child(short *addr)
+{
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	if (pid == 0) {
+		*(volatile short *)addr = 1;
+		_exit(0);
+	}
+	if (pid < 0 || waitpid(pid, &status, 0) != pid)
+		return -1;
+	return WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+}
+
+static void test_protect(int interleaved)
+{
+	snd_pcm_direct_t dsnoop;
+	unsigned int chn;
+
+	slave_setup(interleaved);
+	snoop_init(&dsnoop, SLAVE_CHANNELS, NULL);
+	ring[0] = 42;
+	snoop_zero_copy_protect(&dsnoop, PROT_READ);
+	TEST_CHECK(ring[0] == 42);
+	for (chn = 0; chn < SLAVE_CHANNELS; chn++) {
+		short *last = (short *)slave_areas[chn].addr +
+			(slave_areas[chn].first + slave_areas[chn].step *
+			 (SLAVE_FRAMES - 1)) / 16;
+		short *first = (short *)slave_areas[chn].addr +
+			slave_areas[chn].first / 16;
+		TEST_CHECK(write_in_child(first) == SIGSEGV);
+		TEST_CHECK(write_in_child(last) == SIGSEGV);
+	}
+	snoop_zero_copy_protect(&dsnoop, PROT_READ | PROT_WRITE);
+	TEST_CHECK(write_in_child(ring) == 0);
+	ring[0] = 0;
+}
+
+static char error_text[256];
+
+static void error_handler(const char *file, int line, const char *function,
+			  int err, const char *fmt, ...)
+{
+	va_list arg;
+
+	va_start(arg, fmt);
+	vsnprintf(error_text, sizeof(error_text), fmt, arg);
+	va_end(arg);
+}
+
+/* the plugin is refused with the option before the slave is opened */
+static void check_option(const char *type, const char *option,
+			 const char *error)
+{
+	char conf_text[256];
+	snd_config_t *conf;
+	snd_input_t *input;
+	snd_pcm_t *pcm;
+	int err;
+
+	snprintf(conf_text, sizeof(conf_text),
+		 "pcm.t { type %s ipc_key 5678 slave.pcm null %s }\n",
+		 type, option);
+	if (ALSA_CHECK(snd_config_top(&conf)) < 0)
+		return;
+	ALSA_CHECK(snd_input_buffer_open(&input, conf_text, strlen(conf_text)));
+	ALSA_CHECK(snd_config_load(conf, input));
+	snd_input_close(input);
+	error_text[0] = '\0';
+	snd_lib_error_set_handler(error_handler);
+	err = snd_pcm_open_lconf(&pcm, "t", SND_PCM_STREAM_CAPTURE, 0, conf);
+	snd_lib_error_set_handler(NULL);
+	TEST_CHECK(err == -EINVAL);
+	if (err >= 0)
+		snd_pcm_close(pcm);
+	if (!strstr(error_text, error)) {
+		fprintf(stderr, "%s %s: \"%s\"\n", type, option, error_text);
+		any_test_failed = 1;
+	}
+	snd_config_delete(conf);
+}
+
+static void test_options(void)
+{
+	check_option("dmix", "zero_copy 1", "zero_copy is supported by the dsnoop plugin only");
+	check_option("dshare", "zero_copy 1", "zero_copy is supported by the dsnoop plugin only");
+	check_option("dsnoop", "lockless_mix 1", "lockless_mix is supported by the dmix plugin only");
+	check_option("dsnoop", "float_sum 1", "float_sum is supported by the dmix plugin only");
+	check_option("dshare", "soft_limit 0.5", "soft_limit is supported by the dmix plugin only");
+}
+
+int main(void)
+{
+	size_t size = SLAVE_FRAMES * SLAVE_CHANNELS * sizeof(short);
+
+	ring = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	test_access();
+	test_align();
+	test_protect(1);
+	test_protect(0);
+	test_protect(SLAVE_SHARED_BLOCKS);
+	test_options();
+	munmap(ring, size);
+	return TEST_EXIT_CODE();
+}
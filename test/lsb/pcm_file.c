@@ -0,0 +1,288 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "test.h"
+
+#define CHANNELS	2
+#define FRAMES		100003
+#define WAV_HEADER	44
+
+static unsigned int rnd_state = 1;
+
+static unsigned char rnd_byte(void)
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return rnd_state >> 16;
+}
+
+static snd_pcm_t *open_file(const char *options, const char *path)
+{
+	char conf_text[1024];
+	snd_config_t *conf = NULL;
+	snd_input_t *input;
+	snd_pcm_t *pcm = NULL;
+
+	snprintf(conf_text, sizeof(conf_text),
+		 "pcm.t { type file file \"%s\" %s "
+		 "slave.pcm { type null } }\n", path, options);
+	if (ALSA_CHECK(snd_config_top(&conf)) < 0)
+		return NULL;
+	ALSA_CHECK(snd_input_buffer_open(&input, conf_text, strlen(conf_text)));
+	ALSA_CHECK(snd_config_load(conf, input));
+	snd_input_close(input);
+	if (ALSA_CHECK(snd_pcm_open_lconf(&pcm, "t", SND_PCM_STREAM_PLAYBACK, 0, conf)) < 0)
+		goto out;
+	if (ALSA_CHECK(snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16,
+					  SND_PCM_ACCESS_RW_INTERLEAVED,
+					  CHANNELS, 48000, 0, 500000)) < 0) {
+		snd_pcm_close(pcm);
+		pcm = NULL;
+	}
+ out:
+	snd_config_delete(conf);
+	return pcm;
+}
+
+/* write in uneven pieces, so that the chunks of the writer are split */
+static void write_frames(snd_pcm_t *pcm, const short *data, unsigned int frames)
+{
+	unsigned int pos, n = 1;
+
+	for (pos = 0; pos < frames; pos += n) {
+		n = n * 5 % 4093 + 1;
+		if (n > frames - pos)
+			n = frames - pos;
+		TEST_CHECK(snd_pcm_writei(pcm, data + pos * CHANNELS, n) ==
+			   (snd_pcm_sframes_t)n);
+	}
+}
+
+static long file_size(const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) < 0)
+		return -1;
+	return st.st_size;
+}
+
+static unsigned char *read_file(const char *path, long *size)
+{
+	unsigned char *buf;
+	FILE *file;
+
+	*size = file_size(path);
+	if (*size < 0)
+		return NULL;
+	buf = malloc(*size + 1);
+	file = fopen(path, "rb");
+	if (!buf || !file ||
+	    fread(buf, 1, *size, file) != (size_t)*size) {
+		free(buf);
+		buf = NULL;
+	}
+	if (file)
+		fclose(file);
+	return buf;
+}
+
+static unsigned int le32(const unsigned char *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+/*
+ * The writer thread and the mapped window have to give the same file as
+ * the synchronous writes; drain waits for the writer, so everything is
+ * on disk before the close.
+ */
+static void check_output(const char *format, const char *mode,
+			 const char *dump_text, const short *data)
+{
+	char path[2][32] = {
+		"/tmp/alsa-test-file-XXXXXX",
+		"/tmp/alsa-test-file-XXXXXX",
+	};
+	long header = strcmp(format, "wav") ? 0 : WAV_HEADER;
+	long bytes = FRAMES * CHANNELS * 2;
+	char options[64];
+	unsigned char *out[2] = { NULL, NULL };
+	long size[2];
+	snd_output_t *output;
+	snd_pcm_t *pcm;
+	char *dump;
+	int i, fd;
+
+	for (i = 0; i < 2; i++) {
+		fd = mkstemp(path[i]);
+		if (fd < 0) {
+			perror("mkstemp");
+			any_test_failed = 1;
+			return;
+		}
+		close(fd);
+	}
+
+	snprintf(options, sizeof(options), "format %s", format);
+	pcm = open_file(options, path[0]);
+	if (!pcm)
+		goto out;
+	write_frames(pcm, data, FRAMES);
+	snd_pcm_close(pcm);
+
+	snprintf(options, sizeof(options), "format %s %s", format, mode);
+	pcm = open_file(options, path[1]);
+	if (!pcm)
+		goto out;
+	write_frames(pcm, data, FRAMES);
+	ALSA_CHECK(snd_pcm_drain(pcm));
+	if (!strstr(mode, "mmap_window"))
+		TEST_CHECK(file_size(path[1]) == header + bytes);
+	ALSA_CHECK(snd_output_buffer_open(&output));
+	snd_pcm_dump(pcm, output);
+	snd_output_buffer_string(output, &dump);
+	TEST_CHECK(strstr(dump, dump_text) != NULL);
+	snd_output_close(output);
+	snd_pcm_close(pcm);
+
+	for (i = 0; i < 2; i++)
+		out[i] = read_file(path[i], &size[i]);
+	TEST_CHECK(out[0] && out[1]);
+	if (!out[0] || !out[1])
+		goto out;
+	/* the preallocated space is cut */
+	TEST_CHECK(size[0] == header + bytes);
+	TEST_CHECK(size[1] == size[0]);
+	if (size[1] == size[0])
+		TEST_CHECK(memcmp(out[0], out[1], size[0]) == 0);
+	TEST_CHECK(memcmp(out[1] + header, data, bytes) == 0);
+	if (header) {
+		TEST_CHECK(le32(out[1] + 4) == bytes + 0x24);
+		TEST_CHECK(le32(out[1] + 0x28) == bytes);
+	}
+	if (any_test_failed)
+		fprintf(stderr, "format %s %s\n", format, mode);
+ out:
+	for (i = 0; i < 2; i++) {
+		free(out[i]);
+		unlink(path[i]);
+	}
+}
+
+/*
+ * with checkpoints the header is valid while the file is still open, also
+ * when the parameters are set again in the middle of the stream
+ */
+static void check_checkpoint(const char *mode, const short *data)
+{
+	char path[] = "/tmp/alsa-test-file-XXXXXX";
+	char options[64];
+	unsigned char header[WAV_HEADER];
+	unsigned int len;
+	snd_pcm_t *pcm;
+	FILE *file;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		any_test_failed = 1;
+		return;
+	}
+	close(fd);
+	snprintf(options, sizeof(options), "format wav checkpoint 1 %s", mode);
+	pcm = open_file(options, path);
+	if (!pcm)
+		goto out;
+	/* a bit more than two seconds */
+	write_frames(pcm, data, FRAMES / 2);
+	ALSA_CHECK(snd_pcm_drain(pcm));
+	ALSA_CHECK(snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16,
+				      SND_PCM_ACCESS_RW_INTERLEAVED,
+				      CHANNELS, 48000, 0, 500000));
+	write_frames(pcm, data + FRAMES / 2 * CHANNELS, FRAMES - FRAMES / 2);
+	ALSA_CHECK(snd_pcm_drain(pcm));
+	file = fopen(path, "rb");
+	TEST_CHECK(file != NULL);
+	if (file) {
+		TEST_CHECK(fread(header, 1, sizeof(header), file) == sizeof(header));
+		fclose(file);
+		len = le32(header + 0x28);
+		TEST_CHECK(len >= 2 * 48000 * CHANNELS * 2);
+		TEST_CHECK(len <= FRAMES * CHANNELS * 2);
+		TEST_CHECK(le32(header + 4) == len + 0x24);
+	}
+	snd_pcm_close(pcm);
+ out:
+	unlink(path);
+}
+
+/*
+ * A file which cannot grow any more, as on a full disk: the mapped
+ * writes have to fail the stream instead of raising SIGBUS.
+ */
+static void check_full(const short *data)
+{
+	char path[] = "/tmp/alsa-test-file-XXXXXX";
+	struct rlimit old, limit;
+	snd_pcm_t *pcm;
+	unsigned int i, n = 4096;
+	snd_pcm_sframes_t r = 0;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		any_test_failed = 1;
+		return;
+	}
+	close(fd);
+	pcm = open_file("mmap_window 1", path);
+	if (!pcm)
+		goto out;
+	signal(SIGXFSZ, SIG_IGN);
+	getrlimit(RLIMIT_FSIZE, &old);
+	limit = old;
+	limit.rlim_cur = 3 << 19;
+	setrlimit(RLIMIT_FSIZE, &limit);
+	/* up to 4 MB */
+	for (i = 0; i < 256; i++) {
+		r = snd_pcm_writei(pcm, data, n);
+		if (r < 0)
+			break;
+	}
+	TEST_CHECK(r < 0);
+	setrlimit(RLIMIT_FSIZE, &old);
+	signal(SIGXFSZ, SIG_DFL);
+	snd_pcm_close(pcm);
+	TEST_CHECK(file_size(path) <= 3 << 19);
+ out:
+	unlink(path);
+}
+
+int main(void)
+{
+	short *data;
+	unsigned int i;
+
+	data = malloc(FRAMES * CHANNELS * sizeof(*data));
+	if (!data)
+		return 1;
+	for (i = 0; i < FRAMES * CHANNELS * sizeof(*data); i++)
+		((unsigned char *)data)[i] = rnd_byte();
+	check_output("raw", "async_buffer 1", " 0 dropped", data);
+	check_output("wav", "async_buffer 1",
+		     "Writer thread: ring 1048576 bytes", data);
+	check_output("raw", "mmap_window 1", "Mapped window: 1048576 bytes", data);
+	check_output("wav", "mmap_window 1 async_buffer 2",
+		     "Writer thread: ring 2097152 bytes", data);
+	check_checkpoint("", data);
+	check_checkpoint("mmap_window 1", data);
+	check_checkpoint("async_buffer 1", data);
+	check_full(data);
+	free(data);
+	return TEST_EXIT_CODE();
+}
@@ -0,0 +1,179 @@
+/*
+ * The table driven mu-Law and A-Law block helpers against the bit
+ * manipulation coders they replaced, for every 16 bit sample and every
+ * code.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+#include <alsa/pcm_plugin.h>
+
+/* the coders of pcm_mulaw.c and pcm_alaw.c before the tables */
+
+static int ulaw_val_seg(int val)
+{
+	int r = 0;
+	val >>= 7;
+	if (val & 0xf0) {
+		val >>= 4;
+		r += 4;
+	}
+	if (val & 0x0c) {
+		val >>= 2;
+		r += 2;
+	}
+	if (val & 0x02)
+		r += 1;
+	return r;
+}
+
+static unsigned char ref_s16_to_ulaw(int pcm_val)
+{
+	int mask;
+	int seg;
+	unsigned char uval;
+
+	if (pcm_val < 0) {
+		pcm_val = 0x84 - pcm_val;
+		mask = 0x7f;
+	} else {
+		pcm_val += 0x84;
+		mask = 0xff;
+	}
+	if (pcm_val > 0x7fff)
+		pcm_val = 0x7fff;
+	seg = ulaw_val_seg(pcm_val);
+	uval = (seg << 4) | ((pcm_val >> (seg + 3)) & 0x0f);
+	return uval ^ mask;
+}
+
+static int ref_ulaw_to_s16(unsigned char u_val)
+{
+	int t;
+
+	u_val = ~u_val;
+	t = ((u_val & 0x0f) << 3) + 0x84;
+	t <<= (u_val & 0x70) >> 4;
+	return ((u_val & 0x80) ? (0x84 - t) : (t - 0x84));
+}
+
+static int alaw_val_seg(int val)
+{
+	int r = 1;
+	val >>= 8;
+	if (val & 0xf0) {
+		val >>= 4;
+		r += 4;
+	}
+	if (val & 0x0c) {
+		val >>= 2;
+		r += 2;
+	}
+	if (val & 0x02)
+		r += 1;
+	return r;
+}
+
+static unsigned char ref_s16_to_alaw(int pcm_val)
+{
+	int mask;
+	int seg;
+	unsigned char aval;
+
+	if (pcm_val >= 0) {
+		mask = 0xD5;
+	} else {
+		mask = 0x55;
+		pcm_val = -pcm_val;
+		if (pcm_val > 0x7fff)
+			pcm_val = 0x7fff;
+	}
+	if (pcm_val < 256)
+		aval = pcm_val >> 4;
+	else {
+		seg = alaw_val_seg(pcm_val);
+		aval = (seg << 4) | ((pcm_val >> (seg + 3)) & 0x0f);
+	}
+	return aval ^ mask;
+}
+
+static int ref_alaw_to_s16(unsigned char a_val)
+{
+	int t;
+	int seg;
+
+	a_val ^= 0x55;
+	t = a_val & 0x7f;
+	if (t < 16)
+		t = (t << 4) + 8;
+	else {
+		seg = (t >> 4) & 0x07;
+		t = ((t & 0x0f) << 4) + 0x108;
+		t <<= seg - 1;
+	}
+	return ((a_val & 0x80) ? t : -t);
+}
+
+#define SAMPLES		65536
+
+static void check_codec(const char *name,
+			void (*encode)(unsigned char *, const int16_t *, unsigned int),
+			void (*decode)(int16_t *, const unsigned char *, unsigned int),
+			unsigned char (*ref_encode)(int),
+			int (*ref_decode)(unsigned char))
+{
+	int16_t *samples, *linear;
+	unsigned char *codes;
+	unsigned int i, fails = 0;
+
+	samples = malloc(SAMPLES * sizeof(*samples));
+	linear = malloc(SAMPLES * sizeof(*linear));
+	codes = malloc(SAMPLES);
+	if (!samples || !linear || !codes)
+		goto out;
+	for (i = 0; i < SAMPLES; i++)
+		samples[i] = i - 32768;
+
+	encode(codes, samples, SAMPLES);
+	for (i = 0; i < SAMPLES; i++) {
+		if (codes[i] != ref_encode(samples[i]) && fails++ < 4)
+			fprintf(stderr, "%s: %d encoded to %02x, expected %02x\n",
+				name, samples[i], codes[i], ref_encode(samples[i]));
+	}
+	/* odd lengths and offsets for the tail after the unrolled loop */
+	memset(codes, 0, SAMPLES);
+	encode(codes + 1, samples + 1, SAMPLES - 2);
+	TEST_CHECK(codes[0] == 0 && codes[SAMPLES - 1] == 0);
+	for (i = 1; i < SAMPLES - 1; i++)
+		if (codes[i] != ref_encode(samples[i]) && fails++ < 4)
+			fprintf(stderr, "%s: %d encoded to %02x at an odd offset\n",
+				name, samples[i], codes[i]);
+
+	for (i = 0; i < SAMPLES; i++)
+		codes[i] = i;
+	decode(linear, codes, SAMPLES);
+	for (i = 0; i < SAMPLES; i++) {
+		if (linear[i] != ref_decode(codes[i]) && fails++ < 4)
+			fprintf(stderr, "%s: %02x decoded to %d, expected %d\n",
+				name, codes[i], linear[i], ref_decode(codes[i]));
+	}
+	memset(linear, 0, SAMPLES * sizeof(*linear));
+	decode(linear + 3, codes + 3, 7);
+	TEST_CHECK(linear[2] == 0 && linear[10] == 0);
+	for (i = 3; i < 10; i++)
+		TEST_CHECK(linear[i] == ref_decode(codes[i]));
+	TEST_CHECK(fails == 0);
+ out:
+	free(samples);
+	free(linear);
+	free(codes);
+}
+
+int main(void)
+{
+	check_codec("mu-Law", snd_pcm_s16_to_mulaw, snd_pcm_mulaw_to_s16,
+		    ref_s16_to_ulaw, ref_ulaw_to_s16);
+	check_codec("A-Law", snd_pcm_s16_to_alaw, snd_pcm_alaw_to_s16,
+		    ref_s16_to_alaw, ref_alaw_to_s16);
+	return TEST_EXIT_CODE();
+}
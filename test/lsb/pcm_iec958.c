@@ -0,0 +1,308 @@
+/*
+ * The S16 and S32 kernels of the iec958 plugin against a subframe coder
+ * written here from the IEC 60958 layout and against the generic label
+ * path of the plugin (S24_LE): both byte orders, interleaved and
+ * per-channel buffers, written in pieces across the 192 frame blocks.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "test.h"
+
+#define CHANNELS	3
+#define FRAMES		1000
+#define RATE		48000
+
+/* explicit word length and rate, so that all sample formats send the same */
+static const unsigned char status[24] = { 0x04, 0x82, 0x00, 0x02, 0x0b };
+
+static unsigned int rnd_state = 1;
+
+static unsigned int rnd32(void)
+{
+	unsigned int val;
+
+	rnd_state = rnd_state * 1103515245 + 12345;
+	val = rnd_state >> 16;
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return val << 16 | rnd_state >> 16;
+}
+
+static int le_host(void)
+{
+	const unsigned short one = 1;
+
+	return *(const unsigned char *)&one;
+}
+
+static unsigned int bswap32(unsigned int val)
+{
+	return val >> 24 | (val >> 8 & 0xff00) | (val << 8 & 0xff0000) | val << 24;
+}
+
+/* one subframe of the 32 bit sample val at frame of the stream */
+static unsigned int subframe(int val, unsigned int frame, unsigned int channel)
+{
+	unsigned int pos = frame % 192, sub, bit, parity = 0;
+
+	if (channel)
+		sub = 0x04;
+	else
+		sub = pos ? 0x02 : 0x08;
+	sub |= (unsigned int)val >> 8 << 4;
+	if (status[pos / 8] & (1 << (pos % 8)))
+		sub |= 1U << 30;
+	for (bit = 4; bit < 31; bit++)
+		parity ^= sub >> bit & 1;
+	return sub | parity << 31;
+}
+
+static snd_pcm_t *open_iec958(const char *sformat, const char *path,
+			      snd_pcm_format_t format, snd_pcm_access_t access)
+{
+	char conf_text[512];
+	snd_config_t *conf = NULL;
+	snd_input_t *input;
+	snd_pcm_t *pcm = NULL;
+
+	snprintf(conf_text, sizeof(conf_text),
+		 "pcm.t { type iec958 "
+		 "status [ 0x04 0x82 0x00 0x02 0x0b ] "
+		 "slave { format %s pcm { type file file \"%s\" format raw "
+		 "slave.pcm { type null } } } }\n", sformat, path);
+	if (ALSA_CHECK(snd_config_top(&conf)) < 0)
+		return NULL;
+	ALSA_CHECK(snd_input_buffer_open(&input, conf_text, strlen(conf_text)));
+	ALSA_CHECK(snd_config_load(conf, input));
+	snd_input_close(input);
+	if (ALSA_CHECK(snd_pcm_open_lconf(&pcm, "t", SND_PCM_STREAM_PLAYBACK, 0, conf)) < 0)
+		goto out;
+	if (ALSA_CHECK(snd_pcm_set_params(pcm, format, access, CHANNELS,
+					  RATE, 0, 100000)) < 0) {
+		snd_pcm_close(pcm);
+		pcm = NULL;
+	}
+ out:
+	snd_config_delete(conf);
+	return pcm;
+}
+
+/*
+ * Writes the interleaved samples of width bytes in pieces which end
+ * before, on and after the block boundaries, and reads back the file.
+ */
+static void *play(const char *sformat, snd_pcm_format_t format,
+		  snd_pcm_access_t access, const void *data, unsigned int width,
+		  long *size)
+{
+	char path[] = "/tmp/alsa-test-iec958-XXXXXX";
+	static const unsigned int sizes[] = { 1, 190, 1, 193, 37, 383, 7 };
+	unsigned char *planes = NULL, *out = NULL;
+	const unsigned char *bytes = data;
+	unsigned int pos, n, i, chn;
+	snd_pcm_t *pcm;
+	struct stat st;
+	FILE *file;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		any_test_failed = 1;
+		return NULL;
+	}
+	close(fd);
+	pcm = open_iec958(sformat, path, format, access);
+	if (!pcm)
+		goto out;
+	if (access == SND_PCM_ACCESS_RW_NONINTERLEAVED) {
+		planes = malloc(FRAMES * CHANNELS * width);
+		if (!planes)
+			goto out_close;
+		for (i = 0; i < FRAMES; i++)
+			for (chn = 0; chn < CHANNELS; chn++)
+				memcpy(planes + (chn * FRAMES + i) * width,
+				       bytes + (i * CHANNELS + chn) * width, width);
+	}
+	for (pos = 0, i = 0; pos < FRAMES; pos += n, i++) {
+		n = sizes[i % (sizeof(sizes) / sizeof(sizes[0]))];
+		if (n > FRAMES - pos)
+			n = FRAMES - pos;
+		if (planes) {
+			void *bufs[CHANNELS];
+
+			for (chn = 0; chn < CHANNELS; chn++)
+				bufs[chn] = planes + (chn * FRAMES + pos) * width;
+			TEST_CHECK(snd_pcm_writen(pcm, bufs, n) == (snd_pcm_sframes_t)n);
+		} else {
+			TEST_CHECK(snd_pcm_writei(pcm, bytes + pos * CHANNELS * width, n) ==
+				   (snd_pcm_sframes_t)n);
+		}
+	}
+	ALSA_CHECK(snd_pcm_drain(pcm));
+ out_close:
+	snd_pcm_close(pcm);
+	free(planes);
+	if (stat(path, &st) < 0)
+		goto out;
+	*size = st.st_size;
+	out = malloc(*size + 1);
+	file = fopen(path, "rb");
+	if (!out || !file || fread(out, 1, *size, file) != (size_t)*size) {
+		free(out);
+		out = NULL;
+	}
+	if (file)
+		fclose(file);
+ out:
+	unlink(path);
+	TEST_CHECK(out != NULL);
+	return out;
+}
+
+static unsigned int get_word(const unsigned char *p, int big_endian)
+{
+	if (big_endian)
+		return (unsigned int)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+	return (unsigned int)p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0];
+}
+
+static void check_encode(int s16, int big_endian, snd_pcm_access_t access)
+{
+	const char *sformat = big_endian ? "IEC958_SUBFRAME_BE" : "IEC958_SUBFRAME_LE";
+	unsigned int width = s16 ? 2 : 4;
+	int32_t *samples, *s24;
+	unsigned char *data, *out[2];
+	long size[2];
+	unsigned int i, fails = 0;
+
+	samples = malloc(FRAMES * CHANNELS * sizeof(*samples));
+	s24 = malloc(FRAMES * CHANNELS * sizeof(*s24));
+	data = malloc(FRAMES * CHANNELS * width);
+	if (!samples || !s24 || !data)
+		goto out_free;
+	for (i = 0; i < FRAMES * CHANNELS; i++) {
+		unsigned int val = rnd32();
+
+		if (s16) {
+			((int16_t *)data)[i] = val;
+			samples[i] = (int16_t)val * 65536;
+		} else {
+			((int32_t *)data)[i] = val;
+			samples[i] = val;
+		}
+		/* the same sample in the low 24 bits, for the label path */
+		s24[i] = samples[i] >> 8;
+	}
+
+	out[0] = play(sformat, s16 ? SND_PCM_FORMAT_S16 : SND_PCM_FORMAT_S32,
+		      access, data, width, &size[0]);
+	out[1] = play(sformat, SND_PCM_FORMAT_S24, access, s24, 4, &size[1]);
+	if (!out[0] || !out[1])
+		goto out;
+	TEST_CHECK(size[0] == FRAMES * CHANNELS * 4);
+	TEST_CHECK(size[1] == size[0]);
+	if (size[0] != FRAMES * CHANNELS * 4 || size[1] != size[0])
+		goto out;
+	TEST_CHECK(memcmp(out[0], out[1], size[0]) == 0);
+	for (i = 0; i < FRAMES * CHANNELS; i++) {
+		unsigned int frame = i / CHANNELS, chn = i % CHANNELS;
+
+		if (get_word(out[0] + i * 4, big_endian) !=
+		    subframe(samples[i], frame, chn) && fails++ < 4)
+			fprintf(stderr, "frame %u channel %u: %08x, expected %08x\n",
+				frame, chn, get_word(out[0] + i * 4, big_endian),
+				subframe(samples[i], frame, chn));
+	}
+	TEST_CHECK(fails == 0);
+ out:
+	if (any_test_failed)
+		fprintf(stderr, "encode %s %s %s\n", s16 ? "S16" : "S32", sformat,
+			snd_pcm_access_name(access));
+	free(out[0]);
+	free(out[1]);
+ out_free:
+	free(samples);
+	free(s24);
+	free(data);
+}
+
+/* the preamble, status, validity and parity bits are all dropped */
+static void check_decode(int s16, int big_endian, snd_pcm_access_t access)
+{
+	snd_pcm_format_t format = big_endian ? SND_PCM_FORMAT_IEC958_SUBFRAME_BE :
+		SND_PCM_FORMAT_IEC958_SUBFRAME_LE;
+	const char *sformat[2] = { s16 ? "S16" : "S32", "S24_LE" };
+	uint32_t *subframes;
+	unsigned char *out[2] = { NULL, NULL };
+	long size[2];
+	unsigned int i, k, fails = 0;
+
+	subframes = malloc(FRAMES * CHANNELS * sizeof(*subframes));
+	if (!subframes)
+		return;
+	for (i = 0; i < FRAMES * CHANNELS; i++) {
+		subframes[i] = rnd32();
+		if (big_endian == le_host())
+			subframes[i] = bswap32(subframes[i]);
+	}
+	for (k = 0; k < 2; k++) {
+		out[k] = play(sformat[k], format, access, subframes, 4, &size[k]);
+		if (!out[k])
+			goto out;
+	}
+	TEST_CHECK(size[0] == FRAMES * CHANNELS * (s16 ? 2 : 4));
+	TEST_CHECK(size[1] == FRAMES * CHANNELS * 4);
+	if (size[0] != FRAMES * CHANNELS * (s16 ? 2 : 4) ||
+	    size[1] != FRAMES * CHANNELS * 4)
+		goto out;
+	for (i = 0; i < FRAMES * CHANNELS; i++) {
+		uint32_t sub = subframes[i];
+		int32_t val, expected;
+		unsigned int label;
+
+		if (big_endian == le_host())
+			sub = bswap32(sub);
+		expected = (int32_t)((sub & 0x0ffffff0) << 4);
+		/* the label path keeps the top 24 bits */
+		label = get_word(out[1] + i * 4, 0) & 0xffffff;
+		if (label != ((unsigned int)expected >> 8) && fails++ < 4)
+			fprintf(stderr, "sample %u of %08x: label %x\n", i, sub, label);
+		if (s16) {
+			expected >>= 16;
+			val = ((int16_t *)out[0])[i];
+		} else {
+			val = ((int32_t *)out[0])[i];
+		}
+		if (val != expected && fails++ < 4)
+			fprintf(stderr, "sample %u of %08x: %x, expected %x\n",
+				i, sub, val, expected);
+	}
+	TEST_CHECK(fails == 0);
+ out:
+	if (any_test_failed)
+		fprintf(stderr, "decode %s %s\n", sformat[0],
+			snd_pcm_access_name(access));
+	free(out[0]);
+	free(out[1]);
+	free(subframes);
+}
+
+int main(void)
+{
+	static const snd_pcm_access_t access[] = {
+		SND_PCM_ACCESS_RW_INTERLEAVED,
+		SND_PCM_ACCESS_RW_NONINTERLEAVED,
+	};
+	int s16, big_endian;
+	unsigned int i;
+
+	for (i = 0; i < 2; i++)
+		for (s16 = 0; s16 < 2; s16++)
+			for (big_endian = 0; big_endian < 2; big_endian++) {
+				check_encode(s16, big_endian, access[i]);
+				check_decode(s16, big_endian, access[i]);
+			}
+	return TEST_EXIT_CODE();
+}
@@ -0,0 +1,319 @@
+/*
+ * The execution graph of the LADSPA plugin: duplicated plugins in a row
+ * share one stage, and the output with worker threads and with blocks
+ * is the same as the serial one and as a reference computed here.
+ * The plugin index finds a plugin added right after the last scan.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "test.h"
+
+#define CHANNELS	4
+#define FRAMES		4000
+#define RATE		48000
+
+/* gain, gain, mix of channels 0 and 1, gain: three stages */
+#define TEST_GAIN(gain)							\
+	"{ label test_gain policy duplicate "				\
+	"  input { bindings.0 In controls.Gain " gain " } "		\
+	"  output.bindings.0 Out } "
+
+/* gain, gain, mix of channels 0 and 1, gain: three stages */
+#define TEST_PLUGINS							\
+	"plugins [ "							\
+	TEST_GAIN("0.5")						\
+	TEST_GAIN("2.0")						\
+	"{ label test_mix policy none "					\
+	"  input.bindings { 0 InL 1 InR } "				\
+	"  output.bindings { 0 OutL 1 OutR } } "			\
+	TEST_GAIN("0.25")						\
+	"] "
+
+static float samples[FRAMES * CHANNELS];
+static float planes[CHANNELS][FRAMES];
+static float reference[FRAMES * CHANNELS];
+
+static unsigned int rnd_state = 1;
+
+static float rnd_sample(void)
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return (int)(rnd_state >> 16) / 32768.0f - 1.0f;
+}
+
+/* the plugins of ladspa_test.so, one sample at a time */
+static void make_reference(void)
+{
+	float state[3][CHANNELS] = { { 0 } };
+	static const float gain[3] = { 0.5f, 2.0f, 0.25f };
+	unsigned int i, c, k;
+
+	for (i = 0; i < FRAMES; i++) {
+		float *in = &samples[i * CHANNELS];
+		float *out = &reference[i * CHANNELS];
+		float val[CHANNELS], a, b;
+
+		for (c = 0; c < CHANNELS; c++) {
+			val[c] = in[c];
+			for (k = 0; k < 2; k++) {
+				state[k][c] = state[k][c] * 0.5f + val[c] * gain[k];
+				val[c] = state[k][c];
+			}
+		}
+		a = val[0];
+		b = val[1];
+		val[0] = a + b * 0.5f;
+		val[1] = b - a * 0.5f;
+		for (c = 0; c < CHANNELS; c++) {
+			state[2][c] = state[2][c] * 0.5f + val[c] * gain[2];
+			out[c] = state[2][c];
+		}
+	}
+}
+
+static int open_ladspa(snd_pcm_t **pcmp, const char *plugin_path,
+		       const char *options, const char *path)
+{
+	char conf_text[2048];
+	snd_config_t *conf = NULL;
+	snd_input_t *input;
+	int err;
+
+	snprintf(conf_text, sizeof(conf_text),
+		 "pcm.t { type ladspa path \"%s\" %s "
+		 TEST_PLUGINS
+		 "slave.pcm { type file file \"%s\" format raw "
+		 "slave.pcm { type null } } }\n",
+		 plugin_path, options, path);
+	err = snd_config_top(&conf);
+	if (err < 0)
+		return err;
+	ALSA_CHECK(snd_input_buffer_open(&input, conf_text, strlen(conf_text)));
+	ALSA_CHECK(snd_config_load(conf, input));
+	snd_input_close(input);
+	err = snd_pcm_open_lconf(pcmp, "t", SND_PCM_STREAM_PLAYBACK, 0, conf);
+	snd_config_delete(conf);
+	return err;
+}
+
+/* the dump has the stages and the worker threads */
+static void check_dump(snd_pcm_t *pcm, const char *expected)
+{
+	snd_output_t *out;
+	char *text;
+
+	if (ALSA_CHECK(snd_output_buffer_open(&out)) < 0)
+		return;
+	snd_pcm_dump(pcm, out);
+	snd_output_buffer_string(out, &text);
+	if (!strstr(text, expected)) {
+		fprintf(stderr, "no \"%s\" in the dump:\n%s", expected, text);
+		any_test_failed = 1;
+	}
+	snd_output_close(out);
+}
+
+/* plays the samples in pieces, returns the interleaved output */
+static float *play(const char *options, const char *expected)
+{
+	char path[] = "/tmp/alsa-test-ladspa-XXXXXX";
+	static const unsigned int sizes[] = { 1, 500, 33, 1024, 7, 999 };
+	unsigned int pos, n, i, c;
+	void *bufs[CHANNELS];
+	float *out = NULL;
+	snd_pcm_t *pcm;
+	FILE *file;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		any_test_failed = 1;
+		return NULL;
+	}
+	close(fd);
+	if (ALSA_CHECK(open_ladspa(&pcm, LADSPA_TEST_PATH, options, path)) < 0)
+		goto out;
+	if (ALSA_CHECK(snd_pcm_set_params(pcm, SND_PCM_FORMAT_FLOAT,
+					  SND_PCM_ACCESS_RW_NONINTERLEAVED,
+					  CHANNELS, RATE, 0, 100000)) < 0) {
+		snd_pcm_close(pcm);
+		goto out;
+	}
+	check_dump(pcm, "Stages: 3");
+	if (expected)
+		check_dump(pcm, expected);
+	for (pos = 0, i = 0; pos < FRAMES; pos += n, i++) {
+		n = sizes[i % (sizeof(sizes) / sizeof(sizes[0]))];
+		if (n > FRAMES - pos)
+			n = FRAMES - pos;
+		for (c = 0; c < CHANNELS; c++)
+			bufs[c] = planes[c] + pos;
+		TEST_CHECK(snd_pcm_writen(pcm, bufs, n) == (snd_pcm_sframes_t)n);
+	}
+	ALSA_CHECK(snd_pcm_drain(pcm));
+	snd_pcm_close(pcm);
+	out = calloc(FRAMES * CHANNELS + 1, sizeof(*out));
+	file = fopen(path, "rb");
+	if (!out || !file ||
+	    fread(out, sizeof(*out), FRAMES * CHANNELS + 1, file) != FRAMES * CHANNELS) {
+		free(out);
+		out = NULL;
+	}
+	if (file)
+		fclose(file);
+ out:
+	unlink(path);
+	TEST_CHECK(out != NULL);
+	return out;
+}
+
+static int copy_file(const char *dst, const char *src)
+{
+	char buf[4096];
+	FILE *in, *out;
+	size_t n;
+	int err = 0;
+
+	in = fopen(src, "rb");
+	if (!in)
+		return -1;
+	out = fopen(dst, "wb");
+	if (!out) {
+		fclose(in);
+		return -1;
+	}
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+		if (fwrite(buf, 1, n, out) != n)
+			err = -1;
+	fclose(in);
+	if (fclose(out))
+		err = -1;
+	return err;
+}
+
+static int file_has(const char *path, const char *str)
+{
+	char buf[4096];
+	FILE *file;
+	size_t n = 0;
+
+	file = fopen(path, "r");
+	if (file) {
+		n = fread(buf, 1, sizeof(buf) - 1, file);
+		fclose(file);
+	}
+	buf[n] = '\0';
+	return strstr(buf, str) != NULL;
+}
+
+/*
+ * The index lists the plugin directory empty, the plugin is added with
+ * the modification time of the directory kept and is found all the same.
+ * The index is written to a directory created for it, an index which
+ * cannot be written is left out.  A missing directory in the path is
+ * skipped.
+ */
+static void check_index(void)
+{
+	char dir[] = "/tmp/alsa-test-ladspa-XXXXXX";
+	char plugins[64], cache[64], index[64], options[128];
+	char module[64], out[64], path[128];
+	struct timespec times[2];
+	snd_pcm_t *pcm;
+	struct stat st;
+
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		any_test_failed = 1;
+		return;
+	}
+	snprintf(plugins, sizeof(plugins), "%s/plugins", dir);
+	snprintf(cache, sizeof(cache), "%s/cache", dir);
+	snprintf(index, sizeof(index), "%s/cache/index", dir);
+	snprintf(module, sizeof(module), "%s/plugins/test.so", dir);
+	snprintf(out, sizeof(out), "%s/out", dir);
+	snprintf(options, sizeof(options), "index \"%s\"", index);
+	TEST_CHECK(mkdir(plugins, 0700) == 0);
+
+	TEST_CHECK(open_ladspa(&pcm, plugins, options, out) == -ENOENT);
+	TEST_CHECK(stat(index, &st) == 0);
+	TEST_CHECK(!file_has(index, "test_gain"));
+	TEST_CHECK(stat(plugins, &st) == 0);
+	TEST_CHECK(copy_file(module, LADSPA_TEST_PATH "/ladspa_test.so") == 0);
+	times[0] = st.st_atim;
+	times[1] = st.st_mtim;
+	TEST_CHECK(utimensat(AT_FDCWD, plugins, times, 0) == 0);
+	if (ALSA_CHECK(open_ladspa(&pcm, plugins, options, out)) >= 0)
+		snd_pcm_close(pcm);
+	TEST_CHECK(file_has(index, "test_gain"));
+	/* now from the index */
+	if (ALSA_CHECK(open_ladspa(&pcm, plugins, options, out)) >= 0)
+		snd_pcm_close(pcm);
+	if (ALSA_CHECK(open_ladspa(&pcm, plugins,
+				   "index \"/nonexistent/alsa/index\"", out)) >= 0)
+		snd_pcm_close(pcm);
+	/* a missing directory in the path is skipped with and without index */
+	snprintf(path, sizeof(path), "%s/missing:%s", dir, plugins);
+	if (ALSA_CHECK(open_ladspa(&pcm, path, options, out)) >= 0)
+		snd_pcm_close(pcm);
+	if (ALSA_CHECK(open_ladspa(&pcm, path, "", out)) >= 0)
+		snd_pcm_close(pcm);
+
+	unlink(module);
+	unlink(index);
+	unlink(out);
+	rmdir(plugins);
+	rmdir(cache);
+	rmdir(dir);
+}
+
+int main(void)
+{
+	static const struct {
+		const char *options;
+		const char *dump;
+	} tests[] = {
+		{ "threads 1", "Threads: 1" },
+		{ "threads 3", "Threads: 3" },
+		{ "block 64", "Block: 64 frames" },
+		{ "threads 2 block 100", "Threads: 2" },
+	};
+	float *serial, *out;
+	unsigned int i, k, fails = 0;
+
+	for (i = 0; i < FRAMES * CHANNELS; i++) {
+		samples[i] = rnd_sample();
+		planes[i % CHANNELS][i / CHANNELS] = samples[i];
+	}
+	make_reference();
+
+	serial = play("", NULL);
+	if (!serial)
+		return TEST_EXIT_CODE();
+	for (i = 0; i < FRAMES * CHANNELS; i++) {
+		if (fabsf(serial[i] - reference[i]) > 1e-5f && fails++ < 4)
+			fprintf(stderr, "sample %u: %f, expected %f\n",
+				i, serial[i], reference[i]);
+	}
+	TEST_CHECK(fails == 0);
+
+	for (k = 0; k < sizeof(tests) / sizeof(tests[0]); k++) {
+		out = play(tests[k].options, tests[k].dump);
+		if (!out)
+			continue;
+		if (memcmp(out, serial, FRAMES * CHANNELS * sizeof(*out))) {
+			fprintf(stderr, "%s: not the serial output\n",
+				tests[k].options);
+			any_test_failed = 1;
+		}
+		free(out);
+	}
+	free(serial);
+	check_index();
+	return TEST_EXIT_CODE();
+}
@@ -0,0 +1,506 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include "test.h"
+
+#define CHANNELS	2
+#define RATE		48000
+#define PERIOD		480
+
+/* the control plugin of ctl_test.c stands in for card 0 */
+static const char ctl_conf[] =
+	"ctl.hw {\n"
+	"	@args [ CARD ]\n"
+	"	@args.CARD { type integer }\n"
+	"	type test\n"
+	"}\n"
+	"ctl_type.test { lib \"" CTL_TEST_MODULE "\" }\n";
+
+/* a scope checking every frame it sees against the written pattern */
+struct check_scope {
+	snd_pcm_t *pcm;
+	snd_pcm_scope_t *s16;
+	snd_pcm_uframes_t old;
+	unsigned long frames;	/* frames seen */
+	unsigned long bad;	/* frames not matching the pattern */
+	unsigned int resets;
+};
+
+static int pattern(snd_pcm_uframes_t frame, unsigned int channel)
+{
+	int v = frame & 0x7fff;
+
+	return channel ? -v : v;
+}
+
+static int check_enable(snd_pcm_scope_t *scope ATTRIBUTE_UNUSED)
+{
+	return 0;
+}
+
+static void check_disable(snd_pcm_scope_t *scope ATTRIBUTE_UNUSED)
+{
+}
+
+static void check_start(snd_pcm_scope_t *scope ATTRIBUTE_UNUSED)
+{
+}
+
+static void check_stop(snd_pcm_scope_t *scope ATTRIBUTE_UNUSED)
+{
+}
+
+static void check_update(snd_pcm_scope_t *scope)
+{
+	struct check_scope *c = snd_pcm_scope_get_callback_private(scope);
+	snd_pcm_uframes_t now = snd_pcm_meter_get_now(c->pcm);
+	snd_pcm_uframes_t size = snd_pcm_meter_get_bufsize(c->pcm);
+	snd_pcm_uframes_t boundary = snd_pcm_meter_get_boundary(c->pcm);
+	snd_pcm_uframes_t f;
+	unsigned int ch;
+
+	for (f = c->old; f != now; f = (f + 1) % boundary) {
+		for (ch = 0; ch < CHANNELS; ch++) {
+			int16_t *buf = snd_pcm_scope_s16_get_channel_buffer(c->s16, ch);
+			if (buf[f % size] != pattern(f, ch)) {
+				c->bad++;
+				break;
+			}
+		}
+		c->frames++;
+	}
+	c->old = now;
+}
+
+static void check_reset(snd_pcm_scope_t *scope)
+{
+	struct check_scope *c = snd_pcm_scope_get_callback_private(scope);
+
+	c->old = snd_pcm_meter_get_now(c->pcm);
+	c->resets++;
+}
+
+static void check_close(snd_pcm_scope_t *scope ATTRIBUTE_UNUSED)
+{
+}
+
+static const snd_pcm_scope_ops_t check_ops = {
+	.enable = check_enable,
+	.disable = check_disable,
+	.start = check_start,
+	.stop = check_stop,
+	.update = check_update,
+	.reset = check_reset,
+	.close = check_close,
+};
+
+/* a meter without scopes and without setup */
+static snd_pcm_t *open_meter_pcm(const char *options)
+{
+	char conf_text[256];
+	snd_config_t *conf = NULL;
+	snd_input_t *input;
+	snd_pcm_t *pcm = NULL;
+
+	snprintf(conf_text, sizeof(conf_text),
+		 "pcm.t { type meter %s slave.pcm { type null } }\n", options);
+	if (ALSA_CHECK(snd_config_top(&conf)) < 0)
+		return NULL;
+	ALSA_CHECK(snd_input_buffer_open(&input, conf_text, strlen(conf_text)));
+	ALSA_CHECK(snd_config_load(conf, input));
+	snd_input_close(input);
+	ALSA_CHECK(snd_pcm_open_lconf(&pcm, "t", SND_PCM_STREAM_PLAYBACK, 0, conf));
+	snd_config_delete(conf);
+	return pcm;
+}
+
+static int set_params(snd_pcm_t *pcm, snd_pcm_format_t format,
+		      unsigned int channels)
+{
+	return ALSA_CHECK(snd_pcm_set_params(pcm, format,
+					     SND_PCM_ACCESS_RW_INTERLEAVED,
+					     channels, RATE, 0, 100000));
+}
+
+static snd_pcm_t *open_meter(struct check_scope *c)
+{
+	snd_pcm_scope_t *scope;
+	snd_pcm_t *pcm;
+
+	pcm = open_meter_pcm("");
+	if (!pcm)
+		return NULL;
+	memset(c, 0, sizeof(*c));
+	c->pcm = pcm;
+	/* the scopes are updated in the order they are added */
+	ALSA_CHECK(snd_pcm_scope_s16_open(pcm, "s16", &c->s16));
+	ALSA_CHECK(snd_pcm_scope_malloc(&scope));
+	snd_pcm_scope_set_name(scope, "check");
+	snd_pcm_scope_set_ops(scope, &check_ops);
+	snd_pcm_scope_set_callback_private(scope, c);
+	ALSA_CHECK(snd_pcm_meter_add_scope(pcm, scope));
+	if (set_params(pcm, SND_PCM_FORMAT_S32, CHANNELS) < 0) {
+		snd_pcm_close(pcm);
+		pcm = NULL;
+	}
+	return pcm;
+}
+
+/* the s16 scope takes the upper half of S32 */
+static void write_pattern(snd_pcm_t *pcm, snd_pcm_uframes_t *pos,
+			  unsigned int frames)
+{
+	int32_t buf[PERIOD * CHANNELS];
+	unsigned int i, ch;
+
+	for (i = 0; i < frames; i++)
+		for (ch = 0; ch < CHANNELS; ch++)
+			buf[i * CHANNELS + ch] = pattern(*pos + i, ch) * 65536;
+	TEST_CHECK(snd_pcm_writei(pcm, buf, frames) == (snd_pcm_sframes_t)frames);
+	*pos += frames;
+}
+
+static int dump_has(snd_pcm_t *pcm, const char *text)
+{
+	snd_output_t *output;
+	char *dump;
+	int found;
+
+	ALSA_CHECK(snd_output_buffer_open(&output));
+	snd_pcm_dump(pcm, output);
+	snd_output_buffer_string(output, &dump);
+	found = strstr(dump, text) != NULL;
+	snd_output_close(output);
+	return found;
+}
+
+/*
+ * Written at about the real rate, the meter thread gets every range and
+ * the scopes see the frames in order, as written.
+ */
+static void test_ranges(void)
+{
+	struct check_scope c;
+	snd_pcm_uframes_t pos = 0;
+	snd_pcm_t *pcm;
+	unsigned int i;
+
+	pcm = open_meter(&c);
+	if (!pcm)
+		return;
+	for (i = 0; i < 100; i++) {
+		write_pattern(pcm, &pos, PERIOD);
+		usleep(PERIOD * 1000000 / RATE);
+	}
+	/* give the thread a few rounds */
+	usleep(100000);
+	TEST_CHECK(c.frames >= pos / 2);
+	TEST_CHECK(c.frames <= pos);
+	TEST_CHECK(c.bad == 0);
+	TEST_CHECK(!dump_has(pcm, "overruns"));
+	if (any_test_failed)
+		fprintf(stderr, "%lu of %lu frames seen, %lu bad\n",
+			c.frames, (unsigned long)pos, c.bad);
+	snd_pcm_close(pcm);
+}
+
+/*
+ * More ranges than the ring holds between two rounds of the thread: the
+ * stream does not wait, the scopes are reset instead and the dump
+ * counts it.
+ */
+static void test_overrun(void)
+{
+	struct check_scope c;
+	snd_pcm_uframes_t pos = 0;
+	snd_pcm_t *pcm;
+	unsigned int i, resets;
+
+	pcm = open_meter(&c);
+	if (!pcm)
+		return;
+	write_pattern(pcm, &pos, PERIOD);
+	ALSA_CHECK(snd_pcm_start(pcm));
+	usleep(100000);
+	resets = c.resets;
+	for (i = 0; i < 2000; i++)
+		write_pattern(pcm, &pos, 1);
+	usleep(100000);
+	TEST_CHECK(c.resets > resets);
+	TEST_CHECK(dump_has(pcm, "Scope resets after overruns"));
+	/* and the scopes go on from there */
+	for (i = 0; i < 10; i++) {
+		write_pattern(pcm, &pos, PERIOD);
+		usleep(PERIOD * 1000000 / RATE);
+	}
+	usleep(100000);
+	TEST_CHECK(c.bad == 0);
+	snd_pcm_close(pcm);
+}
+
+/* a -6 dBFS 997 Hz sine on the first channel, 0.25 DC on the others */
+static double level_sample(snd_pcm_uframes_t frame, unsigned int channel)
+{
+	if (channel)
+		return 0.25;
+	return 0.5 * sin(2 * M_PI * 997 * frame / RATE);
+}
+
+static void write_level(snd_pcm_t *pcm, snd_pcm_format_t format,
+			unsigned int channels, snd_pcm_uframes_t *pos,
+			unsigned int frames)
+{
+	float buf[PERIOD * 4 * 8];
+	unsigned int i, ch;
+
+	for (i = 0; i < frames; i++) {
+		for (ch = 0; ch < channels; ch++) {
+			double v = level_sample(*pos + i, ch);
+			unsigned int k = i * channels + ch;
+
+			if (format == SND_PCM_FORMAT_S16)
+				((int16_t *)buf)[k] = lrint(v * 32768);
+			else
+				buf[k] = v;
+		}
+	}
+	TEST_CHECK(snd_pcm_writei(pcm, buf, frames) == (snd_pcm_sframes_t)frames);
+	*pos += frames;
+}
+
+/*
+ * Stream about 4 s at four times the real rate and read the levels
+ * meanwhile; the peak is of the last update, so the highest is kept.
+ */
+static void run_level(snd_pcm_t *pcm, snd_pcm_scope_t *level,
+		      snd_pcm_format_t format, unsigned int channels,
+		      double *peak, double *rms)
+{
+	snd_pcm_uframes_t pos = 0;
+	unsigned int ch;
+	double p, r;
+
+	for (ch = 0; ch < channels; ch++)
+		peak[ch] = -INFINITY;
+	while (pos < 4 * RATE) {
+		write_level(pcm, format, channels, &pos, PERIOD * 4);
+		if (pos == PERIOD * 4)
+			ALSA_CHECK(snd_pcm_start(pcm));
+		usleep(PERIOD * 1000000 / RATE);
+		for (ch = 0; ch < channels; ch++) {
+			if (snd_pcm_scope_level_get_channel(level, ch, &p, &r) < 0)
+				continue;
+			if (p > peak[ch])
+				peak[ch] = p;
+		}
+	}
+	usleep(100000);
+	for (ch = 0; ch < channels; ch++) {
+		rms[ch] = -INFINITY;
+		ALSA_CHECK(snd_pcm_scope_level_get_channel(level, ch, NULL, &rms[ch]));
+	}
+	/* the channels of the setup only */
+	TEST_CHECK(snd_pcm_scope_level_get_channel(level, channels, &p, &r) == -EINVAL);
+}
+
+static void check_level(snd_pcm_format_t format, unsigned int channels)
+{
+	snd_pcm_scope_t *level;
+	double peak[8], rms[8], momentary, short_term;
+	snd_pcm_t *pcm;
+	unsigned int ch;
+
+	pcm = open_meter_pcm("");
+	if (!pcm)
+		return;
+	ALSA_CHECK(snd_pcm_scope_level_open(pcm, "level", &level));
+	/* nothing measured before the setup */
+	TEST_CHECK(snd_pcm_scope_level_get_loudness(level, &momentary, &short_term) == -EBADFD);
+	if (set_params(pcm, format, channels) < 0)
+		goto out;
+	run_level(pcm, level, format, channels, peak, rms);
+	TEST_CHECK(fabs(peak[0] + 6.02) < 0.05);
+	TEST_CHECK(fabs(rms[0] + 9.03) < 0.05);
+	for (ch = 1; ch < channels; ch++) {
+		TEST_CHECK(fabs(peak[ch] + 12.04) < 0.05);
+		TEST_CHECK(fabs(rms[ch] + 12.04) < 0.05);
+	}
+	/* the K-weighting removes the DC, the sine is -3.01 LUFS at 0 dBFS */
+	ALSA_CHECK(snd_pcm_scope_level_get_loudness(level, &momentary, &short_term));
+	TEST_CHECK(fabs(momentary + 9.03) < 0.1);
+	TEST_CHECK(fabs(short_term + 9.03) < 0.1);
+	if (any_test_failed)
+		fprintf(stderr, "%s: peak %f %f, rms %f %f, loudness %f %f\n",
+			snd_pcm_format_name(format), peak[0], peak[1],
+			rms[0], rms[1], momentary, short_term);
+ out:
+	snd_pcm_close(pcm);
+}
+
+static volatile int reader_quit;
+
+/* reads the levels all the time, the snapshot must stay valid */
+static void *level_reader(void *arg)
+{
+	snd_pcm_scope_t *level = arg;
+	double peak, rms;
+	unsigned int ch = 0;
+
+	while (!reader_quit) {
+		snd_pcm_scope_level_get_channel(level, ch, &peak, &rms);
+		ch = (ch + 1) % 8;
+	}
+	return NULL;
+}
+
+/* a new setup with more channels while another thread reads the levels */
+static void test_level_resetup(void)
+{
+	snd_pcm_scope_t *level;
+	double peak[8], rms[8];
+	pthread_t thread;
+	snd_pcm_t *pcm;
+
+	pcm = open_meter_pcm("");
+	if (!pcm)
+		return;
+	ALSA_CHECK(snd_pcm_scope_level_open(pcm, "level", &level));
+	reader_quit = 0;
+	if (pthread_create(&thread, NULL, level_reader, level)) {
+		any_test_failed = 1;
+		snd_pcm_close(pcm);
+		return;
+	}
+	if (set_params(pcm, SND_PCM_FORMAT_FLOAT, 1) >= 0) {
+		run_level(pcm, level, SND_PCM_FORMAT_FLOAT, 1, peak, rms);
+		ALSA_CHECK(snd_pcm_drop(pcm));
+		ALSA_CHECK(snd_pcm_hw_free(pcm));
+	}
+	if (set_params(pcm, SND_PCM_FORMAT_FLOAT, 8) >= 0) {
+		run_level(pcm, level, SND_PCM_FORMAT_FLOAT, 8, peak, rms);
+		TEST_CHECK(fabs(rms[0] + 9.03) < 0.05);
+		TEST_CHECK(fabs(rms[7] + 12.04) < 0.05);
+	}
+	reader_quit = 1;
+	pthread_join(thread, NULL);
+	snd_pcm_close(pcm);
+}
+
+/* counts the updates of the meter */
+static void count_update(snd_pcm_scope_t *scope)
+{
+	unsigned int *updates = snd_pcm_scope_get_callback_private(scope);
+
+	(*updates)++;
+}
+
+static const snd_pcm_scope_ops_t count_ops = {
+	.enable = check_enable,
+	.disable = check_disable,
+	.start = check_start,
+	.stop = check_stop,
+	.update = count_update,
+	.reset = check_stop,
+	.close = check_close,
+};
+
+static void read_ctl(snd_ctl_t *ctl, const char *name, long *value,
+		     unsigned int count)
+{
+	snd_ctl_elem_value_t *elem;
+	unsigned int i;
+
+	snd_ctl_elem_value_alloca(&elem);
+	snd_ctl_elem_value_set_interface(elem, SND_CTL_ELEM_IFACE_MIXER);
+	snd_ctl_elem_value_set_name(elem, name);
+	if (ALSA_CHECK(snd_ctl_elem_read(ctl, elem)) < 0)
+		return;
+	for (i = 0; i < count; i++)
+		value[i] = snd_ctl_elem_value_get_integer(elem, i);
+}
+
+/*
+ * The level scope of the configuration publishes the levels as the
+ * controls of ctl_test.c, which count the writes: the controls are
+ * written only when they change, far less often than the updates.
+ */
+static void test_level_ctl(snd_ctl_t *ctl)
+{
+	snd_pcm_scope_t *level, *scope;
+	double peak[CHANNELS], rms[CHANNELS], p, r;
+	long cpeak[2], crms[2], loudness[2], writes[3];
+	unsigned int updates = 0, ch;
+	snd_pcm_t *pcm;
+
+	pcm = open_meter_pcm("scopes.level { type level card 0 control Test }");
+	if (!pcm)
+		return;
+	level = snd_pcm_meter_search_scope(pcm, "level");
+	TEST_CHECK(level != NULL);
+	ALSA_CHECK(snd_pcm_scope_malloc(&scope));
+	snd_pcm_scope_set_name(scope, "count");
+	snd_pcm_scope_set_ops(scope, &count_ops);
+	snd_pcm_scope_set_callback_private(scope, &updates);
+	ALSA_CHECK(snd_pcm_meter_add_scope(pcm, scope));
+	if (!level || set_params(pcm, SND_PCM_FORMAT_FLOAT, CHANNELS) < 0)
+		goto out;
+	run_level(pcm, level, SND_PCM_FORMAT_FLOAT, CHANNELS, peak, rms);
+	read_ctl(ctl, "Test Peak Level", cpeak, 2);
+	read_ctl(ctl, "Test RMS Level", crms, 2);
+	read_ctl(ctl, "Test Loudness", loudness, 2);
+	read_ctl(ctl, "Test Level Writes", writes, 3);
+	/* the stream is over, the last updates have no peak */
+	for (ch = 0; ch < CHANNELS; ch++) {
+		ALSA_CHECK(snd_pcm_scope_level_get_channel(level, ch, &p, &r));
+		TEST_CHECK(p < -144.0 && cpeak[ch] == -14400);
+		TEST_CHECK(labs(crms[ch] - lrint(r * 100)) <= 1);
+	}
+	TEST_CHECK(labs(crms[0] + 903) <= 5);
+	TEST_CHECK(labs(crms[1] + 1204) <= 5);
+	TEST_CHECK(labs(loudness[0] + 903) <= 10);
+	TEST_CHECK(labs(loudness[1] + 903) <= 10);
+	TEST_CHECK(updates > 20);
+	TEST_CHECK(writes[0] > 0 && writes[0] < updates / 2);
+	TEST_CHECK(writes[1] > 0 && writes[1] < updates / 2);
+	TEST_CHECK(writes[2] > 0 && writes[2] < updates);
+	if (any_test_failed)
+		fprintf(stderr, "updates %u, writes %ld %ld %ld\n", updates,
+			writes[0], writes[1], writes[2]);
+ out:
+	snd_pcm_close(pcm);
+}
+
+int main(void)
+{
+	char path[] = "/tmp/alsa-test-meter-conf-XXXXXX";
+	snd_ctl_t *ctl;
+	int fd;
+
+	test_ranges();
+	test_overrun();
+	check_level(SND_PCM_FORMAT_FLOAT, 2);
+	check_level(SND_PCM_FORMAT_S16, 2);
+	test_level_resetup();
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	if (write(fd, ctl_conf, strlen(ctl_conf)) != (ssize_t)strlen(ctl_conf)) {
+		perror("write");
+		close(fd);
+		unlink(path);
+		return 1;
+	}
+	close(fd);
+	setenv("ALSA_CONFIG_PATH", path, 1);
+	if (ALSA_CHECK(snd_ctl_open(&ctl, "hw:0", 0)) >= 0) {
+		test_level_ctl(ctl);
+		snd_ctl_close(ctl);
+	}
+	unlink(path);
+	return TEST_EXIT_CODE();
+}
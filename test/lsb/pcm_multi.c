@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+
+#define FRAMES		4801
+
+static unsigned int rnd_state = 1;
+
+static unsigned char rnd_byte(void)
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return rnd_state >> 16;
+}
+
+/* two stereo slaves writing into files, behind a plug for the access */
+static int open_multi(snd_pcm_t **pcmp, const char *options,
+		      const char *path0, const char *path1)
+{
+	char conf_text[1024];
+	snd_config_t *conf = NULL;
+	snd_input_t *input;
+	int err;
+
+	snprintf(conf_text, sizeof(conf_text),
+		 "pcm.t { type plug slave.pcm { type multi %s "
+		 "slaves.a { pcm { type file file \"%s\" format raw "
+		 "slave.pcm { type null } } channels 2 } "
+		 "slaves.b { pcm { type file file \"%s\" format raw "
+		 "slave.pcm { type null } } channels 2 } "
+		 "bindings.0 { slave a channel 0 } "
+		 "bindings.1 { slave a channel 1 } "
+		 "bindings.2 { slave b channel 0 } "
+		 "bindings.3 { slave b channel 1 } } }\n",
+		 options, path0, path1);
+	err = snd_config_top(&conf);
+	if (err < 0)
+		return err;
+	ALSA_CHECK(snd_input_buffer_open(&input, conf_text, strlen(conf_text)));
+	ALSA_CHECK(snd_config_load(conf, input));
+	snd_input_close(input);
+	err = snd_pcm_open_lconf(pcmp, "t", SND_PCM_STREAM_PLAYBACK, 0, conf);
+	snd_config_delete(conf);
+	return err;
+}
+
+static size_t read_file(const char *path, unsigned char *out, size_t size)
+{
+	FILE *file;
+	size_t n = 0;
+
+	file = fopen(path, "rb");
+	if (file) {
+		n = fread(out, 1, size, file);
+		fclose(file);
+	}
+	return n;
+}
+
+/*
+ * Play 4 channels into the two slaves; the channels 0-1 have to end up
+ * in the first file and 2-3 in the second one.  Returns the dump.
+ */
+static char *play_multi(const char *options, const short *data,
+			short *out0, short *out1)
+{
+	char path0[] = "/tmp/alsa-test-multi-XXXXXX";
+	char path1[] = "/tmp/alsa-test-multi-XXXXXX";
+	snd_output_t *output;
+	snd_pcm_t *pcm;
+	char *dump = NULL, *str;
+	int fd0, fd1;
+
+	fd0 = mkstemp(path0);
+	fd1 = mkstemp(path1);
+	if (fd0 < 0 || fd1 < 0) {
+		perror("mkstemp");
+		any_test_failed = 1;
+		goto out;
+	}
+	if (ALSA_CHECK(open_multi(&pcm, options, path0, path1)) < 0)
+		goto out;
+	if (ALSA_CHECK(snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16,
+					  SND_PCM_ACCESS_RW_INTERLEAVED, 4,
+					  48000, 0, 500000)) < 0) {
+		snd_pcm_close(pcm);
+		goto out;
+	}
+	TEST_CHECK(snd_pcm_writei(pcm, data, FRAMES) == FRAMES);
+	ALSA_CHECK(snd_output_buffer_open(&output));
+	snd_pcm_dump(pcm, output);
+	snd_output_buffer_string(output, &str);
+	dump = strdup(str);
+	snd_output_close(output);
+	snd_pcm_close(pcm);
+	TEST_CHECK(read_file(path0, (unsigned char *)out0, FRAMES * 4 + 1) == FRAMES * 4);
+	TEST_CHECK(read_file(path1, (unsigned char *)out1, FRAMES * 4 + 1) == FRAMES * 4);
+ out:
+	if (fd0 >= 0) {
+		close(fd0);
+		unlink(path0);
+	}
+	if (fd1 >= 0) {
+		close(fd1);
+		unlink(path1);
+	}
+	return dump;
+}
+
+static void check_split(const short *data, const short *out0,
+			const short *out1)
+{
+	unsigned int i;
+
+	for (i = 0; i < FRAMES; i++) {
+		if (out0[i * 2] != data[i * 4] ||
+		    out0[i * 2 + 1] != data[i * 4 + 1] ||
+		    out1[i * 2] != data[i * 4 + 2] ||
+		    out1[i * 2 + 1] != data[i * 4 + 3])
+			break;
+	}
+	TEST_CHECK(i == FRAMES);
+}
+
+/* the worker threads give the same output as the calling thread */
+static void test_threads(void)
+{
+	short *data, *out[4];
+	char *dump;
+	unsigned int i;
+
+	data = malloc(FRAMES * 4 * sizeof(*data));
+	for (i = 0; i < 4; i++)
+		out[i] = malloc(FRAMES * 2 * sizeof(*data) + 1);
+	if (!data || !out[0] || !out[1] || !out[2] || !out[3])
+		goto out;
+	for (i = 0; i < FRAMES * 4 * sizeof(*data); i++)
+		((unsigned char *)data)[i] = rnd_byte();
+
+	dump = play_multi("", data, out[0], out[1]);
+	TEST_CHECK(dump != NULL);
+	if (dump) {
+		/* without workers nothing is timed */
+		TEST_CHECK(strstr(dump, "Worker threads") == NULL);
+		TEST_CHECK(strstr(dump, "Slave latency") == NULL);
+		free(dump);
+	}
+	check_split(data, out[0], out[1]);
+
+	dump = play_multi("threads yes", data, out[2], out[3]);
+	TEST_CHECK(dump != NULL);
+	if (dump) {
+		TEST_CHECK(strstr(dump, "Worker threads: 1") != NULL);
+		TEST_CHECK(strstr(dump, "Slave latency") != NULL);
+		TEST_CHECK(strstr(dump, "1: 0 ops") == NULL);
+		free(dump);
+	}
+	check_split(data, out[2], out[3]);
+
+	dump = play_multi("threads yes cpus.b 0", data, out[2], out[3]);
+	TEST_CHECK(dump != NULL);
+	if (dump) {
+		TEST_CHECK(strstr(dump, ", CPU 0") != NULL);
+		free(dump);
+	}
+	check_split(data, out[2], out[3]);
+ out:
+	free(data);
+	for (i = 0; i < 4; i++)
+		free(out[i]);
+}
+
+/*
+ * cpus without threads and a CPU for the first slave, which runs on the
+ * calling thread, are configuration errors
+ */
+static void test_cpus_errors(void)
+{
+	snd_pcm_t *pcm;
+	int err;
+
+	err = open_multi(&pcm, "cpus.b 0", "/dev/null", "/dev/null");
+	TEST_CHECK(err == -EINVAL);
+	if (err >= 0)
+		snd_pcm_close(pcm);
+	err = open_multi(&pcm, "threads yes cpus.a 0", "/dev/null", "/dev/null");
+	TEST_CHECK(err == -EINVAL);
+	if (err >= 0)
+		snd_pcm_close(pcm);
+}
+
+int main(void)
+{
+	test_threads();
+	test_cpus_errors();
+	return TEST_EXIT_CODE();
+}
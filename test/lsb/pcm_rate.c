@@ -0,0 +1,367 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "test.h"
+#include <alsa/pcm_rate.h>
+
+#define ENTRY(name) \
+	extern int SND_PCM_RATE_PLUGIN_ENTRY(name) (unsigned int version, \
+						    void **objp, \
+						    snd_pcm_rate_ops_t *ops)
+ENTRY(linear);
+ENTRY(polyphase);
+ENTRY(polyphase_fast);
+ENTRY(polyphase_medium);
+ENTRY(polyphase_best);
+
+typedef int (*rate_entry_t)(unsigned int version, void **objp,
+			    snd_pcm_rate_ops_t *ops);
+
+#define PERIODS		40
+#define SETTLE		10	/* periods skipped for the filter delay */
+#define AMPLITUDE	16384.0
+
+/*
+ * convert a sine of freq Hz, return the gain in dB; out keeps the
+ * last period
+ */
+static double convert_sine(rate_entry_t entry,
+			   unsigned int in_rate, unsigned int out_rate,
+			   unsigned int in_period, unsigned int out_period,
+			   double freq, short *out)
+{
+	snd_pcm_rate_ops_t ops;
+	snd_pcm_rate_info_t info;
+	snd_pcm_channel_area_t in_area, out_area;
+	short *in;
+	double energy = 0;
+	unsigned int p, k, n = 0;
+	void *obj;
+
+	memset(&ops, 0, sizeof(ops));
+	memset(&info, 0, sizeof(info));
+	if (ALSA_CHECK(entry(SND_PCM_RATE_PLUGIN_VERSION, &obj, &ops)) < 0)
+		return 0;
+	info.in.format = info.out.format = SND_PCM_FORMAT_S16;
+	info.in.rate = in_rate;
+	info.out.rate = out_rate;
+	info.in.period_size = in_period;
+	info.out.period_size = out_period;
+	info.in.buffer_size = in_period * 4;
+	info.out.buffer_size = out_period * 4;
+	info.channels = 1;
+	in = calloc(in_period, sizeof(*in));
+	if (ALSA_CHECK(ops.init(obj, &info)) < 0 || !in) {
+		free(in);
+		ops.close(obj);
+		return 0;
+	}
+	ops.reset(obj);
+	in_area.addr = in;
+	in_area.first = 0;
+	in_area.step = 16;
+	out_area.addr = out;
+	out_area.first = 0;
+	out_area.step = 16;
+	for (p = 0; p < PERIODS; p++) {
+		for (k = 0; k < in_period; k++)
+			in[k] = lrint(AMPLITUDE * sin(2 * M_PI * freq *
+						      (p * in_period + k) / in_rate));
+		ops.convert(obj, &out_area, 0, out_period, &in_area, 0, in_period);
+		if (p < SETTLE)
+			continue;
+		for (k = 0; k < out_period; k++, n++)
+			energy += (double)out[k] * out[k];
+	}
+	free(in);
+	ops.free(obj);
+	ops.close(obj);
+	if (energy == 0)
+		return -200;
+	return 20 * log10(sqrt(energy / n) / (AMPLITUDE / sqrt(2)));
+}
+
+static void test_polyphase_response(void)
+{
+	static const struct {
+		rate_entry_t entry;
+		double stopband;
+	} q[] = {
+		{ SND_PCM_RATE_PLUGIN_ENTRY(polyphase_fast), -40 },
+		{ SND_PCM_RATE_PLUGIN_ENTRY(polyphase_medium), -60 },
+		{ SND_PCM_RATE_PLUGIN_ENTRY(polyphase_best), -60 },
+	};
+	short out[2][480];
+	double gain, edge[3];
+	unsigned int i;
+
+	for (i = 0; i < sizeof(q) / sizeof(q[0]); i++) {
+		/* flat passband when upsampling */
+		gain = convert_sine(q[i].entry, 44100, 48000, 441, 480, 1000, out[0]);
+		TEST_CHECK(fabs(gain) < 0.1);
+		/* a tone above the new Nyquist frequency is removed */
+		gain = convert_sine(q[i].entry, 48000, 22050, 960, 441, 15000, out[0]);
+		TEST_CHECK(gain < q[i].stopband);
+		/* the better presets keep more of the upper band */
+		edge[i] = convert_sine(q[i].entry, 48000, 44100, 480, 441, 19000, out[0]);
+		if (i > 0)
+			TEST_CHECK(edge[i] > edge[i - 1]);
+	}
+	TEST_CHECK(edge[2] > -1);
+
+	/* "polyphase" is the medium preset */
+	convert_sine(SND_PCM_RATE_PLUGIN_ENTRY(polyphase), 44100, 48000, 441, 480, 1000, out[0]);
+	convert_sine(SND_PCM_RATE_PLUGIN_ENTRY(polyphase_medium), 44100, 48000, 441, 480, 1000, out[1]);
+	TEST_CHECK(memcmp(out[0], out[1], sizeof(out[0])) == 0);
+}
+
+enum { LAYOUT_PLANAR, LAYOUT_SHARED, LAYOUT_PER_CHANNEL };
+
+/*
+ * areas of an interleaved buffer with one addr for all channels, with
+ * an own addr per channel as rate_alloc_tmp_buf() sets it up, or of
+ * separate buffers
+ */
+static void set_areas(snd_pcm_channel_area_t *areas, char *buf, int layout,
+		      unsigned int channels, unsigned int frames,
+		      unsigned int width)
+{
+	unsigned int c;
+
+	for (c = 0; c < channels; c++) {
+		switch (layout) {
+		case LAYOUT_PLANAR:
+			areas[c].addr = buf + c * frames * width / 8;
+			areas[c].first = 0;
+			areas[c].step = width;
+			break;
+		case LAYOUT_SHARED:
+			areas[c].addr = buf;
+			areas[c].first = c * width;
+			areas[c].step = channels * width;
+			break;
+		case LAYOUT_PER_CHANNEL:
+			areas[c].addr = buf + c * width / 8;
+			areas[c].first = 0;
+			areas[c].step = channels * width;
+			break;
+		}
+	}
+}
+
+#define LINEAR_PERIODS	4
+
+/* the interleaved fast paths must give the same result as the planar code */
+static void check_linear(snd_pcm_format_t format, unsigned int channels,
+			 unsigned int in_period, unsigned int out_period)
+{
+	unsigned int width = snd_pcm_format_physical_width(format);
+	unsigned int in_bytes = in_period * channels * width / 8;
+	unsigned int out_bytes = out_period * channels * width / 8;
+	snd_pcm_channel_area_t in_areas[8], out_areas[8];
+	snd_pcm_rate_ops_t ops;
+	snd_pcm_rate_info_t info;
+	char *in, *out, *result[3];
+	unsigned int i, p, c, k;
+	int layout;
+	void *obj;
+
+	in = malloc(in_bytes);
+	out = malloc(out_bytes);
+	for (layout = 0; layout < 3; layout++)
+		result[layout] = malloc(out_bytes * LINEAR_PERIODS);
+	for (layout = 0; layout < 3; layout++) {
+		memset(&ops, 0, sizeof(ops));
+		memset(&info, 0, sizeof(info));
+		if (ALSA_CHECK(SND_PCM_RATE_PLUGIN_ENTRY(linear)(SND_PCM_RATE_PLUGIN_VERSION,
+								  &obj, &ops)) < 0)
+			goto out;
+		info.in.format = info.out.format = format;
+		info.in.rate = in_period * 100;
+		info.out.rate = out_period * 100;
+		info.in.period_size = in_period;
+		info.out.period_size = out_period;
+		info.in.buffer_size = in_period * LINEAR_PERIODS;
+		info.out.buffer_size = out_period * LINEAR_PERIODS;
+		info.channels = channels;
+		if (ALSA_CHECK(ops.init(obj, &info)) < 0) {
+			ops.close(obj);
+			goto out;
+		}
+		if (ops.reset)
+			ops.reset(obj);
+		set_areas(in_areas, in, layout, channels, in_period, width);
+		set_areas(out_areas, out, layout, channels, out_period, width);
+		for (p = 0; p < LINEAR_PERIODS; p++) {
+			/* a different ramp for every channel */
+			for (c = 0; c < channels; c++) {
+				for (k = 0; k < in_period; k++) {
+					char *dst = snd_pcm_channel_area_addr(&in_areas[c], k);
+					int v = ((p * in_period + k) * (c + 3) * 997) % 60000 - 30000;
+					if (format == SND_PCM_FORMAT_FLOAT)
+						*(float *)dst = v / 32768.0f;
+					else
+						*(short *)dst = v;
+				}
+			}
+			ops.convert(obj, out_areas, 0, out_period, in_areas, 0, in_period);
+			/* store the result interleaved */
+			for (c = 0; c < channels; c++)
+				for (k = 0; k < out_period; k++)
+					memcpy(result[layout] + p * out_bytes +
+					       (k * channels + c) * width / 8,
+					       snd_pcm_channel_area_addr(&out_areas[c], k),
+					       width / 8);
+		}
+		ops.free(obj);
+		ops.close(obj);
+	}
+	for (i = 1; i < 3; i++)
+		TEST_CHECK(memcmp(result[0], result[i], out_bytes * LINEAR_PERIODS) == 0);
+ out:
+	for (layout = 0; layout < 3; layout++)
+		free(result[layout]);
+	free(in);
+	free(out);
+}
+
+static void test_linear_layouts(void)
+{
+	static const unsigned int channels_list[] = { 1, 2, 3, 6, 8 };
+	unsigned int i;
+
+	for (i = 0; i < sizeof(channels_list) / sizeof(channels_list[0]); i++) {
+		check_linear(SND_PCM_FORMAT_S16, channels_list[i], 441, 480);
+		check_linear(SND_PCM_FORMAT_S16, channels_list[i], 480, 441);
+		check_linear(SND_PCM_FORMAT_FLOAT, channels_list[i], 441, 480);
+		check_linear(SND_PCM_FORMAT_FLOAT, channels_list[i], 480, 441);
+	}
+}
+
+/* polyphase has to be asked for, the default stays with linear */
+static void test_default_converter(void)
+{
+	static const char conf_text[] =
+		"pcm.r { type rate slave { pcm { type null } rate 48000 format S16 } }\n";
+	snd_config_t *conf;
+	snd_input_t *input;
+	snd_output_t *output;
+	snd_pcm_t *pcm;
+	char *dump;
+
+	if (ALSA_CHECK(snd_config_top(&conf)) < 0)
+		return;
+	ALSA_CHECK(snd_input_buffer_open(&input, conf_text, strlen(conf_text)));
+	ALSA_CHECK(snd_config_load(conf, input));
+	snd_input_close(input);
+	if (ALSA_CHECK(snd_pcm_open_lconf(&pcm, "r", SND_PCM_STREAM_PLAYBACK, 0, conf)) < 0) {
+		snd_config_delete(conf);
+		return;
+	}
+	ALSA_CHECK(snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16,
+				      SND_PCM_ACCESS_RW_INTERLEAVED,
+				      2, 44100, 0, 100000));
+	ALSA_CHECK(snd_output_buffer_open(&output));
+	snd_pcm_dump(pcm, output);
+	snd_output_buffer_string(output, &dump);
+	TEST_CHECK(strstr(dump, "Converter:") != NULL);
+	TEST_CHECK(strstr(dump, "polyphase") == NULL);
+	snd_output_close(output);
+	snd_pcm_close(pcm);
+	snd_config_delete(conf);
+}
+
+#define CACHE_FRAMES	4410
+
+/*
+ * play a fixed signal through a linear rate PCM writing to a file,
+ * return 1 when the converter was taken from the cache
+ */
+static int play_cached(unsigned int out_rate, const char *path,
+		       char *data, size_t *data_size)
+{
+	char conf_text[512], *dump;
+	snd_config_t *conf;
+	snd_input_t *input;
+	snd_output_t *output;
+	snd_pcm_t *pcm;
+	short buf[CACHE_FRAMES * 2];
+	unsigned int k;
+	int cached = -1;
+	FILE *f;
+
+	snprintf(conf_text, sizeof(conf_text),
+		 "pcm.r { type rate converter linear "
+		 "slave { pcm { type file file \"%s\" format raw "
+		 "slave.pcm { type null } } rate %u format S16 } }\n",
+		 path, out_rate);
+	if (ALSA_CHECK(snd_config_top(&conf)) < 0)
+		return -1;
+	ALSA_CHECK(snd_input_buffer_open(&input, conf_text, strlen(conf_text)));
+	ALSA_CHECK(snd_config_load(conf, input));
+	snd_input_close(input);
+	if (ALSA_CHECK(snd_pcm_open_lconf(&pcm, "r", SND_PCM_STREAM_PLAYBACK, 0, conf)) < 0)
+		goto out;
+	ALSA_CHECK(snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16,
+				      SND_PCM_ACCESS_RW_INTERLEAVED,
+				      2, 44100, 0, 100000));
+	ALSA_CHECK(snd_output_buffer_open(&output));
+	snd_pcm_dump(pcm, output);
+	snd_output_buffer_string(output, &dump);
+	cached = strstr(dump, "(this converter was cached)") != NULL;
+	snd_output_close(output);
+	for (k = 0; k < CACHE_FRAMES * 2; k++)
+		buf[k] = (k * 1237) % 50000 - 25000;
+	TEST_CHECK(snd_pcm_writei(pcm, buf, CACHE_FRAMES) == CACHE_FRAMES);
+	snd_pcm_close(pcm);
+	f = fopen(path, "rb");
+	if (f) {
+		*data_size = fread(data, 1, *data_size, f);
+		fclose(f);
+	}
+	unlink(path);
+ out:
+	snd_config_delete(conf);
+	return cached;
+}
+
+/* a converter kept after close is reused with the same setup only */
+static void test_converter_cache(void)
+{
+	static char data[2][CACHE_FRAMES * 4 * 2];
+	char path[] = "/tmp/alsa-test-rate-XXXXXX";
+	size_t size[2];
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		any_test_failed = 1;
+		return;
+	}
+	close(fd);
+	/* start without the converters of the tests above */
+	snd_config_update_free_global();
+	size[0] = size[1] = sizeof(data[0]);
+	TEST_CHECK(play_cached(48000, path, data[0], &size[0]) == 0);
+	TEST_CHECK(play_cached(48000, path, data[1], &size[1]) == 1);
+	/* the cached converter starts from a clean state */
+	TEST_CHECK(size[0] > 0 && size[0] == size[1] &&
+		   memcmp(data[0], data[1], size[0]) == 0);
+	size[1] = sizeof(data[1]);
+	TEST_CHECK(play_cached(32000, path, data[1], &size[1]) == 0);
+	/* freeing the global configuration drops the cache */
+	snd_config_update_free_global();
+	size[1] = sizeof(data[1]);
+	TEST_CHECK(play_cached(48000, path, data[1], &size[1]) == 0);
+}
+
+int main(void)
+{
+	test_linear_layouts();
+	test_polyphase_response();
+	test_default_converter();
+	test_converter_cache();
+	return TEST_EXIT_CODE();
+}
@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+
+#define PERIOD		256
+#define LEVEL		16384
+
+/* the control plugin of ctl_test.c stands in for card 0 */
+static const char ctl_conf[] =
+	"ctl.hw {\n"
+	"	@args [ CARD ]\n"
+	"	@args.CARD { type integer }\n"
+	"	type test\n"
+	"}\n"
+	"ctl_type.test { lib \"" CTL_TEST_MODULE "\" }\n";
+
+static snd_ctl_t *ctl;
+
+static void set_switch(int on)
+{
+	snd_ctl_elem_value_t *value;
+
+	snd_ctl_elem_value_alloca(&value);
+	snd_ctl_elem_value_set_interface(value, SND_CTL_ELEM_IFACE_MIXER);
+	snd_ctl_elem_value_set_name(value, "Test Playback Switch");
+	snd_ctl_elem_value_set_integer(value, 0, on);
+	snd_ctl_elem_value_set_integer(value, 1, on);
+	ALSA_CHECK(snd_ctl_elem_write(ctl, value));
+}
+
+static snd_pcm_t *open_softvol(const char *options, const char *path)
+{
+	char conf_text[1024];
+	snd_config_t *conf = NULL;
+	snd_pcm_hw_params_t *params;
+	snd_input_t *input;
+	snd_pcm_t *pcm = NULL;
+
+	snprintf(conf_text, sizeof(conf_text),
+		 "pcm.t { type softvol %s resolution 2 "
+		 "control { name \"Test Playback Switch\" card 0 } "
+		 "slave.pcm { type file file \"%s\" format raw "
+		 "slave.pcm { type null } } }\n", options, path);
+	if (ALSA_CHECK(snd_config_top(&conf)) < 0)
+		return NULL;
+	ALSA_CHECK(snd_input_buffer_open(&input, conf_text, strlen(conf_text)));
+	ALSA_CHECK(snd_config_load(conf, input));
+	snd_input_close(input);
+	if (ALSA_CHECK(snd_pcm_open_lconf(&pcm, "t", SND_PCM_STREAM_PLAYBACK, 0, conf)) < 0)
+		goto out;
+	snd_pcm_hw_params_alloca(&params);
+	ALSA_CHECK(snd_pcm_hw_params_any(pcm, params));
+	ALSA_CHECK(snd_pcm_hw_params_set_access(pcm, params, SND_PCM_ACCESS_RW_INTERLEAVED));
+	ALSA_CHECK(snd_pcm_hw_params_set_format(pcm, params, SND_PCM_FORMAT_S16));
+	ALSA_CHECK(snd_pcm_hw_params_set_channels(pcm, params, 2));
+	ALSA_CHECK(snd_pcm_hw_params_set_rate(pcm, params, 48000, 0));
+	ALSA_CHECK(snd_pcm_hw_params_set_period_size(pcm, params, PERIOD, 0));
+	ALSA_CHECK(snd_pcm_hw_params_set_buffer_size(pcm, params, PERIOD * 4));
+	if (ALSA_CHECK(snd_pcm_hw_params(pcm, params)) < 0) {
+		snd_pcm_close(pcm);
+		pcm = NULL;
+	}
+ out:
+	snd_config_delete(conf);
+	return pcm;
+}
+
+static void write_level(snd_pcm_t *pcm, unsigned int frames)
+{
+	short buf[PERIOD * 2];
+	unsigned int i, n;
+
+	for (i = 0; i < PERIOD * 2; i++)
+		buf[i] = LEVEL;
+	for (; frames > 0; frames -= n) {
+		n = frames < PERIOD ? frames : PERIOD;
+		TEST_CHECK(snd_pcm_writei(pcm, buf, n) == (snd_pcm_sframes_t)n);
+	}
+}
+
+/* read the output of both channels, left samples only */
+static unsigned int read_left(const char *path, short *out, unsigned int frames)
+{
+	short frame[2];
+	unsigned int n = 0;
+	FILE *file;
+
+	file = fopen(path, "rb");
+	if (!file)
+		return 0;
+	while (n < frames && fread(frame, sizeof(frame), 1, file) == 1) {
+		TEST_CHECK(frame[0] == frame[1]);
+		out[n++] = frame[0];
+	}
+	fclose(file);
+	return n;
+}
+
+/*
+ * The switch is turned on and off again while playing; each change has
+ * to move the gain monotonically over one period, starting with the next
+ * transfer, and end exactly on the new value.
+ */
+static void check_ramp(const char *ramp)
+{
+	char path[] = "/tmp/alsa-test-softvol-XXXXXX";
+	char options[64];
+	short out[PERIOD * 8];
+	unsigned int i, n;
+	snd_pcm_t *pcm;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		any_test_failed = 1;
+		return;
+	}
+	close(fd);
+	snprintf(options, sizeof(options), "ramp %s", ramp);
+	set_switch(0);
+	pcm = open_softvol(options, path);
+	if (!pcm)
+		goto out;
+	write_level(pcm, PERIOD + 10);
+	set_switch(1);
+	write_level(pcm, 2 * PERIOD + 20);
+	set_switch(0);
+	write_level(pcm, 2 * PERIOD);
+	snd_pcm_close(pcm);
+
+	n = read_left(path, out, PERIOD * 8);
+	TEST_CHECK(n == 5 * PERIOD + 30);
+	if (n != 5 * PERIOD + 30)
+		goto out;
+	for (i = 0; i < PERIOD + 10; i++)
+		TEST_CHECK(out[i] == 0);
+	/* up */
+	TEST_CHECK(out[PERIOD + 10] < LEVEL / 8);
+	TEST_CHECK(out[PERIOD * 3 / 2 + 10] > 0 && out[PERIOD * 3 / 2 + 10] < LEVEL);
+	for (i = PERIOD + 11; i < 2 * PERIOD + 10; i++)
+		TEST_CHECK(out[i] >= out[i - 1]);
+	for (i = 2 * PERIOD + 9; i < 3 * PERIOD + 30; i++)
+		TEST_CHECK(out[i] == LEVEL);
+	/* and down */
+	TEST_CHECK(out[3 * PERIOD + 30] < LEVEL);
+	TEST_CHECK(out[PERIOD * 7 / 2 + 30] > 0 && out[PERIOD * 7 / 2 + 30] < LEVEL);
+	for (i = 3 * PERIOD + 31; i < 4 * PERIOD + 30; i++)
+		TEST_CHECK(out[i] <= out[i - 1]);
+	for (i = 4 * PERIOD + 29; i < 5 * PERIOD + 30; i++)
+		TEST_CHECK(out[i] == 0);
+	if (any_test_failed)
+		fprintf(stderr, "ramp %s\n", ramp);
+ out:
+	unlink(path);
+}
+
+/*
+ * With events, the volume is taken from the cache of the event thread;
+ * a change has to be picked up without reading the control.
+ */
+static void check_events(void)
+{
+	char path[] = "/tmp/alsa-test-softvol-XXXXXX";
+	short out[PERIOD * 4];
+	unsigned int i, n;
+	snd_pcm_t *pcm;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		any_test_failed = 1;
+		return;
+	}
+	close(fd);
+	set_switch(0);
+	pcm = open_softvol("events yes", path);
+	if (!pcm)
+		goto out;
+	write_level(pcm, PERIOD);
+	set_switch(1);
+	/* give the thread the time to get the event */
+	usleep(200000);
+	write_level(pcm, PERIOD);
+	set_switch(0);
+	usleep(200000);
+	write_level(pcm, PERIOD);
+	snd_pcm_close(pcm);
+
+	n = read_left(path, out, PERIOD * 4);
+	TEST_CHECK(n == 3 * PERIOD);
+	if (n != 3 * PERIOD)
+		goto out;
+	for (i = 0; i < PERIOD; i++)
+		TEST_CHECK(out[i] == 0);
+	for (i = PERIOD; i < 2 * PERIOD; i++)
+		TEST_CHECK(out[i] == LEVEL);
+	for (i = 2 * PERIOD; i < 3 * PERIOD; i++)
+		TEST_CHECK(out[i] == 0);
+ out:
+	unlink(path);
+}
+
+int main(void)
+{
+	char path[] = "/tmp/alsa-test-softvol-conf-XXXXXX";
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	if (write(fd, ctl_conf, strlen(ctl_conf)) != (ssize_t)strlen(ctl_conf)) {
+		perror("write");
+		close(fd);
+		unlink(path);
+		return 1;
+	}
+	close(fd);
+	setenv("ALSA_CONFIG_PATH", path, 1);
+	if (ALSA_CHECK(snd_ctl_open(&ctl, "hw:0", 0)) < 0)
+		goto out;
+
+	check_ramp("linear");
+	check_ramp("exponential");
+	check_events();
+
+	snd_ctl_close(ctl);
+ out:
+	unlink(path);
+	return TEST_EXIT_CODE();
+}